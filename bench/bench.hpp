@@ -0,0 +1,168 @@
+#pragma once
+
+/**
+ * @file bench.hpp
+ * @brief Tiny harness for the micro benchmarks: times a function and counts
+ * the heap allocations it makes. The counting replaces the global operator
+ * new, so include this header in exactly one source file per benchmark
+ * executable.
+ */
+
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+// @brief Number of calls to operator new the calling thread made since it
+// started. Per thread, so background threads (a logger's writer, a cache's
+// watcher) don't count towards the function being measured.
+inline thread_local uint64_t g_Allocations = 0;
+
+// @brief Keeps the compiler from optimizing p_Value (and its computation) away
+template <typename T> inline void doNotOptimize (const T& p_Value) {
+    asm volatile ("" : : "r,m"(p_Value) : "memory");
+}
+
+/**
+ * @brief Calls p_Function p_Iterations times and prints the time and the
+ * number of heap allocations per call.
+ * @return allocations per call
+ */
+template <typename Function>
+double run (std::string_view p_Name, uint64_t p_Iterations, Function&& p_Function) {
+    // warm up caches and whatever is initialized lazily
+    for (uint64_t i = 0; i < p_Iterations / 10 + 1; i++) {
+        p_Function ();
+    }
+
+    uint64_t allocations_before = g_Allocations;
+    auto start                  = std::chrono::steady_clock::now ();
+    for (uint64_t i = 0; i < p_Iterations; i++) {
+        p_Function ();
+    }
+    auto end = std::chrono::steady_clock::now ();
+
+    double nanoseconds = std::chrono::duration<double, std::nano> (end - start).count ();
+    double allocations = static_cast<double> (g_Allocations - allocations_before) / p_Iterations;
+    std::printf ("%-40.*s %10.1f ns/op %8.2f allocs/op\n", static_cast<int> (p_Name.size ()),
+    p_Name.data (), nanoseconds / p_Iterations, allocations);
+    return allocations;
+}
+
+/**
+ * @brief Calls p_Function p_Iterations times on each of p_Threads threads at
+ * once and prints the time and the heap allocations per call. The time per
+ * call is the wall clock time of the whole run divided by the calls of one
+ * thread, so it grows if the threads slow each other down.
+ * @param p_Function Called with the index of the thread
+ * @return allocations per call
+ */
+template <typename Function>
+double runThreads (std::string_view p_Name, unsigned p_Threads, uint64_t p_Iterations, Function&& p_Function) {
+    std::atomic<uint64_t> allocations{ 0 };
+    std::chrono::steady_clock::time_point start;
+
+    // every thread warms up, then they start together
+    std::barrier start_barrier (p_Threads, [&start] () noexcept { start = std::chrono::steady_clock::now (); });
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < p_Threads; t++) {
+        threads.emplace_back ([&, t] {
+            for (uint64_t i = 0; i < p_Iterations / 10 + 1; i++) {
+                p_Function (t);
+            }
+            start_barrier.arrive_and_wait ();
+
+            uint64_t allocations_before = g_Allocations;
+            for (uint64_t i = 0; i < p_Iterations; i++) {
+                p_Function (t);
+            }
+            allocations += g_Allocations - allocations_before;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join ();
+    }
+    auto end = std::chrono::steady_clock::now ();
+
+    double nanoseconds = std::chrono::duration<double, std::nano> (end - start).count ();
+    double calls       = static_cast<double> (p_Iterations) * p_Threads;
+    double allocations_per_call = static_cast<double> (allocations.load ()) / calls;
+    std::printf ("%-40.*s %10.1f ns/op %8.2f allocs/op\n", static_cast<int> (p_Name.size ()),
+    p_Name.data (), nanoseconds / p_Iterations, allocations_per_call);
+    return allocations_per_call;
+}
+
+} // namespace bench
+
+// GCC pairs the replaced operator new with the free() of the replaced
+// operator delete once it is inlined, and takes them for mismatched
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new (std::size_t p_Size) {
+    bench::g_Allocations++;
+    if (void* memory = std::malloc (p_Size ? p_Size : 1))
+        return memory;
+    throw std::bad_alloc ();
+}
+
+void* operator new[] (std::size_t p_Size) {
+    return operator new (p_Size);
+}
+
+void operator delete (void* p_Memory) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete (void* p_Memory, std::size_t) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete[] (void* p_Memory) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete[] (void* p_Memory, std::size_t) noexcept {
+    std::free (p_Memory);
+}
+
+// std::pmr::new_delete_resource() allocates with the aligned forms
+void* operator new (std::size_t p_Size, std::align_val_t p_Alignment) {
+    bench::g_Allocations++;
+    size_t alignment = static_cast<size_t> (p_Alignment);
+    // aligned_alloc wants a multiple of the alignment
+    if (void* memory = std::aligned_alloc (alignment, (p_Size + alignment - 1) / alignment * alignment ?: alignment))
+        return memory;
+    throw std::bad_alloc ();
+}
+
+void* operator new[] (std::size_t p_Size, std::align_val_t p_Alignment) {
+    return operator new (p_Size, p_Alignment);
+}
+
+void operator delete (void* p_Memory, std::align_val_t) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete (void* p_Memory, std::size_t, std::align_val_t) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete[] (void* p_Memory, std::align_val_t) noexcept {
+    std::free (p_Memory);
+}
+
+void operator delete[] (void* p_Memory, std::size_t, std::align_val_t) noexcept {
+    std::free (p_Memory);
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,595 @@
+/**
+ * @file ccerve_bench.cpp
+ * @brief HTTP/1.1 load generator for a running cerve instance. Every thread
+ * drives its share of the connections through its own epoll loop, keeps up
+ * to --pipeline requests in flight on each of them and picks the path of
+ * every request from a weighted mix (e.g. small pages and large images).
+ * With --close, every request gets a connection of its own. Prints the
+ * requests per second, the throughput and the latency distribution as JSON,
+ * so runs on different commits can be compared by a script.
+ *
+ * Latency is measured from the moment a request is queued on its connection
+ * (with --close that includes connecting) until the last byte of its
+ * response arrived.
+ *
+ * Usage: ccerve-bench [--threads N] [--connections N] [--pipeline N]
+ * [--duration s] [--warmup s] [--close] [--path PATH[:WEIGHT]]...
+ * [ip_address port]
+ * e.g. ./build/bench/ccerve-bench --threads 4 --connections 256 --pipeline 4
+ * --path /index.html:9 --path /big.png:1 127.0.0.1 8000
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "metrics.hpp"
+
+using ccerve::LatencyHistogram;
+using ccerve::monotonicNs;
+
+// @brief Options of a run
+struct BenchConfig {
+    std::string ip_address = "127.0.0.1";
+    int port               = 8000;
+    size_t threads         = 1;
+    size_t connections     = 64;
+    size_t pipeline        = 1;
+    unsigned duration_s    = 10;
+
+    // @brief Nothing is counted during the first warmup_s seconds
+    unsigned warmup_s = 1;
+
+    // @brief Send "Connection: close" and open a connection per request
+    bool close = false;
+
+    std::vector<std::string> paths;
+    std::vector<unsigned> weights;
+};
+
+// @brief What a thread counted, added up over all threads at the end
+struct BenchResult {
+    uint64_t requests   = 0;
+    uint64_t errors     = 0;
+    uint64_t reconnects = 0;
+    uint64_t bytes      = 0;
+    uint64_t max_ns     = 0;
+
+    // @brief Responses by the first digit of their status code (0 for
+    // anything unexpected)
+    uint64_t by_status_class[6] = {};
+
+    // @brief Latencies of every request and of the requests of each path
+    // (heap allocated, they are a few KiB each)
+    std::unique_ptr<LatencyHistogram> latency = std::make_unique<LatencyHistogram> ();
+    std::vector<std::unique_ptr<LatencyHistogram>> path_latencies;
+    std::vector<uint64_t> path_requests;
+};
+
+// @brief A request sent and not answered yet
+struct InFlight {
+    uint64_t start_ns;
+    size_t path;
+};
+
+// @brief State of one client connection
+struct BenchConnection {
+    int sock       = -1;
+    bool connected = false;
+
+    // @brief Requests not written to the socket yet
+    std::string out;
+    size_t out_offset = 0;
+
+    // @brief Oldest first, responses arrive in this order
+    std::deque<InFlight> in_flight;
+
+    // @brief Head of the response being read, until its empty line
+    std::string head;
+
+    // @brief The head is complete and this much of the body is still to come
+    bool in_body     = false;
+    size_t body_left = 0;
+
+    int status       = 0;
+    bool close_after = false;
+};
+
+/**
+ * @brief Reads the status code, Content-Length and "Connection: close" out of
+ * the head of a response
+ * @return false if the status line is malformed
+ */
+static bool parseHead (std::string_view p_Head, int& p_Status, size_t& p_ContentLength, bool& p_Close) {
+    // "HTTP/1.1 200 OK"
+    if (p_Head.size () < 12 || !p_Head.starts_with ("HTTP/1."))
+        return false;
+    std::from_chars (p_Head.data () + 9, p_Head.data () + 12, p_Status);
+
+    p_ContentLength = 0;
+    size_t length_pos = p_Head.find ("Content-Length: ");
+    if (length_pos != std::string_view::npos) {
+        const char* value = p_Head.data () + length_pos + 16;
+        std::from_chars (value, p_Head.data () + p_Head.size (), p_ContentLength);
+    }
+    p_Close = p_Head.find ("Connection: close") != std::string_view::npos;
+    return true;
+}
+
+// @brief Runs one thread's share of the connections until p_End (monotonicNs())
+class BenchThread {
+    public:
+    BenchThread (const BenchConfig& p_Config, const sockaddr_in& p_Address, size_t p_Connections,
+    uint64_t p_MeasureStart, uint64_t p_End)
+    : m_Config (p_Config), m_Address (p_Address), m_Connections (p_Connections),
+      m_MeasureStart (p_MeasureStart), m_End (p_End),
+      m_Pick (p_Config.weights.begin (), p_Config.weights.end ()), m_Random (std::random_device{}()) {
+        for (const std::string& path : p_Config.paths) {
+            m_Requests.push_back ("GET " + path + " HTTP/1.1\r\nHost: " + p_Config.ip_address +
+            (p_Config.close ? "\r\nConnection: close\r\n\r\n" : "\r\n\r\n"));
+            m_Result.path_latencies.push_back (std::make_unique<LatencyHistogram> ());
+            m_Result.path_requests.push_back (0);
+        }
+    }
+
+    BenchResult& getResult () {
+        return m_Result;
+    }
+
+    void run () {
+        m_EpollFd = epoll_create1 (EPOLL_CLOEXEC);
+        if (m_EpollFd < 0) {
+            std::cerr << "epoll_create1 failed: " << std::strerror (errno) << std::endl;
+            return;
+        }
+
+        size_t open = 0;
+        for (size_t i = 0; i < m_Connections.size (); i++) {
+            if (openConnection (i))
+                open++;
+        }
+
+        std::vector<epoll_event> events (1024);
+        char buffer[65536];
+        while (open > 0) {
+            uint64_t now = monotonicNs ();
+            if (now >= m_End)
+                break;
+            int timeout_ms = static_cast<int> (std::min<uint64_t> ((m_End - now) / 1000000 + 1, 100));
+            int ready = epoll_wait (m_EpollFd, events.data (), static_cast<int> (events.size ()), timeout_ms);
+
+            for (int e = 0; e < ready; e++) {
+                size_t index          = events[e].data.u64;
+                BenchConnection& conn = m_Connections[index];
+                if (conn.sock < 0)
+                    continue;
+
+                if (events[e].events & EPOLLERR) {
+                    failConnection (conn);
+                    open--;
+                    continue;
+                }
+                if (events[e].events & EPOLLOUT)
+                    conn.connected = true;
+
+                bool reopen = false;
+                if (events[e].events & (EPOLLIN | EPOLLHUP)) {
+                    // edge triggered: read until the socket has nothing left
+                    while (true) {
+                        ssize_t received = recv (conn.sock, buffer, sizeof (buffer), 0);
+                        if (received > 0) {
+                            if (!handleData (conn, buffer, static_cast<size_t> (received), reopen))
+                                break;
+                            continue;
+                        }
+                        if (received < 0 && errno == EINTR)
+                            continue;
+                        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                            break;
+                        // closed by the server: fine between responses (e.g.
+                        // an idle timeout), an error in the middle of one
+                        if (conn.in_flight.empty () && !conn.in_body && conn.head.empty ())
+                            reopen = true;
+                        else
+                            failConnection (conn);
+                        break;
+                    }
+                }
+                if (conn.sock < 0) {
+                    open--;
+                    continue;
+                }
+
+                if (reopen) {
+                    close (conn.sock);
+                    conn.sock = -1;
+                    if (monotonicNs () >= m_MeasureStart)
+                        m_Result.reconnects++;
+                    if (!openConnection (index))
+                        open--;
+                    continue;
+                }
+
+                fillPipeline (conn);
+                if (conn.connected && !flushRequests (conn)) {
+                    failConnection (conn);
+                    open--;
+                }
+            }
+        }
+
+        for (BenchConnection& conn : m_Connections) {
+            if (conn.sock >= 0)
+                close (conn.sock);
+        }
+        close (m_EpollFd);
+    }
+
+    private:
+    const BenchConfig& m_Config;
+    const sockaddr_in& m_Address;
+    std::vector<BenchConnection> m_Connections;
+    uint64_t m_MeasureStart;
+    uint64_t m_End;
+
+    // @brief Rendered request of every path
+    std::vector<std::string> m_Requests;
+    std::discrete_distribution<size_t> m_Pick;
+    std::mt19937_64 m_Random;
+
+    int m_EpollFd = -1;
+    BenchResult m_Result;
+
+    // @brief Starts connecting m_Connections[p_Index] and queues its first
+    // requests, returns false if it failed
+    bool openConnection (size_t p_Index) {
+        BenchConnection& conn = m_Connections[p_Index];
+        conn                  = BenchConnection ();
+        conn.sock             = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (conn.sock < 0) {
+            m_Result.errors++;
+            return false;
+        }
+        const int enable = 1;
+        setsockopt (conn.sock, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof (enable));
+
+        if (connect (conn.sock, reinterpret_cast<const sockaddr*> (&m_Address), sizeof (m_Address)) < 0 &&
+        errno != EINPROGRESS) {
+            failConnection (conn);
+            return false;
+        }
+
+        epoll_event event{};
+        event.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.u64 = p_Index;
+        if (epoll_ctl (m_EpollFd, EPOLL_CTL_ADD, conn.sock, &event) < 0) {
+            failConnection (conn);
+            return false;
+        }
+        fillPipeline (conn);
+        return true;
+    }
+
+    void failConnection (BenchConnection& p_Conn) {
+        close (p_Conn.sock);
+        p_Conn.sock = -1;
+        m_Result.errors++;
+    }
+
+    // @brief Queues requests until p_Conn has as many in flight as allowed.
+    // A connection which is closed after its response gets only one.
+    void fillPipeline (BenchConnection& p_Conn) {
+        size_t depth = m_Config.close ? 1 : m_Config.pipeline;
+        if (p_Conn.close_after)
+            return;
+        uint64_t now = monotonicNs ();
+        while (p_Conn.in_flight.size () < depth) {
+            size_t path = m_Pick (m_Random);
+            p_Conn.out += m_Requests[path];
+            p_Conn.in_flight.push_back ({ now, path });
+            if (m_Config.close)
+                p_Conn.close_after = true;
+        }
+    }
+
+    // @brief Writes the queued requests, returns false if the socket failed
+    bool flushRequests (BenchConnection& p_Conn) {
+        while (p_Conn.out_offset < p_Conn.out.size ()) {
+            ssize_t sent = send (p_Conn.sock, p_Conn.out.data () + p_Conn.out_offset,
+            p_Conn.out.size () - p_Conn.out_offset, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            p_Conn.out_offset += static_cast<size_t> (sent);
+        }
+        p_Conn.out.clear ();
+        p_Conn.out_offset = 0;
+        return true;
+    }
+
+    /**
+     * @brief Consumes received bytes: the head of a response is kept until it
+     * is complete, the body is only counted
+     * @param p_Reopen Set if the server closes the connection after a
+     * response, the caller opens a new one
+     * @return false if nothing more is read from p_Conn
+     */
+    bool handleData (BenchConnection& p_Conn, const char* p_Data, size_t p_Size, bool& p_Reopen) {
+        bool measuring = monotonicNs () >= m_MeasureStart;
+        if (measuring)
+            m_Result.bytes += p_Size;
+
+        while (p_Size > 0) {
+            if (p_Conn.in_body) {
+                size_t taken = std::min (p_Size, p_Conn.body_left);
+                p_Conn.body_left -= taken;
+                p_Data += taken;
+                p_Size -= taken;
+            } else {
+                // the empty line may be split over two reads
+                size_t searched = p_Conn.head.size () >= 3 ? p_Conn.head.size () - 3 : 0;
+                size_t before   = p_Conn.head.size ();
+                p_Conn.head.append (p_Data, p_Size);
+                size_t head_end = p_Conn.head.find ("\r\n\r\n", searched);
+                if (head_end == std::string::npos)
+                    return true;
+
+                size_t head_size = head_end + 4;
+                size_t taken     = head_size - before;
+                bool close       = false;
+                if (p_Conn.in_flight.empty () ||
+                !parseHead (p_Conn.head, p_Conn.status, p_Conn.body_left, close)) {
+                    // an answer to nothing, or garbage
+                    failConnection (p_Conn);
+                    return false;
+                }
+                p_Conn.head.clear ();
+                p_Conn.in_body = true;
+                p_Conn.close_after |= close;
+                p_Data += taken;
+                p_Size -= taken;
+            }
+
+            if (p_Conn.in_body && p_Conn.body_left == 0) {
+                completeResponse (p_Conn, measuring);
+                if (p_Conn.close_after) {
+                    // pipelined requests behind it are never answered
+                    p_Reopen = true;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // @brief Counts the response to the oldest request in flight
+    void completeResponse (BenchConnection& p_Conn, bool p_Measuring) {
+        InFlight request = p_Conn.in_flight.front ();
+        p_Conn.in_flight.pop_front ();
+        p_Conn.in_body = false;
+
+        if (!p_Measuring || request.start_ns < m_MeasureStart)
+            return;
+        uint64_t latency = monotonicNs () - request.start_ns;
+        m_Result.requests++;
+        m_Result.max_ns = std::max (m_Result.max_ns, latency);
+        m_Result.latency->record (latency);
+        m_Result.path_latencies[request.path]->record (latency);
+        m_Result.path_requests[request.path]++;
+        int status_class = p_Conn.status / 100;
+        m_Result.by_status_class[status_class >= 1 && status_class <= 5 ? status_class : 0]++;
+    }
+};
+
+// @brief Sum of the histograms of every thread, and its quantiles
+struct MergedLatency {
+    std::vector<uint64_t> buckets = std::vector<uint64_t> (LatencyHistogram::BUCKET_COUNT);
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+
+    void add (const LatencyHistogram& p_Histogram) {
+        for (size_t i = 0; i < buckets.size (); i++)
+            buckets[i] += p_Histogram.getBucket (i);
+        count += p_Histogram.getCount ();
+        sum += p_Histogram.getSum ();
+    }
+
+    // @brief Upper end of the bucket holding the p_Quantile quantile, in µs
+    double quantileUs (double p_Quantile) const {
+        uint64_t rank = static_cast<uint64_t> (p_Quantile * static_cast<double> (count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size (); i++) {
+            seen += buckets[i];
+            if (seen > rank)
+                return static_cast<double> (LatencyHistogram::bucketStart (i + 1)) / 1000;
+        }
+        return 0;
+    }
+
+    double meanUs () const {
+        return count ? static_cast<double> (sum) / static_cast<double> (count) / 1000 : 0;
+    }
+};
+
+// @brief Prints p_Value as a JSON string (paths need no more than this)
+static void printJsonString (std::string_view p_Value) {
+    std::putchar ('"');
+    for (char c : p_Value) {
+        if (c == '"' || c == '\\')
+            std::putchar ('\\');
+        std::putchar (c);
+    }
+    std::putchar ('"');
+}
+
+static void printUsage (const char* p_Program) {
+    std::cerr << "Usage: " << p_Program << " [--threads N] [--connections N] [--pipeline N] "
+                 "[--duration s] [--warmup s] [--close] [--path PATH[:WEIGHT]]... [ip_address port]"
+              << std::endl;
+}
+
+// @brief Converts a command line argument to a number, exits if it isn't one
+// (or is smaller than p_Min)
+static size_t parseNumber (std::string_view p_Name, std::string_view p_Value, size_t p_Min) {
+    size_t value = 0;
+    auto [end, error] = std::from_chars (p_Value.data (), p_Value.data () + p_Value.size (), value);
+    if (error != std::errc () || end != p_Value.data () + p_Value.size () || value < p_Min) {
+        std::cerr << "Invalid " << p_Name << ": " << p_Value << std::endl;
+        exit (EXIT_FAILURE);
+    }
+    return value;
+}
+
+int main (int argc, char* argv[]) {
+    BenchConfig config;
+    std::vector<const char*> positional_args;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            config.threads = parseNumber ("number of threads", argv[++i], 1);
+        } else if (arg == "--connections" && i + 1 < argc) {
+            config.connections = parseNumber ("number of connections", argv[++i], 1);
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            config.pipeline = parseNumber ("pipelining depth", argv[++i], 1);
+        } else if (arg == "--duration" && i + 1 < argc) {
+            config.duration_s = static_cast<unsigned> (parseNumber ("duration", argv[++i], 1));
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            config.warmup_s = static_cast<unsigned> (parseNumber ("warmup", argv[++i], 0));
+        } else if (arg == "--close") {
+            config.close = true;
+        } else if (arg == "--path" && i + 1 < argc) {
+            std::string_view path = argv[++i];
+            unsigned weight       = 1;
+            size_t colon          = path.rfind (':');
+            if (colon != std::string_view::npos) {
+                weight = static_cast<unsigned> (parseNumber ("path weight", path.substr (colon + 1), 1));
+                path   = path.substr (0, colon);
+            }
+            if (!path.starts_with ('/')) {
+                std::cerr << "Paths must start with /" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.paths.emplace_back (path);
+            config.weights.push_back (weight);
+        } else if (arg.starts_with ("--")) {
+            printUsage (argv[0]);
+            exit (EXIT_FAILURE);
+        } else {
+            positional_args.push_back (argv[i]);
+        }
+    }
+
+    if (positional_args.size () == 2) {
+        config.ip_address = positional_args[0];
+        config.port       = static_cast<int> (parseNumber ("port number", positional_args[1], 1));
+    } else if (!positional_args.empty ()) {
+        printUsage (argv[0]);
+        exit (EXIT_FAILURE);
+    }
+    if (config.paths.empty ()) {
+        config.paths.push_back ("/");
+        config.weights.push_back (1);
+    }
+    config.threads = std::min (config.threads, config.connections);
+
+    rlimit fd_limit;
+    if (getrlimit (RLIMIT_NOFILE, &fd_limit) == 0) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit (RLIMIT_NOFILE, &fd_limit);
+    }
+
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons (static_cast<uint16_t> (config.port));
+    address.sin_addr.s_addr = inet_addr (config.ip_address.c_str ());
+
+    uint64_t start         = monotonicNs ();
+    uint64_t measure_start = start + uint64_t{ config.warmup_s } * 1000000000;
+    uint64_t end           = measure_start + uint64_t{ config.duration_s } * 1000000000;
+
+    // connections are spread evenly, the first threads take the remainder
+    std::vector<std::unique_ptr<BenchThread>> bench_threads;
+    for (size_t t = 0; t < config.threads; t++) {
+        size_t connections = config.connections / config.threads + (t < config.connections % config.threads);
+        bench_threads.push_back (std::make_unique<BenchThread> (config, address, connections, measure_start, end));
+    }
+    std::vector<std::thread> threads;
+    for (auto& bench_thread : bench_threads)
+        threads.emplace_back ([&bench_thread] { bench_thread->run (); });
+    for (std::thread& thread : threads)
+        thread.join ();
+
+    // the threads run until end, so the measurement lasted exactly this long
+    double seconds = config.duration_s;
+
+    BenchResult total;
+    MergedLatency latency;
+    std::vector<MergedLatency> path_latencies (config.paths.size ());
+    std::vector<uint64_t> path_requests (config.paths.size ());
+    for (auto& bench_thread : bench_threads) {
+        BenchResult& result = bench_thread->getResult ();
+        total.requests += result.requests;
+        total.errors += result.errors;
+        total.reconnects += result.reconnects;
+        total.bytes += result.bytes;
+        total.max_ns = std::max (total.max_ns, result.max_ns);
+        for (size_t i = 0; i < std::size (total.by_status_class); i++)
+            total.by_status_class[i] += result.by_status_class[i];
+        latency.add (*result.latency);
+        for (size_t p = 0; p < config.paths.size (); p++) {
+            path_latencies[p].add (*result.path_latencies[p]);
+            path_requests[p] += result.path_requests[p];
+        }
+    }
+
+    std::printf ("{\n  \"target\": \"%s:%d\",\n", config.ip_address.c_str (), config.port);
+    std::printf ("  \"threads\": %zu,\n  \"connections\": %zu,\n  \"pipeline\": %zu,\n",
+    config.threads, config.connections, config.close ? size_t{ 1 } : config.pipeline);
+    std::printf ("  \"keep_alive\": %s,\n  \"duration_s\": %.3f,\n", config.close ? "false" : "true", seconds);
+    std::printf ("  \"requests\": %" PRIu64 ",\n  \"errors\": %" PRIu64 ",\n  \"reconnects\": %" PRIu64 ",\n",
+    total.requests, total.errors, total.reconnects);
+    std::printf ("  \"status\": { \"1xx\": %" PRIu64 ", \"2xx\": %" PRIu64 ", \"3xx\": %" PRIu64 ", \"4xx\": %" PRIu64 ", \"5xx\": %" PRIu64 ", "
+                 "\"other\": %" PRIu64 " },\n",
+    total.by_status_class[1], total.by_status_class[2], total.by_status_class[3],
+    total.by_status_class[4], total.by_status_class[5], total.by_status_class[0]);
+    std::printf ("  \"rps\": %.1f,\n", static_cast<double> (total.requests) / seconds);
+    std::printf ("  \"throughput_bytes_per_s\": %.0f,\n", static_cast<double> (total.bytes) / seconds);
+    std::printf ("  \"latency_us\": { \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+                 "\"p999\": %.1f, \"max\": %.1f },\n",
+    latency.meanUs (), latency.quantileUs (0.5), latency.quantileUs (0.9), latency.quantileUs (0.99),
+    latency.quantileUs (0.999), static_cast<double> (total.max_ns) / 1000);
+    std::printf ("  \"paths\": [");
+    for (size_t p = 0; p < config.paths.size (); p++) {
+        std::printf ("%s\n    { \"path\": ", p ? "," : "");
+        printJsonString (config.paths[p]);
+        std::printf (", \"weight\": %u, \"requests\": %" PRIu64 ", \"p50_us\": %.1f, \"p99_us\": %.1f }",
+        config.weights[p], path_requests[p], path_latencies[p].quantileUs (0.5),
+        path_latencies[p].quantileUs (0.99));
+    }
+    std::printf ("\n  ]\n}\n");
+
+    return total.requests > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
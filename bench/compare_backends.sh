@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+#
+# Runs keepalive-bench against cerve once per I/O backend and prints the
+# requests/sec of each run.
+#
+# Usage: bench/compare_backends.sh [build_dir docroot connections seconds path]
+# e.g.   bench/compare_backends.sh build . "100 1000 10000" 10 /index.html
+
+set -euo pipefail
+
+BUILD_DIR=$(realpath "${1:-build}")
+DOCROOT=${2:-.}
+CONNECTIONS=${3:-"100 1000 10000"}
+SECONDS_PER_RUN=${4:-10}
+RESOURCE=${5:-/index.html}
+PORT=18000
+
+printf "%-10s %12s %14s\n" "backend" "connections" "requests/sec"
+
+for backend in epoll io_uring coroutine; do
+    for connections in $CONNECTIONS; do
+        (cd "$DOCROOT" && exec "$BUILD_DIR/cerve" --backend "$backend" 127.0.0.1 "$PORT" >/dev/null) &
+        server_pid=$!
+        sleep 0.5
+
+        rps=$("$BUILD_DIR/bench/keepalive-bench" 127.0.0.1 "$PORT" "$connections" \
+            "$SECONDS_PER_RUN" "$RESOURCE" | awk '/requests\/sec/ { print $2 }')
+        printf "%-10s %12s %14s\n" "$backend" "$connections" "$rps"
+
+        kill "$server_pid"
+        wait "$server_pid" 2>/dev/null || true
+        PORT=$((PORT + 1))
+    done
+done
@@ -0,0 +1,187 @@
+/**
+ * @file coroutine_bench.cpp
+ * @brief Compares the two ways a worker can be written: each request of the
+ * corpus goes around a keep-alive connection over a socket pair, once with
+ * callbacks on an EventLoop (what EpollWorker does) and once with a coroutine
+ * awaiting the socket on a Reactor (what CoroutineWorker does). Neither may
+ * call the global allocator. Then starting and finishing a task on its own,
+ * with its frame allocated globally and from a pool: a pooled frame mustn't
+ * allocate either.
+ *
+ * Usage: coroutine-bench [iterations]
+ */
+
+#include <cstdlib>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.hpp"
+#include "connection.hpp"
+#include "corpus.hpp"
+#include "event_loop.hpp"
+#include "file_cache.hpp"
+#include "http_parser.hpp"
+#include "http_request.hpp"
+#include "reactor.hpp"
+#include "task.hpp"
+
+namespace coro = ccerve::coro;
+
+// @brief Size of the buffer a request is received into
+static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+// @brief Queues the response to the request in p_Received on p_Conn
+static void answer (ccerve::Connection& p_Conn, std::string_view p_Received, ccerve::FileCache& p_FileCache) {
+    ccerve::parse::RequestReader& reader = p_Conn.getRequestReader ();
+    reader.append (p_Received);
+    ccerve::parse::Request request;
+    reader.next (request);
+    p_Conn.queueResponse (
+    ccerve::parse::handleRequest (request, &p_FileCache, nullptr, nullptr, false, p_Conn.getArena ()));
+    reader.consume ();
+}
+
+// @brief Reads whatever arrived on p_Peer
+static void drainPeer (int p_Peer, std::vector<char>& p_Buffer) {
+    while (read (p_Peer, p_Buffer.data (), p_Buffer.size ()) > 0) {
+    }
+}
+
+// @brief The callbacks of EpollWorker, without the timers and metrics
+static void handleEvents (ccerve::EventLoop& p_EventLoop, ccerve::Connection& p_Conn,
+ccerve::FileCache& p_FileCache, char* p_Buffer) {
+    int ready = p_EventLoop.wait (0);
+    for (int i = 0; i < ready; i++) {
+        if (p_EventLoop.getEvent (i).events & EPOLLIN) {
+            ssize_t bytes_received;
+            while ((bytes_received = recv (p_Conn.getSock (), p_Buffer, BUFFER_SIZE, 0)) > 0)
+                answer (p_Conn, std::string_view (p_Buffer, bytes_received), p_FileCache);
+        }
+        size_t bytes_sent = 0;
+        p_Conn.flush (bytes_sent);
+        if (!p_Conn.hasPendingWrites ())
+            p_Conn.releaseArena ();
+    }
+}
+
+// @brief The coroutine of CoroutineWorker, without the timers and metrics.
+// Ends once the socket is unwatched.
+static coro::Task<> serve (coro::Reactor& p_Reactor, ccerve::Connection& p_Conn, ccerve::FileCache& p_FileCache,
+char* p_Buffer) {
+    int sock = p_Conn.getSock ();
+    iovec iov[ccerve::Connection::MAX_GATHERED_SEGMENTS];
+    while (true) {
+        ssize_t bytes_received = co_await p_Reactor.recv (sock, p_Buffer, BUFFER_SIZE);
+        if (bytes_received <= 0)
+            co_return;
+        answer (p_Conn, std::string_view (p_Buffer, bytes_received), p_FileCache);
+
+        while (p_Conn.hasPendingWrites ()) {
+            const ccerve::OutputSegment& segment = p_Conn.getNextSegment ();
+            ssize_t bytes_sent;
+            if (segment.isFile ()) {
+                bytes_sent =
+                co_await p_Reactor.sendfile (sock, segment.file_fd, segment.file_offset, segment.file_remaining);
+            } else {
+                bool more        = false;
+                size_t iov_count = p_Conn.gatherSegments (iov, more);
+                bytes_sent = co_await p_Reactor.send (sock, std::span<const iovec> (iov, iov_count), more ? MSG_MORE : 0);
+            }
+            if (bytes_sent <= 0)
+                co_return;
+            p_Conn.markSent (bytes_sent);
+        }
+        p_Conn.releaseArena ();
+    }
+}
+
+static coro::Task<uint64_t> twice (uint64_t p_Value) {
+    co_return p_Value * 2;
+}
+
+// @brief A task awaiting another one: two frames
+static coro::Task<> accumulate (uint64_t& p_Sum) {
+    p_Sum += co_await twice (p_Sum | 1);
+}
+
+int main (int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 200000;
+
+    bench::TemporarySite site;
+    if (!site.created ())
+        return EXIT_FAILURE;
+
+    ccerve::FileCache file_cache (64 * 1024 * 1024, 1024 * 1024);
+    // the pool a worker hands its connections and frames
+    std::pmr::unsynchronized_pool_resource memory (std::pmr::pool_options{ 0, 64 * 1024 });
+    std::vector<char> peer_buffer (256 * 1024);
+    std::vector<char> buffer (BUFFER_SIZE);
+    double callback_allocations  = 0;
+    double coroutine_allocations = 0;
+
+    for (bool coroutine : { false, true }) {
+        int socks[2];
+        if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, socks) != 0) {
+            std::perror ("socketpair");
+            return EXIT_FAILURE;
+        }
+        ccerve::Connection conn (socks[0], sockaddr_in{}, &memory);
+        ccerve::EventLoop event_loop;
+        coro::Reactor reactor;
+        coro::setFrameMemory (&memory);
+        if (coroutine) {
+            reactor.watch (socks[0]);
+            serve (reactor, conn, file_cache, buffer.data ()).detach ();
+        } else {
+            event_loop.add (socks[0], EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        }
+
+        for (const bench::CorpusRequest& corpus_request : bench::REQUESTS) {
+            // the range request sends megabytes of a file
+            if (corpus_request.name == "range")
+                continue;
+            std::string name = std::string (coroutine ? "coroutine" : "callbacks") + " (" +
+            std::string (corpus_request.name) + ")";
+            double allocations = bench::run (name, iterations, [&] {
+                if (write (socks[1], corpus_request.text.data (), corpus_request.text.size ()) < 0)
+                    std::abort ();
+                do {
+                    if (coroutine)
+                        reactor.poll (0);
+                    else
+                        handleEvents (event_loop, conn, file_cache, buffer.data ());
+                    drainPeer (socks[1], peer_buffer);
+                } while (conn.hasPendingWrites ());
+            });
+            (coroutine ? coroutine_allocations : callback_allocations) += allocations;
+        }
+
+        // the coroutine sees its receive canceled and ends
+        reactor.unwatch (socks[0]);
+        reactor.poll (0);
+        coro::setFrameMemory (nullptr);
+        close (socks[1]);
+    }
+
+    uint64_t sum = 0;
+    bench::run ("task (global frames)", iterations, [&sum] { accumulate (sum).detach (); });
+    coro::setFrameMemory (&memory);
+    double pooled_allocations =
+    bench::run ("task (pooled frames)", iterations, [&sum] { accumulate (sum).detach (); });
+    coro::setFrameMemory (nullptr);
+    bench::doNotOptimize (sum);
+
+    if (callback_allocations != 0 || coroutine_allocations != 0) {
+        std::fprintf (stderr, "A request on a keep-alive connection allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    if (pooled_allocations != 0) {
+        std::fprintf (stderr, "A pooled coroutine frame allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+/**
+ * @file corpus.hpp
+ * @brief Fixed requests the micro benchmarks replay, so their numbers can be
+ * compared between commits. They are what browsers and tools send for the
+ * files of a small site (SITE_FILES).
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+namespace bench {
+
+// @brief A file of the site the requests ask for
+struct SiteFile {
+    std::string_view path;
+    size_t size;
+};
+
+// @brief The files the requests ask for (favicon.ico is missing on purpose).
+// The video is too large for the file cache.
+inline constexpr std::array<SiteFile, 4> SITE_FILES = { {
+{ "index.html", 8 * 1024 },
+{ "assets/css/main.css", 24 * 1024 },
+{ "assets/img/logo.png", 6 * 1024 },
+{ "media/clip.mp4", 4 * 1024 * 1024 },
+} };
+
+// @brief Creates the files of the corpus below p_Root
+inline void makeSite (const std::filesystem::path& p_Root) {
+    for (const SiteFile& file : SITE_FILES) {
+        std::filesystem::path path = p_Root / file.path;
+        std::filesystem::create_directories (path.parent_path ());
+        std::ofstream (path, std::ios::binary) << std::string (file.size, 'x');
+    }
+}
+
+// @brief The site in a temporary directory, which is the working directory
+// (handleRequest() resolves paths relative to it) until it is removed
+class TemporarySite {
+    public:
+    TemporarySite () {
+        if (!mkdtemp (m_Root)) {
+            std::perror ("mkdtemp");
+            return;
+        }
+        makeSite (m_Root);
+        std::filesystem::current_path (m_Root);
+        m_Created = true;
+    }
+
+    ~TemporarySite () {
+        if (!m_Created)
+            return;
+        std::filesystem::current_path ("/");
+        std::filesystem::remove_all (m_Root);
+    }
+
+    TemporarySite (const TemporarySite&)            = delete;
+    TemporarySite& operator= (const TemporarySite&) = delete;
+
+    // @brief Whether the site could be created
+    bool created () const {
+        return m_Created;
+    }
+
+    private:
+    char m_Root[32] = "/tmp/ccerve-bench-XXXXXX";
+    bool m_Created  = false;
+};
+
+// @brief A request and what it stands for
+struct CorpusRequest {
+    std::string_view name;
+    std::string_view text;
+};
+
+inline constexpr std::array<CorpusRequest, 6> REQUESTS = { {
+{ "navigation", "GET / HTTP/1.1\r\n"
+                "Host: 127.0.0.1:8000\r\n"
+                "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like "
+                "Gecko) Chrome/126.0.0.0 Safari/537.36\r\n"
+                "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,"
+                "image/apng,*/*;q=0.8\r\n"
+                "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+                "Accept-Language: en-US,en;q=0.9\r\n"
+                "Cache-Control: max-age=0\r\n"
+                "Connection: keep-alive\r\n"
+                "Sec-Fetch-Dest: document\r\n"
+                "Sec-Fetch-Mode: navigate\r\n"
+                "Sec-Fetch-Site: none\r\n"
+                "Sec-Fetch-User: ?1\r\n"
+                "Upgrade-Insecure-Requests: 1\r\n"
+                "\r\n" },
+{ "stylesheet", "GET /assets/css/main.css?v=3 HTTP/1.1\r\n"
+                "Host: 127.0.0.1:8000\r\n"
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+                "Accept: text/css,*/*;q=0.1\r\n"
+                "Accept-Language: en-US,en;q=0.5\r\n"
+                "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+                "Connection: keep-alive\r\n"
+                "Referer: http://127.0.0.1:8000/index.html\r\n"
+                "Sec-Fetch-Dest: style\r\n"
+                "Sec-Fetch-Mode: no-cors\r\n"
+                "Sec-Fetch-Site: same-origin\r\n"
+                "Priority: u=2\r\n"
+                "\r\n" },
+{ "revalidation", "GET /assets/img/logo.png HTTP/1.1\r\n"
+                  "Host: 127.0.0.1:8000\r\n"
+                  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+                  "Accept: image/avif,image/webp,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+                  "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+                  "Connection: keep-alive\r\n"
+                  "Referer: http://127.0.0.1:8000/index.html\r\n"
+                  "If-Modified-Since: Tue, 01 Oct 2030 10:00:00 GMT\r\n"
+                  "Sec-Fetch-Dest: image\r\n"
+                  "\r\n" },
+{ "range", "GET /media/clip.mp4 HTTP/1.1\r\n"
+           "Host: 127.0.0.1:8000\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+           "Accept: video/webm,video/ogg,video/*;q=0.9,*/*;q=0.5\r\n"
+           "Range: bytes=65536-\r\n"
+           "Connection: keep-alive\r\n"
+           "Sec-Fetch-Dest: video\r\n"
+           "\r\n" },
+{ "not found", "GET /favicon.ico HTTP/1.1\r\n"
+               "Host: 127.0.0.1:8000\r\n"
+               "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+               "Accept: image/avif,image/webp,*/*\r\n"
+               "Connection: keep-alive\r\n"
+               "\r\n" },
+{ "curl", "GET /index.html HTTP/1.1\r\n"
+          "Host: 127.0.0.1:8000\r\n"
+          "User-Agent: curl/8.5.0\r\n"
+          "Accept: */*\r\n"
+          "\r\n" },
+} };
+
+} // namespace bench
@@ -0,0 +1,212 @@
+/**
+ * @file keepalive_bench.cpp
+ * @brief Opens a given number of keep-alive connections to a running cerve
+ * instance and sends requests on all of them for a fixed duration. Prints the
+ * throughput achieved. A connection the server closes after a response (it
+ * announces that with "Connection: close") is replaced by a new one.
+ *
+ * Usage: keepalive-bench [ip_address port connections seconds path]
+ * e.g. ./build/bench/keepalive-bench 127.0.0.1 8000 10000 10 /index.html
+ */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// @brief State of one client connection
+struct BenchConnection {
+    int sock         = -1;
+    bool connected   = false;
+    size_t sent      = 0; // bytes of the current request already sent
+    std::string received; // bytes of the current response received so far
+};
+
+/**
+ * @brief Checks whether @p_Received holds a complete response
+ * @param p_Close Set if the server closes the connection after it
+ * @return length of the response or 0 if more data is needed
+ */
+static size_t completeResponseLength (const std::string& p_Received, bool& p_Close) {
+    size_t header_end = p_Received.find ("\r\n\r\n");
+    if (header_end == std::string::npos)
+        return 0;
+
+    size_t close_pos = p_Received.find ("Connection: close");
+    p_Close          = close_pos != std::string::npos && close_pos < header_end;
+
+    size_t content_length = 0;
+    size_t pos            = p_Received.find ("Content-Length:");
+    if (pos != std::string::npos && pos < header_end)
+        content_length = std::stoul (p_Received.substr (pos + 15));
+
+    size_t total = header_end + 4 + content_length;
+    return p_Received.size () >= total ? total : 0;
+}
+
+int main (int argc, char* argv[]) {
+    std::string ip_address = "127.0.0.1";
+    int port               = 8000;
+    size_t connections     = 1000;
+    int seconds            = 10;
+    std::string path       = "/";
+
+    if (argc == 6) {
+        ip_address  = argv[1];
+        port        = std::stoi (argv[2]);
+        connections = std::stoul (argv[3]);
+        seconds     = std::stoi (argv[4]);
+        path        = argv[5];
+    } else if (argc != 1) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [ip_address port connections seconds path]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    rlimit fd_limit;
+    if (getrlimit (RLIMIT_NOFILE, &fd_limit) == 0) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit (RLIMIT_NOFILE, &fd_limit);
+    }
+
+    const std::string request = "GET " + path + " HTTP/1.1\r\nHost: " +
+    ip_address + "\r\nConnection: keep-alive\r\n\r\n";
+
+    sockaddr_in server_addr{};
+    server_addr.sin_family      = AF_INET;
+    server_addr.sin_port        = htons (port);
+    server_addr.sin_addr.s_addr = inet_addr (ip_address.c_str ());
+
+    int epoll_fd = epoll_create1 (0);
+    std::vector<BenchConnection> conns (connections);
+
+    // starts connecting conns[i], returns false if no socket is left
+    auto openConn = [&] (size_t i) {
+        conns[i]      = BenchConnection ();
+        conns[i].sock = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (conns[i].sock < 0)
+            return false;
+        connect (conns[i].sock, (sockaddr*)&server_addr, sizeof (server_addr));
+
+        epoll_event event{};
+        event.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.u64 = i;
+        epoll_ctl (epoll_fd, EPOLL_CTL_ADD, conns[i].sock, &event);
+        return true;
+    };
+
+    for (size_t i = 0; i < connections; i++) {
+        if (!openConn (i)) {
+            std::cerr << "Could only open " << i << " sockets: " << strerror (errno) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    using clock         = std::chrono::steady_clock;
+    const auto deadline = clock::now () + std::chrono::seconds (seconds);
+    size_t completed = 0, errors = 0, reconnects = 0, open = connections;
+    char buffer[65536];
+    std::vector<epoll_event> events (1024);
+
+    auto closeConn = [&] (BenchConnection& conn) {
+        close (conn.sock);
+        conn.sock = -1;
+        errors++;
+        open--;
+    };
+
+    // sends (the rest of) the current request, returns false on error
+    auto sendRequest = [&] (BenchConnection& conn) {
+        while (conn.sent < request.size ()) {
+            ssize_t n = send (conn.sock, request.data () + conn.sent,
+            request.size () - conn.sent, MSG_NOSIGNAL);
+            if (n < 0)
+                return errno == EAGAIN;
+            conn.sent += n;
+        }
+        return true;
+    };
+
+    while (clock::now () < deadline && open > 0) {
+        int ready = epoll_wait (epoll_fd, events.data (), events.size (), 100);
+        for (int e = 0; e < ready; e++) {
+            BenchConnection& conn = conns[events[e].data.u64];
+            if (conn.sock < 0)
+                continue;
+
+            if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                closeConn (conn);
+                continue;
+            }
+
+            if (!conn.connected && (events[e].events & EPOLLOUT)) {
+                conn.connected = true;
+            }
+            if (conn.connected && !sendRequest (conn)) {
+                closeConn (conn);
+                continue;
+            }
+
+            while (events[e].events & EPOLLIN) {
+                ssize_t n = recv (conn.sock, buffer, sizeof (buffer), 0);
+                if (n <= 0) {
+                    if (n == 0 || errno != EAGAIN)
+                        closeConn (conn);
+                    break;
+                }
+                conn.received.append (buffer, n);
+
+                // a response is done, send the next request on the same
+                // connection
+                bool close_after = false;
+                while (size_t length = completeResponseLength (conn.received, close_after)) {
+                    conn.received.erase (0, length);
+                    conn.sent = 0;
+                    completed++;
+                    if (close_after) {
+                        // the server ends the connection, carry on with a new one
+                        close (conn.sock);
+                        reconnects++;
+                        if (!openConn (events[e].data.u64)) {
+                            conn.sock = -1;
+                            errors++;
+                            open--;
+                        }
+                        break;
+                    }
+                    if (!sendRequest (conn)) {
+                        closeConn (conn);
+                        break;
+                    }
+                }
+                if (conn.sock < 0 || close_after)
+                    break;
+            }
+        }
+    }
+
+    std::cout << "connections:      " << connections << "\n"
+              << "still open:       " << open << "\n"
+              << "duration:         " << seconds << "s\n"
+              << "requests:         " << completed << "\n"
+              << "errors:           " << errors << "\n"
+              << "reconnects:       " << reconnects << "\n"
+              << "requests/sec:     " << completed / static_cast<double> (seconds)
+              << std::endl;
+
+    for (auto& conn : conns) {
+        if (conn.sock >= 0)
+            close (conn.sock);
+    }
+    close (epoll_fd);
+    return 0;
+}
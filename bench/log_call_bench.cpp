@@ -0,0 +1,61 @@
+/**
+ * @file log_call_bench.cpp
+ * @brief Measures a Logger::info call (an access log line) from 1, 4 and 16
+ * threads logging at once into a sink which only counts the messages. The
+ * queue blocks when it's full, so with many threads this is also how fast
+ * the write thread drains it. Exits with an error if a call allocates.
+ *
+ * Usage: log-call-bench [iterations per thread]
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "bench.hpp"
+#include "logger.hpp"
+
+// @brief Counts the messages it gets instead of writing them
+class CountingSink : public ccerve::sinks::BaseSink {
+    public:
+    void write (std::string_view) override {
+        m_Count++;
+    }
+
+    size_t getCount () const {
+        return m_Count;
+    }
+
+    private:
+    size_t m_Count = 0;
+};
+
+int main (int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 200000;
+
+    double allocations = 0;
+    for (unsigned threads : { 1, 4, 16 }) {
+        auto sink = std::make_shared<CountingSink> ();
+        {
+            ccerve::log::Logger logger ("Default Logger", ccerve::log::LOG_LEVEL::INFO,
+            ccerve::log::SinksVector{ sink });
+            std::string name = "Logger::info (" + std::to_string (threads) + (threads == 1 ? " thread)" : " threads)");
+            allocations += bench::runThreads (name, threads, iterations, [&logger] (unsigned p_Thread) {
+                logger.info ("{} -- {} {} {} {}", "127.0.0.1", "GET", "/index.html", "HTTP/1.1", 200 + p_Thread);
+            });
+        }
+
+        // warm-up calls included, the logger is gone so every message was written
+        size_t expected = (iterations + iterations / 10 + 1) * threads;
+        if (sink->getCount () != expected) {
+            std::fprintf (stderr, "Messages were lost (%zu of %zu)!\n", sink->getCount (), expected);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (allocations != 0) {
+        std::fprintf (stderr, "Logger::info allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file logger_bench.cpp
+ * @brief Compares the Logger's lock-free queue with the mutex guarded
+ * std::queue (and a notify per message) it replaced, and the batched file
+ * sink and the memory-mapped rotating sink with one which writes and flushes
+ * every message. Several threads log
+ * at once. Printed are the messages per second until every message has
+ * reached the sink and the CPU time a logging thread spends in a call on
+ * average (CPU time, so the write thread running in between isn't counted
+ * on machines with few cores).
+ *
+ * Usage: logger-bench [threads] [messages per thread] [log file]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.hpp"
+
+// @brief Counts the messages it gets instead of writing them
+class CountingSink : public ccerve::sinks::BaseSink {
+    public:
+    void write (std::string_view p_Msg) override {
+        m_Count++;
+        m_Bytes += p_Msg.size ();
+    }
+
+    size_t getCount () const {
+        return m_Count;
+    }
+
+    private:
+    size_t m_Count = 0;
+    size_t m_Bytes = 0;
+};
+
+namespace legacy {
+
+// The queue of the Logger as it was before the lock-free ring
+class Logger {
+    public:
+    explicit Logger (std::shared_ptr<ccerve::sinks::BaseSink> p_Sink)
+    : m_Sink (std::move (p_Sink)), m_WriteThread ([this] { write (); }) {
+    }
+
+    ~Logger () {
+        m_StopWriteThread = true;
+        m_CV.notify_one ();
+        m_WriteThread.join ();
+    }
+
+    template <typename... Args> void info (std::string_view p_Msg, Args&&... p_Args) {
+        auto user_formatted_str = std::vformat (p_Msg, std::make_format_args (p_Args...));
+        auto tag = std::format ("{}{}{}", cpp_colors::foreground::green, "info", cpp_colors::style::reset);
+        {
+            std::lock_guard<std::mutex> queue_lock{ m_LogQueueMutex };
+            m_LogQueue.push (std::format ("[{}] - [{}] - [{}] - {}\n", getCurrentTime (),
+            "Default Logger", tag, user_formatted_str));
+        }
+        m_CV.notify_one ();
+    }
+
+    private:
+    std::shared_ptr<ccerve::sinks::BaseSink> m_Sink;
+    std::queue<std::string> m_LogQueue;
+    std::mutex m_LogQueueMutex;
+    std::condition_variable m_CV;
+    std::atomic_bool m_StopWriteThread{ false };
+    std::thread m_WriteThread;
+
+    void write () {
+        while (true) {
+            std::unique_lock<std::mutex> queue_lock{ m_LogQueueMutex };
+            m_CV.wait (queue_lock, [this] { return m_StopWriteThread || !m_LogQueue.empty (); });
+            while (!m_LogQueue.empty ()) {
+                std::string msg = std::move (m_LogQueue.front ());
+                m_LogQueue.pop ();
+                queue_lock.unlock ();
+                m_Sink->write (msg);
+                queue_lock.lock ();
+            }
+            if (m_StopWriteThread)
+                break;
+        }
+    }
+};
+
+// The file sink as it was before batching: one write and flush per message
+class FileSink : public ccerve::sinks::BaseSink {
+    public:
+    using BaseSink::write;
+
+    explicit FileSink (const std::string& p_Path)
+    : m_File (p_Path) {
+    }
+
+    void write (std::string_view p_Msg) override {
+        std::lock_guard<std::mutex> file_lock (m_FileMutex);
+        m_File << p_Msg << std::flush;
+    }
+
+    private:
+    std::ofstream m_File;
+    std::mutex m_FileMutex;
+};
+
+} // namespace legacy
+
+// @brief CPU time the calling thread has used
+static int64_t threadCpuTimeNs () {
+    timespec now;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Logs p_Messages access log like lines from each of p_Threads threads
+ * through the logger p_MakeLogger returns for p_Sink and prints the
+ * throughput. The logger is destroyed before the clock stops, so every
+ * message is written.
+ */
+template <typename MakeLogger>
+static void run (const char* p_Name, size_t p_Threads, size_t p_Messages,
+std::shared_ptr<ccerve::sinks::BaseSink> p_Sink, MakeLogger&& p_MakeLogger) {
+    using clock = std::chrono::steady_clock;
+
+    std::atomic<int64_t> calls_ns{ 0 };
+    auto start = clock::now ();
+    {
+        auto logger = p_MakeLogger (std::move (p_Sink));
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < p_Threads; t++) {
+            threads.emplace_back ([&logger, &calls_ns, t, p_Messages] {
+                // an address changing for each line, like inet_ntoa() gives
+                char address[] = "127.0.0.1";
+                int64_t calls_start = threadCpuTimeNs ();
+                for (size_t i = 0; i < p_Messages; i++) {
+                    address[8] = static_cast<char> ('0' + i % 10);
+                    logger->info ("{} -- {} {} {} {}", address, "GET", "/assets/img/logo.png", "HTTP/1.1", 200 + t);
+                }
+                calls_ns += threadCpuTimeNs () - calls_start;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join ();
+    }
+    auto end = clock::now ();
+
+    double seconds = std::chrono::duration<double> (end - start).count ();
+    double total   = static_cast<double> (p_Threads * p_Messages);
+    std::printf ("%-36s %10.0f msgs/s %8.1f ns/call\n", p_Name, total / seconds,
+    static_cast<double> (calls_ns.load ()) / total);
+}
+
+// @brief Makes the Logger for a sink
+static auto makeLogger (std::shared_ptr<ccerve::sinks::BaseSink> p_Sink) {
+    return std::make_unique<ccerve::log::Logger> ("Default Logger",
+    ccerve::log::LOG_LEVEL::INFO, ccerve::log::SinksVector{ std::move (p_Sink) });
+}
+
+// @brief Number of lines of the file at p_Path
+static size_t countLines (const std::string& p_Path) {
+    std::ifstream file (p_Path);
+    size_t lines = 0;
+    for (std::string line; std::getline (file, line);)
+        lines++;
+    return lines;
+}
+
+int main (int argc, char* argv[]) {
+    size_t threads   = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 4;
+    size_t messages  = argc > 2 ? std::strtoull (argv[2], nullptr, 10) : 200000;
+    std::string path = argc > 3 ? argv[3] : "logger-bench.log";
+    size_t expected  = threads * messages;
+
+    auto legacy_sink = std::make_shared<CountingSink> ();
+    run ("mutex + std::queue (old)", threads, messages, legacy_sink,
+    [] (auto p_Sink) { return std::make_unique<legacy::Logger> (p_Sink); });
+
+    auto ring_sink = std::make_shared<CountingSink> ();
+    run ("lock-free ring, deferred formatting", threads, messages, ring_sink, makeLogger);
+
+    if (legacy_sink->getCount () != expected || ring_sink->getCount () != expected) {
+        std::fprintf (stderr, "Messages were lost (%zu and %zu of %zu)!\n",
+        legacy_sink->getCount (), ring_sink->getCount (), expected);
+        return EXIT_FAILURE;
+    }
+
+    run ("file, flush per message (old)", threads, messages,
+    std::make_shared<legacy::FileSink> (path), makeLogger);
+    size_t legacy_lines = countLines (path);
+
+    run ("file, batched writev", threads, messages,
+    std::make_shared<ccerve::sinks::FileSink> (path), makeLogger);
+    size_t batched_lines = countLines (path);
+    std::filesystem::remove (path);
+
+    // small segments, so the run includes rotations
+    ccerve::sinks::RotationPolicy rotation;
+    rotation.segment_size = 16 * 1024 * 1024;
+    rotation.retention    = 100;
+    run ("file, mmap segments", threads, messages,
+    std::make_shared<ccerve::sinks::RotatingFileSink> (path, rotation), makeLogger);
+    size_t segment_lines = countLines (path);
+    std::filesystem::remove (path);
+    for (size_t i = 1; std::filesystem::exists (path + "." + std::to_string (i)); i++) {
+        segment_lines += countLines (path + "." + std::to_string (i));
+        std::filesystem::remove (path + "." + std::to_string (i));
+    }
+
+    if (legacy_lines != expected || batched_lines != expected || segment_lines != expected) {
+        std::fprintf (stderr, "Lines are missing from the log file (%zu, %zu and %zu of %zu)!\n",
+        legacy_lines, batched_lines, segment_lines, expected);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file mime_bench.cpp
+ * @brief Compares the perfect hash lookup of the MIME table with the linear
+ * search through parallel string arrays it replaced. Exits with an error if
+ * the lookup allocates.
+ *
+ * Usage: mime-bench [iterations]
+ */
+
+#include <array>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "bench.hpp"
+#include "mime_types.hpp"
+
+// @brief Paths as they are looked up while serving a typical page
+static constexpr std::array<std::string_view, 8> PATHS = {
+    "./index.html",
+    "./assets/css/main.css",
+    "./assets/js/app.min.js",
+    "./assets/img/logo.png",
+    "./assets/img/hero.webp",
+    "./assets/fonts/inter.woff2",
+    "./favicon.ico",
+    "./downloads/archive.tar.xz",
+};
+
+namespace legacy {
+
+// The content type tables and lookup as they were before the MIME table
+static const int TOTAL_CONTENT_TYPES = 7;
+
+static const std::string TEXT_FILE_FORMATS[TOTAL_CONTENT_TYPES] = { ".html", ".css", ".svg" };
+static const std::string BINARY_FILE_FORMATS[TOTAL_CONTENT_TYPES] = { ".png",
+    ".jpg", "jpeg", ".webp" };
+static const std::string ALL_CONTENT_TYPES[TOTAL_CONTENT_TYPES] = { "text/html",
+    "text/css", "image/svg+xml", "image/jpeg", "image/jpg", "image/png", "image/webp" };
+
+static auto getContentType (std::string_view resource_path) -> std::string {
+    std::string_view file_name = resource_path.substr (resource_path.rfind ('/') + 1);
+    size_t position_of_extension_dot = file_name.rfind ('.');
+    if (position_of_extension_dot == std::string_view::npos || position_of_extension_dot == 0) {
+        return "";
+    }
+
+    std::string_view extension = file_name.substr (position_of_extension_dot);
+    for (int i = 0; i < TOTAL_CONTENT_TYPES; i++) {
+        if (extension == TEXT_FILE_FORMATS[i]) {
+            return "text/" + std::string (extension.substr (1));
+        } else if (extension == BINARY_FILE_FORMATS[i]) {
+            return "image/" + std::string (extension.substr (1));
+        }
+    }
+    return "USCT";
+}
+
+static auto isSupportedContentType (const std::string& content_type) -> bool {
+    for (int i = 0; i < TOTAL_CONTENT_TYPES; i++) {
+        if (content_type == ALL_CONTENT_TYPES[i])
+            return true;
+    }
+    return false;
+}
+
+} // namespace legacy
+
+int main (int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 1000000;
+
+    size_t path_index = 0;
+    bench::run ("linear search (old)", iterations, [&path_index] {
+        std::string content_type = legacy::getContentType (PATHS[path_index++ % PATHS.size ()]);
+        bool supported = legacy::isSupportedContentType (content_type);
+        bench::doNotOptimize (supported);
+    });
+
+    // the index keeps the compiler from resolving the lookups at compile time
+    path_index         = 0;
+    double allocations = bench::run ("mime::findByPath", iterations, [&path_index] {
+        const ccerve::mime::MimeType* mime_type =
+        ccerve::mime::findByPath (PATHS[path_index++ % PATHS.size ()]);
+        bench::doNotOptimize (mime_type);
+    });
+
+    if (allocations != 0) {
+        std::fprintf (stderr, "mime::findByPath allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file parser_bench.cpp
+ * @brief Measures parsing of each request of the corpus and checks that it
+ * doesn't allocate. Exits with an error if it does.
+ *
+ * Usage: parser-bench [iterations]
+ */
+
+#include <cstdlib>
+#include <string>
+
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "http_request.hpp"
+
+int main (int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 1000000;
+
+    double allocations = 0;
+    for (const bench::CorpusRequest& corpus_request : bench::REQUESTS) {
+        std::string name = "parseRequest (" + std::string (corpus_request.name) + ")";
+        allocations += bench::run (name, iterations, [&corpus_request] {
+            ccerve::parse::Request request;
+            bool parsed = ccerve::parse::parseRequest (corpus_request.text, request);
+            bench::doNotOptimize (parsed);
+            bench::doNotOptimize (request);
+        });
+    }
+
+    bench::run ("Request::get (known header)", iterations, [] {
+        static ccerve::parse::Request request;
+        static bool parsed = ccerve::parse::parseRequest (bench::REQUESTS[1].text, request);
+        bench::doNotOptimize (parsed);
+        bench::doNotOptimize (request.get (ccerve::parse::Header::ACCEPT_ENCODING));
+    });
+
+    if (allocations != 0) {
+        std::fprintf (stderr, "parseRequest allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file response_bench.cpp
+ * @brief Measures how long producing the response to each request of the
+ * corpus takes (handleRequest(): finding the file, evaluating conditions and
+ * ranges, rendering the headers), with and without the file cache, the
+ * listing of a directory and the rendering of an error page on its own.
+ * Then each request goes around a keep-alive connection (read, answered
+ * from the connection's arena, sent over a socket pair, arena released),
+ * which must not call the global allocator at all. The files of the corpus
+ * are created in a temporary directory, which is served and removed
+ * afterwards.
+ *
+ * Usage: response-bench [iterations]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <memory_resource>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.hpp"
+#include "connection.hpp"
+#include "corpus.hpp"
+#include "directory_listing.hpp"
+#include "file_cache.hpp"
+#include "http_parser.hpp"
+#include "http_request.hpp"
+
+/**
+ * @brief Passes p_Text through p_Conn like a worker does and reads the
+ * response from p_Peer, the other end of its socket
+ */
+static void serveRequest (ccerve::Connection& p_Conn, int p_Peer, std::string_view p_Text,
+ccerve::FileCache& p_FileCache, std::vector<char>& p_Buffer) {
+    ccerve::parse::RequestReader& reader = p_Conn.getRequestReader ();
+    reader.append (p_Text);
+    ccerve::parse::Request request;
+    reader.next (request);
+    p_Conn.queueResponse (
+    ccerve::parse::handleRequest (request, &p_FileCache, nullptr, nullptr, false, p_Conn.getArena ()));
+    reader.consume ();
+
+    do {
+        size_t bytes_sent = 0;
+        p_Conn.flush (bytes_sent);
+        while (read (p_Peer, p_Buffer.data (), p_Buffer.size ()) > 0) {
+        }
+    } while (p_Conn.hasPendingWrites ());
+    // what a worker does once a connection is drained
+    p_Conn.releaseArena ();
+}
+
+int main (int argc, char* argv[]) {
+    uint64_t iterations = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : 200000;
+
+    bench::TemporarySite site;
+    if (!site.created ())
+        return EXIT_FAILURE;
+
+    std::array<ccerve::parse::Request, bench::REQUESTS.size ()> requests;
+    double keep_alive_allocations = 0;
+    for (size_t i = 0; i < requests.size (); i++) {
+        if (!ccerve::parse::parseRequest (bench::REQUESTS[i].text, requests[i])) {
+            std::fprintf (stderr, "Request \"%.*s\" of the corpus could not be parsed!\n",
+            static_cast<int> (bench::REQUESTS[i].name.size ()), bench::REQUESTS[i].name.data ());
+            return EXIT_FAILURE;
+        }
+    }
+
+    {
+        ccerve::FileCache file_cache (64 * 1024 * 1024, 1024 * 1024);
+        for (size_t i = 0; i < requests.size (); i++) {
+            std::string name (bench::REQUESTS[i].name);
+            bench::run ("handleRequest (" + name + ")", iterations, [&requests, i] {
+                ccerve::parse::Response response = ccerve::parse::handleRequest (requests[i]);
+                bench::doNotOptimize (response);
+            });
+            bench::run ("handleRequest (" + name + ", cached)", iterations, [&requests, &file_cache, i] {
+                ccerve::parse::Response response = ccerve::parse::handleRequest (requests[i], &file_cache);
+                bench::doNotOptimize (response);
+            });
+        }
+
+        // the whole corpus, from the bytes of a request to its response
+        size_t next = 0;
+        bench::run ("parse + handleRequest (corpus)", iterations, [&next, &file_cache] {
+            ccerve::parse::Request request;
+            ccerve::parse::parseRequest (bench::REQUESTS[next++ % bench::REQUESTS.size ()].text, request);
+            ccerve::parse::Response response = ccerve::parse::handleRequest (request, &file_cache);
+            bench::doNotOptimize (response);
+        });
+
+        // a directory without an index.html: read once, then its page is
+        // served from memory. Dated back, a directory modified just now isn't
+        // cached (see DirectoryListings::RACY_INTERVAL_NS).
+        std::filesystem::last_write_time ("assets",
+        std::filesystem::last_write_time ("assets") - std::chrono::minutes (1));
+        ccerve::DirectoryListings listings (1024 * 1024);
+        ccerve::parse::Request listing_request;
+        ccerve::parse::parseRequest ("GET /assets/ HTTP/1.1\r\nHost: 127.0.0.1:8000\r\n\r\n", listing_request);
+        bench::run ("handleRequest (directory listing)", iterations, [&listing_request, &file_cache, &listings] {
+            ccerve::parse::Response response =
+            ccerve::parse::handleRequest (listing_request, &file_cache, nullptr, &listings);
+            bench::doNotOptimize (response);
+        });
+
+        int socks[2];
+        if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, socks) != 0) {
+            std::perror ("socketpair");
+            return EXIT_FAILURE;
+        }
+        // the pool a worker hands its connections (with the defaults, blocks
+        // as large as those of an arena wouldn't be pooled)
+        std::pmr::unsynchronized_pool_resource memory (std::pmr::pool_options{ 0, 64 * 1024 });
+        {
+            ccerve::Connection conn (socks[0], sockaddr_in{}, &memory);
+            std::vector<char> buffer (256 * 1024);
+            for (const bench::CorpusRequest& corpus_request : bench::REQUESTS) {
+                // the range request sends megabytes of a file
+                if (corpus_request.name == "range")
+                    continue;
+                std::string name (corpus_request.name);
+                keep_alive_allocations += bench::run ("keep-alive (" + name + ")", iterations,
+                [&conn, &socks, &corpus_request, &file_cache, &buffer] {
+                    serveRequest (conn, socks[1], corpus_request.text, file_cache, buffer);
+                });
+            }
+        }
+        close (socks[1]);
+    }
+
+    // an error page touches no file, this is constructing the response alone
+    bench::run ("makeErrorResponse (400)", iterations, [] {
+        ccerve::parse::Response response = ccerve::parse::makeErrorResponse (400);
+        bench::doNotOptimize (response);
+    });
+
+    if (keep_alive_allocations != 0) {
+        std::fprintf (stderr, "A request on a keep-alive connection allocated memory!\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -7,21 +7,6 @@
 
 #include <iostream>
 
-static const int TOTAL_CONTENT_TYPES = 7;
-
-static const std::string TEXT_FILE_FORMATS[TOTAL_CONTENT_TYPES] = { ".html", ".css", ".svg" };
-static const std::string BINARY_FILE_FORMATS[TOTAL_CONTENT_TYPES] = { ".png",
-    ".jpg", "jpeg", ".webp" };
-
-static const std::string TEXT_CONTENT_TYPES[TOTAL_CONTENT_TYPES] = {
-    "text/html", "text/css", "image/svg+xml"
-};
-static const std::string IMAGE_CONTENT_TYPES[TOTAL_CONTENT_TYPES] = {
-    "image/jpeg", "image/jpg", "image/png", "image/webp"
-};
-static const std::string ALL_CONTENT_TYPES[TOTAL_CONTENT_TYPES] = { "text/html",
-    "text/css", "image/svg+xml", "image/jpeg", "image/jpg", "image/png", "image/webp" };
-
 // multiline string literals are a part of c++11 and onwards.
 static const std::string CONTENT_TYPE_NOT_SUPPORTED_HTML = R"""(
                                                 <!DOCTYPE html>
@@ -44,4 +29,64 @@ static const std::string RESOURCE_NOT_FOUND_HTML = R"""(
                                                     <h1>Not Found</h1>
                                                     <p>The requested resource was not found on this server.</p>
                                                 </body>
-                                                </html>)""";
\ No newline at end of file
+                                                </html>)""";
+
+static const std::string BAD_REQUEST_HTML = R"""(
+                                                <!DOCTYPE html>
+                                                <html>
+                                                <head>
+                                                    <title>400 Bad Request</title>
+                                                </head>
+                                                <body>
+                                                    <h1>Bad Request</h1>
+                                                    <p>The request could not be understood by this server.</p>
+                                                </body>
+                                                </html>)""";
+
+static const std::string MOVED_PERMANENTLY_HTML = R"""(
+                                                <!DOCTYPE html>
+                                                <html>
+                                                <head>
+                                                    <title>301 Moved Permanently</title>
+                                                </head>
+                                                <body>
+                                                    <h1>Moved Permanently</h1>
+                                                    <p>The directory is found at the path ending in a slash.</p>
+                                                </body>
+                                                </html>)""";
+
+static const std::string NOT_IMPLEMENTED_HTML = R"""(
+                                                <!DOCTYPE html>
+                                                <html>
+                                                <head>
+                                                    <title>501 Not Implemented</title>
+                                                </head>
+                                                <body>
+                                                    <h1>Not Implemented</h1>
+                                                    <p>The request method is not supported by this server.</p>
+                                                </body>
+                                                </html>)""";
+
+static const std::string REQUEST_TOO_LARGE_HTML = R"""(
+                                                <!DOCTYPE html>
+                                                <html>
+                                                <head>
+                                                    <title>Request Too Large</title>
+                                                </head>
+                                                <body>
+                                                    <h1>Request Too Large</h1>
+                                                    <p>The request is larger than this server accepts.</p>
+                                                </body>
+                                                </html>)""";
+
+static const std::string RANGE_NOT_SATISFIABLE_HTML = R"""(
+                                                <!DOCTYPE html>
+                                                <html>
+                                                <head>
+                                                    <title>416 Range Not Satisfiable</title>
+                                                </head>
+                                                <body>
+                                                    <h1>Range Not Satisfiable</h1>
+                                                    <p>None of the requested ranges lies within the resource.</p>
+                                                </body>
+                                                </html>)""";
@@ -0,0 +1,95 @@
+#pragma once
+
+/**
+ * @file compressor.hpp
+ * @brief Holds the declaration of the Compressor class which compresses
+ * cached files in the background.
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+
+#include "file_cache.hpp"
+
+namespace ccerve {
+
+// @brief Content codings a body can be sent in, besides as it is
+enum class ContentCoding : uint8_t {
+    BROTLI,
+    GZIP,
+};
+
+/**
+ * @brief Compresses files of the file cache once, on a background thread, and
+ * puts the result into the cache as if it was a sidecar file (e.g. "a.css.br"
+ * next to "a.css"). Requests never wait for it: until a variant is ready the
+ * file is sent uncompressed. A variant which isn't smaller than its file is
+ * cached as missing, so it isn't tried again.
+ */
+class Compressor {
+    public:
+    // @brief Starts the background thread
+    explicit Compressor (FileCache& p_FileCache);
+    ~Compressor ();
+
+    Compressor (const Compressor&)            = delete;
+    Compressor& operator= (const Compressor&) = delete;
+
+    // @brief Whether the server was built with the library of p_Coding
+    static bool isSupported (ContentCoding p_Coding);
+
+    /**
+     * @brief Queues the compression of p_Source, unless p_VariantPath is
+     * queued already. Never blocks.
+     * @param p_VariantPath Path the variant is cached under
+     * @param p_Source The file as held by the file cache. The variant gets its
+     * modification time and inode.
+     * @param p_Generation Returned by the FileCache::find() of p_VariantPath,
+     * which must have been called before p_Source was looked up. Otherwise a
+     * change of the file in between would go unnoticed.
+     */
+    void schedule (const std::string& p_VariantPath, ContentCoding p_Coding,
+    std::shared_ptr<const CachedFile> p_Source, uint64_t p_Generation);
+
+    private:
+    struct Job {
+        std::string variant_path;
+        ContentCoding coding;
+        std::shared_ptr<const CachedFile> source;
+        uint64_t generation;
+    };
+
+    // @brief Requests beyond this many queued jobs are dropped (they are
+    // scheduled again by a later request)
+    static constexpr size_t MAX_QUEUED_JOBS = 1024;
+
+    FileCache& m_FileCache;
+
+    std::mutex m_JobsMutex;
+    std::condition_variable m_JobsCondition;
+    std::deque<Job> m_Jobs;
+
+    // @brief Variant paths of the queued jobs and the running one
+    std::unordered_set<std::string> m_Queued;
+
+    bool m_Stop = false;
+    std::thread m_Thread;
+
+    // @brief Body of the background thread
+    void run ();
+
+    /**
+     * @brief Compresses p_Input with the best compression of p_Coding
+     * @return false if it failed (or p_Coding isn't supported)
+     */
+    static bool compress (ContentCoding p_Coding, std::string_view p_Input, std::string& p_Output);
+};
+
+} // namespace ccerve
@@ -0,0 +1,339 @@
+#pragma once
+
+/**
+ * @file connection.hpp
+ * @brief Holds the declaration of the Connection class which keeps the state
+ * of a single client connection.
+ */
+
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "http_parser.hpp"
+#include "sockets.hpp"
+#include "timer_wheel.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Part of the data waiting to be sent: either bytes held in memory
+ * (owned, borrowed or shared with the file cache) or a range of an open file.
+ * A file segment owns its descriptor and is sent without copying its contents
+ * to user space.
+ */
+struct OutputSegment {
+    // @brief Bytes to send if this isn't a file segment, usually allocated
+    // from the arena of the connection
+    std::pmr::string data;
+    size_t data_offset = 0;
+
+    // @brief Keeps the file cache's copy of a file alive while
+    // borrowed_data points into it
+    std::shared_ptr<const std::string> shared_data;
+
+    // @brief Bytes which outlive the segment (e.g. status lines, error pages
+    // or a range of shared_data), sent instead of data if set
+    std::string_view borrowed_data;
+
+    // @brief File to send, -1 for in-memory segments
+    int file_fd = -1;
+    off_t file_offset     = 0;
+    size_t file_remaining = 0;
+
+    OutputSegment () = default;
+    // @brief In-memory segment taking over p_Data (and its memory resource)
+    explicit OutputSegment (std::pmr::string&& p_Data) : data (std::move (p_Data)) {
+    }
+    OutputSegment (OutputSegment&& p_Other) noexcept;
+    OutputSegment& operator= (OutputSegment&& p_Other) noexcept;
+    ~OutputSegment ();
+
+    bool isFile () const {
+        return file_fd >= 0;
+    }
+
+    // @brief In-memory bytes of the segment
+    std::string_view bytes () const {
+        return borrowed_data.data () ? borrowed_data : std::string_view (data);
+    }
+
+    // @brief Whether every byte of the segment has been sent
+    bool isDone () const {
+        return isFile () ? file_remaining == 0 : data_offset >= bytes ().size ();
+    }
+
+    // @brief Number of bytes left to send
+    size_t remaining () const {
+        return isFile () ? file_remaining : bytes ().size () - data_offset;
+    }
+
+    // @brief Marks p_Bytes more bytes as sent
+    void consume (size_t p_Bytes);
+};
+
+/**
+ * @brief State of one accepted client connection. The socket is non-blocking,
+ * so whatever part of a response can't be written right away is kept here
+ * until the socket becomes writable again. File bodies are either shared with
+ * the file cache or queued as open files and written with sendfile(), so a
+ * large download doesn't need more memory than a small one.
+ */
+class Connection {
+    public:
+    using Timer = TimerWheel<Connection>::Timer;
+
+    // @brief What the timer of a connection is waiting for
+    enum class Deadline : uint8_t {
+        IDLE,    // the next request, or the client to take the response
+        REQUEST, // the rest of a request
+    };
+
+    // @brief First block the arena takes from the worker's memory, enough
+    // for the responses to a few requests
+    static constexpr size_t ARENA_BLOCK_SIZE = 4096;
+
+    /**
+     * @param p_Sock File descriptor of the accepted (non-blocking) socket.
+     * The connection takes ownership of it and closes it on destruction.
+     * @param p_SockAddr Address of the client
+     * @param p_Memory Where the arena and the queue of segments get their
+     * memory from (the pool of the worker, which only its thread uses)
+     */
+    Connection (int p_Sock, const sockaddr_in& p_SockAddr,
+    std::pmr::memory_resource* p_Memory = std::pmr::get_default_resource ());
+    ~Connection ();
+
+    Connection (const Connection&)            = delete;
+    Connection& operator= (const Connection&) = delete;
+
+    // @brief getter function for the client socket
+    int getSock () const {
+        return m_Sock;
+    }
+
+    // @brief getter function for the client address
+    const sockaddr_in& getSockAddr () const {
+        return m_SockAddr;
+    }
+
+    // @brief getter function for the bytes received but not served yet
+    parse::RequestReader& getRequestReader () {
+        return m_RequestReader;
+    }
+
+    /**
+     * @brief Appends a response to the data waiting to be sent. Nothing is
+     * copied: its headers are moved, the body is borrowed or shared. Takes
+     * ownership of the file of the response.
+     */
+    void queueResponse (parse::Response&& p_Response);
+
+    /**
+     * @brief Writes as much of the pending data as the socket accepts.
+     * Consecutive in-memory segments (e.g. every response of a batch of
+     * pipelined requests) go out in one sendmsg.
+     * @param p_BytesSent Receives the number of bytes written
+     * @return false if the socket failed (or a file got shorter than its
+     * announced length, errno is EIO then), true otherwise (even if some
+     * data is still pending)
+     */
+    bool flush (size_t& p_BytesSent);
+
+    /**
+     * @brief Moves the oldest unsent segment out of the connection. Used when
+     * the segment is handed to the kernel and must not be touched by
+     * queueResponse() until the write completes.
+     */
+    OutputSegment takeNextSegment ();
+
+    // @brief Whether the oldest unsent segment is an in-memory one
+    bool nextSegmentInMemory () const {
+        return !m_Segments.empty () && !m_Segments.front ().isFile ();
+    }
+
+    /**
+     * @brief Most in-memory segments gathered into one write. Less than
+     * IOV_MAX, which the kernel rejects.
+     */
+    static constexpr size_t MAX_GATHERED_SEGMENTS = 64;
+
+    // @brief Whether there is data which couldn't be written yet
+    bool hasPendingWrites () const {
+        return !m_Segments.empty ();
+    }
+
+    /**
+     * @brief Most segments queued before the worker stops reading requests
+     * of the connection. Bodies are borrowed, shared or files, so this bounds
+     * what a client which pipelines requests without reading the responses
+     * can make the server hold: the arena of their heads and their open
+     * files.
+     */
+    static constexpr size_t MAX_QUEUED_SEGMENTS = 256;
+
+    // @brief Whether the client has to take some of its responses before
+    // more of its requests are read
+    bool isBackedUp () const {
+        return m_Segments.size () >= MAX_QUEUED_SEGMENTS;
+    }
+
+    // @brief Marks that reading stopped because the connection was backed
+    // up, the worker resumes once it isn't anymore
+    void setInputPaused (bool p_Paused) {
+        m_InputPaused = p_Paused;
+    }
+
+    bool isInputPaused () const {
+        return m_InputPaused;
+    }
+
+    /**
+     * @brief Gathers the in-memory segments up to the next file segment into
+     * p_Iov, for a write made by the caller. Used with markSent() by workers
+     * which don't write through flush().
+     * @param p_More Set if segments follow the gathered ones (MSG_MORE)
+     * @return number of entries put into p_Iov, 0 if the next segment is a
+     * file
+     */
+    size_t gatherSegments (iovec (&p_Iov)[MAX_GATHERED_SEGMENTS], bool& p_More) const;
+
+    // @brief Oldest unsent segment, there must be one
+    const OutputSegment& getNextSegment () const {
+        return m_Segments.front ();
+    }
+
+    // @brief Drops the first p_Bytes of the pending data, which the caller
+    // wrote
+    void markSent (size_t p_Bytes);
+
+    /**
+     * @brief Arena the responses to the requests of this connection (and the
+     * paths looked up for them) are allocated from. Nothing is freed before
+     * releaseArena(), so answering a request costs a few pointer bumps.
+     */
+    std::pmr::memory_resource* getArena () {
+        return &m_Arena;
+    }
+
+    /**
+     * @brief Frees everything allocated from the arena at once (its blocks go
+     * back to the worker's memory). Only allowed when nothing allocated from
+     * it is left: no pending segment and none taken out with
+     * takeNextSegment() alive, e.g. once every response has been sent.
+     */
+    void releaseArena () {
+        m_Arena.release ();
+    }
+
+    // @brief Marks the connection to be closed once pending data is written
+    void setKeepAlive (bool p_KeepAlive) {
+        m_KeepAlive = p_KeepAlive;
+    }
+
+    bool getKeepAlive () const {
+        return m_KeepAlive;
+    }
+
+    // @brief Timer of the deadline the connection is closed at
+    Timer& getTimer () {
+        return m_Timer;
+    }
+
+    Deadline getDeadline () const {
+        return m_Deadline;
+    }
+
+    void setDeadline (Deadline p_Deadline) {
+        m_Deadline = p_Deadline;
+    }
+
+    /**
+     * @brief Notes when a response was queued (monotonicNs()). Responses
+     * queued while earlier ones are still being sent are timed from the
+     * first, the clock runs until everything has been sent.
+     */
+    void startSendClock (uint64_t p_Now) {
+        if (m_SendStart == 0)
+            m_SendStart = p_Now;
+    }
+
+    bool isSendClockRunning () const {
+        return m_SendStart != 0;
+    }
+
+    // @return when the clock was started
+    uint64_t stopSendClock () {
+        uint64_t start = m_SendStart;
+        m_SendStart    = 0;
+        return start;
+    }
+
+    // @brief Counts a request read from the connection
+    // @return number of requests read so far, including this one
+    size_t countRequest () {
+        return ++m_RequestCount;
+    }
+
+    /**
+     * @brief Marks a request of the connection as being answered on another
+     * thread (see FilePool). The requests after it wait in the request reader
+     * until its response is queued, so the responses stay in order.
+     * @param p_Job Tells the response of this request apart from the one of an
+     * earlier connection with the same socket, 0 once it was queued
+     */
+    void setPendingJob (uint64_t p_Job) {
+        m_PendingJob = p_Job;
+    }
+
+    uint64_t getPendingJob () const {
+        return m_PendingJob;
+    }
+
+    private:
+    // @brief File descriptor of the client socket
+    int m_Sock;
+
+    // @brief Struct defining the socket address of client socket
+    sockaddr_in m_SockAddr;
+
+    // @brief Monotonic arena of the responses, declared before m_Segments
+    // which point into it
+    std::pmr::monotonic_buffer_resource m_Arena;
+
+    // @brief Response data waiting for the socket to become writable: status
+    // line, headers and body of every response, each in its own segment. Its
+    // blocks come from the worker's pool, which keeps the freed ones.
+    std::pmr::deque<OutputSegment> m_Segments;
+
+    // @brief Received bytes, cut into requests as they complete
+    parse::RequestReader m_RequestReader;
+
+    // @brief false once the client asked for "Connection: close"
+    bool m_KeepAlive = true;
+
+    bool m_InputPaused = false;
+
+    // @brief Armed in the timer wheel of the worker owning the connection
+    Timer m_Timer{ *this };
+    Deadline m_Deadline = Deadline::IDLE;
+
+    size_t m_RequestCount = 0;
+
+    // @brief Request answered on another thread, 0 if there is none
+    uint64_t m_PendingJob = 0;
+
+    // @brief When the oldest response not sent completely was queued, 0 if
+    // there is none
+    uint64_t m_SendStart = 0;
+
+    // @brief Queues the parts of a multipart/byteranges body, each range of
+    // a file with a descriptor of its own
+    void queueParts (parse::Response& p_Response);
+};
+
+} // namespace ccerve
@@ -0,0 +1,105 @@
+#pragma once
+
+/**
+ * @file coroutine_worker.hpp
+ * @brief Holds the declaration of the CoroutineWorker class
+ */
+
+#include <coroutine>
+#include <memory>
+#include <unordered_map>
+
+#include "reactor.hpp"
+#include "task.hpp"
+#include "worker.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Worker which serves every connection with a coroutine awaiting its
+ * socket on a Reactor, so a connection's handling reads top to bottom (read,
+ * answer, send, repeat) instead of being split over event callbacks. The
+ * frames of the coroutines come from the pool of connection memory, a
+ * connection costs one block the next connection gets again.
+ */
+class CoroutineWorker : public Worker {
+    public:
+    CoroutineWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context = {}, int p_ServerSock = -1);
+    virtual ~CoroutineWorker ();
+
+    virtual void run () override;
+
+    private:
+    // @brief A connection and what its coroutine waits for
+    struct Client {
+        Connection conn;
+
+        // @brief Coroutine of the connection while it waits for m_FilePool
+        // to answer a request
+        std::coroutine_handle<> job_waiter;
+
+        // @brief Set by closeClient(), the coroutine then ends
+        bool closing = false;
+
+        Client (int p_Sock, const sockaddr_in& p_SockAddr, std::pmr::memory_resource* p_Memory)
+        : conn (p_Sock, p_SockAddr, p_Memory) {
+        }
+    };
+
+    // @brief Awaitable which suspends a connection's coroutine until
+    // handleWakeUps() or closeClient() resumes it
+    struct JobAwaiter {
+        Client& client;
+
+        bool await_ready () const {
+            return false;
+        }
+
+        void await_suspend (std::coroutine_handle<> p_Awaiter) {
+            client.job_waiter = p_Awaiter;
+        }
+
+        void await_resume () {
+            client.job_waiter = nullptr;
+        }
+    };
+
+    coro::Reactor m_Reactor;
+
+    // @brief Every open client connection keyed by its socket. A client is
+    // erased by its coroutine, once that is done with it.
+    std::unordered_map<int, std::unique_ptr<Client>> m_Clients;
+
+    // @brief Whether tickTimers() is running
+    bool m_Ticking = false;
+
+    // @brief Buffer every client socket of this worker is read into. Only
+    // one coroutine runs at a time and none suspends while holding data in
+    // it.
+    char m_Buffer[BUFFER_SIZE];
+
+    // @brief Accepts connections and starts a serve() for each of them,
+    // until the server socket is unwatched
+    coro::Task<> acceptConnections ();
+
+    // @brief Reads, answers and sends every request of p_Client, then
+    // closes it
+    coro::Task<> serve (Client& p_Client);
+
+    // @brief Handles the wake-ups of m_WakeFd: stop(), drain() and the
+    // answers of m_FilePool
+    coro::Task<> handleWakeUps ();
+
+    // @brief Closes the connections whose deadline passed, while any timer
+    // is armed
+    coro::Task<> tickTimers ();
+
+    // @brief Makes the coroutine of p_Client end, wherever it waits
+    void closeClient (Client& p_Client);
+
+    // @brief Stops accepting and closes the connections waiting for their
+    // next request
+    void startDraining ();
+};
+
+} // namespace ccerve
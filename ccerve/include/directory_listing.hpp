@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+ * @file directory_listing.hpp
+ * @brief Holds the declaration of the DirectoryListings class which renders
+ * the HTML listing of a directory without an index.html (like python's
+ * http.server) and keeps it until the directory changes.
+ */
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+#include "file_cache.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Cache of directory listings keyed by the path of their directory.
+ * A directory is read (and its entries sorted) once per change: every
+ * request compares the modification time and inode of the directory with
+ * the ones it had when it was read, which change whenever an entry is
+ * added, removed or renamed.
+ *
+ * Listings are split into pages of PAGE_SIZE entries ("?page=N"), each
+ * rendered on its first request and kept with the entries, so a large
+ * directory is neither sent nor rendered in one piece. Pages are handed out
+ * as shared pointers like the files of the FileCache, so a response still
+ * being sent keeps its page alive when the listing is dropped.
+ */
+class DirectoryListings {
+    public:
+    // @brief Entries shown on one page
+    static constexpr size_t PAGE_SIZE = 1000;
+
+    // @brief Content type of the pages
+    static constexpr std::string_view CONTENT_TYPE = "text/html; charset=utf-8";
+
+    // @param p_Budget Bytes all listings (their entries and rendered pages)
+    // may take up together. The least recently used ones are dropped first.
+    explicit DirectoryListings (size_t p_Budget);
+
+    DirectoryListings (const DirectoryListings&)            = delete;
+    DirectoryListings& operator= (const DirectoryListings&) = delete;
+
+    /**
+     * @brief Gets a page of the listing of a directory, reading the
+     * directory if it changed since it was last read
+     * @param p_Path Path of the directory relative to the served directory,
+     * ending in '/' (e.g. "./docs/")
+     * @param p_Url Path the directory was requested at, shown as the title
+     * @param p_Query Query of the request, "page=N" selects the page
+     * @return the page, nullptr if p_Path isn't a directory which can be
+     * read, leaves the served directory or the page doesn't exist
+     */
+    std::shared_ptr<const CachedFile> getPage (const std::string& p_Path, std::string_view p_Url,
+    std::string_view p_Query);
+
+    private:
+    // @brief Memory a listing takes up besides its entries and pages
+    static constexpr size_t LISTING_OVERHEAD = 256;
+
+    // @brief A directory modified this recently (ns) may still change within
+    // the resolution of its timestamp, so its listing isn't kept
+    static constexpr long long RACY_INTERVAL_NS = 1000000000;
+
+    struct Entry {
+        std::string name;
+        bool is_directory;
+    };
+
+    struct Listing {
+        // @brief Modification time and inode of the directory when it was read
+        timespec mtime{};
+        ino_t inode = 0;
+
+        // @brief Sorted by name, case-insensitively
+        std::vector<Entry> entries;
+
+        // @brief Rendered pages, nullptr if not requested yet
+        std::vector<std::shared_ptr<const CachedFile>> pages;
+
+        // @brief Memory taken up, counted against the budget
+        size_t bytes = 0;
+    };
+
+    std::mutex m_Mutex;
+
+    // @brief Most recently used listing first
+    std::list<std::pair<std::string, std::shared_ptr<Listing>>> m_Lru;
+    std::unordered_map<std::string, decltype (m_Lru)::iterator> m_Listings;
+
+    size_t m_Bytes = 0;
+    size_t m_Budget;
+
+    // @brief Reads and sorts the entries of the directory p_Path
+    // @return nullptr if it can't be read
+    static std::shared_ptr<Listing> readDirectory (const std::string& p_Path, const struct stat& p_Stat);
+
+    // @brief Renders page p_Page (counted from 0) of p_Listing
+    static std::shared_ptr<const CachedFile> renderPage (const Listing& p_Listing, std::string_view p_Url,
+    size_t p_Page);
+
+    // @brief Page (counted from 0) a query asks for, SIZE_MAX if invalid
+    static size_t parsePage (std::string_view p_Query);
+
+    // @brief Keeps p_Listing as the listing of p_Path, the mutex must be held
+    void store (const std::string& p_Path, std::shared_ptr<Listing> p_Listing);
+
+    // @brief Drops least recently used listings until the budget is kept,
+    // the mutex must be held
+    void evict ();
+};
+
+} // namespace ccerve
@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * @file epoll_worker.hpp
+ * @brief Holds the declaration of the EpollWorker class
+ */
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "event_loop.hpp"
+#include "worker.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Worker which waits on its non-blocking sockets with an
+ * edge-triggered epoll event loop.
+ */
+class EpollWorker : public Worker {
+    public:
+    EpollWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context = {}, int p_ServerSock = -1);
+    virtual ~EpollWorker ();
+
+    virtual void run () override;
+
+    private:
+    // @brief epoll instance watching the server socket and every client
+    EventLoop m_EventLoop;
+
+    // @brief State of every open client connection keyed by its socket
+    std::unordered_map<int, std::unique_ptr<Connection>> m_Connections;
+
+    // @brief Connections closed while handling the current batch of events
+    std::vector<std::unique_ptr<Connection>> m_ClosedConnections;
+
+    // @brief Buffer every client socket of this worker is read into
+    char m_Buffer[BUFFER_SIZE];
+
+    // @brief Accept every connection waiting on the server socket
+    void acceptConnections ();
+
+    // @brief Read and answer every request the client has sent so far
+    void handleReadable (Connection& p_Conn);
+
+    // @brief Write pending responses, then read on if reading waited for
+    // them
+    void handleWritable (Connection& p_Conn);
+
+    /**
+     * @brief Write pending responses. Closes the connection when it's done or
+     * the client asked for it to be closed.
+     * @return false if the connection was closed
+     */
+    bool sendPending (Connection& p_Conn);
+
+    // @brief Stop watching the client and release its state
+    void closeConnection (Connection& p_Conn);
+
+    // @brief Stops accepting and closes the connections waiting for their
+    // next request
+    void startDraining ();
+};
+
+} // namespace ccerve
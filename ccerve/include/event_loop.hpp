@@ -0,0 +1,67 @@
+#pragma once
+
+/**
+ * @file event_loop.hpp
+ * @brief Holds the declaration of the EventLoop class, a thin wrapper over an
+ * epoll instance.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/epoll.h>
+
+#include "exception.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Wrapper over an epoll file descriptor. File descriptors are
+ * registered together with the events they are interested in and wait()
+ * returns the ones which became ready.
+ */
+class EventLoop {
+    public:
+    /**
+     * @brief Creates the epoll instance.
+     * @param p_MaxEvents Maximum number of events returned by a single wait()
+     * Can throw EventLoopCreationFailure.
+     */
+    EventLoop (size_t p_MaxEvents = 1024);
+    ~EventLoop ();
+
+    EventLoop (const EventLoop&)            = delete;
+    EventLoop& operator= (const EventLoop&) = delete;
+
+    // @brief Starts watching p_Fd for p_Events
+    bool add (int p_Fd, uint32_t p_Events);
+
+    // @brief Changes the events p_Fd is watched for
+    bool modify (int p_Fd, uint32_t p_Events);
+
+    // @brief Stops watching p_Fd
+    bool remove (int p_Fd);
+
+    /**
+     * @brief Waits until at least one of the registered file descriptors is
+     * ready or until the timeout expires.
+     * @param p_TimeoutMs -1 to wait indefinitely
+     * @return number of ready events (accessible through getEvent()), -1 on
+     * error
+     */
+    int wait (int p_TimeoutMs = -1);
+
+    // @brief Returns the i-th event filled by the last wait()
+    const epoll_event& getEvent (int i) const {
+        return m_Events[i];
+    }
+
+    private:
+    // @brief File descriptor of the epoll instance
+    int m_EpollFd;
+
+    // @brief Buffer filled by epoll_wait
+    std::vector<epoll_event> m_Events;
+};
+
+} // namespace ccerve
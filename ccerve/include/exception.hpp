@@ -46,5 +46,51 @@ class ServerSockBindFailure : public std::exception {
     }
 };
 
+// @brief Exception for when the epoll instance of an event loop can't be
+// created
+class EventLoopCreationFailure : public std::exception {
+    private:
+    std::string message;
+
+    public:
+    // Constructor accepting const char*
+    EventLoopCreationFailure (const char* msg) : message (msg) {
+    }
+
+    const char* what () const noexcept {
+        return message.c_str ();
+    }
+};
+
+// @brief Exception for when an io_uring instance can't be created or mapped
+class IoUringCreationFailure : public std::exception {
+    private:
+    std::string message;
+
+    public:
+    // Constructor accepting const char*
+    IoUringCreationFailure (const char* msg) : message (msg) {
+    }
+
+    const char* what () const noexcept {
+        return message.c_str ();
+    }
+};
+
+// @brief Exception for when the file cache can't watch the served directory
+class FileCacheCreationFailure : public std::exception {
+    private:
+    std::string message;
+
+    public:
+    // Constructor accepting const char*
+    FileCacheCreationFailure (const char* msg) : message (msg) {
+    }
+
+    const char* what () const noexcept {
+        return message.c_str ();
+    }
+};
+
 } // namespace exception
 } // namespace ccerve
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+/**
+ * @file file_cache.hpp
+ * @brief Holds the declaration of the FileCache class which keeps the
+ * contents of frequently served files in memory.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "exception.hpp"
+
+namespace ccerve {
+
+// @brief Contents and metadata of a cached file
+struct CachedFile {
+    std::string contents;
+
+    // @brief Last modification time when the file was read
+    timespec mtime{};
+
+    // @brief Inode of the file (of the original file for variants made by
+    // the compressor), part of its entity tag
+    ino_t inode = 0;
+
+    // @brief The file doesn't exist (remembered for compressed variants,
+    // which are looked for on every request)
+    bool missing = false;
+
+    // @brief Compressed in memory by the compressor, nothing exists on disk
+    // at the path it is cached under: only a request for the original file
+    // may get it, a request for the path itself must not
+    bool made_in_memory = false;
+};
+
+// @brief Counters of the file cache, used to size its budget
+struct FileCacheStats {
+    uint64_t hits          = 0;
+    uint64_t misses        = 0;
+    uint64_t evictions     = 0;
+    uint64_t invalidations = 0;
+    size_t entries         = 0;
+    size_t bytes           = 0;
+};
+
+/**
+ * @brief Concurrent cache of file contents keyed by their normalized path
+ * relative to the served directory. It is split into shards, each with its
+ * own lock, LRU list and share of the memory budget, so workers rarely wait
+ * for each other.
+ *
+ * A background thread watches the served directory (and every directory
+ * below it) with inotify and drops an entry as soon as its file is changed,
+ * moved or deleted. Entries are handed out as shared pointers, so a response
+ * still being sent keeps the old contents alive.
+ */
+class FileCache {
+    public:
+    /**
+     * @brief Starts watching p_Root. Can throw FileCacheCreationFailure.
+     * @param p_Budget Bytes all cached files may take up together
+     * @param p_MaxFileSize Larger files are never cached (they are sent with
+     * sendfile instead)
+     * @param p_Root Directory the paths are relative to
+     */
+    FileCache (size_t p_Budget, size_t p_MaxFileSize, const std::string& p_Root = ".");
+    ~FileCache ();
+
+    FileCache (const FileCache&)            = delete;
+    FileCache& operator= (const FileCache&) = delete;
+
+    /**
+     * @brief Looks up the file at p_Path.
+     * @param p_Generation On a miss, receives what insert() needs to find out
+     * whether the file changed while it was being read
+     * @return the cached file (check CachedFile::missing), nullptr on a miss
+     */
+    std::shared_ptr<const CachedFile> find (std::string_view p_Path, uint64_t& p_Generation);
+
+    /**
+     * @brief Suffixes of the compressed variants of a file (most preferred
+     * first). A change to a file drops its variants as well.
+     */
+    static constexpr std::array<std::string_view, 2> VARIANT_SUFFIXES = { ".br", ".gz" };
+
+    /**
+     * @brief Reads the open file p_Fd and caches it under p_Path, unless
+     * p_Path was invalidated after find() returned p_Generation (then it is
+     * only returned).
+     * @param p_Stat Result of fstat on p_Fd
+     * @return the file, nullptr if it can't be cached (too large, outside the
+     * served directory or not watched) or read
+     */
+    std::shared_ptr<const CachedFile> insert (std::string_view p_Path, int p_Fd,
+    const struct stat& p_Stat, uint64_t p_Generation);
+
+    /**
+     * @brief Caches contents which weren't read from p_Path itself (a
+     * compressed variant made in memory, or the marker of a missing file),
+     * with the same conditions as the other insert().
+     */
+    std::shared_ptr<const CachedFile> insert (std::string_view p_Path,
+    CachedFile&& p_File, uint64_t p_Generation);
+
+    // @brief Drops the entry of p_Path, or of every path below it if
+    // p_Prefix is set
+    void invalidate (const std::string& p_Path, bool p_Prefix = false);
+
+    // @brief Drops every entry
+    void clear ();
+
+    // @brief Sum of the counters of every shard
+    FileCacheStats getStats ();
+
+    private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    // @brief Memory an entry takes up besides the contents of its file
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    // @brief Period (ms) at which the counters are logged if they changed
+    static constexpr int STATS_INTERVAL_MS = 60 * 1000;
+
+    // @brief Hashes the keys and the views they are looked up with alike, so
+    // a lookup doesn't copy its key
+    struct KeyHash {
+        using is_transparent = void;
+
+        size_t operator() (std::string_view p_Key) const {
+            return std::hash<std::string_view>{}(p_Key);
+        }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+
+        // @brief Most recently used entry first
+        std::list<std::pair<std::string, std::shared_ptr<const CachedFile>>> lru;
+        std::unordered_map<std::string, decltype (lru)::iterator, KeyHash, std::equal_to<>> entries;
+
+        size_t bytes = 0;
+
+        // @brief Incremented by every invalidation of an entry of this shard
+        uint64_t generation = 0;
+
+        uint64_t hits          = 0;
+        uint64_t misses        = 0;
+        uint64_t evictions     = 0;
+        uint64_t invalidations = 0;
+    };
+
+    std::array<Shard, SHARD_COUNT> m_Shards;
+
+    // @brief Budget of each shard
+    size_t m_ShardBudget;
+    size_t m_MaxFileSize;
+
+    // @brief Directory the cache keys are relative to
+    std::string m_Root;
+
+    // @brief inotify instance and the directory (cache key prefix) of each
+    // of its watches. Only touched by the watcher thread after construction.
+    int m_InotifyFd;
+    std::unordered_map<int, std::string> m_WatchedDirs;
+
+    // @brief Directories which couldn't be watched (e.g. the inotify watch
+    // limit was hit). Nothing below them is cached.
+    std::unordered_set<std::string> m_UnwatchedDirs;
+    std::mutex m_UnwatchedDirsMutex;
+    std::atomic_bool m_HasUnwatchedDirs;
+
+    // @brief eventfd which wakes up the watcher thread when it has to stop
+    int m_WakeFd;
+    std::atomic_bool m_Stop;
+    std::thread m_Watcher;
+
+    // @brief Key of p_Path: the path relative to the served directory without
+    // "." and ".." components. Empty if the path leaves the directory.
+    static std::string makeKey (std::string_view p_Path);
+
+    // @brief Key of p_Path as a view into it if the path is normal already
+    // ("./a/b.css", the usual case), empty otherwise
+    static std::string_view normalKeyView (std::string_view p_Path);
+
+    Shard& getShard (std::string_view p_Key);
+
+    // @brief Caches p_File under p_Key unless the shard was invalidated
+    // since p_Generation
+    std::shared_ptr<const CachedFile> store (std::string&& p_Key,
+    std::shared_ptr<const CachedFile> p_File, uint64_t p_Generation);
+
+    // @brief Removes an entry, the shard must be locked
+    static void removeEntry (Shard& p_Shard, decltype (Shard::entries)::iterator p_Itr);
+
+    // @brief Whether changes to the file p_Key are noticed
+    bool isWatched (const std::string& p_Key);
+
+    // @brief Watches p_Dir and every directory below it
+    void watchTree (const std::string& p_Dir);
+
+    // @brief Body of the watcher thread
+    void watch ();
+
+    // @brief Applies the inotify events in p_Buffer
+    void handleEvents (const char* p_Buffer, size_t p_Length);
+};
+
+} // namespace ccerve
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * @file file_pool.hpp
+ * @brief Holds the declaration of the FilePool class whose threads do the
+ * file system work (open, stat, read, directory listings) which could block
+ * a worker's event loop.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ccerve {
+
+/**
+ * @brief Threads which run tasks that may block on the disk, so a worker
+ * keeps serving its other connections meanwhile. Every thread has a deque of
+ * its own and every thread submitting tasks (a worker) is given one of them,
+ * so workers don't contend for a single queue. A thread runs the oldest task
+ * of its deque; once it is empty, it steals the newest task of another deque,
+ * so a burst of slow tasks from one worker is spread over every thread.
+ */
+class FilePool {
+    public:
+    using Task = std::move_only_function<void ()>;
+
+    // @brief Starts p_Threads threads (at least one)
+    explicit FilePool (size_t p_Threads);
+
+    // @brief Stops the threads once every queued task is done
+    ~FilePool ();
+
+    FilePool (const FilePool&)            = delete;
+    FilePool& operator= (const FilePool&) = delete;
+
+    // @brief Queues p_Task on the deque of the calling thread. Never blocks
+    // on the tasks.
+    void submit (Task p_Task);
+
+    private:
+    struct Deque {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // @brief One per thread, never resized (the threads hold on to them)
+    std::vector<std::unique_ptr<Deque>> m_Deques;
+
+    // @brief Tasks in all deques. Raised under m_SleepMutex before a task is
+    // pushed, so a thread going to sleep can't miss it.
+    std::atomic<size_t> m_Queued{ 0 };
+
+    // @brief Hands every submitting thread its deque
+    std::atomic<size_t> m_NextDeque{ 0 };
+
+    std::mutex m_SleepMutex;
+    std::condition_variable m_SleepCondition;
+    bool m_Stop = false;
+
+    std::vector<std::thread> m_Threads;
+
+    // @brief Body of thread p_Index
+    void run (size_t p_Index);
+
+    /**
+     * @brief Takes the oldest task of deque p_Index, or else the newest task
+     * of any other deque
+     * @return false if every deque is empty
+     */
+    bool take (size_t p_Index, Task& p_Task);
+};
+
+} // namespace ccerve
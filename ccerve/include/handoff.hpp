@@ -0,0 +1,70 @@
+#pragma once
+
+/**
+ * @file handoff.hpp
+ * @brief Holds the functions a running server uses to hand its listening
+ * sockets over to a newly started one (hot upgrade), and the new server uses
+ * to take them over. The sockets go over a Unix socket pair as SCM_RIGHTS
+ * messages, so they are never closed and no connection is refused while the
+ * servers change places.
+ *
+ * 1. the old server starts the new one with spawn(), which passes one end of
+ *    the pair in the environment (CHANNEL_ENV)
+ * 2. the old server sends its sockets with sendSockets(), the new one gets
+ *    them with takeChannel() and receiveSockets() and creates its workers
+ * 3. the new server sends sendReady() once its workers run, the old one
+ *    (waiting in waitReady()) stops accepting and finishes its connections
+ */
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace ccerve {
+namespace handoff {
+
+// @brief Environment variable holding the descriptor of the channel
+constexpr const char* CHANNEL_ENV = "CCERVE_HANDOFF_FD";
+
+/**
+ * @brief Starts p_Command (the new server) with the channel to this process
+ * in its environment
+ * @param p_Channel Receives this process' end of the channel
+ * @return pid of the new process, -1 if it couldn't be started (errno is
+ * set)
+ */
+pid_t spawn (const std::vector<std::string>& p_Command, int& p_Channel);
+
+/**
+ * @brief Sends p_Socks over p_Channel, in order
+ * @return false if the channel broke
+ */
+bool sendSockets (int p_Channel, std::span<const int> p_Socks);
+
+/**
+ * @brief Waits until the process at the other end of p_Channel reports that
+ * it serves the sockets
+ * @return false if it exited, failed or took longer than p_TimeoutMs
+ */
+bool waitReady (int p_Channel, int p_TimeoutMs);
+
+/**
+ * @brief Gets the channel this process was started with by spawn() and
+ * removes it from the environment
+ * @return -1 if this process wasn't started to take over from another one
+ */
+int takeChannel ();
+
+/**
+ * @brief Receives the sockets sent with sendSockets() (close-on-exec)
+ * @return empty if the channel broke before all of them arrived
+ */
+std::vector<int> receiveSockets (int p_Channel);
+
+// @brief Reports to the old server that the sockets are served
+bool sendReady (int p_Channel);
+
+} // namespace handoff
+} // namespace ccerve
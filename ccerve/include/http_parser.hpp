@@ -5,13 +5,22 @@
  * @brief Contains declarations of HTTP parsing functions
  */
 
-#include <filesystem>
-#include <fstream>
+#include <ctime>
 #include <iostream>
-#include <map>
-#include <sstream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
 
 #include "GLOBAL.hpp"
+#include "compressor.hpp"
+#include "directory_listing.hpp"
+#include "file_cache.hpp"
+#include "http_request.hpp"
+#include "mime_types.hpp"
 
 namespace ccerve {
 
@@ -20,31 +29,155 @@ namespace ccerve {
  */
 namespace parse {
 
-using HeaderMap = std::map<std::string, std::string>;
+// @brief Part of a multipart/byteranges body
+struct BodyPart {
+    // @brief Delimiter and headers of the part
+    std::pmr::string head;
+
+    // @brief Range of the file (of body, or of file_fd if body is empty)
+    ByteRange range;
+};
+
+/**
+ * @brief Response produced by handleRequest(), kept in separate pieces which
+ * are sent one after the other without being copied together: the status
+ * line, the rendered headers and the body. The body is none (304) or one of
+ * - a borrowed buffer which outlives every connection (e.g. error pages)
+ * - (a range of) the contents of a file shared with the file cache
+ * - a range of a file which isn't read into memory at all: the response owns
+ *   an open descriptor of it. Only move-able since it owns the file.
+ * - the parts of a multipart/byteranges body, cut out of one of the above
+ *
+ * Its strings are allocated from the memory resource it is constructed with,
+ * the arena of its connection when it answers a request. Moving a response
+ * keeps them there.
+ */
+struct Response {
+    int status_code = 200;
+
+    // @brief Static type of the body, empty if there is no body
+    std::string_view content_type;
+
+    // @brief Type of the served file, nullptr for generated bodies
+    const mime::MimeType* mime_type = nullptr;
+
+    // @brief Status line including its "\r\n" (points to a static table)
+    std::string_view status_line;
+
+    // @brief Header fields and the empty line ending them
+    std::pmr::string headers;
+
+    // @brief Body held in memory, sent if there is no file: borrowed (e.g.
+    // error pages) or part of the contents of cached_file
+    std::string_view body;
+
+    // @brief Keeps the file cache's copy of a file (or a page generated for
+    // this response) alive while body points into it
+    std::shared_ptr<const CachedFile> cached_file;
+
+    // @brief File to send after the headers, -1 if there is none
+    int file_fd = -1;
+
+    // @brief Range of the file to send
+    off_t file_offset = 0;
+    size_t file_size  = 0;
+
+    // @brief Coding of the body ("br", "gzip"), empty if it isn't compressed
+    std::string_view content_encoding;
+
+    // @brief Whether the body depends on the Accept-Encoding of the request
+    bool vary_accept_encoding = false;
+
+    // @brief Validators of the served file: its entity tag is made of these
+    // and content_encoding
+    timespec last_modified{};
+    ino_t inode = 0;
+
+    // @brief Size of the whole file (a 206 response sends a part of it)
+    size_t full_size = 0;
+
+    // @brief Value of the Content-Range header, empty if there is none
+    std::pmr::string content_range;
+
+    // @brief Value of the Location header of a redirect, empty otherwise
+    std::pmr::string location;
+
+    // @brief Parts of a multipart/byteranges body, empty otherwise. They are
+    // followed by multipart_end.
+    std::pmr::vector<BodyPart> parts;
+    std::pmr::string multipart_boundary;
+    std::pmr::string multipart_end;
+
+    // @brief The connection is closed after this response (announced with
+    // "Connection: close")
+    bool close_connection = false;
+
+    Response () : Response (std::pmr::get_default_resource ()) {
+    }
+    explicit Response (std::pmr::memory_resource* p_Memory);
+    Response (Response&& p_Other) noexcept;
+    Response& operator= (Response&& p_Other) noexcept;
+    ~Response ();
+};
+
+/**
+ * @brief  Produces the response of a HTTP request by querying for the resource
+ * asked for in the request. Compressible files are sent compressed if the
+ * client accepts it and a compressed variant exists. A client whose copy is
+ * still current (If-None-Match, If-Modified-Since) gets a 304 without the file
+ * being read. A directory is answered with its index.html, or else its
+ * listing; one asked for without the trailing '/' is redirected to it.
+ * @param  request (const Request&) the parsed request
+ * @param  file_cache Cache to look the file up in, nullptr to always read it
+ * from disk
+ * @param  compressor Makes compressed variants of cached files, nullptr if
+ * only sidecar files on disk are used
+ * @param  listings Renders and keeps directory listings, nullptr to answer
+ * directories without an index.html with a 404
+ * @param  close_connection The server closes the connection after this
+ * request, whether the client asked for it or not
+ * @param  memory Where the response and the paths looked up for it are
+ * allocated (see Connection::getArena())
+ * @return response (Response) head of the HTTP response and the file to send
+ * as its body
+ */
+auto handleRequest (const Request& request, FileCache* file_cache = nullptr,
+Compressor* compressor = nullptr, DirectoryListings* listings = nullptr, bool close_connection = false,
+std::pmr::memory_resource* memory = std::pmr::get_default_resource ()) -> Response;
 
 /**
- * @brief Fills the map with key-value (header: value) pairs that are present in
- * the HTTP message
- * @param header_map (HeaderMap&)
- * @param message (std::string) HTTP message
+ * @brief  Produces the response of request like handleRequest() does, if
+ * that takes nothing but memory: the file (or its compressed variant) is in
+ * the file cache, or the request is answered with an error. Directories
+ * aren't answered, nor anything else which takes a system call that could
+ * wait for the disk.
+ * @return nullopt if the disk is needed: the request has to go to
+ * handleRequest() on a thread which may block
  */
-auto parseMessage (HeaderMap& header_map, const std::string& message) -> void;
+auto handleRequestFromMemory (const Request& request, FileCache* file_cache, Compressor* compressor,
+bool close_connection, std::pmr::memory_resource* memory) -> std::optional<Response>;
 
 /**
- * @brief  Fills the map with request headers + response headers. The response
- * headers are filled by calling appropriate functions that query for resources
- * asked for in the request. The key difference in this function and the
- * parseMessage() function is that this assumes that the message is a HTTP
- * Request.
- * @param  header_map (HeaderMap&).
- * @param  message HTTP request
- * @return response (std::string) HTTP response
+ * @brief  Produces the error page of a request which couldn't be read (400,
+ * 413, 431 or 501). The connection is closed after it.
+ * @param  status_code HTTP status code of the error
  */
-auto handleRequest (HeaderMap& header_map, const std::string& http_request) -> std::string;
+auto makeErrorResponse (int status_code) -> Response;
 
-auto printHeaderMap (const HeaderMap& header_map) -> void;
+/**
+ * @brief  Produces a 200 response whose body is a page generated by the
+ * server (e.g. the metrics), sent without validators or caching
+ * @param  request the request being answered
+ * @param  content_type Content-Type of the page
+ * @param  page The page, in contents. The response keeps it alive.
+ * @param  close_connection The server closes the connection after this
+ * request, whether the client asked for it or not
+ */
+auto makePageResponse (const Request& request, std::string_view content_type,
+std::shared_ptr<const CachedFile> page, bool close_connection = false) -> Response;
 
-auto printHeaderKeys (const HeaderMap& header_map) -> void;
+// @brief Prints the request line and every header of request
+auto printRequest (const Request& request) -> void;
 
 } // namespace parse
 } // namespace ccerve
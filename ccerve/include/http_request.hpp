@@ -0,0 +1,225 @@
+#pragma once
+
+/**
+ * @file http_request.hpp
+ * @brief Holds the Request struct, the parser filling it and the
+ * RequestReader which cuts requests out of the bytes received on a
+ * connection. Parsing doesn't copy anything: every field of a Request is a
+ * view into the buffer the request was received in.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace ccerve {
+namespace parse {
+
+// @brief Headers the server looks at. They get a fixed slot in Request so
+// they are found without searching.
+enum class Header : uint8_t {
+    HOST,
+    CONNECTION,
+    ACCEPT,
+    ACCEPT_ENCODING,
+    IF_NONE_MATCH,
+    IF_MODIFIED_SINCE,
+    RANGE,
+    IF_RANGE,
+    CONTENT_LENGTH,
+    TRANSFER_ENCODING,
+    USER_AGENT,
+    COUNT,
+};
+
+static constexpr size_t HEADER_COUNT = static_cast<size_t> (Header::COUNT);
+
+// @brief Lower case names of the headers of the Header enum, in its order
+static constexpr std::array<std::string_view, HEADER_COUNT> HEADER_NAMES = {
+    "host",
+    "connection",
+    "accept",
+    "accept-encoding",
+    "if-none-match",
+    "if-modified-since",
+    "range",
+    "if-range",
+    "content-length",
+    "transfer-encoding",
+    "user-agent",
+};
+
+// @brief A header which isn't part of the Header enum
+struct HeaderField {
+    std::string_view name;
+    std::string_view value;
+};
+
+/**
+ * @brief A parsed HTTP request. The views point into the received message, so
+ * a Request must not outlive it.
+ */
+struct Request {
+    // @brief Other headers after this many are dropped
+    static constexpr size_t MAX_OTHER_HEADERS = 32;
+
+    std::string_view method;
+
+    // @brief Request target as sent (e.g. "/a/b.html?x=1")
+    std::string_view target;
+
+    // @brief Target without the query (e.g. "/a/b.html")
+    std::string_view path;
+
+    std::string_view version;
+
+    // @brief Values of the known headers, empty if they weren't sent
+    std::array<std::string_view, HEADER_COUNT> headers{};
+
+    // @brief Every other header, in the order they were sent
+    std::array<HeaderField, MAX_OTHER_HEADERS> other_headers{};
+    size_t other_header_count = 0;
+
+    // @brief Value of a known header, empty if it wasn't sent
+    std::string_view get (Header p_Header) const {
+        return headers[static_cast<size_t> (p_Header)];
+    }
+
+    // @brief Value of any header (name is case insensitive), empty if it
+    // wasn't sent
+    std::string_view get (std::string_view p_Name) const;
+};
+
+/**
+ * @brief Case insensitive comparison of ASCII strings (header names and
+ * tokens are case insensitive)
+ */
+auto equalsIgnoreCase (std::string_view lhs, std::string_view rhs) -> bool;
+
+/**
+ * @brief Parses the request line and the headers of message into request.
+ * Nothing is allocated.
+ * @param message The request up to and including the empty line ending its
+ * headers (anything after it is ignored)
+ * @param request (Request&) filled with views into message
+ * @return false if message isn't a well formed HTTP request
+ */
+auto parseRequest (std::string_view message, Request& request) -> bool;
+
+// @brief Content codings a client accepts (of those the server can send)
+struct AcceptedEncodings {
+    bool brotli = false;
+    bool gzip   = false;
+};
+
+/**
+ * @brief Parses the value of an Accept-Encoding header. Codings with q=0 are
+ * refused, "*" stands for every coding not listed.
+ */
+auto parseAcceptEncoding (std::string_view value) -> AcceptedEncodings;
+
+/**
+ * @brief Whether the value of an If-None-Match header lists etag or is "*".
+ * Tags are compared weakly: a "W/" in front of one is ignored.
+ * @param etag Entity tag including its quotes
+ */
+auto matchesEntityTag (std::string_view value, std::string_view etag) -> bool;
+
+// @brief Range of bytes of a representation, end excluded
+struct ByteRange {
+    size_t start = 0;
+    size_t end   = 0;
+};
+
+// @brief Requests with more ranges get the whole representation
+static constexpr size_t MAX_RANGES = 16;
+
+// @brief Outcome of parseRange()
+enum class RangeStatus {
+    IGNORED,       // no, malformed or too many ranges: send everything (200)
+    SATISFIABLE,   // at least one range lies within the representation (206)
+    UNSATISFIABLE, // every range starts past its end (416)
+};
+
+/**
+ * @brief Parses the value of a Range header ("bytes=0-99,200-,-50")
+ * @param size Size of the representation the ranges refer to
+ * @param ranges Receives the satisfiable ranges (clamped to size) in the
+ * order they were asked for
+ * @param range_count Number of entries put into ranges
+ */
+auto parseRange (std::string_view value, size_t size, std::array<ByteRange, MAX_RANGES>& ranges,
+size_t& range_count) -> RangeStatus;
+
+// @brief Outcome of RequestReader::next()
+enum class ReadStatus {
+    INCOMPLETE,        // more bytes are needed
+    COMPLETE,          // a request was parsed
+    BAD_REQUEST,       // malformed request (400)
+    HEADERS_TOO_LARGE, // no end of headers within MAX_HEADER_SIZE (431)
+    BODY_TOO_LARGE,    // Content-Length above MAX_BODY_SIZE (413)
+    NOT_IMPLEMENTED,   // body framing we don't support (501)
+};
+
+/**
+ * @brief Collects the bytes received on a connection and cuts complete
+ * requests out of them. A request may arrive split over several reads and a
+ * read may hold several requests (pipelining). Scanning for the end of the
+ * headers resumes where the last call stopped, so a slowly arriving request
+ * isn't scanned again from its start.
+ */
+class RequestReader {
+    public:
+    // @brief Requests whose headers are larger are rejected
+    static constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+
+    // @brief Requests with a larger body are rejected. Bodies are skipped,
+    // no method we implement uses them.
+    static constexpr size_t MAX_BODY_SIZE = 1024 * 1024;
+
+    // @brief Adds received bytes
+    void append (std::string_view p_Data);
+
+    /**
+     * @brief Parses the next complete request.
+     * @param p_Request On COMPLETE, receives the request. Its views stay
+     * valid until consume() or append() is called.
+     * @return COMPLETE if a request was parsed, INCOMPLETE if more bytes are
+     * needed, anything else if the connection can't be read any further
+     */
+    ReadStatus next (Request& p_Request);
+
+    // @brief Drops the request returned by the last next()
+    void consume ();
+
+    // @brief Bytes of the request returned by the last next() (headers and
+    // body), valid until consume() or append() is called
+    std::string_view current () const {
+        return std::string_view (m_Buffer).substr (m_Start, m_RequestLength);
+    }
+
+    // @brief Whether bytes of an unfinished request are buffered
+    bool hasPendingData () const {
+        return m_Start < m_Buffer.size ();
+    }
+
+    private:
+    std::string m_Buffer;
+
+    // @brief Where the next request starts in m_Buffer
+    size_t m_Start = 0;
+
+    // @brief How far (from m_Start) the end of the headers was searched
+    size_t m_Scanned = 0;
+
+    // @brief Length of the headers of the next request, 0 until found
+    size_t m_HeadersEnd = 0;
+
+    // @brief Length (headers + body) of the request returned by next()
+    size_t m_RequestLength = 0;
+};
+
+} // namespace parse
+} // namespace ccerve
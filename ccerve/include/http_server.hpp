@@ -5,18 +5,33 @@
  * @brief Holds the declaration of the HttpServer class
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <exception>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string_view>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
+#include "compressor.hpp"
+#include "coroutine_worker.hpp"
+#include "directory_listing.hpp"
+#include "epoll_worker.hpp"
 #include "exception.hpp"
+#include "file_cache.hpp"
+#include "file_pool.hpp"
 #include "http_parser.hpp"
 #include "logger.hpp"
+#include "metrics.hpp"
+#include "server_config.hpp"
 #include "sockets.hpp"
+#include "uring_worker.hpp"
+#include "worker.hpp"
 
 /**
  * @namespace Main namespace of the project
@@ -26,48 +41,100 @@ namespace ccerve {
 class HttpServer {
     public:
     HttpServer (std::string p_IPAddress, int p_Port, bool p_Log = true);
+    HttpServer (const ServerConfig& p_Config, bool p_Log = true);
     ~HttpServer ();
+
+    /**
+     * @brief Starts every worker and blocks until the session is stopped.
+     * The calling thread waits for the signals of blockSignals():
+     * - SIGTERM, SIGINT: the workers stop accepting, finish their open
+     *   connections (for up to ServerConfig::drain_timeout_ms) and the log is
+     *   flushed. The same signal again closes the connections right away.
+     * - SIGUSR2: ServerConfig::upgrade_command is started and takes the
+     *   listening sockets over (see handoff.hpp). Once it serves them, this
+     *   server finishes its connections like after SIGTERM.
+     */
     void startListeningSession ();
+
+    // @brief Stops every worker and joins their threads
     void stopListeningSession ();
 
+    /**
+     * @brief Blocks the signals startListeningSession() waits for in the
+     * calling thread. Must be called before any thread is started (the
+     * logger's too), so that every thread inherits the mask and none of them
+     * is killed by the signals.
+     */
+    static void blockSignals ();
+
     private:
-    // @brief File descriptor of server socket (listening socket)
-    int m_ServerSock;
+    // @brief How long a new server may take to start serving the sockets
+    // handed over to it
+    static constexpr int HANDOFF_TIMEOUT_MS = 10000;
+
+    // @brief Options the server was started with
+    ServerConfig m_Config;
 
-    // @brief Struct defining the socket address of server socket
+    // @brief Struct defining the socket address of server sockets
     struct sockaddr_in m_ServerSockAddr;
 
-    // @brief File descriptor of the socket created when connection is accepted
-    int m_ClientSock;
+    // @brief Cache of small files shared by every worker, nullptr if
+    // disabled. Declared before m_Workers so that it outlives them.
+    std::unique_ptr<FileCache> m_FileCache;
 
-    // @brief Struct defining the socket address of client socket
-    struct sockaddr_in m_ClientSockAddr;
-    socklen_t m_ClientSockAddrLen = sizeof (m_ClientSockAddr);
+    // @brief Compresses cached files in the background, nullptr if disabled.
+    // Uses m_FileCache, so it is declared (and destroyed) after it.
+    std::unique_ptr<Compressor> m_Compressor;
 
-    // @brief Size of buffer which will store the message sent by client
-    static const size_t BUFFER_SIZE = 30760; // ! Probably a better way to do this
+    // @brief Directory listings shared by every worker, nullptr if disabled
+    std::unique_ptr<DirectoryListings> m_Listings;
 
-    /**
-    @brief Maximum number of connections which could wait in queue before before
-    server starts rejecting
-    */
-    static const size_t BACKLOG_SIZE = 100;
+    // @brief Counters of the connections of every worker
+    ConnectionStats m_ConnectionStats;
 
-    // @brief the string in which server response will be stored
-    std::string response;
+    // @brief What the workers count and time, rendered at
+    // ServerConfig::metrics_path. Outlives the workers, they record into it.
+    std::unique_ptr<Metrics> m_Metrics;
 
-    // @brief Accept connection on given socket
-    void acceptConnection ();
+    // @brief Workers, each with its own server socket and event loop
+    std::vector<std::unique_ptr<Worker>> m_Workers;
 
-    // @brief Send a HTTP response to client
-    void sendResponse (const std::string& p_Response, int p_ClientSock);
+    // @brief Threads running m_Workers
+    std::vector<std::thread> m_WorkerThreads;
 
-    /*
-    These functions are called within the constructor and can throw
-    exceptions.
-    */
-    void createServerSocket ();
+    // @brief Answers the requests which need the disk for the workers,
+    // nullptr if they answer them themselves. Declared after m_Workers: its
+    // tasks hand their responses to the workers, so it is stopped first.
+    std::unique_ptr<FilePool> m_FilePool;
 
-    void bindServerSocket (); // Can throw ServerSockBindFail
+    // @brief Mutex to protect starting and joining of worker threads
+    std::mutex m_WorkerThreadsMutex;
+
+    // @brief Workers whose run() returned, each also writes m_WakeFd
+    std::atomic<size_t> m_FinishedWorkers{ 0 };
+    int m_WakeFd;
+
+    // @brief Channel to the server this one took the listening sockets over
+    // from, -1 once it was told that they are served (or if there is none)
+    int m_HandoffChannel = -1;
+
+    // @brief Waits for signals (p_SignalFd) and the workers until every
+    // worker has finished
+    void superviseWorkers (int p_SignalFd);
+
+    /**
+     * @brief Starts ServerConfig::upgrade_command and hands the listening
+     * sockets over to it
+     * @return true once the new server serves them, false if it couldn't be
+     * started or failed (it is killed, this server goes on as before)
+     */
+    bool handOver ();
+
+    /**
+     * @brief Receives the listening sockets of the server this one replaces
+     * (if it was started by handOver()) and keeps those bound to this
+     * server's address
+     */
+    std::vector<int> takeOverSockets ();
 };
 } // namespace ccerve
\ No newline at end of file
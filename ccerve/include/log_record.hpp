@@ -0,0 +1,155 @@
+#pragma once
+
+/**
+ * @file log_record.hpp
+ * @brief Holds the LogRecord struct: a log message as it waits in the
+ * Logger's queue, before it is formatted. The thread which logs only copies
+ * the arguments into the record, the write thread formats them.
+ */
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+namespace ccerve {
+namespace log {
+
+// @brief Enum for different log level options (INFO, WARN, ERROR)
+enum LOG_LEVEL {
+    INFO,
+    WARN,
+    ERROR,
+};
+
+// @brief Arguments which are copied into a record as text (and formatted
+// as a string_view)
+template <typename T>
+concept StringArgument = std::convertible_to<const T&, std::string_view>;
+
+// @brief Arguments a record can hold: text, or values which can be copied
+// byte by byte (numbers, enums, ...)
+template <typename T>
+concept CapturableArgument = StringArgument<T> || std::is_trivially_copyable_v<T>;
+
+/**
+ * @brief A log message in the queue of a Logger. It keeps the format string
+ * (a string literal, so only its address is kept) and copies of the
+ * arguments: a tuple of them at the start of args, followed by the text of
+ * the string arguments. render, instantiated for the argument types, is how
+ * the write thread finds its way back from the bytes to the types.
+ *
+ * Messages whose arguments don't fit (or can't be copied like that) are
+ * formatted right away into text.
+ */
+struct LogRecord {
+    // @brief Bytes the arguments (and their text) may take up
+    static constexpr size_t ARGS_SIZE = 192;
+
+    // @brief Appends the message to p_Out
+    using RenderFunction = void (*) (const LogRecord& p_Record, std::string& p_Out);
+
+    // @brief When the message was logged (seconds, CLOCK_REALTIME_COARSE)
+    time_t time = 0;
+
+    LOG_LEVEL level = LOG_LEVEL::INFO;
+
+    std::string_view format;
+
+    // @brief Formats args, nullptr if the message is in text
+    RenderFunction render = nullptr;
+
+    alignas (std::max_align_t) std::byte args[ARGS_SIZE];
+
+    // @brief The formatted message if render is nullptr. Kept in the slot of
+    // the queue, so its memory is reused by later messages.
+    std::string text;
+
+    /**
+     * @brief Copies p_Args into args and sets render
+     * @return false if they don't fit, the record is unchanged
+     */
+    template <typename... Args> bool capture (const Args&... p_Args) {
+        if constexpr (!(CapturableArgument<Args> && ...)) {
+            return false;
+        } else {
+            using Captured = std::tuple<CapturedType<Args>...>;
+            static_assert (alignof (Captured) <= alignof (std::max_align_t));
+            static_assert (std::is_trivially_destructible_v<Captured>);
+
+            size_t size = sizeof (Captured) + (textSize (p_Args) + ... + 0);
+            if (size > ARGS_SIZE)
+                return false;
+
+            // braced initialization copies the arguments left to right, so
+            // their text lands in order behind the tuple
+            size_t text_offset = sizeof (Captured);
+            new (args) Captured{ captureArgument (p_Args, text_offset)... };
+            render = &renderCaptured<Captured>;
+            return true;
+        }
+    }
+
+    private:
+    // @brief Where the text of a string argument was copied to in args
+    struct CapturedString {
+        uint16_t offset;
+        uint16_t size;
+    };
+
+    template <typename T>
+    using CapturedType = std::conditional_t<StringArgument<T>, CapturedString, T>;
+
+    template <typename T> static size_t textSize (const T& p_Arg) {
+        if constexpr (StringArgument<T>)
+            return std::string_view (p_Arg).size ();
+        else
+            return 0;
+    }
+
+    template <typename T> CapturedType<T> captureArgument (const T& p_Arg, size_t& p_TextOffset) {
+        if constexpr (StringArgument<T>) {
+            std::string_view text = p_Arg;
+            std::memcpy (args + p_TextOffset, text.data (), text.size ());
+            CapturedString captured{ static_cast<uint16_t> (p_TextOffset), static_cast<uint16_t> (text.size ()) };
+            p_TextOffset += text.size ();
+            return captured;
+        } else {
+            return p_Arg;
+        }
+    }
+
+    // @brief What a captured argument is formatted as
+    template <typename T> const T& restore (const T& p_Captured) const {
+        return p_Captured;
+    }
+
+    std::string_view restore (const CapturedString& p_Captured) const {
+        return { reinterpret_cast<const char*> (args) + p_Captured.offset, p_Captured.size };
+    }
+
+    template <typename... Values>
+    static void formatTo (std::string& p_Out, std::string_view p_Format, const Values&... p_Values) {
+        std::vformat_to (std::back_inserter (p_Out), p_Format, std::make_format_args (p_Values...));
+    }
+
+    template <typename Captured> static void renderCaptured (const LogRecord& p_Record, std::string& p_Out) {
+        const Captured& captured = *std::launder (reinterpret_cast<const Captured*> (p_Record.args));
+        std::apply (
+        [&] (const auto&... p_Captured) {
+            formatTo (p_Out, p_Record.format, p_Record.restore (p_Captured)...);
+        },
+        captured);
+    }
+};
+
+} // namespace log
+} // namespace ccerve
@@ -12,16 +12,19 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <format>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
 #include <vector>
 
 #include "colors.hpp"
+#include "log_record.hpp"
+#include "mpsc_ring.hpp"
 #include "sinks.hpp"
 #include "utils.hpp"
 
@@ -35,6 +38,8 @@
  * to declare it in the source file)
  * - ANSI color codes get printed to logs
  * - Thread safe logging (DONE)
+ * - Format on the write thread instead of the thread which logs (DONE: see
+ * LogRecord)
  */
 
 namespace ccerve {
@@ -44,11 +49,27 @@ namespace ccerve {
  */
 namespace log {
 
-// @brief Enum for different log level options (INFO, WARN, ERROR)
-enum LOG_LEVEL {
-    INFO,
-    WARN,
-    ERROR,
+// @brief What a thread logging into a full queue does
+enum class FullQueuePolicy {
+    BLOCK,     // wait until the writer thread makes room
+    DROP,      // drop the new message (and count it)
+    OVERWRITE, // drop the oldest message in the queue (and count it)
+};
+
+/**
+ * @brief When the logger makes its sinks flush the messages they hold back.
+ * They are always flushed when the logger is destroyed.
+ */
+struct FlushPolicy {
+    // @brief After this many messages, 0 to not count messages
+    size_t every_messages = 0;
+
+    // @brief This long after the first message written since the last flush,
+    // 0 to not flush after a time
+    unsigned every_ms = 1000;
+
+    // @brief Right after an error message
+    bool on_error = true;
 };
 
 using cpp_colors::foreground::green;
@@ -66,10 +87,14 @@ using SinksVector = std::vector<std::shared_ptr<sinks::BaseSink>>;
 class Logger {
 
     public:
+    // @brief Messages the queue holds before FullQueuePolicy applies
+    static constexpr size_t DEFAULT_QUEUE_CAPACITY = 8192;
+
     Logger (std::string_view p = "",
     LOG_LEVEL p_Level          = LOG_LEVEL::INFO,
     const SinksVector& p_Sinks = SinksVector (
-    { std::make_shared<sinks::StdOutSink> (sinks::StdOutSink ()) }));
+    { std::make_shared<sinks::StdOutSink> (sinks::StdOutSink ()) }),
+    size_t p_QueueCapacity = DEFAULT_QUEUE_CAPACITY);
     ~Logger ();
 
     // @brief Pushes the sink to the sinks vector
@@ -87,54 +112,84 @@ class Logger {
     // @brief getter function for logger name
     std::string_view getLoggerName ();
 
-    // @brief pops from @var m_LogQueue and writes it to all sinks
+    // @brief setter function for what happens when the queue is full
+    void setFullQueuePolicy (FullQueuePolicy p_Policy);
+
+    // @brief getter function for what happens when the queue is full
+    FullQueuePolicy getFullQueuePolicy () const;
+
+    // @brief Number of messages dropped (or overwritten) since the queue was
+    // full
+    uint64_t getDroppedCount () const;
+
+    // @brief setter function for when the sinks are flushed
+    void setFlushPolicy (const FlushPolicy& p_Policy);
+
+    // @brief getter function for when the sinks are flushed
+    FlushPolicy getFlushPolicy () const;
+
+    // @brief pops batches from @var m_LogQueue and writes them to all sinks
     void write () const;
 
     /**
-     * @brief Pushed log message to log queue (thread safe).
-     * @param p_Msg message to push
+     * @brief Blocks until every message queued before the call has been
+     * written and the sinks have been flushed (e.g. before the process
+     * exits or hands over to another one)
+     */
+    void flush () const;
+
+    /**
+     * @brief Pushed log message to log queue (thread safe, lock-free unless
+     * the queue is full and the policy is BLOCK). Only the time and copies of
+     * the arguments are queued, the message is formatted on the write thread.
+     * @param p_Msg format string, checked against the arguments at compile
+     * time
      * @param p_LogLevel if the log level of the logger is larger than this,
      * the message won't be pushed.
      */
     template <typename... Args>
-    void log (std::string_view p_Msg, LOG_LEVEL p_LogLevel, std::string p_Tag, Args&&... p_Args) const {
+    void log (std::format_string<Args...> p_Msg, LOG_LEVEL p_LogLevel, Args&&... p_Args) const {
         if (p_LogLevel < m_LogLevel)
             return;
 
-        // std::format requires compile time expressions but std::vformat does
-        // not
-        auto user_formatted_str =
-        std::vformat (p_Msg, std::make_format_args (p_Args...));
-
-        {
-            // push to log queue
-            std::lock_guard<std::mutex> queue_lock{ m_LogQueueMutex };
-            m_LogQueue.push (std::format (m_LogFormat, getCurrentTime (),
-            m_LoggerName, p_Tag, user_formatted_str));
+        timespec now;
+        clock_gettime (CLOCK_REALTIME_COARSE, &now);
+
+        auto fill = [&] (LogRecord& p_Record) {
+            p_Record.time   = now.tv_sec;
+            p_Record.level  = p_LogLevel;
+            p_Record.format = p_Msg.get ();
+            if (!p_Record.capture (p_Args...)) {
+                // too large to be copied, format it right here
+                p_Record.render = nullptr;
+                p_Record.text.clear ();
+                std::vformat_to (std::back_inserter (p_Record.text), p_Msg.get (),
+                std::make_format_args (p_Args...));
+            }
+        };
+        while (!m_LogQueue.tryEmplace (fill)) {
+            if (!makeRoom ())
+                return;
         }
-
-        m_CV.notify_one (); // wake up the write thread
+        notifyWriter ();
     };
 
-    // @brief Calls log() with green colored "info" string attached to the
-    // message
+    // @brief Calls log() with the "info" level
     template <typename... Args>
-    void info (std::string_view p_Msg, Args&&... p_Args) const {
-        log (p_Msg, LOG_LEVEL::INFO, GREEN ("info"), std::forward<Args> (p_Args)...);
+    void info (std::format_string<Args...> p_Msg, Args&&... p_Args) const {
+        log (p_Msg, LOG_LEVEL::INFO, std::forward<Args> (p_Args)...);
     };
 
-    // @brief Calls log() with yellow colored "warn" string attached to the
-    // message
+    // @brief Calls log() with the "warn" level
     template <typename... Args>
-    void warn (std::string_view p_Msg, Args&&... p_Args) const {
-        log (p_Msg, LOG_LEVEL::WARN, YELLOW ("warn"), std::forward<Args> (p_Args)...);
+    void warn (std::format_string<Args...> p_Msg, Args&&... p_Args) const {
+        log (p_Msg, LOG_LEVEL::WARN, std::forward<Args> (p_Args)...);
     };
 
-    // @brief Calls log() with red colored "error" string attached to the
-    // message
+    // @brief Calls log() with the "error" level
     template <typename... Args>
-    void error (std::string_view p_Msg, Args&&... p_Args) const {
-        log (p_Msg, LOG_LEVEL::ERROR, RED ("error"), std::forward<Args> (p_Args)...);
+    void error (std::format_string<Args...> p_Msg, Args&&... p_Args) const {
+        log (p_Msg, LOG_LEVEL::ERROR, std::forward<Args> (p_Args)...);
     };
 
     // @briefs Returns the list of active Loggers (singletons singletons...)
@@ -144,23 +199,67 @@ class Logger {
     std::string m_LoggerName;
     LOG_LEVEL m_LogLevel;
 
-    // @brief Format for log messages
-    // This is a hack for now. I will change it later.
-    static inline constexpr std::string_view m_LogFormat =
-    "[{}] - [{}] - [{}] - {}\n";
+    /*
+    Format for log messages: "[time] - [logger name] - [level] - message\n".
+    The level is colored green (info), yellow (warn) or red (error).
+    */
 
     // @brief All the sinks that the logger will write to
     SinksVector m_Sinks;
 
-    // @brief Queue to hold logs
-    mutable std::queue<std::string> m_LogQueue;
+    // @brief Queue to hold logs. Threads logging at the same time don't wait
+    // for each other.
+    mutable MpscRing<LogRecord> m_LogQueue;
+
+    // @brief Messages taken out of the queue at once and handed to the
+    // sinks as one batch. Only used by the write thread.
+    static constexpr size_t BATCH_SIZE = 256;
+    mutable std::vector<std::string> m_Batch;
+
+    // @brief Second the time in m_TimeText was rendered for, the time of a
+    // message is only rendered again if its second differs
+    mutable time_t m_TimeTextSecond = -1;
+    mutable char m_TimeText[64] = {};
+    mutable size_t m_TimeTextSize = 0;
+
+    // @brief Fields of the FlushPolicy (atomic, the write thread reads them
+    // while they may be set)
+    std::atomic<size_t> m_FlushEveryMessages{ 0 };
+    std::atomic<unsigned> m_FlushEveryMs{ 0 };
+    std::atomic_bool m_FlushOnError{ false };
+
+    std::atomic<FullQueuePolicy> m_FullQueuePolicy{ FullQueuePolicy::BLOCK };
+
+    // @brief Messages lost to a full queue, and how many of them the write
+    // thread has reported so far
+    mutable std::atomic<uint64_t> m_DroppedCount{ 0 };
+    mutable uint64_t m_ReportedDropCount = 0;
+
+    /*
+    The write thread spins for a while when the queue runs empty and then
+    parks on m_CV. Only then do logging threads pay for waking it (a lock and a
+    futex call), a busy writer is never signaled.
+    */
+
+    // @brief Whether the write thread is (about to be) parked
+    mutable std::atomic_bool m_WriterParked{ false };
+
+    // @brief Calls of flush() so far, and how many of them the write thread
+    // has completed (changed under m_ParkMutex, waited for on m_FlushedCV)
+    mutable std::atomic<uint64_t> m_FlushRequests{ 0 };
+    mutable std::atomic<uint64_t> m_FlushesDone{ 0 };
+    mutable std::condition_variable m_FlushedCV;
 
-    // @brief Mutex to lock operations on log queue
-    mutable std::mutex m_LogQueueMutex;
+    // @brief Mutex m_CV is waited on with
+    mutable std::mutex m_ParkMutex;
 
     // @brief Condition variable to wake up the Write thread
     mutable std::condition_variable m_CV;
 
+    // @brief Rounds the write thread spins, then yields, before parking
+    static constexpr unsigned SPIN_ROUNDS  = 256;
+    static constexpr unsigned YIELD_ROUNDS = 16;
+
     /** @brief Thread to write messages to sinks.
     Note that creating two different file sinks for the same file will result in
     interleaved text. If you know that two loggers will print to the same file,
@@ -172,13 +271,36 @@ class Logger {
     // @brief Variable to terminate write thread (atomic to avoid race
     // conditions)
     std::atomic_bool m_StopWriteThread;
+
+    /**
+     * @brief Applies m_FullQueuePolicy when the queue is full
+     * @return false if the message is to be dropped, true to try again
+     */
+    bool makeRoom () const;
+
+    // @brief Wakes the write thread after a message was queued if it is
+    // parked
+    void notifyWriter () const;
+
+    // @brief Renders p_Record as a line of the log into p_Out
+    void render (const LogRecord& p_Record, std::string& p_Out) const;
+
+    // @brief Unparks the write thread
+    void wakeWriter () const;
+
+    // @brief Writes p_Msgs to every sink
+    void writeToSinks (std::span<const std::string> p_Msgs) const;
+
+    // @brief Makes every sink flush
+    void flushSinks () const;
 };
 
 /**
  * @brief Gets the default logger
- * @return shared_ptr to the default logger
+ * @return shared_ptr to the default logger (a reference, so logging doesn't
+ * touch its reference count)
  */
-std::shared_ptr<Logger> getDefaultLogger ();
+std::shared_ptr<Logger>& getDefaultLogger ();
 
 /**
 * @brief Changes the default logger to the one given as argument
@@ -189,18 +311,18 @@ void setDefaultLogger (Logger* p_Logger);
 
 // @brief Calls the default logger's info()
 template <typename... Args>
-void info (std::string_view p_Msg, Args&&... p_Args) {
+void info (std::format_string<Args...> p_Msg, Args&&... p_Args) {
     getDefaultLogger ()->info (p_Msg, std::forward<Args> (p_Args)...);
 };
 
 // @brief Calls the default logger's warn()
 template <typename... Args>
-void warn (std::string_view p_Msg, Args&&... p_Args) {
+void warn (std::format_string<Args...> p_Msg, Args&&... p_Args) {
     getDefaultLogger ()->warn (p_Msg, std::forward<Args> (p_Args)...);
 };
 // @brief Calls the default logger's error()
 template <typename... Args>
-void error (std::string_view p_Msg, Args&&... p_Args) {
+void error (std::format_string<Args...> p_Msg, Args&&... p_Args) {
     getDefaultLogger ()->error (p_Msg, std::forward<Args> (p_Args)...);
 };
 
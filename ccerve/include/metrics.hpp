@@ -0,0 +1,209 @@
+#pragma once
+
+/**
+ * @file metrics.hpp
+ * @brief Holds the counters and latency histograms every worker records
+ * into, and the Metrics class which renders them in the Prometheus text
+ * format.
+ */
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_cache.hpp"
+
+namespace ccerve {
+
+// @brief Counters of the connections of every worker
+struct ConnectionStats {
+    // @brief Connections open right now, kept below
+    // ConnectionLimits::max_connections
+    std::atomic<size_t> open{ 0 };
+
+    std::atomic<uint64_t> accepted{ 0 };
+
+    // @brief Closed right after being accepted, too many were open
+    std::atomic<uint64_t> rejected{ 0 };
+
+    // @brief Closed by the idle timeout and by the request timeout
+    std::atomic<uint64_t> idle_timeouts{ 0 };
+    std::atomic<uint64_t> request_timeouts{ 0 };
+};
+
+// @brief Nanoseconds on the monotonic clock, what latencies are measured with
+inline uint64_t monotonicNs () {
+    timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t> (now.tv_sec) * 1000000000 + static_cast<uint64_t> (now.tv_nsec);
+}
+
+/**
+ * @brief Counter written by a single thread and read by any. Adding is a
+ * plain load and store (no locked instruction), readers still never see a
+ * torn value.
+ */
+class Counter {
+    public:
+    void add (uint64_t p_Value = 1) {
+        m_Value.store (m_Value.load (std::memory_order_relaxed) + p_Value, std::memory_order_relaxed);
+    }
+
+    uint64_t get () const {
+        return m_Value.load (std::memory_order_relaxed);
+    }
+
+    private:
+    std::atomic<uint64_t> m_Value{ 0 };
+};
+
+/**
+ * @brief Histogram of latencies in nanoseconds with log-linear buckets (as
+ * HdrHistogram has them): every power of two is split into SUB_BUCKETS
+ * buckets of equal width, so any value is known to within 1/SUB_BUCKETS of
+ * itself, from nanoseconds up to minutes, in a few KiB. Recorded into by a
+ * single thread, like a Counter.
+ */
+class LatencyHistogram {
+    public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr unsigned SUB_BUCKETS     = 1 << SUB_BUCKET_BITS;
+
+    // @brief Values up to 2^MAX_BITS ns (about 18 minutes), larger ones are
+    // counted in the last bucket
+    static constexpr unsigned MAX_BITS = 40;
+
+    static constexpr size_t BUCKET_COUNT = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record (uint64_t p_Ns) {
+        m_Buckets[bucketIndex (p_Ns)].add ();
+        m_Count.add ();
+        m_Sum.add (p_Ns);
+    }
+
+    // @brief Bucket p_Ns is counted in. Values below SUB_BUCKETS * 2 have a
+    // bucket each, above that the top SUB_BUCKET_BITS + 1 bits pick it.
+    static size_t bucketIndex (uint64_t p_Ns) {
+        if (p_Ns < 2 * SUB_BUCKETS)
+            return static_cast<size_t> (p_Ns);
+        if (p_Ns >= (uint64_t{ 1 } << MAX_BITS))
+            return BUCKET_COUNT - 1;
+        unsigned shift = std::bit_width (p_Ns) - 1 - SUB_BUCKET_BITS;
+        return shift * SUB_BUCKETS + static_cast<size_t> (p_Ns >> shift);
+    }
+
+    // @brief Smallest value counted in bucket p_Index (the next bucket's is
+    // the end of its range)
+    static uint64_t bucketStart (size_t p_Index) {
+        if (p_Index < 2 * SUB_BUCKETS)
+            return p_Index;
+        unsigned shift = static_cast<unsigned> (p_Index / SUB_BUCKETS) - 1;
+        return (p_Index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    uint64_t getBucket (size_t p_Index) const {
+        return m_Buckets[p_Index].get ();
+    }
+
+    // @brief Number of values recorded
+    uint64_t getCount () const {
+        return m_Count.get ();
+    }
+
+    // @brief Sum of the values recorded (ns)
+    uint64_t getSum () const {
+        return m_Sum.get ();
+    }
+
+    private:
+    std::array<Counter, BUCKET_COUNT> m_Buckets;
+    Counter m_Count;
+    Counter m_Sum;
+};
+
+// @brief What the latency of a request is split into
+enum class Phase {
+    PARSE, // reading the request out of the received bytes
+    FILE,  // finding the file (in the cache or on disk) and building the response
+    SEND,  // from the response being queued until the socket took all of it
+};
+
+/**
+ * @brief Everything one worker counts. Only the worker writes to it, and it
+ * starts on a cache line of its own, so recording never contends with other
+ * workers or with a scrape.
+ */
+struct alignas (64) WorkerMetrics {
+    // @brief Status codes the server answers with, anything else is counted
+    // as "other"
+    static constexpr std::array<int, 10> STATUS_CODES = { 200, 206, 301, 304, 400, 404, 413, 416, 431, 501 };
+
+    // @brief Methods counted by name, anything else is counted as "other"
+    static constexpr std::array<std::string_view, 3> METHODS = { "GET", "HEAD", "POST" };
+
+    static constexpr size_t PHASE_COUNT = 3;
+
+    std::array<Counter, STATUS_CODES.size () + 1> requests_by_status;
+    std::array<Counter, METHODS.size () + 1> requests_by_method;
+
+    Counter bytes_received;
+    Counter bytes_sent;
+
+    // @brief accept() failed (other than the client giving up first)
+    Counter accept_errors;
+
+    std::array<LatencyHistogram, PHASE_COUNT> latencies;
+
+    // @brief Counts a request answered with p_StatusCode
+    void countRequest (std::string_view p_Method, int p_StatusCode);
+
+    void recordLatency (Phase p_Phase, uint64_t p_Ns) {
+        latencies[static_cast<size_t> (p_Phase)].record (p_Ns);
+    }
+};
+
+/**
+ * @brief Gathers the WorkerMetrics of every worker, the ConnectionStats and
+ * the counters of the file cache, and renders their sum in the Prometheus
+ * text format. Workers keep recording while it renders, so a scrape is a
+ * (slightly smeared) snapshot, never a stop of the world.
+ */
+class Metrics {
+    public:
+    /**
+     * @param p_ConnectionStats Counters shared by the workers
+     * @param p_FileCache Cache whose counters are rendered too, nullptr if
+     * disabled
+     */
+    Metrics (const ConnectionStats& p_ConnectionStats, FileCache* p_FileCache = nullptr);
+
+    Metrics (const Metrics&)            = delete;
+    Metrics& operator= (const Metrics&) = delete;
+
+    // @brief Counters for a new worker, valid as long as this object
+    WorkerMetrics& addWorker ();
+
+    // @brief Appends every metric to p_Out (text format version 0.0.4)
+    void render (std::string& p_Out);
+
+    // @brief Content-Type of what render() produces
+    static constexpr std::string_view CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+    private:
+    const ConnectionStats& m_ConnectionStats;
+    FileCache* m_FileCache;
+
+    // @brief Guards m_Workers, which only grows while the workers are made
+    std::mutex m_WorkersMutex;
+    std::vector<std::unique_ptr<WorkerMetrics>> m_Workers;
+};
+
+} // namespace ccerve
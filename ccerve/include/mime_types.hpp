@@ -0,0 +1,211 @@
+#pragma once
+
+/**
+ * @file mime_types.hpp
+ * @brief Holds the table of served file types and its lookup by extension.
+ * The lookup goes through a perfect hash computed at compile time: one hash,
+ * one slot, one string compare, no allocation.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace ccerve {
+namespace mime {
+
+// @brief How long clients may reuse a file without asking the server again
+enum class CachePolicy : uint8_t {
+    REVALIDATE, // documents which change in place (html, json, ...)
+    SHORT,      // assets referenced by documents (css, js, ...)
+    LONG,       // media and fonts, which rarely change
+};
+
+// @brief Everything the server needs to know about a type of file
+struct MimeType {
+    // @brief Lower case, without the dot
+    std::string_view extension;
+
+    // @brief Value of the Content-Type header
+    std::string_view type;
+
+    bool binary;
+
+    // @brief Whether gzip / brotli shrink it noticeably
+    bool compressible;
+
+    CachePolicy cache_policy;
+};
+
+// clang-format off
+static constexpr std::array MIME_TYPES = {
+    // documents
+    MimeType{ "html",        "text/html",                     false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "htm",         "text/html",                     false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "txt",         "text/plain",                    false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "md",          "text/markdown",                 false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "csv",         "text/csv",                      false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "xml",         "application/xml",               false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "json",        "application/json",              false, true,  CachePolicy::REVALIDATE },
+    MimeType{ "pdf",         "application/pdf",               true,  false, CachePolicy::REVALIDATE },
+    // assets
+    MimeType{ "css",         "text/css",                      false, true,  CachePolicy::SHORT },
+    MimeType{ "js",          "text/javascript",               false, true,  CachePolicy::SHORT },
+    MimeType{ "mjs",         "text/javascript",               false, true,  CachePolicy::SHORT },
+    MimeType{ "map",         "application/json",              false, true,  CachePolicy::SHORT },
+    MimeType{ "wasm",        "application/wasm",              true,  true,  CachePolicy::SHORT },
+    MimeType{ "webmanifest", "application/manifest+json",     false, true,  CachePolicy::SHORT },
+    // images
+    MimeType{ "svg",         "image/svg+xml",                 false, true,  CachePolicy::LONG },
+    MimeType{ "png",         "image/png",                     true,  false, CachePolicy::LONG },
+    MimeType{ "jpg",         "image/jpeg",                    true,  false, CachePolicy::LONG },
+    MimeType{ "jpeg",        "image/jpeg",                    true,  false, CachePolicy::LONG },
+    MimeType{ "gif",         "image/gif",                     true,  false, CachePolicy::LONG },
+    MimeType{ "webp",        "image/webp",                    true,  false, CachePolicy::LONG },
+    MimeType{ "avif",        "image/avif",                    true,  false, CachePolicy::LONG },
+    MimeType{ "ico",         "image/x-icon",                  true,  true,  CachePolicy::LONG },
+    MimeType{ "bmp",         "image/bmp",                     true,  true,  CachePolicy::LONG },
+    // fonts
+    MimeType{ "woff",        "font/woff",                     true,  false, CachePolicy::LONG },
+    MimeType{ "woff2",       "font/woff2",                    true,  false, CachePolicy::LONG },
+    MimeType{ "ttf",         "font/ttf",                      true,  true,  CachePolicy::LONG },
+    MimeType{ "otf",         "font/otf",                      true,  true,  CachePolicy::LONG },
+    MimeType{ "eot",         "application/vnd.ms-fontobject", true,  true,  CachePolicy::LONG },
+    // audio / video
+    MimeType{ "mp3",         "audio/mpeg",                    true,  false, CachePolicy::LONG },
+    MimeType{ "ogg",         "audio/ogg",                     true,  false, CachePolicy::LONG },
+    MimeType{ "wav",         "audio/wav",                     true,  true,  CachePolicy::LONG },
+    MimeType{ "mp4",         "video/mp4",                     true,  false, CachePolicy::LONG },
+    MimeType{ "webm",        "video/webm",                    true,  false, CachePolicy::LONG },
+    MimeType{ "ogv",         "video/ogg",                     true,  false, CachePolicy::LONG },
+    // archives
+    MimeType{ "zip",         "application/zip",               true,  false, CachePolicy::LONG },
+    MimeType{ "gz",          "application/gzip",              true,  false, CachePolicy::LONG },
+};
+// clang-format on
+
+// @brief Value of the Cache-Control header of files with a policy
+constexpr auto cacheControl (CachePolicy policy) -> std::string_view {
+    switch (policy) {
+    case CachePolicy::SHORT:
+        return "public, max-age=3600";
+    case CachePolicy::LONG:
+        return "public, max-age=604800";
+    case CachePolicy::REVALIDATE:
+        break;
+    }
+    // may be stored, but is checked with the server before every use
+    return "no-cache";
+}
+
+namespace detail {
+
+// @brief Number of slots of the hash table (a power of 2 a few times larger
+// than MIME_TYPES, so a collision free seed is found quickly)
+static constexpr unsigned SLOT_BITS = 7;
+static constexpr size_t SLOT_COUNT  = size_t (1) << SLOT_BITS;
+static constexpr uint8_t EMPTY_SLOT = 0xff;
+
+static_assert (MIME_TYPES.size () < EMPTY_SLOT && MIME_TYPES.size () * 2 < SLOT_COUNT);
+
+constexpr auto toLower (char character) -> char {
+    return (character >= 'A' && character <= 'Z') ? character - 'A' + 'a' : character;
+}
+
+// @brief FNV-1a of the lower case extension
+constexpr auto hashExtension (std::string_view extension) -> uint64_t {
+    uint64_t hash = 14695981039346656037ull;
+    for (char character : extension) {
+        hash ^= static_cast<uint8_t> (toLower (character));
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// @brief Slot of extension for a seed (multiply-shift takes the well mixed
+// high bits)
+constexpr auto slotOf (std::string_view extension, uint64_t seed) -> size_t {
+    return ((hashExtension (extension) ^ seed) * 0x9e3779b97f4a7c15ull) >> (64 - SLOT_BITS);
+}
+
+struct PerfectHash {
+    bool found    = false;
+    uint64_t seed = 0;
+
+    // @brief Index into MIME_TYPES of the extension in each slot
+    std::array<uint8_t, SLOT_COUNT> slots{};
+};
+
+// @brief Tries seeds until every extension gets a slot of its own
+constexpr auto buildPerfectHash () -> PerfectHash {
+    for (uint64_t seed = 0; seed < 100000; seed++) {
+        PerfectHash perfect_hash{ true, seed, {} };
+        perfect_hash.slots.fill (EMPTY_SLOT);
+
+        bool collision = false;
+        for (size_t i = 0; i < MIME_TYPES.size () && !collision; i++) {
+            uint8_t& slot = perfect_hash.slots[slotOf (MIME_TYPES[i].extension, seed)];
+            collision     = slot != EMPTY_SLOT;
+            slot          = static_cast<uint8_t> (i);
+        }
+        if (!collision)
+            return perfect_hash;
+    }
+    return PerfectHash{};
+}
+
+static constexpr PerfectHash PERFECT_HASH = buildPerfectHash ();
+
+static_assert (PERFECT_HASH.found, "no perfect hash for MIME_TYPES found");
+
+} // namespace detail
+
+/**
+ * @brief Finds the type of files with an extension (case insensitive)
+ * @param  extension Without the dot
+ * @return the type, nullptr if files of this type aren't served
+ */
+constexpr auto findByExtension (std::string_view extension) -> const MimeType* {
+    const uint8_t index = detail::PERFECT_HASH.slots[detail::slotOf (extension, detail::PERFECT_HASH.seed)];
+    if (index == detail::EMPTY_SLOT)
+        return nullptr;
+
+    std::string_view candidate = MIME_TYPES[index].extension;
+    if (candidate.size () != extension.size ())
+        return nullptr;
+    for (size_t i = 0; i < extension.size (); i++) {
+        if (detail::toLower (extension[i]) != candidate[i])
+            return nullptr;
+    }
+    return &MIME_TYPES[index];
+}
+
+/**
+ * @brief Finds the type of a file from the extension of its name
+ * @return the type, nullptr if the file has no extension (hidden files like
+ * ".profile" don't count) or files of its type aren't served
+ */
+constexpr auto findByPath (std::string_view path) -> const MimeType* {
+    // one pass from the end, which stops at the first dot or slash
+    for (size_t i = path.size (); i-- > 0;) {
+        if (path[i] == '/')
+            return nullptr;
+        if (path[i] == '.') {
+            if (i == 0 || path[i - 1] == '/')
+                return nullptr;
+            return findByExtension (path.substr (i + 1));
+        }
+    }
+    return nullptr;
+}
+
+static_assert (findByExtension ("html")->type == "text/html");
+static_assert (findByExtension ("WOFF2")->type == "font/woff2");
+static_assert (findByPath ("./a/b.min.js")->type == "text/javascript");
+static_assert (findByPath ("./.profile") == nullptr && findByPath ("./README") == nullptr);
+static_assert (findByPath ("./a.d/README") == nullptr && findByPath (".profile") == nullptr);
+static_assert (findByExtension ("exe") == nullptr);
+
+} // namespace mime
+} // namespace ccerve
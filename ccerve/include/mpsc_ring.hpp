@@ -0,0 +1,144 @@
+#pragma once
+
+/**
+ * @file mpsc_ring.hpp
+ * @brief Holds the MpscRing class, the bounded lock-free queue between the
+ * threads which log and the thread writing the logs.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace ccerve {
+
+/**
+ * @brief Bounded lock-free queue of preallocated slots (Vyukov's bounded
+ * queue). Each slot carries a sequence number telling whether it is free for
+ * the producer of a given position or filled for the consumer of it, so a
+ * push or pop is one CAS on the position plus one store to the slot. Nothing
+ * is allocated after construction and no thread ever waits for a lock.
+ *
+ * Meant for many producers and one consumer, but popping is safe from any
+ * thread: a producer may pop the oldest entry to make room for its own.
+ * @tparam T Type of the entries, must be default constructible and move-able
+ */
+template <typename T> class MpscRing {
+    public:
+    // @brief Size of a cache line, positions and slots are kept apart by it
+    static constexpr size_t CACHE_LINE = 64;
+
+    // @param p_Capacity Number of slots, rounded up to a power of two
+    explicit MpscRing (size_t p_Capacity)
+    : m_Mask (std::bit_ceil (std::max<size_t> (p_Capacity, 2)) - 1),
+      m_Slots (std::make_unique<Slot[]> (m_Mask + 1)) {
+        for (size_t i = 0; i <= m_Mask; i++)
+            m_Slots[i].sequence.store (i, std::memory_order_relaxed);
+    }
+
+    MpscRing (const MpscRing&)            = delete;
+    MpscRing& operator= (const MpscRing&) = delete;
+
+    size_t getCapacity () const {
+        return m_Mask + 1;
+    }
+
+    /**
+     * @brief Appends p_Value (moved from only on success)
+     * @return false if the ring is full
+     */
+    bool tryPush (T& p_Value) {
+        return tryEmplace ([&p_Value] (T& p_Slot) { p_Slot = std::move (p_Value); });
+    }
+
+    /**
+     * @brief Takes the oldest entry
+     * @return false if the ring is empty
+     */
+    bool tryPop (T& p_Value) {
+        return tryConsume ([&p_Value] (T& p_Slot) { p_Value = std::move (p_Slot); });
+    }
+
+    /**
+     * @brief Appends an entry by letting p_Fill write it straight into a
+     * claimed slot (which still holds what an earlier entry left behind), so
+     * a large entry isn't copied in. Consumers wait for the slot until p_Fill
+     * returns, it should be short.
+     * @return false if the ring is full (p_Fill isn't called)
+     */
+    template <typename Fill> bool tryEmplace (Fill&& p_Fill) {
+        size_t position = m_PushPosition.load (std::memory_order_relaxed);
+        while (true) {
+            Slot& slot      = m_Slots[position & m_Mask];
+            size_t sequence = slot.sequence.load (std::memory_order_acquire);
+            ptrdiff_t lag   = static_cast<ptrdiff_t> (sequence - position);
+            if (lag == 0) {
+                // the slot is free for this position, claim it
+                if (m_PushPosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) {
+                    p_Fill (slot.value);
+                    slot.sequence.store (position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                // the slot still holds the entry of the previous lap
+                return false;
+            } else {
+                // another producer claimed the position first
+                position = m_PushPosition.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Hands the oldest entry to p_Consume in its slot, the slot is
+     * only reused after p_Consume returns
+     * @return false if the ring is empty (p_Consume isn't called)
+     */
+    template <typename Consume> bool tryConsume (Consume&& p_Consume) {
+        size_t position = m_PopPosition.load (std::memory_order_relaxed);
+        while (true) {
+            Slot& slot      = m_Slots[position & m_Mask];
+            size_t sequence = slot.sequence.load (std::memory_order_acquire);
+            ptrdiff_t lag   = static_cast<ptrdiff_t> (sequence - (position + 1));
+            if (lag == 0) {
+                if (m_PopPosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed)) {
+                    p_Consume (slot.value);
+                    // free the slot for the producer of the next lap
+                    slot.sequence.store (position + m_Mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                // nothing was pushed to this position yet
+                return false;
+            } else {
+                position = m_PopPosition.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // @brief Whether no entry is waiting (exact only if nothing is pushed or
+    // popped meanwhile)
+    bool empty () const {
+        size_t position = m_PopPosition.load (std::memory_order_acquire);
+        return m_Slots[position & m_Mask].sequence.load (std::memory_order_acquire) != position + 1;
+    }
+
+    private:
+    struct alignas (CACHE_LINE) Slot {
+        std::atomic<size_t> sequence{ 0 };
+        T value{};
+    };
+
+    const size_t m_Mask;
+    std::unique_ptr<Slot[]> m_Slots;
+
+    // @brief Next position to push to and to pop from. On separate cache
+    // lines, producers and the consumer don't invalidate each other's.
+    alignas (CACHE_LINE) std::atomic<size_t> m_PushPosition{ 0 };
+    alignas (CACHE_LINE) std::atomic<size_t> m_PopPosition{ 0 };
+};
+
+} // namespace ccerve
@@ -0,0 +1,277 @@
+#pragma once
+
+/**
+ * @file reactor.hpp
+ * @brief Holds the declaration of the Reactor class, which lets coroutines
+ * await system calls on non-blocking descriptors and timers on top of an
+ * EventLoop.
+ */
+
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+#include <span>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "event_loop.hpp"
+
+namespace ccerve {
+namespace coro {
+
+// @brief What an operation waits for its descriptor to become
+enum class Interest : uint8_t {
+    READABLE,
+    WRITABLE,
+};
+
+/**
+ * @brief A system call a coroutine waits for. The reactor makes it again
+ * whenever its descriptor becomes ready, until it doesn't block anymore.
+ */
+struct Operation {
+    // @brief What the system call returned, -errno if it failed
+    ssize_t result = 0;
+
+    // @brief Coroutine resumed once result is set
+    std::coroutine_handle<> waiter;
+
+    // @brief Makes the system call once, false if it would block
+    bool (*attempt) (Operation& p_Operation) = nullptr;
+};
+
+/**
+ * @brief Runs coroutines waiting for I/O on an edge-triggered EventLoop, like
+ * the callbacks of EpollWorker but written as sequential code:
+ *
+ *     ssize_t received = co_await reactor.recv (sock, buffer, size);
+ *
+ * An operation first makes its system call right away and only suspends if
+ * it would block, so a socket with data waiting costs what calling recv()
+ * does. A suspended operation is made again (and its coroutine resumed) when
+ * its descriptor becomes ready. Awaiting costs no allocation: the operation
+ * lives in the awaiting coroutine's frame.
+ *
+ * Only one operation per direction may wait on a descriptor at a time. Not
+ * thread safe, every coroutine runs on the thread calling poll().
+ */
+class Reactor {
+    public:
+    /**
+     * @param p_MaxEvents Maximum number of events handled by a single poll()
+     * Can throw EventLoopCreationFailure.
+     */
+    explicit Reactor (size_t p_MaxEvents = 1024);
+
+    // @brief Destroys the coroutines still asleep. Everything else must be
+    // resumed (or done) by then.
+    ~Reactor ();
+
+    Reactor (const Reactor&)            = delete;
+    Reactor& operator= (const Reactor&) = delete;
+
+    // @brief Starts watching p_Fd (non-blocking) for both directions
+    bool watch (int p_Fd);
+
+    /**
+     * @brief Stops watching p_Fd, before it is closed. Operations waiting on
+     * it complete with -ECANCELED: their coroutines are resumed by the next
+     * poll().
+     */
+    void unwatch (int p_Fd);
+
+    // @brief Queues p_Handle to be resumed by the next poll(), which then
+    // doesn't wait for I/O
+    void post (std::coroutine_handle<> p_Handle);
+
+    /**
+     * @brief Waits until an operation can go on, a sleeper is due or
+     * p_TimeoutMs passed (-1 for no timeout), then resumes every coroutine
+     * which may go on: those whose operation completed, the due sleepers and
+     * the posted ones
+     * @return false if waiting failed
+     */
+    bool poll (int p_TimeoutMs = -1);
+
+    /**
+     * @brief Awaitable system call on p_Fd: resumes the awaiter with what
+     * p_Call returned (-errno if it failed), trying again whenever p_Fd
+     * becomes ready while it would block
+     */
+    template <typename Call> class IoAwaiter : private Operation {
+        public:
+        IoAwaiter (Reactor& p_Reactor, int p_Fd, Interest p_Interest, Call p_Call)
+        : m_Reactor (p_Reactor), m_Fd (p_Fd), m_Interest (p_Interest), m_Call (p_Call) {
+            attempt = &attemptCall;
+        }
+
+        bool await_ready () {
+            return attemptCall (*this);
+        }
+
+        bool await_suspend (std::coroutine_handle<> p_Awaiter) {
+            waiter = p_Awaiter;
+            if (m_Reactor.park (m_Fd, m_Interest, *this))
+                return true;
+            // not watched, e.g. unwatched while the coroutine was running
+            result = -EBADF;
+            return false;
+        }
+
+        ssize_t await_resume () const {
+            return result;
+        }
+
+        private:
+        Reactor& m_Reactor;
+        int m_Fd;
+        Interest m_Interest;
+        Call m_Call;
+
+        static bool attemptCall (Operation& p_Operation) {
+            auto& self = static_cast<IoAwaiter&> (p_Operation);
+            while (true) {
+                ssize_t ret = self.m_Call ();
+                if (ret >= 0) {
+                    self.result = ret;
+                    return true;
+                }
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return false;
+                self.result = -errno;
+                return true;
+            }
+        }
+    };
+
+    // @brief Awaitable recv(): bytes received, 0 once the peer closed
+    auto recv (int p_Fd, void* p_Buffer, size_t p_Length) {
+        return IoAwaiter (*this, p_Fd, Interest::READABLE,
+        [=] { return ::recv (p_Fd, p_Buffer, p_Length, 0); });
+    }
+
+    // @brief Awaitable read() (e.g. of an eventfd)
+    auto read (int p_Fd, void* p_Buffer, size_t p_Length) {
+        return IoAwaiter (*this, p_Fd, Interest::READABLE, [=] { return ::read (p_Fd, p_Buffer, p_Length); });
+    }
+
+    // @brief Awaitable sendmsg() of the gathered p_Iov: bytes sent
+    auto send (int p_Fd, std::span<const iovec> p_Iov, int p_Flags = 0) {
+        return IoAwaiter (*this, p_Fd, Interest::WRITABLE, [=] {
+            msghdr msg{};
+            msg.msg_iov    = const_cast<iovec*> (p_Iov.data ());
+            msg.msg_iovlen = p_Iov.size ();
+            return ::sendmsg (p_Fd, &msg, p_Flags | MSG_NOSIGNAL);
+        });
+    }
+
+    // @brief Awaitable sendfile() of p_Count bytes of p_FileFd from
+    // p_Offset: bytes sent, 0 if the file ends before p_Offset
+    auto sendfile (int p_Fd, int p_FileFd, off_t p_Offset, size_t p_Count) {
+        return IoAwaiter (*this, p_Fd, Interest::WRITABLE, [=] {
+            off_t offset = p_Offset;
+            return ::sendfile (p_Fd, p_FileFd, &offset, p_Count);
+        });
+    }
+
+    // @brief Awaitable accept4() of a non-blocking, close-on-exec socket:
+    // its descriptor, p_Address receives the peer's address
+    auto accept (int p_Fd, sockaddr_in& p_Address) {
+        return IoAwaiter (*this, p_Fd, Interest::READABLE, [p_Fd, &p_Address] {
+            socklen_t length = sizeof (p_Address);
+            return static_cast<ssize_t> (
+            ::accept4 (p_Fd, reinterpret_cast<sockaddr*> (&p_Address), &length, SOCK_NONBLOCK | SOCK_CLOEXEC));
+        });
+    }
+
+    // @brief Awaitable which resumes its awaiter after p_Ms milliseconds
+    // (or later). It can't be canceled.
+    class SleepAwaiter {
+        public:
+        SleepAwaiter (Reactor& p_Reactor, unsigned p_Ms) : m_Reactor (p_Reactor), m_Ms (p_Ms) {
+        }
+
+        bool await_ready () const {
+            return m_Ms == 0;
+        }
+
+        void await_suspend (std::coroutine_handle<> p_Awaiter) {
+            m_Reactor.addSleeper (m_Ms, p_Awaiter);
+        }
+
+        void await_resume () const {
+        }
+
+        private:
+        Reactor& m_Reactor;
+        unsigned m_Ms;
+    };
+
+    SleepAwaiter sleep (unsigned p_Ms) {
+        return SleepAwaiter (*this, p_Ms);
+    }
+
+    private:
+    // @brief Operations waiting on a descriptor
+    struct Waiters {
+        bool watched        = false;
+        Operation* readable = nullptr;
+        Operation* writable = nullptr;
+    };
+
+    struct Sleeper {
+        // @brief When it is due (steady clock, ns)
+        uint64_t due;
+        std::coroutine_handle<> handle;
+    };
+
+    EventLoop m_EventLoop;
+
+    // @brief Indexed by descriptor: they are small and reused, so this only
+    // grows up to the largest one open at a time
+    std::vector<Waiters> m_Waiters;
+
+    // @brief Coroutines resumed by the next poll(), and the ones being
+    // resumed (both keep their capacity)
+    std::vector<std::coroutine_handle<>> m_Posted;
+    std::vector<std::coroutine_handle<>> m_Resuming;
+
+    // @brief Min-heap by due time
+    std::vector<Sleeper> m_Sleepers;
+
+    // @brief Waiters of p_Fd, nullptr if it isn't watched
+    Waiters* findWaiters (int p_Fd) {
+        if (p_Fd < 0 || static_cast<size_t> (p_Fd) >= m_Waiters.size () || !m_Waiters[p_Fd].watched)
+            return nullptr;
+        return &m_Waiters[p_Fd];
+    }
+
+    /**
+     * @brief Makes p_Operation wait until p_Fd becomes ready for p_Interest
+     * @return false if p_Fd isn't watched
+     */
+    bool park (int p_Fd, Interest p_Interest, Operation& p_Operation);
+
+    // @brief Makes the operation waiting on p_Fd for p_Interest again and
+    // resumes its coroutine if it completed
+    void complete (int p_Fd, Interest p_Interest);
+
+    void addSleeper (unsigned p_Ms, std::coroutine_handle<> p_Handle);
+
+    // @brief Orders the heap of sleepers so the first one due is at its front
+    static bool isDueLater (const Sleeper& p_Left, const Sleeper& p_Right);
+
+    // @brief Milliseconds until the first sleeper is due (rounded up), -1 if
+    // there is none
+    int getSleepMs () const;
+};
+
+} // namespace coro
+} // namespace ccerve
@@ -0,0 +1,111 @@
+#pragma once
+
+/**
+ * @file server_config.hpp
+ * @brief Holds the ServerConfig struct which gathers every option the server
+ * can be started with.
+ */
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace ccerve {
+
+// @brief How the workers wait for and perform socket I/O
+enum class IoBackend {
+    EPOLL,     // non-blocking sockets + edge-triggered epoll
+    IO_URING,  // io_uring (Linux 6.0+), falls back to epoll if unavailable
+    COROUTINE, // a coroutine per connection, awaiting epoll readiness
+};
+
+// @brief Limits which keep slow, idle or too many clients from tying up the
+// workers
+struct ConnectionLimits {
+    // @brief A connection waiting for its next request, or not taking the
+    // response it is sent, is closed after this long
+    unsigned idle_timeout_ms = 15000;
+
+    // @brief A request must be received completely within this long of its
+    // first byte (a client dripping it in byte by byte doesn't extend it)
+    unsigned request_timeout_ms = 10000;
+
+    // @brief A connection is closed after this many requests, 0 for no limit
+    size_t max_requests = 1000;
+
+    // @brief Connections open at the same time over all workers. Further ones
+    // are closed right after they are accepted. 0 for no limit.
+    size_t max_connections = 10000;
+};
+
+// @brief Options the HttpServer is started with. Defaults match running
+// ./cerve without any arguments.
+struct ServerConfig {
+    // @brief Address the server sockets are bound to
+    std::string ip_address = "127.0.0.1";
+
+    // @brief Port the server sockets are bound to
+    int port = 8000;
+
+    // @brief Number of worker threads. Each one owns a listening socket bound
+    // to the same address (SO_REUSEPORT) and an event loop.
+    size_t workers = 1;
+
+    // @brief I/O backend every worker uses
+    IoBackend backend = IoBackend::EPOLL;
+
+    // @brief Memory budget (bytes) of the file cache, 0 disables it
+    size_t cache_size = 64 * 1024 * 1024;
+
+    // @brief Larger files aren't cached but sent from disk with sendfile
+    size_t cache_max_file_size = 1024 * 1024;
+
+    // @brief Compress cached files in the background and keep the result in
+    // the cache (sidecar files like "a.css.br" are served in any case)
+    bool compress = false;
+
+    // @brief Answer directories without an index.html with a listing of
+    // their entries (like python's http.server) instead of a 404
+    bool directory_listings = true;
+
+    // @brief Memory budget (bytes) of the cached directory listings
+    size_t listing_cache_size = 16 * 1024 * 1024;
+
+    // @brief Threads shared by the workers which answer the requests that
+    // need the disk (files not in the file cache, directories), so a slow
+    // disk doesn't hold up the requests a worker can answer from memory. 0
+    // to answer every request on the worker's thread.
+    size_t file_threads = 4;
+
+    ConnectionLimits limits;
+
+    // @brief After SIGTERM or SIGINT (or after handing over to a new server)
+    // the open connections get this long to finish, the ones left are
+    // closed. 0 to wait for them however long they take.
+    unsigned drain_timeout_ms = 10000;
+
+    // @brief Command line a SIGUSR2 starts the server's replacement with
+    // (usually the one it was started with, so a new binary at the same path
+    // takes over). Empty to ignore SIGUSR2.
+    std::vector<std::string> upgrade_command;
+
+    // @brief Path the server's counters and latency histograms are served at
+    // in the Prometheus text format (e.g. "/metrics"), empty to not serve
+    // them. It hides a file of the same name.
+    std::string metrics_path;
+
+    // @brief What a thread does when it logs while the log queue is full
+    log::FullQueuePolicy log_full_policy = log::FullQueuePolicy::BLOCK;
+
+    // @brief When log messages held back by the log file are written to it
+    log::FlushPolicy log_flush;
+
+    // @brief Write the log file as memory-mapped segments which are rotated
+    // according to log_rotation, instead of one growing file
+    bool log_rotate = false;
+    sinks::RotationPolicy log_rotation;
+};
+
+} // namespace ccerve
@@ -6,13 +6,19 @@
  * resources to which the logs are written.
  */
 
+#include <condition_variable>
+#include <ctime>
 #include <exception>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <span>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
+#include <sys/uio.h>
 
 namespace ccerve {
 
@@ -37,45 +43,192 @@ class BaseSink {
     public:
     // @brief writes to the appropriate resource
     virtual void write (std::string_view p_Msg);
+
+    /**
+     * @brief Writes a batch of messages, in order. The logger hands over
+     * whatever it took out of its queue at once. A sink may hold the messages
+     * back until flush() (calls write() for each message unless overridden).
+     */
+    virtual void write (std::span<const std::string> p_Msgs);
+
+    // @brief Pushes out messages held back by the sink
+    virtual void flush ();
+
     virtual ~BaseSink () = default;
 };
 
 // @brief Stdout sink
 class StdOutSink : public BaseSink {
     public:
+    using BaseSink::write;
+
     // @brief Writes to standard output
     virtual void write (std::string_view p_Msg) override;
+
+    // @brief Flushes std::cout
+    virtual void flush () override;
+
     virtual ~StdOutSink () = default;
 };
 
-// @brief Sink for files.
+/**
+ * @brief Sink for files. Messages are collected in a buffer and written with
+ * a single writev() together with the batch which flushes them (or when the
+ * buffer fills up), not one write per message.
+ */
 class FileSink : public BaseSink {
     public:
     /**
      * @brief Constructor for FileSink class.
      * @param p_Path The path of the log file. If the path and file do not
      * exist, they will be created.
+     * @param p_Append Append to the file instead of emptying it, e.g. while
+     * the server this one took over from is still writing it
      */
-    FileSink (std::string_view p_Path);
+    FileSink (std::string_view p_Path, bool p_Append = false);
 
-    // @brief Destructor for FileSink class. (This closes the file if is open)
+    // @brief Destructor for FileSink class. (This flushes and closes the
+    // file if is open)
     virtual ~FileSink ();
 
     // @brief Writes to file associated with the sink
     virtual void write (std::string_view p_Msg) override;
 
+    // @brief Buffers the messages, writes them if the buffer is full
+    virtual void write (std::span<const std::string> p_Msgs) override;
+
+    // @brief Writes the buffered messages to the file
+    virtual void flush () override;
+
+    // @brief The buffer is written out once it holds this many bytes
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
     // @brief Vector of all paths
     static std::vector<std::string_view> FileSinks;
 
     private:
-    // @brief The file to which the messages will be written
-    std::ofstream m_File;
+    // @brief The file to which the messages will be written, -1 if it
+    // couldn't be opened
+    int m_File = -1;
+
+    // @brief Messages written to the sink but not to the file yet
+    std::string m_Buffer;
+
+    // @brief Pieces of the last writev(), kept to reuse their memory
+    std::vector<iovec> m_Pieces;
 
     // @brief The name of the file
     std::string m_FilePath;
 
     // @brief Mutex to protect file writes
     std::mutex m_FileMutex;
+
+    // @brief Writes m_Buffer followed by p_Msgs with as few writev() calls
+    // as possible (one unless there are more than IOV_MAX pieces), empties
+    // m_Buffer
+    void writeOut (std::span<const std::string> p_Msgs);
+};
+
+// @brief When a RotatingFileSink starts a new segment and what it keeps
+struct RotationPolicy {
+    // @brief Size of a segment. It is created this large (padded with zero
+    // bytes until it is rotated) and mapped into memory.
+    size_t segment_size = 64 * 1024 * 1024;
+
+    // @brief A segment this old is rotated at the next write, 0 to rotate by
+    // size only
+    unsigned max_age_s = 0;
+
+    // @brief Name rotated segments after the time they were rotated
+    // ("log.txt.20261017-230512") instead of numbering them ("log.txt.1" is
+    // the newest)
+    bool dated_names = false;
+
+    // @brief Rotated segments kept, older ones are deleted
+    size_t retention = 10;
+
+    // @brief How often the written part of the segment is synced to disk in
+    // the background, 0 to leave that to the kernel
+    unsigned sync_interval_ms = 1000;
+};
+
+/**
+ * @brief Sink for high-volume logs. It writes into a memory-mapped segment
+ * file of a fixed size, so writing a message is a memcpy and no system call.
+ * A full (or old) segment is trimmed to what was written and renamed, and the
+ * next one is started under the sink's path. A background thread syncs the
+ * written part to disk now and then.
+ */
+class RotatingFileSink : public BaseSink {
+    public:
+    /**
+     * @param p_Path Path of the segment being written. Directories are
+     * created. A file left there (e.g. by a crash) is rotated first.
+     * @param p_Shared The file left there is still written by the server
+     * this one took over from. It is rotated as it is, its writer trims it.
+     */
+    RotatingFileSink (std::string_view p_Path, const RotationPolicy& p_Policy = {}, bool p_Shared = false);
+
+    // @brief Trims the current segment to what was written and stops syncing
+    virtual ~RotatingFileSink ();
+
+    // @brief Copies the message into the segment
+    virtual void write (std::string_view p_Msg) override;
+
+    // @brief Copies the messages into the segment
+    virtual void write (std::span<const std::string> p_Msgs) override;
+
+    private:
+    // @brief A mapped segment file. The sync thread may keep it alive for a
+    // moment after it was rotated.
+    struct Segment {
+        int fd      = -1;
+        char* data  = nullptr;
+        size_t size = 0;
+
+        ~Segment ();
+    };
+
+    std::string m_Path;
+    RotationPolicy m_Policy;
+
+    // @brief Segment being written, nullptr if it couldn't be created
+    std::shared_ptr<Segment> m_Segment;
+
+    // @brief Bytes written to and synced of m_Segment
+    size_t m_Used   = 0;
+    size_t m_Synced = 0;
+
+    // @brief When m_Segment was started
+    time_t m_StartTime = 0;
+
+    // @brief Protects everything above
+    std::mutex m_Mutex;
+
+    std::condition_variable m_SyncCV;
+    bool m_StopSync = false;
+    std::thread m_SyncThread;
+
+    // @brief Copies p_Msg to the segment, rotating first if it doesn't fit
+    // or is too old. Called with m_Mutex held.
+    void append (std::string_view p_Msg);
+
+    // @brief Creates, sizes and maps a new segment at m_Path
+    void openSegment ();
+
+    // @brief Trims the current segment to m_Used and unmaps it
+    void closeSegment ();
+
+    // @brief Closes the current segment, renames it and opens a new one
+    void rotate ();
+
+    // @brief Renames the file at m_Path to its rotated name and deletes
+    // segments past the retention
+    void retire ();
+
+    // @brief Runs on m_SyncThread: msync()s what was written every
+    // sync_interval_ms
+    void syncLoop ();
 };
 } // namespace sinks
 } // namespace ccerve
@@ -9,6 +9,8 @@
  * hidden within these functions.
  */
 
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <arpa/inet.h>
@@ -28,5 +30,23 @@ inline static int closeSocket (int sock) {
     return close (sock);
 }
 
+// Making sockets non-blocking
+inline static bool setNonBlocking (int sock) {
+    int flags = fcntl (sock, F_GETFL, 0);
+    return flags >= 0 && fcntl (sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Checking for bytes received but not read yet (without reading them)
+inline static bool hasUnreadData (int sock) {
+    char byte;
+    return recv (sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+}
+
+// Checking whether a failed send only means the client has gone away (reset
+// or closed its end), which isn't an error of the server
+inline static bool isPeerGone (int error) {
+    return error == EPIPE || error == ECONNRESET;
+}
+
 } // namespace sockets
 } // namespace ccerve
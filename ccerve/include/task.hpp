@@ -0,0 +1,192 @@
+#pragma once
+
+/**
+ * @file task.hpp
+ * @brief Holds the Task coroutine type and the memory coroutine frames are
+ * allocated from.
+ */
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace ccerve {
+
+/**
+ * @namespace Namespace of the coroutine runtime (Task, Reactor)
+ */
+namespace coro {
+
+namespace detail {
+// @brief Resource frames are allocated from on this thread, nullptr for the
+// global allocator
+inline thread_local std::pmr::memory_resource* t_FrameMemory = nullptr;
+} // namespace detail
+
+/**
+ * @brief Makes the frames of the coroutines started on the calling thread
+ * come from p_Memory (nullptr for the global allocator). A worker hands its
+ * pool of connection memory, so the frame of a connection's handler is a
+ * block of the pool which the next connection gets again. p_Memory must
+ * outlive the frames and isn't locked: a frame is freed where it was
+ * allocated.
+ */
+inline void setFrameMemory (std::pmr::memory_resource* p_Memory) {
+    detail::t_FrameMemory = p_Memory;
+}
+
+/**
+ * @brief Base of the promises of the runtime: allocates frames from the frame
+ * memory of the thread. The resource is stored in front of the frame, so it
+ * is freed to the same one.
+ */
+struct FramePromise {
+    static constexpr size_t HEADER_SIZE = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    static void* operator new (size_t p_Size) {
+        std::pmr::memory_resource* memory =
+        detail::t_FrameMemory ? detail::t_FrameMemory : std::pmr::new_delete_resource ();
+        auto* block = static_cast<std::byte*> (memory->allocate (p_Size + HEADER_SIZE));
+        ::new (block) std::pmr::memory_resource* (memory);
+        return block + HEADER_SIZE;
+    }
+
+    static void operator delete (void* p_Frame, size_t p_Size) {
+        auto* block = static_cast<std::byte*> (p_Frame) - HEADER_SIZE;
+        std::pmr::memory_resource* memory = *std::launder (reinterpret_cast<std::pmr::memory_resource**> (block));
+        memory->deallocate (block, p_Size + HEADER_SIZE);
+    }
+};
+
+namespace detail {
+// @brief Where a task keeps what it returns
+template <typename T> struct TaskResult {
+    std::optional<T> value;
+
+    void return_value (T p_Value) {
+        value.emplace (std::move (p_Value));
+    }
+
+    T take () {
+        return std::move (*value);
+    }
+};
+
+template <> struct TaskResult<void> {
+    void return_void () {
+    }
+
+    void take () {
+    }
+};
+} // namespace detail
+
+/**
+ * @brief Coroutine which starts when it is awaited (or detached) and resumes
+ * its awaiter once it is done, without going through a scheduler. An
+ * exception it throws is rethrown in the awaiter.
+ * @tparam T What co_return hands the awaiter
+ */
+template <typename T = void> class [[nodiscard]] Task {
+    public:
+    struct promise_type : FramePromise, detail::TaskResult<T> {
+        // @brief Coroutine awaiting the task, resumed when it is done
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+        bool detached = false;
+
+        Task get_return_object () {
+            return Task (std::coroutine_handle<promise_type>::from_promise (*this));
+        }
+
+        std::suspend_always initial_suspend () noexcept {
+            return {};
+        }
+
+        struct FinalAwaiter {
+            bool await_ready () noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend (std::coroutine_handle<promise_type> p_Handle) noexcept {
+                promise_type& promise = p_Handle.promise ();
+                if (promise.detached) {
+                    p_Handle.destroy ();
+                    return std::noop_coroutine ();
+                }
+                return promise.continuation ? promise.continuation : std::noop_coroutine ();
+            }
+
+            void await_resume () noexcept {
+            }
+        };
+
+        FinalAwaiter final_suspend () noexcept {
+            return {};
+        }
+
+        void unhandled_exception () {
+            // nobody could get it, it goes to whoever resumed the task
+            if (detached)
+                throw;
+            exception = std::current_exception ();
+        }
+    };
+
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task (Task&& p_Other) noexcept : m_Handle (std::exchange (p_Other.m_Handle, {})) {
+    }
+
+    Task& operator= (Task&& p_Other) noexcept {
+        if (this != &p_Other) {
+            if (m_Handle)
+                m_Handle.destroy ();
+            m_Handle = std::exchange (p_Other.m_Handle, {});
+        }
+        return *this;
+    }
+
+    ~Task () {
+        if (m_Handle)
+            m_Handle.destroy ();
+    }
+
+    bool await_ready () const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend (std::coroutine_handle<> p_Awaiter) noexcept {
+        m_Handle.promise ().continuation = p_Awaiter;
+        return m_Handle;
+    }
+
+    T await_resume () {
+        if (m_Handle.promise ().exception)
+            std::rethrow_exception (m_Handle.promise ().exception);
+        return m_Handle.promise ().take ();
+    }
+
+    /**
+     * @brief Runs the task up to its first suspension without anybody
+     * awaiting it. Its frame is freed once it is done.
+     */
+    void detach () && {
+        Handle handle              = std::exchange (m_Handle, {});
+        handle.promise ().detached = true;
+        handle.resume ();
+    }
+
+    private:
+    explicit Task (Handle p_Handle) : m_Handle (p_Handle) {
+    }
+
+    Handle m_Handle;
+};
+
+} // namespace coro
+} // namespace ccerve
@@ -0,0 +1,226 @@
+#pragma once
+
+/**
+ * @file timer_wheel.hpp
+ * @brief Holds the TimerWheel class which keeps the deadlines of a worker's
+ * connections.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ccerve {
+
+/**
+ * @brief Hierarchical timing wheel: LEVELS wheels of SLOT_COUNT slots, where
+ * one slot of a level spans a whole turn of the level below it. A timer is put
+ * into the level matching how far away it expires and moves down a level when
+ * the level above turns to its slot. Arming and canceling are O(1), advancing
+ * costs O(1) per tick plus the timers which expire or move down.
+ *
+ * Timers are embedded in their owner (a node of an intrusive doubly linked
+ * list), so nothing is allocated and a destroyed owner leaves the wheel on
+ * its own. The wheel counts in ticks, what a tick is is up to the user.
+ * @tparam Owner Type of the objects timers are embedded in
+ */
+template <typename Owner> class TimerWheel {
+    private:
+    // @brief Node of the list of a slot. A slot's head links to itself when
+    // the slot is empty.
+    struct Link {
+        Link* prev = nullptr;
+        Link* next = nullptr;
+    };
+
+    public:
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr size_t SLOT_COUNT  = size_t (1) << SLOT_BITS;
+    static constexpr unsigned LEVELS    = 4;
+
+    // @brief Timers further away are clamped to this many ticks
+    static constexpr uint64_t MAX_DELAY = (uint64_t (1) << (SLOT_BITS * LEVELS)) - 1;
+
+    // @brief A deadline of p_Owner, armed at most once at a time
+    class Timer : private Link {
+        public:
+        explicit Timer (Owner& p_Owner)
+        : m_Owner (p_Owner) {
+        }
+
+        ~Timer () {
+            cancel ();
+        }
+
+        Timer (const Timer&)            = delete;
+        Timer& operator= (const Timer&) = delete;
+
+        bool isArmed () const {
+            return this->next != nullptr;
+        }
+
+        // @brief Tick the timer expires at (if it is armed)
+        uint64_t getExpiry () const {
+            return m_Expiry;
+        }
+
+        Owner& getOwner () {
+            return m_Owner;
+        }
+
+        private:
+        friend class TimerWheel;
+
+        Owner& m_Owner;
+        uint64_t m_Expiry = 0;
+
+        // @brief Wheel the timer is armed in
+        TimerWheel* m_Wheel = nullptr;
+
+        void cancel () {
+            if (!isArmed ())
+                return;
+            this->prev->next = this->next;
+            this->next->prev = this->prev;
+            this->prev = this->next = nullptr;
+            m_Wheel->m_Count--;
+        }
+    };
+
+    // @param p_Now Current tick
+    explicit TimerWheel (uint64_t p_Now = 0)
+    : m_Now (p_Now) {
+        for (Link& slot : m_Slots)
+            slot.prev = slot.next = &slot;
+    }
+
+    ~TimerWheel () {
+        // owners may outlive the wheel, their timers must not point into it
+        for (Link& slot : m_Slots) {
+            while (slot.next != &slot)
+                static_cast<Timer*> (slot.next)->cancel ();
+        }
+    }
+
+    TimerWheel (const TimerWheel&)            = delete;
+    TimerWheel& operator= (const TimerWheel&) = delete;
+
+    /**
+     * @brief (Re)arms p_Timer to expire at tick p_Expiry. A tick which has
+     * passed already expires with the next one.
+     */
+    void arm (Timer& p_Timer, uint64_t p_Expiry) {
+        p_Timer.cancel ();
+        if (p_Expiry <= m_Now)
+            p_Expiry = m_Now + 1;
+        p_Timer.m_Expiry = std::min (p_Expiry, m_Now + MAX_DELAY);
+        p_Timer.m_Wheel  = this;
+        m_Count++;
+        place (p_Timer);
+    }
+
+    // @brief Disarms p_Timer, nothing happens if it isn't armed
+    void cancel (Timer& p_Timer) {
+        p_Timer.cancel ();
+    }
+
+    // @brief Whether no timer is armed
+    bool empty () const {
+        return m_Count == 0;
+    }
+
+    uint64_t getNow () const {
+        return m_Now;
+    }
+
+    /**
+     * @brief Moves the wheel forward to tick p_Now and disarms every timer
+     * expiring until then
+     * @param p_OnExpired Called with the owner of each of them. It may arm or
+     * cancel any timer.
+     */
+    template <typename OnExpired> void advance (uint64_t p_Now, OnExpired&& p_OnExpired) {
+        if (m_Count == 0) {
+            m_Now = std::max (m_Now, p_Now);
+            return;
+        }
+
+        while (m_Now < p_Now) {
+            m_Now++;
+
+            // a level moves one slot each time the level below completes a
+            // turn, its timers are spread over the levels below
+            for (unsigned level = 1; level < LEVELS; level++) {
+                if ((m_Now & ((uint64_t (1) << (SLOT_BITS * level)) - 1)) != 0)
+                    break;
+                cascade (slotOf (level, m_Now));
+            }
+
+            Link& slot = m_Slots[slotOf (0, m_Now)];
+            while (slot.next != &slot) {
+                Timer& timer = *static_cast<Timer*> (slot.next);
+                timer.cancel ();
+                p_OnExpired (timer.getOwner ());
+            }
+
+            if (m_Count == 0) {
+                m_Now = p_Now;
+                return;
+            }
+        }
+    }
+
+    private:
+    std::array<Link, SLOT_COUNT * LEVELS> m_Slots;
+
+    // @brief Current tick
+    uint64_t m_Now;
+
+    // @brief Number of armed timers
+    size_t m_Count = 0;
+
+    // @brief Index into m_Slots of the slot of p_Tick in p_Level
+    static size_t slotOf (unsigned p_Level, uint64_t p_Tick) {
+        return p_Level * SLOT_COUNT + ((p_Tick >> (SLOT_BITS * p_Level)) & (SLOT_COUNT - 1));
+    }
+
+    // @brief Links p_Timer into the slot of its expiry in the lowest level
+    // whose turn reaches it
+    void place (Timer& p_Timer) {
+        uint64_t delay = p_Timer.m_Expiry - m_Now;
+        unsigned level = 0;
+        while (level + 1 < LEVELS && delay >= (uint64_t (1) << (SLOT_BITS * (level + 1))))
+            level++;
+
+        Link& slot      = m_Slots[slotOf (level, p_Timer.m_Expiry)];
+        p_Timer.prev    = slot.prev;
+        p_Timer.next    = &slot;
+        slot.prev->next = &p_Timer;
+        slot.prev       = &p_Timer;
+    }
+
+    // @brief Places the timers of a slot again, each lands in a lower level
+    void cascade (size_t p_Slot) {
+        Link& slot = m_Slots[p_Slot];
+        Link pending;
+        if (slot.next == &slot)
+            return;
+
+        // take the whole list first, place() may link into the same slot
+        pending.next       = slot.next;
+        pending.prev       = slot.prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        slot.prev = slot.next = &slot;
+
+        while (pending.next != &pending) {
+            Timer& timer     = *static_cast<Timer*> (pending.next);
+            pending.next     = timer.next;
+            timer.next->prev = &pending;
+            place (timer);
+        }
+    }
+};
+
+} // namespace ccerve
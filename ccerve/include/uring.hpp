@@ -0,0 +1,158 @@
+#pragma once
+
+/**
+ * @file uring.hpp
+ * @brief Holds the declaration of the IoUring class, a small wrapper over the
+ * raw io_uring system calls (no liburing needed).
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "exception.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Owns an io_uring instance: the submission and completion rings and,
+ * optionally, a ring of provided buffers that recv operations pick from.
+ *
+ * Submission entries are only handed to the kernel by submitAndWait() (or by
+ * getSqe() when the submission ring is full), so everything queued while
+ * handling a batch of completions goes out in a single io_uring_enter.
+ */
+class IoUring {
+    public:
+    /**
+     * @brief Creates the ring. Can throw IoUringCreationFailure.
+     * @param p_Entries Size of the submission ring. The completion ring is
+     * four times as large since multishot operations post many completions.
+     */
+    IoUring (unsigned p_Entries);
+    ~IoUring ();
+
+    IoUring (const IoUring&)            = delete;
+    IoUring& operator= (const IoUring&) = delete;
+
+    /**
+     * @brief Whether the running kernel has everything UringWorker uses: a
+     * ring, a provided buffer ring, multishot accept and recv and the
+     * operations it submits (Linux 6.0+)
+     */
+    static bool isSupported ();
+
+    /**
+     * @brief Returns a zeroed submission entry. If the submission ring is
+     * full, the queued entries are submitted first.
+     */
+    io_uring_sqe* getSqe ();
+
+    /**
+     * @brief Makes sure the next p_Count calls to getSqe() succeed without
+     * submitting in between. Needed before queueing a chain of linked
+     * entries, a chain split over two submissions isn't linked anymore.
+     * @return false if the ring stays too full
+     */
+    bool reserveSqes (unsigned p_Count);
+
+    /**
+     * @brief Submits every queued entry and waits until at least
+     * p_WaitNr completions are available.
+     * @return number of submitted entries, -errno on error
+     */
+    int submitAndWait (unsigned p_WaitNr);
+
+    /**
+     * @brief Calls p_Handler with every available completion entry and marks
+     * them as seen. p_Handler may queue new entries.
+     * @return number of handled completions
+     */
+    template <typename Handler> unsigned forEachCompletion (Handler&& p_Handler) {
+        unsigned head = *m_CqHead;
+        unsigned tail = std::atomic_ref<unsigned> (*m_CqTail).load (std::memory_order_acquire);
+        unsigned handled = 0;
+
+        for (; head != tail; head++, handled++) {
+            p_Handler (m_Cqes[head & *m_CqMask]);
+        }
+        std::atomic_ref<unsigned> (*m_CqHead).store (head, std::memory_order_release);
+
+        return handled;
+    }
+
+    /**
+     * @brief Registers a ring of p_Count buffers of p_Size bytes each under
+     * the group id p_GroupId. recv operations with IOSQE_BUFFER_SELECT pick a
+     * buffer from it and report its id in the completion flags.
+     * @param p_Count must be a power of 2
+     * @return false if the kernel doesn't support provided buffer rings
+     */
+    bool setupBufferRing (uint16_t p_GroupId, unsigned p_Count, unsigned p_Size);
+
+    // @brief Start of the provided buffer p_BufferId
+    char* getBuffer (uint16_t p_BufferId) {
+        return m_BufMemory.data () + static_cast<size_t> (p_BufferId) * m_BufSize;
+    }
+
+    // @brief Hands a provided buffer back to the kernel once it's consumed
+    void returnBuffer (uint16_t p_BufferId);
+
+    /**
+     * @brief Registers an empty table of p_Count files. Its slots are filled
+     * with IORING_OP_FILES_UPDATE and used with IOSQE_FIXED_FILE, which
+     * saves looking the file up on every operation.
+     */
+    bool registerFiles (unsigned p_Count);
+
+    // @brief Whether the kernel reported p_Feature (IORING_FEAT_*) on setup
+    bool hasFeature (uint32_t p_Feature) const {
+        return m_Params.features & p_Feature;
+    }
+
+    private:
+    // @brief File descriptor of the ring
+    int m_RingFd;
+
+    // @brief Parameters filled by io_uring_setup
+    io_uring_params m_Params;
+
+    // @brief mmap-ed submission ring, completion ring and submission entries
+    void* m_SqRing     = nullptr;
+    size_t m_SqRingSize = 0;
+    void* m_CqRing     = nullptr;
+    size_t m_CqRingSize = 0;
+    io_uring_sqe* m_Sqes = nullptr;
+    size_t m_SqesSize   = 0;
+
+    // @brief Pointers into the submission ring
+    unsigned* m_SqHead;
+    unsigned* m_SqTail;
+    unsigned* m_SqMask;
+    unsigned* m_SqArray;
+
+    // @brief Tail including entries which weren't submitted yet
+    unsigned m_SqeTail = 0;
+
+    // @brief Pointers into the completion ring
+    unsigned* m_CqHead;
+    unsigned* m_CqTail;
+    unsigned* m_CqMask;
+    io_uring_cqe* m_Cqes;
+
+    // @brief Provided buffer ring (shared with the kernel) and its buffers
+    io_uring_buf_ring* m_BufRing = nullptr;
+    size_t m_BufRingSize         = 0;
+    std::vector<char> m_BufMemory;
+    unsigned m_BufCount = 0;
+    unsigned m_BufSize  = 0;
+    uint16_t m_BufGroup = 0;
+
+    // @brief Makes the queued entries visible to the kernel
+    unsigned flushSubmissions ();
+};
+
+} // namespace ccerve
@@ -0,0 +1,185 @@
+#pragma once
+
+/**
+ * @file uring_worker.hpp
+ * @brief Holds the declaration of the UringWorker class
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "uring.hpp"
+#include "worker.hpp"
+
+namespace ccerve {
+
+/**
+ * @brief Worker which does all of its socket I/O through io_uring:
+ * - a single multishot accept posts one completion per new client
+ * - every client has one multishot recv which picks buffers from a provided
+ *   buffer ring, so no read buffer is held per idle connection
+ * - responses produced while handling a batch of completions are sent with
+ *   one sendmsg per connection (gathering every in-memory segment). The last
+ *   send of a connection that has to be closed is linked to a shutdown.
+ * - file bodies are sent in chunks: a read of the file (through the
+ *   registered file table when the kernel allows it) linked to the send of
+ *   the chunk, so only one chunk buffer is held per downloading connection.
+ * Everything queued during a batch is submitted with the same io_uring_enter
+ * that waits for the next batch.
+ */
+class UringWorker : public Worker {
+    public:
+    UringWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context = {}, int p_ServerSock = -1);
+    virtual ~UringWorker ();
+
+    virtual void run () override;
+
+    private:
+    // @brief Kind of operation a completion belongs to (low byte of user_data)
+    enum class Operation : uint8_t {
+        ACCEPT,
+        RECV,
+        SEND,
+        SHUTDOWN,
+        WAKE,
+        REGISTER_FILE,
+        RELEASE_FILE,
+        READ,
+        TIMEOUT,
+        CANCEL,
+    };
+
+    // @brief Connection plus the state of its in-flight operations
+    struct UringConnection {
+        std::unique_ptr<Connection> conn;
+
+        // @brief File segment handed to the kernel by the current send
+        OutputSegment in_flight;
+
+        // @brief In-memory segments handed to the kernel by the current
+        // sendmsg, and the iovecs / header pointing at them
+        std::vector<OutputSegment> gathered;
+        std::vector<iovec> gathered_iov;
+        msghdr gathered_msg{};
+
+        // @brief Chunks of file segments are read into this buffer before
+        // they are sent. Allocated by the first file sent on the connection.
+        std::unique_ptr<char[]> file_chunk;
+
+        // @brief Slot of the registered file table holding the file of
+        // in_flight, -1 if its plain descriptor is used
+        int file_slot = -1;
+
+        // @brief Operations submitted and not completed yet. The socket is
+        // closed only when this drops to 0 so no late completion can refer
+        // to a reused file descriptor.
+        unsigned pending_ops = 0;
+
+        bool receiving = false;
+        bool sending   = false;
+        bool closing   = false;
+
+        // @brief The multishot recv is being canceled because the input of
+        // the connection is paused
+        bool recv_canceling = false;
+
+        // @brief A shutdown is linked to the send in flight
+        bool shutdown_linked = false;
+
+        // @brief Already in m_DirtyConnections
+        bool dirty = false;
+    };
+
+    // @brief Number of entries of the submission ring
+    static constexpr unsigned RING_ENTRIES = 4096;
+
+    // @brief Provided buffers for recv (count must be a power of 2). They are
+    // only held between a completion and its handling, not per connection.
+    static constexpr unsigned RECV_BUFFER_COUNT = 512;
+    static constexpr uint16_t RECV_BUFFER_GROUP = 0;
+
+    // @brief Bytes of a file read and sent by one linked read + send
+    static constexpr size_t FILE_CHUNK_SIZE = 64 * 1024;
+
+    // @brief Slots of the registered file table, i.e. how many file segments
+    // can be sent through registered files at the same time
+    static constexpr unsigned FILE_SLOTS = 1024;
+
+    // @brief Written to a slot of the file table to empty it
+    static constexpr int NO_FILE = -1;
+
+    // @brief Created in run() so that the ring belongs to the worker thread
+    std::unique_ptr<IoUring> m_Ring;
+
+    // @brief State of every open client connection keyed by its socket
+    std::unordered_map<int, UringConnection> m_Connections;
+
+    // @brief Connections which got new responses during the current batch
+    std::vector<int> m_DirtyConnections;
+
+    // @brief Wakes the ring up for the next tick of the timers
+    __kernel_timespec m_TickTimeout{ 0, TICK_MS * 1000000ll };
+    bool m_TickTimeoutArmed = false;
+
+    // @brief Unused slots of the registered file table. Empty if the kernel
+    // can't fill slots from a linked operation (IORING_FEAT_LINKED_FILE).
+    std::vector<int> m_FreeFileSlots;
+
+    static uint64_t encodeUserData (int p_Fd, Operation p_Op) {
+        return (static_cast<uint64_t> (p_Fd) << 8) | static_cast<uint8_t> (p_Op);
+    }
+
+    void submitAccept ();
+    void submitRecv (int p_Fd, UringConnection& p_UConn);
+    // @brief Cancels the multishot recv while the input is paused,
+    // handleSend() arms it again once the input is resumed
+    void pauseRecv (int p_Fd, UringConnection& p_UConn);
+    void submitSend (int p_Fd, UringConnection& p_UConn);
+    void submitWakePoll ();
+    void submitTickTimeout ();
+
+    // @brief Stops accepting (cancels the multishot accept, which holds on
+    // to the server socket) and closes the connections waiting for their
+    // next request
+    void startDraining ();
+
+    // @brief Puts the file of in_flight into a free registered slot, linked
+    // to the following read. Uses the plain descriptor if no slot is free.
+    void submitRegisterFile (int p_Fd, UringConnection& p_UConn);
+
+    // @brief Reads the next p_Length bytes of the file of in_flight into
+    // file_chunk, linked to the following send
+    void submitFileRead (int p_Fd, UringConnection& p_UConn, size_t p_Length);
+
+    // @brief Empties the registered slot of the connection, if it has one
+    void releaseFileSlot (UringConnection& p_UConn);
+
+    // @brief Dispatches a completion to the handler of its operation
+    void handleCompletion (const io_uring_cqe& p_Cqe);
+
+    void handleAccept (const io_uring_cqe& p_Cqe);
+    void handleRecv (int p_Fd, UringConnection& p_UConn, const io_uring_cqe& p_Cqe);
+    void handleSend (int p_Fd, UringConnection& p_UConn, const io_uring_cqe& p_Cqe);
+
+    // @brief Sends what every dirty connection has queued
+    void flushDirtyConnections ();
+
+    // @brief Whether a response of the connection is in flight or queued
+    static bool isSending (const UringConnection& p_UConn) {
+        return p_UConn.sending || p_UConn.conn->hasPendingWrites ();
+    }
+
+    /**
+     * @brief Stops the operations of the connection and releases it once
+     * none of them is in flight anymore: right away if none is, p_UConn
+     * mustn't be used after the call then.
+     */
+    void closeConnection (int p_Fd, UringConnection& p_UConn);
+};
+
+} // namespace ccerve
@@ -5,7 +5,29 @@
  * @brief Declarations for general utilities
  */
 
+#include <cstddef>
 #include <ctime>
+#include <string_view>
 
 // @brief Returns string_view of @static_var s_CurrentTimeStr
 const char* getCurrentTime ();
+
+// @brief Length of a date in the format of HTTP headers
+// ("Sun, 06 Nov 1994 08:49:37 GMT")
+static constexpr size_t HTTP_DATE_SIZE = 29;
+
+/**
+ * @brief Writes p_Time as a date in the format of HTTP headers (RFC 9110
+ * IMF-fixdate, always in English and GMT)
+ * @param p_Buffer Receives exactly HTTP_DATE_SIZE characters
+ * @return view of the date in p_Buffer
+ */
+std::string_view formatHttpDate (time_t p_Time, char* p_Buffer);
+
+/**
+ * @brief Reads a date in the format of HTTP headers. The obsolete formats
+ * (RFC 850, asctime) aren't accepted, a request using them is answered as if
+ * it had no date.
+ * @return false if p_Date isn't a valid IMF-fixdate
+ */
+bool parseHttpDate (std::string_view p_Date, time_t& p_Time);
@@ -0,0 +1,349 @@
+#pragma once
+
+/**
+ * @file worker.hpp
+ * @brief Holds the declaration of the Worker base class
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compressor.hpp"
+#include "connection.hpp"
+#include "directory_listing.hpp"
+#include "exception.hpp"
+#include "file_cache.hpp"
+#include "file_pool.hpp"
+#include "http_parser.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "server_config.hpp"
+#include "sockets.hpp"
+#include "timer_wheel.hpp"
+
+namespace ccerve {
+
+// @brief What the HttpServer hands to every worker. The pointers are owned
+// by the server and outlive the workers.
+struct WorkerContext {
+    // @brief Cache shared by all workers, nullptr if disabled
+    FileCache* file_cache = nullptr;
+
+    // @brief Compressor of cached files, nullptr if disabled
+    Compressor* compressor = nullptr;
+
+    // @brief Cache of directory listings, nullptr if directories aren't listed
+    DirectoryListings* listings = nullptr;
+
+    // @brief Threads answering the requests which need the disk, nullptr if
+    // every worker answers them on its own thread
+    FilePool* file_pool = nullptr;
+
+    // @brief Counters shared by all workers
+    ConnectionStats* connection_stats = nullptr;
+
+    // @brief Gathers what every worker records, nullptr if the worker keeps
+    // its counters to itself
+    Metrics* metrics = nullptr;
+
+    // @brief Path the metrics are served at, empty if they aren't
+    std::string metrics_path;
+
+    ConnectionLimits limits;
+};
+
+/**
+ * @brief A worker owns a listening socket and every connection accepted on
+ * that socket. All sockets of the workers are bound to the same address with
+ * SO_REUSEPORT, so the kernel spreads incoming connections over them and no
+ * state is shared between workers. How the sockets are waited on is up to the
+ * derived class (EpollWorker, UringWorker, CoroutineWorker).
+ */
+class Worker {
+    public:
+    /**
+     * @brief Creates the worker's listening socket and binds it.
+     * Can throw ServerSockCreationFailure, ServerSockBindFailure and
+     * EventLoopCreationFailure.
+     * @param p_ServerSockAddr Address to bind to (shared by all workers)
+     * @param p_Context What the worker shares with the others (a worker
+     * without connection_stats or metrics counts for itself)
+     * @param p_ServerSock Socket bound to p_ServerSockAddr (e.g. handed over
+     * by the server this one replaces) the worker takes over instead of
+     * creating its own, -1 to create one
+     */
+    Worker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context = {}, int p_ServerSock = -1);
+    virtual ~Worker ();
+
+    Worker (const Worker&)            = delete;
+    Worker& operator= (const Worker&) = delete;
+
+    // @brief Listens and serves clients until stop() is called
+    virtual void run () = 0;
+
+    // @brief Makes run() return. Can be called from any thread.
+    void stop ();
+
+    /**
+     * @brief Makes the worker stop accepting and run() return once its
+     * connections are closed. Requests which have arrived (or are arriving)
+     * are answered with "Connection: close", idle connections are closed
+     * right away. Can be called from any thread.
+     */
+    void drain ();
+
+    // @brief Listening socket of the worker, -1 once it stopped accepting
+    int getServerSock () const {
+        return m_ServerSock;
+    }
+
+    protected:
+    // @brief File descriptor of server socket (listening socket)
+    int m_ServerSock;
+
+    // @brief Struct defining the socket address of server socket
+    struct sockaddr_in m_ServerSockAddr;
+
+    // @brief eventfd written by stop() to wake up run()
+    int m_WakeFd;
+
+    // @brief Set by stop() to end the loop in run()
+    std::atomic_bool m_Stop;
+
+    // @brief Set by drain(), the loop in run() then calls startDraining()
+    std::atomic_bool m_DrainRequested;
+
+    // @brief The worker doesn't accept anymore and closes every connection
+    // once it is done
+    bool m_Draining = false;
+
+    // @brief Largest block kept in the pools of m_ConnectionMemory, larger
+    // ones (e.g. the arena of a connection with a long pipeline) are
+    // allocated and freed every time
+    static constexpr size_t MAX_POOLED_BLOCK = 64 * 1024;
+
+    // @brief Memory of the connections (their arenas and queues of segments).
+    // Only the thread running the worker uses it, so it takes no locks. A
+    // freed block is kept for the next connection or request, so serving
+    // keep-alive requests doesn't call the global allocator. Declared in this
+    // class, it outlives the connections of the derived ones.
+    std::pmr::unsynchronized_pool_resource m_ConnectionMemory;
+
+    // @brief Cache of small files shared by all workers (owned by HttpServer)
+    FileCache* m_FileCache;
+
+    // @brief Compressor of cached files (owned by HttpServer), nullptr if
+    // disabled
+    Compressor* m_Compressor;
+
+    // @brief Directory listings (owned by HttpServer), nullptr if disabled
+    DirectoryListings* m_Listings;
+
+    // @brief Answers the requests which need the disk (owned by HttpServer),
+    // nullptr if the worker answers them itself
+    FilePool* m_FilePool;
+
+    // @brief A request handed to m_FilePool and, once answered there, its
+    // response
+    struct FileJob {
+        int sock;
+        uint64_t id;
+        // @brief Copy of the request's bytes (the reader's buffer may move),
+        // request points into it
+        std::string text;
+        parse::Request request;
+        bool last_request;
+        // @brief When the request was parsed (monotonicNs())
+        uint64_t start;
+        parse::Response response;
+    };
+
+    // @brief How much of a file sent from disk m_FilePool reads ahead
+    static constexpr size_t FILE_PREFETCH_SIZE = 2 * 1024 * 1024;
+
+    // @brief Id of the last FileJob handed out
+    uint64_t m_LastJob = 0;
+
+    // @brief Jobs answered by m_FilePool, waiting for handleFileJobs()
+    std::mutex m_FileJobsMutex;
+    std::vector<std::unique_ptr<FileJob>> m_AnsweredJobs;
+
+    ConnectionLimits m_Limits;
+
+    // @brief Counters shared by all workers (owned by HttpServer), or
+    // m_OwnConnectionStats
+    ConnectionStats* m_ConnectionStats;
+    ConnectionStats m_OwnConnectionStats;
+
+    // @brief Renders the metrics at m_MetricsPath, nullptr if not served
+    Metrics* m_Metrics;
+    std::string m_MetricsPath;
+
+    // @brief What this worker counts and times, handed out by m_Metrics or
+    // m_OwnWorkerMetrics
+    WorkerMetrics* m_WorkerMetrics;
+    WorkerMetrics m_OwnWorkerMetrics;
+
+    // @brief Length of a tick of m_Timers
+    static constexpr unsigned TICK_MS = 100;
+
+    // @brief Deadlines of the worker's connections
+    TimerWheel<Connection> m_Timers;
+
+    // @brief Size of buffer which will store the message sent by client
+    static const size_t BUFFER_SIZE = 30760; // ! Probably a better way to do this
+
+    /**
+    @brief Maximum number of connections which could wait in queue before before
+    server starts rejecting
+    */
+    static const size_t BACKLOG_SIZE = SOMAXCONN;
+
+    // @brief Starts listening on the server socket
+    bool startListening ();
+
+    // @brief Empties m_WakeFd after the event loop saw it become readable
+    void resetWakeUp ();
+
+    // @brief Closes the server socket once the worker doesn't accept anymore
+    void closeServerSocket ();
+
+    // @brief Whether p_Conn, with nothing left to send, is done: the client
+    // asked for "close", or the worker is draining and no request is coming
+    // in on it
+    bool isFinished (Connection& p_Conn) const {
+        return p_Conn.getPendingJob () == 0 &&
+        (!p_Conn.getKeepAlive () || (m_Draining && !p_Conn.getRequestReader ().hasPendingData ()));
+    }
+
+    /**
+     * @brief Adds received bytes to p_Conn and queues a response for every
+     * request they complete. After a request which can't be read (or asks for
+     * "Connection: close") nothing more is served on p_Conn. Once p_Conn is
+     * backed up (or waits for m_FilePool), the requests left wait in its
+     * reader and its input is paused: the worker stops reading from it until
+     * resumeInput().
+     */
+    void handleInput (Connection& p_Conn, std::string_view p_Data);
+
+    /**
+     * @brief Serves the requests which waited while p_Conn was backed up, if
+     * its input is paused, enough has been sent since and no request is
+     * answered by m_FilePool
+     * @return true if its input was resumed: the worker reads from p_Conn
+     * again
+     */
+    bool resumeInput (Connection& p_Conn);
+
+    /**
+     * @brief Queues the responses m_FilePool answered (waking the event loop
+     * through m_WakeFd) on their connections and serves the requests which
+     * waited behind them
+     * @param p_Find Called with the socket of a job, returns its connection
+     * or nullptr if it was closed meanwhile
+     * @param p_Resume Called with every connection which got a response,
+     * sends it
+     */
+    template <typename Find, typename Resume> void handleFileJobs (Find&& p_Find, Resume&& p_Resume) {
+        std::vector<std::unique_ptr<FileJob>> jobs;
+        {
+            std::lock_guard<std::mutex> jobs_lock (m_FileJobsMutex);
+            jobs.swap (m_AnsweredJobs);
+        }
+        for (std::unique_ptr<FileJob>& job : jobs) {
+            // the socket may belong to a new connection by now
+            Connection* conn = p_Find (job->sock);
+            if (!conn || conn->getPendingJob () != job->id)
+                continue;
+            conn->setPendingJob (0);
+            queueAnswer (*conn, job->request, std::move (job->response), job->start);
+            handleInput (*conn, {});
+            p_Resume (*conn);
+        }
+    }
+
+    // @brief Queues p_Response on p_Conn, counting and logging p_Request
+    // which it answers (parsed at p_Start)
+    void queueAnswer (Connection& p_Conn, const parse::Request& p_Request, parse::Response&& p_Response,
+    uint64_t p_Start);
+
+    /**
+     * @brief Hands the request just read from p_Conn (the current one of its
+     * reader) to m_FilePool. The job parses a copy of its text again, the
+     * views of the request parsed before point into the reader which the
+     * request is consumed from. No other request of p_Conn is served until
+     * handleFileJobs() got its response.
+     */
+    void offloadRequest (Connection& p_Conn, bool p_LastRequest, uint64_t p_Start);
+
+    // @brief Current time in ticks of m_Timers (monotonic)
+    static uint64_t currentTick ();
+
+    /**
+     * @brief Counts an accepted connection
+     * @return false if max_connections are open already: the connection is
+     * rejected (and counted as such), the caller closes it
+     */
+    bool admitConnection ();
+
+    /**
+     * @brief Counts p_Bytes written to p_Conn and, once nothing is left to
+     * send, how long sending its responses took. The arena of a drained
+     * connection is released.
+     * @param p_Drained Whether everything queued on p_Conn has been sent (and
+     * no segment of it is held by the caller any more)
+     */
+    void countSent (Connection& p_Conn, size_t p_Bytes, bool p_Drained);
+
+    // @brief Counts p_Count connections as closed
+    void releaseConnections (size_t p_Count = 1) {
+        m_ConnectionStats->open -= p_Count;
+    }
+
+    /**
+     * @brief Arms the timer of p_Conn for what it is doing now: sending
+     * (progress pushes the deadline back), receiving a request (the deadline
+     * counts from its first byte) or idling
+     * @param p_Sending Whether a response is being sent
+     */
+    void updateTimer (Connection& p_Conn, bool p_Sending);
+
+    // @brief How long the event loop may wait before the timers are due
+    // again, -1 if none is armed
+    int getTimerWaitMs () const {
+        return m_Timers.empty () ? -1 : static_cast<int> (TICK_MS);
+    }
+
+    /**
+     * @brief Counts and logs every connection whose deadline passed
+     * @param p_Close Called with each of them, closes it
+     */
+    template <typename Close> void expireTimers (Close&& p_Close) {
+        m_Timers.advance (currentTick (), [this, &p_Close] (Connection& p_Conn) {
+            if (p_Conn.getDeadline () == Connection::Deadline::REQUEST) {
+                m_ConnectionStats->request_timeouts++;
+            } else {
+                m_ConnectionStats->idle_timeouts++;
+            }
+            log::info ("{} -- timed out", inet_ntoa (p_Conn.getSockAddr ().sin_addr));
+            p_Close (p_Conn);
+        });
+    }
+
+    private:
+    /*
+    These functions are called within the constructor and can throw
+    exceptions.
+    */
+    void createServerSocket ();
+
+    void bindServerSocket (); // Can throw ServerSockBindFail
+};
+
+} // namespace ccerve
@@ -0,0 +1,136 @@
+/**
+ * @file compressor.cpp
+ * @brief Holds the definition of the Compressor class
+ */
+
+#include "compressor.hpp"
+#include "logger.hpp"
+
+#ifdef CCERVE_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef CCERVE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace ccerve {
+
+Compressor::Compressor (FileCache& p_FileCache)
+: m_FileCache (p_FileCache) {
+    m_Thread = std::thread ([this] { run (); });
+}
+
+Compressor::~Compressor () {
+    {
+        std::lock_guard<std::mutex> jobs_lock (m_JobsMutex);
+        m_Stop = true;
+    }
+    m_JobsCondition.notify_one ();
+    if (m_Thread.joinable ())
+        m_Thread.join ();
+}
+
+bool Compressor::isSupported (ContentCoding p_Coding) {
+    switch (p_Coding) {
+    case ContentCoding::BROTLI:
+#ifdef CCERVE_HAVE_BROTLI
+        return true;
+#else
+        return false;
+#endif
+    case ContentCoding::GZIP:
+#ifdef CCERVE_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+void Compressor::schedule (const std::string& p_VariantPath, ContentCoding p_Coding,
+std::shared_ptr<const CachedFile> p_Source, uint64_t p_Generation) {
+    if (!isSupported (p_Coding))
+        return;
+
+    {
+        std::lock_guard<std::mutex> jobs_lock (m_JobsMutex);
+        if (m_Jobs.size () >= MAX_QUEUED_JOBS || !m_Queued.insert (p_VariantPath).second)
+            return;
+        m_Jobs.push_back ({ p_VariantPath, p_Coding, std::move (p_Source), p_Generation });
+    }
+    m_JobsCondition.notify_one ();
+}
+
+void Compressor::run () {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> jobs_lock (m_JobsMutex);
+            m_JobsCondition.wait (jobs_lock, [this] { return m_Stop || !m_Jobs.empty (); });
+            if (m_Stop)
+                return;
+            job = std::move (m_Jobs.front ());
+            m_Jobs.pop_front ();
+        }
+
+        CachedFile variant;
+        variant.mtime          = job.source->mtime;
+        variant.inode          = job.source->inode;
+        variant.made_in_memory = true;
+        if (!compress (job.coding, job.source->contents, variant.contents)) {
+            log::warn ("{} could not be compressed.", job.variant_path);
+            variant.contents.clear ();
+            variant.missing = true;
+        } else if (variant.contents.size () >= job.source->contents.size ()) {
+            // not worth it, the file is sent as it is
+            variant.contents.clear ();
+            variant.missing = true;
+        }
+        // dropped if the file changed since the job was queued
+        m_FileCache.insert (job.variant_path, std::move (variant), job.generation);
+
+        // keeps it queued until now, so a request meanwhile doesn't repeat it
+        std::lock_guard<std::mutex> jobs_lock (m_JobsMutex);
+        m_Queued.erase (job.variant_path);
+    }
+}
+
+bool Compressor::compress (ContentCoding p_Coding, std::string_view p_Input, std::string& p_Output) {
+    if (p_Coding == ContentCoding::BROTLI) {
+#ifdef CCERVE_HAVE_BROTLI
+        size_t output_size = BrotliEncoderMaxCompressedSize (p_Input.size ());
+        p_Output.resize (output_size);
+        if (output_size == 0 ||
+        !BrotliEncoderCompress (BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_DEFAULT_MODE,
+        p_Input.size (), reinterpret_cast<const uint8_t*> (p_Input.data ()), &output_size,
+        reinterpret_cast<uint8_t*> (p_Output.data ()))) {
+            return false;
+        }
+        p_Output.resize (output_size);
+        return true;
+#endif
+    } else if (p_Coding == ContentCoding::GZIP) {
+#ifdef CCERVE_HAVE_ZLIB
+        // windowBits + 16 writes a gzip header and trailer instead of zlib's
+        z_stream stream{};
+        if (deflateInit2 (&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 9,
+            Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        p_Output.resize (deflateBound (&stream, p_Input.size ()));
+        stream.next_in   = reinterpret_cast<Bytef*> (const_cast<char*> (p_Input.data ()));
+        stream.avail_in  = static_cast<uInt> (p_Input.size ());
+        stream.next_out  = reinterpret_cast<Bytef*> (p_Output.data ());
+        stream.avail_out = static_cast<uInt> (p_Output.size ());
+
+        int result = deflate (&stream, Z_FINISH);
+        p_Output.resize (stream.total_out);
+        deflateEnd (&stream);
+        return result == Z_STREAM_END;
+#endif
+    }
+    return false;
+}
+
+} // namespace ccerve
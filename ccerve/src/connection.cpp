@@ -0,0 +1,196 @@
+/**
+ * @file connection.cpp
+ * @brief Holds the definition of the Connection class
+ */
+
+#include "connection.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace ccerve {
+
+Connection::Connection (int p_Sock, const sockaddr_in& p_SockAddr, std::pmr::memory_resource* p_Memory)
+: m_Sock (p_Sock), m_SockAddr (p_SockAddr), m_Arena (ARENA_BLOCK_SIZE, p_Memory), m_Segments (p_Memory) {
+}
+
+Connection::~Connection () {
+    shutdown (m_Sock, SHUT_WR);
+    sockets::closeSocket (m_Sock);
+}
+
+// @brief Shares the ownership of a cached file through its contents
+static std::shared_ptr<const std::string> sharedContents (std::shared_ptr<const CachedFile> p_File) {
+    if (!p_File)
+        return nullptr;
+    const std::string* contents = &p_File->contents;
+    return std::shared_ptr<const std::string> (std::move (p_File), contents);
+}
+
+void Connection::queueResponse (parse::Response&& p_Response) {
+    // every piece is queued where it already is, flush() gathers them
+    m_Segments.emplace_back ().borrowed_data = p_Response.status_line;
+    m_Segments.emplace_back (std::move (p_Response.headers));
+
+    if (!p_Response.parts.empty ()) {
+        queueParts (p_Response);
+        return;
+    }
+
+    if (!p_Response.body.empty ()) {
+        OutputSegment& segment = m_Segments.emplace_back ();
+        segment.borrowed_data  = p_Response.body;
+        segment.shared_data    = sharedContents (std::move (p_Response.cached_file));
+    }
+
+    // an empty file has nothing to send, the response closes it
+    if (p_Response.file_fd >= 0 && p_Response.file_size > 0) {
+        OutputSegment& segment = m_Segments.emplace_back ();
+        segment.file_fd        = p_Response.file_fd;
+        segment.file_offset    = p_Response.file_offset;
+        segment.file_remaining = p_Response.file_size;
+        p_Response.file_fd     = -1;
+    }
+}
+
+void Connection::queueParts (parse::Response& p_Response) {
+    for (parse::BodyPart& part : p_Response.parts) {
+        m_Segments.emplace_back (std::move (part.head));
+
+        size_t length = part.range.end - part.range.start;
+        if (p_Response.file_fd < 0) {
+            OutputSegment& segment = m_Segments.emplace_back ();
+            segment.borrowed_data  = p_Response.body.substr (part.range.start, length);
+            segment.shared_data    = sharedContents (p_Response.cached_file);
+            continue;
+        }
+
+        // every file segment owns a descriptor of its own. Not inherited by
+        // a server started to replace this one, like every other descriptor.
+        int file_fd = fcntl (p_Response.file_fd, F_DUPFD_CLOEXEC, 0);
+        if (file_fd < 0) {
+            log::error ("Could not duplicate the descriptor of a file: {}", std::strerror (errno));
+            // the response is cut short, the client must not wait for the rest
+            m_KeepAlive = false;
+            return;
+        }
+        OutputSegment& segment = m_Segments.emplace_back ();
+        segment.file_fd        = file_fd;
+        segment.file_offset    = static_cast<off_t> (part.range.start);
+        segment.file_remaining = length;
+    }
+    m_Segments.emplace_back (std::move (p_Response.multipart_end));
+}
+
+bool Connection::flush (size_t& p_BytesSent) {
+    p_BytesSent = 0;
+    while (!m_Segments.empty ()) {
+        OutputSegment& segment = m_Segments.front ();
+        ssize_t bytes_sent;
+
+        if (segment.isFile ()) {
+            // straight from the page cache to the socket
+            off_t offset = segment.file_offset;
+            bytes_sent = sendfile (m_Sock, segment.file_fd, &offset, segment.file_remaining);
+            // the file was truncated after its length was announced
+            if (bytes_sent == 0) {
+                errno = EIO;
+                return false;
+            }
+        } else {
+            iovec iov[MAX_GATHERED_SEGMENTS];
+            bool more        = false;
+            size_t iov_count = gatherSegments (iov, more);
+
+            msghdr msg{};
+            msg.msg_iov    = iov;
+            msg.msg_iovlen = iov_count;
+            bytes_sent     = sendmsg (m_Sock, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        }
+
+        if (bytes_sent < 0) {
+            if (errno == EINTR)
+                continue;
+            // socket buffer is full, wait for EPOLLOUT
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        p_BytesSent += bytes_sent;
+        markSent (bytes_sent);
+    }
+
+    return true;
+}
+
+size_t Connection::gatherSegments (iovec (&p_Iov)[MAX_GATHERED_SEGMENTS], bool& p_More) const {
+    size_t iov_count = 0;
+    for (auto itr = m_Segments.begin ();
+    itr != m_Segments.end () && !itr->isFile () && iov_count < MAX_GATHERED_SEGMENTS; ++itr) {
+        p_Iov[iov_count].iov_base = const_cast<char*> (itr->bytes ().data () + itr->data_offset);
+        p_Iov[iov_count].iov_len  = itr->remaining ();
+        iov_count++;
+    }
+    // MSG_MORE: a file follows, let the kernel put the head of its response
+    // into the same packets
+    p_More = iov_count < m_Segments.size ();
+    return iov_count;
+}
+
+void Connection::markSent (size_t p_Bytes) {
+    // a write can end in the middle of any of the gathered segments
+    while (p_Bytes > 0 || (!m_Segments.empty () && m_Segments.front ().isDone ())) {
+        OutputSegment& front = m_Segments.front ();
+        size_t consumed      = std::min (p_Bytes, front.remaining ());
+        front.consume (consumed);
+        p_Bytes -= consumed;
+        if (!front.isDone ())
+            break;
+        m_Segments.pop_front ();
+    }
+}
+
+OutputSegment Connection::takeNextSegment () {
+    OutputSegment segment = std::move (m_Segments.front ());
+    m_Segments.pop_front ();
+    return segment;
+}
+
+OutputSegment::OutputSegment (OutputSegment&& p_Other) noexcept
+: data (std::move (p_Other.data)), data_offset (p_Other.data_offset),
+  shared_data (std::move (p_Other.shared_data)), borrowed_data (p_Other.borrowed_data),
+  file_fd (p_Other.file_fd), file_offset (p_Other.file_offset),
+  file_remaining (p_Other.file_remaining) {
+    p_Other.file_fd = -1;
+}
+
+// like Response, data keeps the memory resource it was allocated from
+OutputSegment& OutputSegment::operator= (OutputSegment&& p_Other) noexcept {
+    if (this != &p_Other) {
+        std::destroy_at (this);
+        std::construct_at (this, std::move (p_Other));
+    }
+    return *this;
+}
+
+OutputSegment::~OutputSegment () {
+    if (file_fd >= 0)
+        close (file_fd);
+}
+
+void OutputSegment::consume (size_t p_Bytes) {
+    if (isFile ()) {
+        file_offset += p_Bytes;
+        file_remaining -= p_Bytes;
+    } else {
+        data_offset += p_Bytes;
+    }
+}
+
+} // namespace ccerve
@@ -0,0 +1,241 @@
+/**
+ * @file coroutine_worker.cpp
+ * @brief Holds the definition of the CoroutineWorker class
+ */
+
+#include "coroutine_worker.hpp"
+#include "logger.hpp"
+
+#include <cerrno>
+#include <span>
+#include <utility>
+
+namespace ccerve {
+
+CoroutineWorker::CoroutineWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context, int p_ServerSock)
+: Worker (p_ServerSockAddr, p_Context, p_ServerSock) {
+}
+
+CoroutineWorker::~CoroutineWorker () {
+    m_Clients.clear ();
+}
+
+void CoroutineWorker::run () {
+    if (!startListening ())
+        return;
+
+    if (!sockets::setNonBlocking (m_ServerSock) || !m_Reactor.watch (m_ServerSock)) {
+        log::error ("Server socket could not be added to the event loop!");
+        return;
+    }
+
+    if (!m_Reactor.watch (m_WakeFd)) {
+        log::error ("Wake up descriptor could not be added to the event loop!");
+        return;
+    }
+
+    // the frames of the coroutines started on this thread come from the
+    // pool of the connections
+    coro::setFrameMemory (&m_ConnectionMemory);
+    acceptConnections ().detach ();
+    handleWakeUps ().detach ();
+
+    while (!m_Stop) {
+        if (m_DrainRequested && !m_Draining)
+            startDraining ();
+        if (m_Draining && m_Clients.empty ())
+            break;
+
+        if (!m_Ticking && !m_Timers.empty ()) {
+            m_Ticking = true;
+            tickTimers ().detach ();
+        }
+
+        if (!m_Reactor.poll ()) {
+            log::error ("Event loop was not able to wait for events!");
+            break;
+        }
+    }
+
+    for (auto& [sock, client] : m_Clients)
+        closeClient (*client);
+    m_Reactor.unwatch (m_WakeFd);
+    if (m_ServerSock >= 0)
+        m_Reactor.unwatch (m_ServerSock);
+    // every coroutine waiting on a descriptor sees its operation canceled
+    // and ends, those of the clients erase them
+    m_Reactor.poll (0);
+    coro::setFrameMemory (nullptr);
+}
+
+coro::Task<> CoroutineWorker::acceptConnections () {
+    while (m_ServerSock >= 0) {
+        sockaddr_in client_sock_addr;
+        ssize_t client_sock = co_await m_Reactor.accept (m_ServerSock, client_sock_addr);
+
+        if (client_sock < 0) {
+            // the server socket isn't watched anymore
+            if (client_sock == -ECANCELED || client_sock == -EBADF)
+                co_return;
+            if (client_sock == -ECONNABORTED)
+                continue;
+            m_WorkerMetrics->accept_errors.add ();
+            log::error ("Socket was not able to accept the connection!");
+            // e.g. out of descriptors: the waiting connections don't make
+            // the socket ready again, try once a tick
+            co_await m_Reactor.sleep (TICK_MS);
+            continue;
+        }
+
+        if (!admitConnection ()) {
+            sockets::closeSocket (client_sock);
+            continue;
+        }
+
+        if (!m_Reactor.watch (client_sock)) {
+            log::error ("Client socket could not be added to the event loop!");
+            sockets::closeSocket (client_sock);
+            releaseConnections ();
+            continue;
+        }
+
+        auto client = std::make_unique<Client> (client_sock, client_sock_addr, &m_ConnectionMemory);
+        updateTimer (client->conn, false);
+        Client& added = *m_Clients.emplace (client_sock, std::move (client)).first->second;
+        // runs until it waits for the first request
+        serve (added).detach ();
+    }
+}
+
+coro::Task<> CoroutineWorker::serve (Client& p_Client) {
+    Connection& conn = p_Client.conn;
+    int sock         = conn.getSock ();
+    iovec iov[Connection::MAX_GATHERED_SEGMENTS];
+
+    while (!p_Client.closing) {
+        // send what the requests read so far were answered with
+        ssize_t bytes_sent = 0;
+        while (conn.hasPendingWrites () && bytes_sent >= 0) {
+            const OutputSegment& segment = conn.getNextSegment ();
+            if (segment.isFile ()) {
+                bytes_sent = co_await m_Reactor.sendfile (sock, segment.file_fd, segment.file_offset,
+                segment.file_remaining);
+                // the file was truncated after its length was announced
+                if (bytes_sent == 0)
+                    bytes_sent = -EIO;
+            } else {
+                bool more        = false;
+                size_t iov_count = conn.gatherSegments (iov, more);
+                bytes_sent       = co_await m_Reactor.send (sock,
+                std::span<const iovec> (iov, iov_count), more ? MSG_MORE : 0);
+            }
+
+            if (bytes_sent > 0) {
+                conn.markSent (bytes_sent);
+                countSent (conn, bytes_sent, !conn.hasPendingWrites ());
+                // progress pushes the deadline back, once sent the one for
+                // the next request is set below
+                if (conn.hasPendingWrites ())
+                    updateTimer (conn, true);
+            }
+        }
+        if (bytes_sent < 0) {
+            if (bytes_sent != -ECANCELED && !sockets::isPeerGone (-bytes_sent))
+                log::error ("Socket was not able to send data!");
+            break;
+        }
+
+        // everything is sent, serve the requests which waited for that
+        if (resumeInput (conn))
+            continue;
+
+        // the file pool answers the request, handleWakeUps() queues its
+        // response and resumes the coroutine
+        if (conn.getPendingJob () != 0) {
+            co_await JobAwaiter{ p_Client };
+            continue;
+        }
+
+        // everything is sent, close if the client asked for it
+        if (isFinished (conn))
+            break;
+
+        updateTimer (conn, false);
+        ssize_t bytes_received = co_await m_Reactor.recv (sock, m_Buffer, BUFFER_SIZE);
+        if (bytes_received <= 0) {
+            // 0: the client closed the connection (normal)
+            if (bytes_received < 0 && bytes_received != -ECANCELED)
+                log::error ("Socket was not able to read data\n");
+            break;
+        }
+        handleInput (conn, std::string_view (m_Buffer, bytes_received));
+    }
+
+    m_Timers.cancel (conn.getTimer ());
+    if (!p_Client.closing)
+        m_Reactor.unwatch (sock);
+    releaseConnections ();
+    // closes the socket, it isn't watched anymore so its number can be
+    // reused right away
+    m_Clients.erase (sock);
+}
+
+coro::Task<> CoroutineWorker::handleWakeUps () {
+    uint64_t wake_ups;
+    // ends once m_WakeFd is unwatched
+    while (co_await m_Reactor.read (m_WakeFd, &wake_ups, sizeof (wake_ups)) > 0) {
+        // stop() or drain() was called (the loop in run() checks which), or
+        // the file pool answered requests
+        handleFileJobs (
+        [this] (int p_Sock) -> Connection* {
+            auto client_itr = m_Clients.find (p_Sock);
+            if (client_itr == m_Clients.end () || client_itr->second->closing)
+                return nullptr;
+            return &client_itr->second->conn;
+        },
+        [this] (Connection& p_Conn) {
+            // the coroutine may be sending the responses queued before
+            Client& client = *m_Clients.at (p_Conn.getSock ());
+            if (client.job_waiter)
+                m_Reactor.post (std::exchange (client.job_waiter, nullptr));
+        });
+    }
+}
+
+coro::Task<> CoroutineWorker::tickTimers () {
+    while (!m_Timers.empty ()) {
+        co_await m_Reactor.sleep (TICK_MS);
+        expireTimers ([this] (Connection& p_Conn) { closeClient (*m_Clients.at (p_Conn.getSock ())); });
+    }
+    m_Ticking = false;
+}
+
+void CoroutineWorker::closeClient (Client& p_Client) {
+    if (p_Client.closing)
+        return;
+    p_Client.closing = true;
+    m_Timers.cancel (p_Client.conn.getTimer ());
+    // resumes the coroutine if it waits on the socket...
+    m_Reactor.unwatch (p_Client.conn.getSock ());
+    // ...or for the file pool
+    if (p_Client.job_waiter)
+        m_Reactor.post (std::exchange (p_Client.job_waiter, nullptr));
+}
+
+void CoroutineWorker::startDraining () {
+    m_Draining = true;
+    // new connections go to the sockets still bound to the address, e.g.
+    // those of the server which took them over. acceptConnections() ends.
+    m_Reactor.unwatch (m_ServerSock);
+    closeServerSocket ();
+
+    // a request which has just arrived is answered (with "close"), closing
+    // its connection would make the client see an error
+    for (auto& [sock, client] : m_Clients) {
+        Connection& conn = client->conn;
+        if (!conn.hasPendingWrites () && isFinished (conn) && !sockets::hasUnreadData (sock))
+            closeClient (*client);
+    }
+}
+
+} // namespace ccerve
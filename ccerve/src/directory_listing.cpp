@@ -0,0 +1,270 @@
+/**
+ * @file directory_listing.cpp
+ * @brief Holds the definition of the DirectoryListings class
+ */
+
+#include "directory_listing.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <ctime>
+#include <dirent.h>
+#include <format>
+#include <iterator>
+
+namespace ccerve {
+
+DirectoryListings::DirectoryListings (size_t p_Budget) : m_Budget (p_Budget) {
+}
+
+// @brief Whether p_Path has a ".." component, which could leave the served
+// directory
+static bool hasParentComponent (std::string_view p_Path) {
+    size_t start = 0;
+    while (start <= p_Path.size ()) {
+        size_t end = std::min (p_Path.find ('/', start), p_Path.size ());
+        if (p_Path.substr (start, end - start) == "..")
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+// @brief Compares names like python's http.server sorts them: ignoring case,
+// ties broken by the bytes of the names
+static bool isNameBefore (std::string_view p_Left, std::string_view p_Right) {
+    auto lower = [] (unsigned char p_Char) {
+        return p_Char >= 'A' && p_Char <= 'Z' ? p_Char + ('a' - 'A') : p_Char;
+    };
+    auto left_end  = p_Left.end ();
+    auto right_end = p_Right.end ();
+    auto [left, right] =
+    std::mismatch (p_Left.begin (), left_end, p_Right.begin (), right_end,
+    [&lower] (char p_A, char p_B) { return lower (p_A) == lower (p_B); });
+    if (left != left_end && right != right_end)
+        return lower (*left) < lower (*right);
+    if (left != left_end || right != right_end)
+        return right != right_end;
+    return p_Left < p_Right;
+}
+
+// @brief Appends p_Text with the characters which mean something in HTML
+// replaced by references
+static void appendEscaped (std::string& p_Out, std::string_view p_Text) {
+    for (char c : p_Text) {
+        switch (c) {
+        case '&': p_Out += "&amp;"; break;
+        case '<': p_Out += "&lt;"; break;
+        case '>': p_Out += "&gt;"; break;
+        case '"': p_Out += "&quot;"; break;
+        case '\'': p_Out += "&#39;"; break;
+        default: p_Out += c; break;
+        }
+    }
+}
+
+// @brief Appends p_Name as a path segment of a URL: everything but the
+// unreserved characters of RFC 3986 is percent-encoded
+static void appendPercentEncoded (std::string& p_Out, std::string_view p_Name) {
+    constexpr std::string_view HEX = "0123456789ABCDEF";
+    for (unsigned char c : p_Name) {
+        bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+        c == '-' || c == '.' || c == '_' || c == '~';
+        if (unreserved) {
+            p_Out += static_cast<char> (c);
+        } else {
+            p_Out += '%';
+            p_Out += HEX[c >> 4];
+            p_Out += HEX[c & 0xF];
+        }
+    }
+}
+
+std::shared_ptr<const CachedFile> DirectoryListings::getPage (const std::string& p_Path,
+std::string_view p_Url, std::string_view p_Query) {
+    size_t page = parsePage (p_Query);
+    if (page == SIZE_MAX || hasParentComponent (p_Path))
+        return nullptr;
+
+    // stat'ed before it is read, a change while it is read is seen next time
+    struct stat dir_stat;
+    if (stat (p_Path.c_str (), &dir_stat) != 0 || !S_ISDIR (dir_stat.st_mode))
+        return nullptr;
+
+    std::shared_ptr<Listing> listing;
+    {
+        std::lock_guard<std::mutex> lock (m_Mutex);
+        auto itr = m_Listings.find (p_Path);
+        if (itr != m_Listings.end ()) {
+            Listing& cached = *itr->second->second;
+            if (cached.inode == dir_stat.st_ino && cached.mtime.tv_sec == dir_stat.st_mtim.tv_sec &&
+            cached.mtime.tv_nsec == dir_stat.st_mtim.tv_nsec) {
+                m_Lru.splice (m_Lru.begin (), m_Lru, itr->second);
+                if (page < cached.pages.size () && cached.pages[page])
+                    return cached.pages[page];
+                listing = itr->second->second;
+            } else {
+                // an entry was added, removed or renamed
+                m_Bytes -= cached.bytes;
+                m_Lru.erase (itr->second);
+                m_Listings.erase (itr);
+            }
+        }
+    }
+
+    bool fresh = !listing;
+    if (fresh) {
+        listing = readDirectory (p_Path, dir_stat);
+        if (!listing)
+            return nullptr;
+    }
+    // an empty directory still has its (empty) first page
+    if (page >= listing->pages.size ())
+        return nullptr;
+    std::shared_ptr<const CachedFile> rendered = renderPage (*listing, p_Url, page);
+
+    if (fresh) {
+        // a change right after the directory was read could leave its
+        // timestamp as it is, like git's "racily clean" index entries
+        timespec now;
+        clock_gettime (CLOCK_REALTIME, &now);
+        long long age = (static_cast<long long> (now.tv_sec) - dir_stat.st_mtim.tv_sec) * 1000000000LL +
+        (now.tv_nsec - dir_stat.st_mtim.tv_nsec);
+        if (age < RACY_INTERVAL_NS)
+            return rendered;
+    }
+
+    std::lock_guard<std::mutex> lock (m_Mutex);
+    if (fresh)
+        store (p_Path, listing);
+    // unless the listing was dropped or replaced meanwhile
+    auto itr = m_Listings.find (p_Path);
+    if (itr != m_Listings.end () && itr->second->second == listing && !listing->pages[page]) {
+        listing->pages[page] = rendered;
+        listing->bytes += rendered->contents.capacity ();
+        m_Bytes += rendered->contents.capacity ();
+    }
+    evict ();
+    return rendered;
+}
+
+std::shared_ptr<DirectoryListings::Listing> DirectoryListings::readDirectory (const std::string& p_Path,
+const struct stat& p_Stat) {
+    DIR* dir = opendir (p_Path.c_str ());
+    if (!dir)
+        return nullptr;
+
+    auto listing   = std::make_shared<Listing> ();
+    listing->mtime = p_Stat.st_mtim;
+    listing->inode = p_Stat.st_ino;
+    while (dirent* entry = readdir (dir)) {
+        std::string_view name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+
+        // links to directories are listed as directories, like python does
+        bool is_directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat entry_stat;
+            is_directory = fstatat (dirfd (dir), entry->d_name, &entry_stat, 0) == 0 && S_ISDIR (entry_stat.st_mode);
+        }
+        listing->entries.push_back ({ std::string (name), is_directory });
+        listing->bytes += sizeof (Entry) + name.size ();
+    }
+    closedir (dir);
+
+    std::sort (listing->entries.begin (), listing->entries.end (),
+    [] (const Entry& p_Left, const Entry& p_Right) { return isNameBefore (p_Left.name, p_Right.name); });
+    listing->pages.resize (std::max<size_t> ((listing->entries.size () + PAGE_SIZE - 1) / PAGE_SIZE, 1));
+    listing->bytes += LISTING_OVERHEAD + listing->pages.size () * sizeof (listing->pages[0]);
+    return listing;
+}
+
+std::shared_ptr<const CachedFile> DirectoryListings::renderPage (const Listing& p_Listing,
+std::string_view p_Url, size_t p_Page) {
+    size_t first = p_Page * PAGE_SIZE;
+    size_t last  = std::min (first + PAGE_SIZE, p_Listing.entries.size ());
+
+    auto page   = std::make_shared<CachedFile> ();
+    page->mtime = p_Listing.mtime;
+    page->inode = p_Listing.inode;
+
+    std::string& html = page->contents;
+    // a name appears twice, the link to it percent-encoded
+    size_t size = 512 + 3 * p_Url.size ();
+    for (size_t i = first; i < last; i++)
+        size += 32 + 4 * p_Listing.entries[i].name.size ();
+    html.reserve (size);
+
+    html += "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">\n<title>Directory listing for ";
+    appendEscaped (html, p_Url);
+    html += "</title>\n</head>\n<body>\n<h1>Directory listing for ";
+    appendEscaped (html, p_Url);
+    html += "</h1>\n<hr>\n<ul>\n";
+    if (p_Url != "/")
+        html += "<li><a href=\"../\">../</a></li>\n";
+    for (size_t i = first; i < last; i++) {
+        const Entry& entry = p_Listing.entries[i];
+        html += "<li><a href=\"";
+        appendPercentEncoded (html, entry.name);
+        html += entry.is_directory ? "/\">" : "\">";
+        appendEscaped (html, entry.name);
+        html += entry.is_directory ? "/</a></li>\n" : "</a></li>\n";
+    }
+    html += "</ul>\n<hr>\n";
+
+    size_t page_count = p_Listing.pages.size ();
+    if (page_count > 1) {
+        auto out = std::back_inserter (html);
+        std::format_to (out, "<p>Page {} of {} ({} entries)", p_Page + 1, page_count, p_Listing.entries.size ());
+        if (p_Page > 0)
+            std::format_to (out, " <a href=\"?page={}\">previous</a>", p_Page);
+        if (p_Page + 1 < page_count)
+            std::format_to (out, " <a href=\"?page={}\">next</a>", p_Page + 2);
+        html += "</p>\n";
+    }
+    html += "</body>\n</html>\n";
+    return page;
+}
+
+size_t DirectoryListings::parsePage (std::string_view p_Query) {
+    constexpr std::string_view PAGE_PARAMETER = "page=";
+    while (!p_Query.empty ()) {
+        size_t end = std::min (p_Query.find ('&'), p_Query.size ());
+        std::string_view parameter = p_Query.substr (0, end);
+        if (parameter.starts_with (PAGE_PARAMETER)) {
+            std::string_view value = parameter.substr (PAGE_PARAMETER.size ());
+            size_t page            = 0;
+            auto [ptr, error] = std::from_chars (value.data (), value.data () + value.size (), page);
+            if (error != std::errc () || ptr != value.data () + value.size () || page == 0)
+                return SIZE_MAX;
+            return page - 1;
+        }
+        p_Query.remove_prefix (std::min (end + 1, p_Query.size ()));
+    }
+    return 0;
+}
+
+void DirectoryListings::store (const std::string& p_Path, std::shared_ptr<Listing> p_Listing) {
+    auto itr = m_Listings.find (p_Path);
+    if (itr != m_Listings.end ()) {
+        // read by another worker at the same time
+        m_Bytes -= itr->second->second->bytes;
+        m_Lru.erase (itr->second);
+        m_Listings.erase (itr);
+    }
+    m_Bytes += p_Listing->bytes;
+    m_Lru.emplace_front (p_Path, std::move (p_Listing));
+    m_Listings.emplace (p_Path, m_Lru.begin ());
+}
+
+void DirectoryListings::evict () {
+    while (m_Bytes > m_Budget && !m_Lru.empty ()) {
+        m_Bytes -= m_Lru.back ().second->bytes;
+        m_Listings.erase (m_Lru.back ().first);
+        m_Lru.pop_back ();
+    }
+}
+
+} // namespace ccerve
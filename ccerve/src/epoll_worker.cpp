@@ -0,0 +1,228 @@
+/**
+ * @file epoll_worker.cpp
+ * @brief Holds the definition of the EpollWorker class
+ */
+
+#include "epoll_worker.hpp"
+#include "logger.hpp"
+
+#include <cerrno>
+
+namespace ccerve {
+
+EpollWorker::EpollWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context, int p_ServerSock)
+: Worker (p_ServerSockAddr, p_Context, p_ServerSock) {
+}
+
+EpollWorker::~EpollWorker () {
+    m_Connections.clear ();
+}
+
+void EpollWorker::run () {
+    if (!startListening ())
+        return;
+
+    // the server socket is edge triggered too, so acceptConnections() must
+    // accept until the queue is empty
+    if (!sockets::setNonBlocking (m_ServerSock) ||
+    !m_EventLoop.add (m_ServerSock, EPOLLIN | EPOLLET)) {
+        log::error ("Server socket could not be added to the event loop!");
+        return;
+    }
+
+    if (!m_EventLoop.add (m_WakeFd, EPOLLIN)) {
+        log::error ("Wake up descriptor could not be added to the event loop!");
+        return;
+    }
+
+    while (!m_Stop) {
+        if (m_DrainRequested && !m_Draining)
+            startDraining ();
+        if (m_Draining && m_Connections.empty ())
+            break;
+
+        // wakes up for the next tick of the timers, if any is armed
+        int ready = m_EventLoop.wait (getTimerWaitMs ());
+        if (ready < 0) {
+            log::error ("Event loop was not able to wait for events!");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            const epoll_event& event = m_EventLoop.getEvent (i);
+
+            if (event.data.fd == m_ServerSock) {
+                acceptConnections ();
+                continue;
+            } else if (event.data.fd == m_WakeFd) {
+                // stop() or drain() was called (the while loop checks
+                // which), or the file pool answered requests
+                resetWakeUp ();
+                handleFileJobs (
+                [this] (int p_Sock) -> Connection* {
+                    auto conn_itr = m_Connections.find (p_Sock);
+                    return conn_itr == m_Connections.end () ? nullptr : conn_itr->second.get ();
+                },
+                [this] (Connection& p_Conn) { handleWritable (p_Conn); });
+                continue;
+            }
+
+            // connections closed earlier in this batch are no longer in the map
+            auto conn_itr = m_Connections.find (event.data.fd);
+            if (conn_itr == m_Connections.end ())
+                continue;
+            Connection& conn = *conn_itr->second;
+
+            if (event.events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection (conn);
+            } else if (event.events & EPOLLIN) {
+                handleReadable (conn); // also flushes the responses
+            } else if (event.events & EPOLLOUT) {
+                handleWritable (conn);
+            }
+        }
+
+        expireTimers ([this] (Connection& p_Conn) { closeConnection (p_Conn); });
+
+        // Closed connections are destroyed only now so that their file
+        // descriptor can't be reused by a connection accepted in the same batch
+        m_ClosedConnections.clear ();
+    }
+
+    releaseConnections (m_Connections.size ());
+    m_Connections.clear ();
+    m_ClosedConnections.clear ();
+}
+
+void EpollWorker::acceptConnections () {
+    while (true) {
+        sockaddr_in client_sock_addr;
+        socklen_t client_sock_addr_len = sizeof (client_sock_addr);
+
+        int client_sock = accept4 (m_ServerSock, (sockaddr*)&client_sock_addr,
+        &client_sock_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // EAGAIN means every waiting connection has been accepted
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                m_WorkerMetrics->accept_errors.add ();
+                log::error ("Socket was not able to accept the connection!");
+            }
+            return;
+        }
+
+        if (!admitConnection ()) {
+            sockets::closeSocket (client_sock);
+            continue;
+        }
+
+        if (!m_EventLoop.add (client_sock, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)) {
+            log::error ("Client socket could not be added to the event loop!");
+            sockets::closeSocket (client_sock);
+            releaseConnections ();
+            continue;
+        }
+
+        auto conn = std::make_unique<Connection> (client_sock, client_sock_addr, &m_ConnectionMemory);
+        updateTimer (*conn, false);
+        m_Connections.emplace (client_sock, std::move (conn));
+    }
+}
+
+void EpollWorker::handleReadable (Connection& p_Conn) {
+    // edge triggered: keep reading until the socket has nothing left
+    while (p_Conn.getKeepAlive ()) {
+        if (p_Conn.isInputPaused ()) {
+            // the client sends requests faster than it takes the responses
+            // (or the file pool answers): read on only once enough of them
+            // is sent, else EPOLLOUT (or the file pool) calls
+            // handleWritable() which resumes
+            if (!sendPending (p_Conn) || !resumeInput (p_Conn))
+                return;
+            continue;
+        }
+
+        ssize_t bytes_received = recv (p_Conn.getSock (), m_Buffer, BUFFER_SIZE, 0);
+
+        if (bytes_received == 0) {
+            // Client closed the connection (Normal)
+            closeConnection (p_Conn);
+            return;
+        } else if (bytes_received < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            log::error ("Socket was not able to read data\n");
+            closeConnection (p_Conn);
+            return;
+        }
+
+        handleInput (p_Conn, std::string_view (m_Buffer, bytes_received));
+    }
+
+    handleWritable (p_Conn);
+}
+
+void EpollWorker::handleWritable (Connection& p_Conn) {
+    if (!sendPending (p_Conn))
+        return;
+    // reads on if the client took enough of its responses (or the file pool
+    // answered), serving the requests it sent meanwhile
+    if (p_Conn.isInputPaused () && p_Conn.getKeepAlive ())
+        handleReadable (p_Conn);
+}
+
+bool EpollWorker::sendPending (Connection& p_Conn) {
+    size_t bytes_sent = 0;
+    bool flushed      = p_Conn.flush (bytes_sent);
+    int send_error    = errno;
+    countSent (p_Conn, bytes_sent, flushed && !p_Conn.hasPendingWrites ());
+    if (!flushed) {
+        // a client which reset the connection is just gone
+        if (!sockets::isPeerGone (send_error))
+            log::error ("Socket was not able to send data!");
+        closeConnection (p_Conn);
+        return false;
+    }
+
+    // everything is sent, close if the client asked for it
+    if (!p_Conn.hasPendingWrites () && isFinished (p_Conn)) {
+        closeConnection (p_Conn);
+        return false;
+    }
+    updateTimer (p_Conn, p_Conn.hasPendingWrites ());
+    return true;
+}
+
+void EpollWorker::closeConnection (Connection& p_Conn) {
+    m_EventLoop.remove (p_Conn.getSock ());
+    m_Timers.cancel (p_Conn.getTimer ());
+    releaseConnections ();
+
+    auto conn_itr = m_Connections.find (p_Conn.getSock ());
+    m_ClosedConnections.push_back (std::move (conn_itr->second));
+    m_Connections.erase (conn_itr);
+}
+
+void EpollWorker::startDraining () {
+    m_Draining = true;
+    // new connections go to the sockets still bound to the address, e.g.
+    // those of the server which took them over
+    m_EventLoop.remove (m_ServerSock);
+    closeServerSocket ();
+
+    // a request which has just arrived is answered (with "close"), closing
+    // its connection would make the client see an error
+    std::vector<Connection*> idle;
+    for (auto& [sock, conn] : m_Connections) {
+        if (!conn->hasPendingWrites () && isFinished (*conn) && !sockets::hasUnreadData (sock))
+            idle.push_back (conn.get ());
+    }
+    for (Connection* conn : idle)
+        closeConnection (*conn);
+}
+
+} // namespace ccerve
@@ -0,0 +1,52 @@
+/**
+ * @file event_loop.cpp
+ * @brief Holds the definition of the EventLoop class
+ */
+
+#include "event_loop.hpp"
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace ccerve {
+
+EventLoop::EventLoop (size_t p_MaxEvents) : m_Events (p_MaxEvents) {
+    m_EpollFd = epoll_create1 (EPOLL_CLOEXEC);
+    if (m_EpollFd < 0) {
+        throw exception::EventLoopCreationFailure (
+        "epoll instance could not be created!");
+    }
+}
+
+EventLoop::~EventLoop () {
+    close (m_EpollFd);
+}
+
+bool EventLoop::add (int p_Fd, uint32_t p_Events) {
+    epoll_event event{};
+    event.events  = p_Events;
+    event.data.fd = p_Fd;
+    return epoll_ctl (m_EpollFd, EPOLL_CTL_ADD, p_Fd, &event) == 0;
+}
+
+bool EventLoop::modify (int p_Fd, uint32_t p_Events) {
+    epoll_event event{};
+    event.events  = p_Events;
+    event.data.fd = p_Fd;
+    return epoll_ctl (m_EpollFd, EPOLL_CTL_MOD, p_Fd, &event) == 0;
+}
+
+bool EventLoop::remove (int p_Fd) {
+    return epoll_ctl (m_EpollFd, EPOLL_CTL_DEL, p_Fd, nullptr) == 0;
+}
+
+int EventLoop::wait (int p_TimeoutMs) {
+    int ready;
+    do {
+        ready = epoll_wait (m_EpollFd, m_Events.data (),
+        static_cast<int> (m_Events.size ()), p_TimeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    return ready;
+}
+
+} // namespace ccerve
@@ -0,0 +1,363 @@
+/**
+ * @file file_cache.cpp
+ * @brief Holds the definition of the FileCache class
+ */
+
+#include "file_cache.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace ccerve {
+
+// @brief Events of a watched directory which make entries stale
+static constexpr uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+FileCache::FileCache (size_t p_Budget, size_t p_MaxFileSize, const std::string& p_Root)
+: m_ShardBudget (p_Budget / SHARD_COUNT), m_MaxFileSize (p_MaxFileSize),
+  m_Root (p_Root), m_HasUnwatchedDirs (false), m_Stop (false) {
+    m_InotifyFd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (m_InotifyFd < 0) {
+        throw exception::FileCacheCreationFailure ("inotify instance could not be created!");
+    }
+
+    m_WakeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_WakeFd < 0) {
+        close (m_InotifyFd);
+        throw exception::FileCacheCreationFailure (
+        "Wake up descriptor of the file cache could not be created!");
+    }
+
+    watchTree ("");
+    if (m_WatchedDirs.empty ()) {
+        close (m_WakeFd);
+        close (m_InotifyFd);
+        throw exception::FileCacheCreationFailure ("Served directory could not be watched!");
+    }
+
+    m_Watcher = std::thread ([this] { watch (); });
+}
+
+FileCache::~FileCache () {
+    m_Stop = true;
+    eventfd_write (m_WakeFd, 1);
+    if (m_Watcher.joinable ())
+        m_Watcher.join ();
+
+    close (m_WakeFd);
+    close (m_InotifyFd);
+}
+
+std::string FileCache::makeKey (std::string_view p_Path) {
+    std::filesystem::path normal_path = std::filesystem::path (p_Path).lexically_normal ();
+    if (normal_path.empty () || normal_path.is_absolute ())
+        return "";
+
+    std::string key = normal_path.string ();
+    if (key == "." || key == ".." || key.starts_with ("../"))
+        return "";
+    return key;
+}
+
+std::string_view FileCache::normalKeyView (std::string_view p_Path) {
+    if (!p_Path.starts_with ("./"))
+        return {};
+
+    // every component is a name, none is "." or ".."
+    std::string_view key = p_Path.substr (2);
+    size_t start         = 0;
+    while (true) {
+        size_t end                 = std::min (key.find ('/', start), key.size ());
+        std::string_view component = key.substr (start, end - start);
+        if (component.empty () || component == "." || component == "..")
+            return {};
+        if (end == key.size ())
+            return key;
+        start = end + 1;
+    }
+}
+
+FileCache::Shard& FileCache::getShard (std::string_view p_Key) {
+    return m_Shards[KeyHash{}(p_Key) % SHARD_COUNT];
+}
+
+std::shared_ptr<const CachedFile> FileCache::find (std::string_view p_Path, uint64_t& p_Generation) {
+    // looked up on every request, so only unusual paths are copied
+    std::string_view key = normalKeyView (p_Path);
+    std::string normalized_key;
+    if (key.empty ()) {
+        normalized_key = makeKey (p_Path);
+        key            = normalized_key;
+    }
+    if (key.empty ())
+        return nullptr;
+
+    Shard& shard = getShard (key);
+    std::lock_guard<std::mutex> shard_lock (shard.mutex);
+
+    auto entry_itr = shard.entries.find (key);
+    if (entry_itr == shard.entries.end ()) {
+        shard.misses++;
+        p_Generation = shard.generation;
+        return nullptr;
+    }
+
+    // move to the front of the LRU list
+    shard.lru.splice (shard.lru.begin (), shard.lru, entry_itr->second);
+    shard.hits++;
+    return entry_itr->second->second;
+}
+
+std::shared_ptr<const CachedFile> FileCache::insert (std::string_view p_Path, int p_Fd,
+const struct stat& p_Stat, uint64_t p_Generation) {
+    size_t file_size = static_cast<size_t> (p_Stat.st_size);
+    if (file_size > m_MaxFileSize || file_size + ENTRY_OVERHEAD > m_ShardBudget)
+        return nullptr;
+
+    std::string key = makeKey (p_Path);
+    if (key.empty () || !isWatched (key))
+        return nullptr;
+
+    // read outside of the lock, the other workers keep going meanwhile
+    auto file      = std::make_shared<CachedFile> ();
+    file->mtime    = p_Stat.st_mtim;
+    file->inode    = p_Stat.st_ino;
+    file->contents.resize (file_size);
+    size_t offset = 0;
+    while (offset < file_size) {
+        ssize_t bytes_read = pread (p_Fd, file->contents.data () + offset,
+        file_size - offset, static_cast<off_t> (offset));
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            return nullptr; // failed or the file got shorter
+        offset += bytes_read;
+    }
+
+    return store (std::move (key), std::move (file), p_Generation);
+}
+
+std::shared_ptr<const CachedFile> FileCache::insert (std::string_view p_Path,
+CachedFile&& p_File, uint64_t p_Generation) {
+    size_t file_size = p_File.contents.size ();
+    if (file_size > m_MaxFileSize || file_size + ENTRY_OVERHEAD > m_ShardBudget)
+        return nullptr;
+
+    std::string key = makeKey (p_Path);
+    if (key.empty () || !isWatched (key))
+        return nullptr;
+
+    return store (std::move (key), std::make_shared<CachedFile> (std::move (p_File)), p_Generation);
+}
+
+std::shared_ptr<const CachedFile> FileCache::store (std::string&& p_Key,
+std::shared_ptr<const CachedFile> p_File, uint64_t p_Generation) {
+    Shard& shard = getShard (p_Key);
+    std::lock_guard<std::mutex> shard_lock (shard.mutex);
+
+    // changed while it was read, serve it this once but don't keep it
+    if (shard.generation != p_Generation)
+        return p_File;
+
+    // another worker was faster
+    auto entry_itr = shard.entries.find (p_Key);
+    if (entry_itr != shard.entries.end ())
+        return entry_itr->second->second;
+
+    size_t entry_size = p_File->contents.size () + ENTRY_OVERHEAD;
+    while (!shard.lru.empty () && shard.bytes + entry_size > m_ShardBudget) {
+        removeEntry (shard, shard.entries.find (shard.lru.back ().first));
+        shard.evictions++;
+    }
+
+    shard.lru.emplace_front (p_Key, std::move (p_File));
+    shard.entries.emplace (std::move (p_Key), shard.lru.begin ());
+    shard.bytes += entry_size;
+    return shard.lru.front ().second;
+}
+
+void FileCache::removeEntry (Shard& p_Shard, decltype (Shard::entries)::iterator p_Itr) {
+    p_Shard.bytes -= p_Itr->second->second->contents.size () + ENTRY_OVERHEAD;
+    p_Shard.lru.erase (p_Itr->second);
+    p_Shard.entries.erase (p_Itr);
+}
+
+void FileCache::invalidate (const std::string& p_Path, bool p_Prefix) {
+    std::string key = makeKey (p_Path);
+
+    if (!p_Prefix) {
+        if (key.empty ())
+            return;
+
+        Shard& shard = getShard (key);
+        std::lock_guard<std::mutex> shard_lock (shard.mutex);
+        shard.generation++;
+
+        auto entry_itr = shard.entries.find (key);
+        if (entry_itr != shard.entries.end ()) {
+            removeEntry (shard, entry_itr);
+            shard.invalidations++;
+        }
+        return;
+    }
+
+    // the paths below a directory are spread over every shard
+    std::string prefix = key.empty () ? "" : key + "/";
+    for (Shard& shard : m_Shards) {
+        std::lock_guard<std::mutex> shard_lock (shard.mutex);
+        shard.generation++;
+
+        for (auto entry_itr = shard.entries.begin (); entry_itr != shard.entries.end ();) {
+            auto current_itr = entry_itr++;
+            if (current_itr->first.starts_with (prefix)) {
+                removeEntry (shard, current_itr);
+                shard.invalidations++;
+            }
+        }
+    }
+}
+
+void FileCache::clear () {
+    invalidate ("", true);
+}
+
+FileCacheStats FileCache::getStats () {
+    FileCacheStats stats;
+    for (Shard& shard : m_Shards) {
+        std::lock_guard<std::mutex> shard_lock (shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.invalidations += shard.invalidations;
+        stats.entries += shard.entries.size ();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+bool FileCache::isWatched (const std::string& p_Key) {
+    if (!m_HasUnwatchedDirs)
+        return true;
+
+    std::lock_guard<std::mutex> unwatched_lock (m_UnwatchedDirsMutex);
+    if (m_UnwatchedDirs.contains (""))
+        return false;
+    for (size_t slash = p_Key.find ('/'); slash != std::string::npos;
+    slash             = p_Key.find ('/', slash + 1)) {
+        if (m_UnwatchedDirs.contains (p_Key.substr (0, slash)))
+            return false;
+    }
+    return true;
+}
+
+void FileCache::watchTree (const std::string& p_Dir) {
+    std::string dir_path = p_Dir.empty () ? m_Root : m_Root + "/" + p_Dir;
+
+    int watch_fd = inotify_add_watch (m_InotifyFd, dir_path.c_str (), WATCH_MASK);
+    if (watch_fd < 0) {
+        log::warn ("Directory {} can't be watched, its files are not cached.", dir_path);
+        std::lock_guard<std::mutex> unwatched_lock (m_UnwatchedDirsMutex);
+        m_UnwatchedDirs.insert (p_Dir);
+        m_HasUnwatchedDirs = true;
+        return;
+    }
+    // a directory moved within the tree keeps its watch, only its key changes
+    m_WatchedDirs[watch_fd] = p_Dir;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator (dir_path, error)) {
+        if (entry.is_directory (error) && !entry.is_symlink (error)) {
+            std::string name = entry.path ().filename ().string ();
+            watchTree (p_Dir.empty () ? name : p_Dir + "/" + name);
+        }
+    }
+}
+
+void FileCache::watch () {
+    // big enough for many events at once, aligned for inotify_event
+    alignas (inotify_event) char buffer[16 * 1024];
+    FileCacheStats last_stats;
+
+    pollfd poll_fds[2] = {
+        { .fd = m_InotifyFd, .events = POLLIN, .revents = 0 },
+        { .fd = m_WakeFd, .events = POLLIN, .revents = 0 },
+    };
+
+    while (!m_Stop) {
+        int ready = poll (poll_fds, 2, STATS_INTERVAL_MS);
+        if (ready < 0 && errno != EINTR) {
+            log::error ("File cache stopped watching, clearing it.");
+            clear ();
+            return;
+        }
+
+        if (ready == 0) {
+            // log the counters now and then so the budget can be sized
+            FileCacheStats stats = getStats ();
+            if (stats.hits != last_stats.hits || stats.misses != last_stats.misses) {
+                log::info ("File cache: {} entries, {} bytes, {} hits, {} misses, "
+                           "{} evictions, {} invalidations",
+                stats.entries, stats.bytes, stats.hits, stats.misses,
+                stats.evictions, stats.invalidations);
+                last_stats = stats;
+            }
+            continue;
+        }
+
+        while (true) {
+            ssize_t length = read (m_InotifyFd, buffer, sizeof (buffer));
+            if (length <= 0)
+                break; // EAGAIN: every event has been read
+            handleEvents (buffer, length);
+        }
+    }
+}
+
+void FileCache::handleEvents (const char* p_Buffer, size_t p_Length) {
+    for (size_t offset = 0; offset < p_Length;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*> (p_Buffer + offset);
+        offset += sizeof (inotify_event) + event->len;
+
+        // events were lost, anything could have changed
+        if (event->mask & IN_Q_OVERFLOW) {
+            clear ();
+            continue;
+        }
+
+        auto dir_itr = m_WatchedDirs.find (event->wd);
+        if (dir_itr == m_WatchedDirs.end ())
+            continue;
+
+        // the directory is gone
+        if (event->mask & IN_IGNORED) {
+            m_WatchedDirs.erase (dir_itr);
+            continue;
+        }
+        if (event->len == 0)
+            continue;
+
+        std::string name = event->name;
+        std::string path = dir_itr->second.empty () ? name : dir_itr->second + "/" + name;
+
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                watchTree (path);
+            invalidate (path, true);
+        } else {
+            invalidate (path);
+            // variants compressed in memory were made from the old contents
+            for (std::string_view suffix : VARIANT_SUFFIXES) {
+                invalidate (path + std::string (suffix));
+            }
+        }
+    }
+}
+
+} // namespace ccerve
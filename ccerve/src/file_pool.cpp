@@ -0,0 +1,86 @@
+/**
+ * @file file_pool.cpp
+ * @brief Holds the definition of the FilePool class
+ */
+
+#include "file_pool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace ccerve {
+
+FilePool::FilePool (size_t p_Threads) {
+    size_t count = std::max<size_t> (p_Threads, 1);
+    for (size_t i = 0; i < count; i++)
+        m_Deques.push_back (std::make_unique<Deque> ());
+    for (size_t i = 0; i < count; i++)
+        m_Threads.emplace_back ([this, i] { run (i); });
+}
+
+FilePool::~FilePool () {
+    {
+        std::lock_guard<std::mutex> sleep_lock (m_SleepMutex);
+        m_Stop = true;
+    }
+    m_SleepCondition.notify_all ();
+    for (std::thread& thread : m_Threads) {
+        if (thread.joinable ())
+            thread.join ();
+    }
+}
+
+void FilePool::submit (Task p_Task) {
+    // a thread keeps the deque it got first, whichever pool it submits to
+    thread_local size_t own_deque = SIZE_MAX;
+    if (own_deque == SIZE_MAX)
+        own_deque = m_NextDeque++;
+    Deque& deque = *m_Deques[own_deque % m_Deques.size ()];
+
+    {
+        std::lock_guard<std::mutex> sleep_lock (m_SleepMutex);
+        m_Queued++;
+    }
+    {
+        std::lock_guard<std::mutex> deque_lock (deque.mutex);
+        deque.tasks.push_back (std::move (p_Task));
+    }
+    m_SleepCondition.notify_one ();
+}
+
+void FilePool::run (size_t p_Index) {
+    while (true) {
+        Task task;
+        if (take (p_Index, task)) {
+            task ();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> sleep_lock (m_SleepMutex);
+        m_SleepCondition.wait (sleep_lock, [this] { return m_Stop || m_Queued > 0; });
+        if (m_Stop && m_Queued == 0)
+            return;
+    }
+}
+
+bool FilePool::take (size_t p_Index, Task& p_Task) {
+    for (size_t i = 0; i < m_Deques.size (); i++) {
+        Deque& deque = *m_Deques[(p_Index + i) % m_Deques.size ()];
+        std::lock_guard<std::mutex> deque_lock (deque.mutex);
+        if (deque.tasks.empty ())
+            continue;
+        // stolen from the other end, away from the tasks its own thread takes
+        if (i == 0) {
+            p_Task = std::move (deque.tasks.front ());
+            deque.tasks.pop_front ();
+        } else {
+            p_Task = std::move (deque.tasks.back ());
+            deque.tasks.pop_back ();
+        }
+        m_Queued--;
+        return true;
+    }
+    return false;
+}
+
+} // namespace ccerve
@@ -0,0 +1,187 @@
+/**
+ * @file handoff.cpp
+ * @brief Holds the definitions of the functions handing listening sockets
+ * over to a new server
+ */
+
+#include "handoff.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace ccerve {
+namespace handoff {
+
+// @brief Descriptors one message may carry (SCM_MAX_FD of the kernel)
+static constexpr size_t MAX_SOCKETS_PER_MESSAGE = 253;
+
+// @brief Byte the new server sends once it serves the sockets
+static constexpr char READY = 'R';
+
+pid_t spawn (const std::vector<std::string>& p_Command, int& p_Channel) {
+    if (p_Command.empty ()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int channel[2];
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0)
+        return -1;
+
+    // prepared before fork(): the child of a process with threads may only
+    // call async-signal-safe functions until it execs
+    std::vector<char*> argv;
+    for (const std::string& arg : p_Command)
+        argv.push_back (const_cast<char*> (arg.c_str ()));
+    argv.push_back (nullptr);
+
+    std::string channel_variable = std::string (CHANNEL_ENV) + "=" + std::to_string (channel[1]);
+    std::string_view channel_prefix (channel_variable.data (), std::strlen (CHANNEL_ENV) + 1);
+    std::vector<char*> envp;
+    for (char** variable = environ; *variable; variable++) {
+        if (!std::string_view (*variable).starts_with (channel_prefix))
+            envp.push_back (*variable);
+    }
+    envp.push_back (channel_variable.data ());
+    envp.push_back (nullptr);
+
+    pid_t pid = fork ();
+    if (pid == 0) {
+        // the new server's end stays open across exec, and the signals this
+        // server handles itself are unblocked again
+        fcntl (channel[1], F_SETFD, 0);
+        sigset_t signals;
+        sigfillset (&signals);
+        sigprocmask (SIG_UNBLOCK, &signals, nullptr);
+        execvpe (argv[0], argv.data (), envp.data ());
+        _exit (127);
+    }
+
+    int fork_errno = errno;
+    close (channel[1]);
+    if (pid < 0) {
+        close (channel[0]);
+        errno = fork_errno;
+        return -1;
+    }
+    p_Channel = channel[0];
+    return pid;
+}
+
+bool sendSockets (int p_Channel, std::span<const int> p_Socks) {
+    // every message carries one byte, telling whether more follow
+    size_t sent = 0;
+    do {
+        size_t count = std::min (p_Socks.size () - sent, MAX_SOCKETS_PER_MESSAGE);
+        char more    = sent + count < p_Socks.size ();
+
+        iovec iov{ &more, 1 };
+        msghdr msg{};
+        msg.msg_iov    = &iov;
+        msg.msg_iovlen = 1;
+
+        alignas (cmsghdr) char control[CMSG_SPACE (MAX_SOCKETS_PER_MESSAGE * sizeof (int))]{};
+        if (count > 0) {
+            msg.msg_control    = control;
+            msg.msg_controllen = CMSG_SPACE (count * sizeof (int));
+            cmsghdr* cmsg      = CMSG_FIRSTHDR (&msg);
+            cmsg->cmsg_level   = SOL_SOCKET;
+            cmsg->cmsg_type    = SCM_RIGHTS;
+            cmsg->cmsg_len     = CMSG_LEN (count * sizeof (int));
+            std::memcpy (CMSG_DATA (cmsg), p_Socks.data () + sent, count * sizeof (int));
+        }
+
+        ssize_t ret;
+        do {
+            ret = sendmsg (p_Channel, &msg, MSG_NOSIGNAL);
+        } while (ret < 0 && errno == EINTR);
+        if (ret != 1)
+            return false;
+        sent += count;
+    } while (sent < p_Socks.size ());
+    return true;
+}
+
+bool waitReady (int p_Channel, int p_TimeoutMs) {
+    pollfd channel{ p_Channel, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll (&channel, 1, p_TimeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0)
+        return false;
+
+    // the other end closes the channel without a byte if it exits
+    char reply = 0;
+    return recv (p_Channel, &reply, 1, 0) == 1 && reply == READY;
+}
+
+int takeChannel () {
+    const char* variable = std::getenv (CHANNEL_ENV);
+    if (!variable)
+        return -1;
+
+    char* end       = nullptr;
+    long channel_fd = std::strtol (variable, &end, 10);
+    bool valid      = end != variable && *end == '\0' && channel_fd >= 0 && channel_fd <= INT_MAX;
+    // servers this one starts get a channel of their own
+    unsetenv (CHANNEL_ENV);
+    if (!valid || fcntl (static_cast<int> (channel_fd), F_SETFD, FD_CLOEXEC) < 0)
+        return -1;
+    return static_cast<int> (channel_fd);
+}
+
+std::vector<int> receiveSockets (int p_Channel) {
+    std::vector<int> socks;
+    while (true) {
+        char more = 0;
+        iovec iov{ &more, 1 };
+        alignas (cmsghdr) char control[CMSG_SPACE (MAX_SOCKETS_PER_MESSAGE * sizeof (int))];
+        msghdr msg{};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof (control);
+
+        ssize_t ret = recvmsg (p_Channel, &msg, MSG_CMSG_CLOEXEC);
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR (&msg); ret == 1 && cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+            for (size_t i = 0; i < count; i++) {
+                int sock;
+                std::memcpy (&sock, CMSG_DATA (cmsg) + i * sizeof (int), sizeof (int));
+                socks.push_back (sock);
+            }
+        }
+
+        if (ret != 1 || (msg.msg_flags & MSG_CTRUNC)) {
+            for (int sock : socks)
+                close (sock);
+            return {};
+        }
+        if (!more)
+            return socks;
+    }
+}
+
+bool sendReady (int p_Channel) {
+    return send (p_Channel, &READY, 1, MSG_NOSIGNAL) == 1;
+}
+
+} // namespace handoff
+} // namespace ccerve
@@ -4,209 +4,775 @@
  */
 
 #include "http_parser.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fcntl.h>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace ccerve {
 namespace parse {
 
+// @brief Longest entity tag makeETag() renders
+static constexpr size_t MAX_ETAG_SIZE = 80;
+
 /**
- * @brief Fills the body key of the input HeaderMap with the data of the file at
- * path specified by resource_path argument.
- * @param header_map (HeaderMap&)
- * @param resource_path The path to the resource file
- * @param read_mode For binary read mode or text read mode
- * @return whether the operation was successful(0) or not(1).
+ * @brief Renders the strong entity tag of the file in response from its
+ * inode, size and modification time. The content coding is part of it, so
+ * every compressed variant has a tag of its own.
+ * @param buffer Receives at most MAX_ETAG_SIZE characters
+ * @return view of the tag (including its quotes) in buffer
  */
-static auto getFileData (HeaderMap& header_map,
-const std::string& resource_path,
-std::ios::openmode read_mode) -> bool {
-    std::ifstream file (resource_path, read_mode);
+static auto makeETag (const Response& response, char* buffer) -> std::string_view {
+    char* end       = buffer;
+    char* const last = buffer + MAX_ETAG_SIZE;
+    *end++ = '"';
+    end    = std::to_chars (end, last, response.inode, 16).ptr;
+    *end++ = '-';
+    end    = std::to_chars (end, last, response.full_size, 16).ptr;
+    *end++ = '-';
+    end    = std::to_chars (end, last, response.last_modified.tv_sec, 16).ptr;
+    *end++ = '.';
+    end    = std::to_chars (end, last, response.last_modified.tv_nsec, 16).ptr;
+    if (!response.content_encoding.empty ()) {
+        *end++ = '-';
+        end    = std::copy (response.content_encoding.begin (), response.content_encoding.end (), end);
+    }
+    *end++ = '"';
+    return std::string_view (buffer, end - buffer);
+}
+
+/**
+ * @brief Whether the client already has the file in response: If-None-Match
+ * lists its entity tag or, if the request has no If-None-Match, it wasn't
+ * modified since the date of If-Modified-Since (RFC 9110 13.2.2)
+ */
+static auto isNotModified (const Request& request, const Response& response) -> bool {
+    std::string_view if_none_match = request.get (Header::IF_NONE_MATCH);
+    if (!if_none_match.empty ()) {
+        char etag_buffer[MAX_ETAG_SIZE];
+        return matchesEntityTag (if_none_match, makeETag (response, etag_buffer));
+    }
 
-    if (std::filesystem::is_directory (resource_path)) {
+    std::string_view if_modified_since = request.get (Header::IF_MODIFIED_SINCE);
+    time_t date = 0;
+    return !if_modified_since.empty () && parseHttpDate (if_modified_since, date) &&
+    response.last_modified.tv_sec <= date;
+}
+
+// @brief Makes a file of the file cache the body of response
+static auto useCachedFile (Response& response, std::shared_ptr<const CachedFile> cached_file) -> void {
+    response.last_modified = cached_file->mtime;
+    response.inode         = cached_file->inode;
+    response.full_size     = cached_file->contents.size ();
+    response.body          = cached_file->contents;
+    response.cached_file   = std::move (cached_file);
+}
+
+/**
+ * @brief Opens the file at resource_path (which isn't cached) and puts it into
+ * response: into the file cache if it is small enough, as an open file
+ * otherwise. If the client already has a file which isn't cached, only its
+ * validators are put into response and its contents aren't read.
+ * @param generation Returned by the FileCache::find() of resource_path
+ * @return whether it is a regular file which could be opened
+ */
+static auto openFileData (Response& response, const Request& request,
+const std::pmr::string& resource_path, FileCache* file_cache, uint64_t generation) -> bool {
+    int file_fd = open (resource_path.c_str (), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
         return false;
     }
 
-    // read all data and store it in body variable
-    if (file.is_open ()) {
-        std::ostringstream osstr;
-        osstr << file.rdbuf ();
+    struct stat file_stat;
+    if (fstat (file_fd, &file_stat) < 0 || !S_ISREG (file_stat.st_mode)) {
+        close (file_fd); // directories and the like can't be served
+        return false;
+    }
+    response.last_modified = file_stat.st_mtim;
+    response.inode         = file_stat.st_ino;
+    response.full_size     = static_cast<size_t> (file_stat.st_size);
 
-        header_map["body"] = osstr.str ();
+    // cached even if the client already has it: clients which only
+    // revalidate the file find it there next time
+    if (file_cache) {
+        if (auto cached_file = file_cache->insert (resource_path, file_fd, file_stat, generation)) {
+            close (file_fd);
+            useCachedFile (response, std::move (cached_file));
+            return true;
+        }
+    }
 
-        file.close ();
+    if (isNotModified (request, response)) {
+        close (file_fd); // answered with a 304
         return true;
     }
-    return false;
+
+    response.file_fd   = file_fd;
+    response.file_size = static_cast<size_t> (file_stat.st_size);
+    return true;
 }
 
 /**
- * @brief Fills the content-type header of the header_map if the content-type is
- * supported
- * @param  header_map (HeaderMap&).
+ * @brief Looks resource_path up in the file cache
+ * @param generation On a miss, receives what openFileData() needs
+ * @return the cached file (possibly a missing one), nullptr on a miss
  */
-static auto getContentType (HeaderMap& header_map) -> void {
-    std::filesystem::path resrc_path (header_map["resource-path"]);
-    header_map["content-type"] = resrc_path.extension ().string ();
-
-    size_t position_of_extension_dot = header_map["content-type"].find (".");
-
-    std::string temp_content_type = header_map["content-type"];
-    if (position_of_extension_dot != std::string::npos) {
-        for (int i = 0; i < TOTAL_CONTENT_TYPES; i++) {
-            if (temp_content_type == TEXT_FILE_FORMATS[i]) {
-                // resource_extension has the format ".ext". I want ext
-                // used .substr(position_of_dot + 1) to return everything after
-                // the "."
-                temp_content_type =
-                "text/" + temp_content_type.substr (position_of_extension_dot + 1);
-                header_map["content-type"] = temp_content_type;
-                return;
-            } else if (temp_content_type == BINARY_FILE_FORMATS[i]) {
-                temp_content_type =
-                "image/" + temp_content_type.substr (position_of_extension_dot + 1);
-                header_map["content-type"] = temp_content_type;
-                return;
-            }
-        }
+static auto findCachedFile (std::string_view resource_path, FileCache* file_cache,
+uint64_t& generation) -> std::shared_ptr<const CachedFile> {
+    return file_cache ? file_cache->find (resource_path, generation) : nullptr;
+}
 
-        temp_content_type          = "USCT";
-        header_map["content-type"] = temp_content_type;
+/**
+ * @brief Gets the file at path specified by resource_path argument so that it
+ * can be sent as the body of the response. Small files come from the file
+ * cache (and are put into it on a miss). Other files aren't read here, their
+ * contents are sent straight from the page cache to the socket by the
+ * connection (sendfile).
+ * @param response (Response&) receives the cached contents or the file
+ * descriptor and size
+ * @param request (const Request&) the request asking for the file
+ * @param resource_path The path to the resource file
+ * @param file_cache nullptr if there is no file cache
+ * @param blocked nullptr if the file may be read from disk, otherwise set
+ * (and false returned) instead of reading it
+ * @return whether the operation was successful or not.
+ */
+static auto getFileData (Response& response, const Request& request,
+const std::pmr::string& resource_path, FileCache* file_cache, bool* blocked) -> bool {
+    uint64_t generation = 0;
+    if (auto cached_file = findCachedFile (resource_path, file_cache, generation)) {
+        // a variant the compressor made isn't a file, the watcher drops it
+        // once a file shows up at its path
+        if (cached_file->missing || cached_file->made_in_memory)
+            return false;
+        useCachedFile (response, std::move (cached_file));
+        return true;
+    }
+    if (blocked) {
+        *blocked = true;
+        return false;
     }
+    return openFileData (response, request, resource_path, file_cache, generation);
 }
 
+// @brief A content coding the server sends and the suffix of its variants
+struct Encoding {
+    ContentCoding coding;
+    std::string_view suffix;
+    std::string_view name;
+};
+
+// @brief Most preferred first
+static constexpr Encoding ENCODINGS[] = {
+    { ContentCoding::BROTLI, FileCache::VARIANT_SUFFIXES[0], "br" },
+    { ContentCoding::GZIP, FileCache::VARIANT_SUFFIXES[1], "gzip" },
+};
+
+// @brief A compressed variant which doesn't exist yet, but can be made by
+// the compressor
+struct MissingVariant {
+    const Encoding* encoding = nullptr;
+    uint64_t generation      = 0;
+};
+
 /**
- * @brief Reads the file if the type of content (png, txt, etc) is supported
- * @param  header_map (HeaderMap&).
- * @return whether the read operation was successful or not
+ * @brief Gets the best compressed variant of the file at resource_path the
+ * client accepts: a sidecar file next to it (e.g. "x.css.br") or a variant the
+ * compressor made. Variants found missing are remembered in the file cache so
+ * they aren't looked for on disk on every request.
+ * @param missing Receives the variants the compressor should make, with the
+ * generation their cache entry had before the file itself is looked up
+ * @param missing_count Number of entries put into missing
+ * @param blocked nullptr if variants may be looked for on disk, otherwise set
+ * (and false returned) instead of looking for one
+ * @return whether response got a variant (if not, it isn't touched)
  */
-static auto readResource (HeaderMap& header_map, const std::string& resource_path) -> bool {
-    bool read_status = false;
-
-    // read file data in the appropriate manner according to their extensions
-    // e.g binary read for images
-    for (int i = 0; i < TOTAL_CONTENT_TYPES; i++) {
-        if (header_map["content-type"] == TEXT_CONTENT_TYPES[i]) {
-            read_status = getFileData (header_map, resource_path,
-            std::ios::in); // read file in normal text mode
-            if (read_status)
-                return read_status;
-        } else if (header_map["content-type"] == IMAGE_CONTENT_TYPES[i]) {
-            read_status = getFileData (header_map, resource_path,
-            std::ios::binary); // read file in binary mode
-            if (read_status)
-                return read_status;
+static auto getCompressedFileData (Response& response, const Request& request,
+const std::pmr::string& resource_path, AcceptedEncodings accepted, FileCache* file_cache, Compressor* compressor,
+MissingVariant (&missing)[std::size (ENCODINGS)], size_t& missing_count, bool* blocked) -> bool {
+    for (const Encoding& encoding : ENCODINGS) {
+        if (encoding.coding == ContentCoding::BROTLI ? !accepted.brotli : !accepted.gzip)
+            continue;
+
+        std::pmr::string variant_path (resource_path.get_allocator ());
+        variant_path.reserve (resource_path.size () + encoding.suffix.size ());
+        variant_path += resource_path;
+        variant_path += encoding.suffix;
+
+        // part of the entity tag openFileData() compares
+        response.content_encoding = encoding.name;
+
+        uint64_t generation = 0;
+        if (auto cached_file = findCachedFile (variant_path, file_cache, generation)) {
+            if (cached_file->missing)
+                continue;
+            useCachedFile (response, std::move (cached_file));
+        } else if (blocked) {
+            *blocked = true;
+            break;
+        } else if (!openFileData (response, request, variant_path, file_cache, generation)) {
+            if (!file_cache) {
+                continue;
+            } else if (compressor && Compressor::isSupported (encoding.coding)) {
+                missing[missing_count++] = { &encoding, generation };
+            } else {
+                CachedFile missing_file;
+                missing_file.missing = true;
+                file_cache->insert (variant_path, std::move (missing_file), generation);
+            }
+            continue;
         }
+        return true;
     }
-    return read_status;
+    response.content_encoding = {};
+    return false;
 }
 
+// @brief Status line of a status code for both HTTP versions we speak
+struct StatusLine {
+    int status_code;
+    std::string_view http_1_1;
+    std::string_view http_1_0;
+};
+
+static constexpr StatusLine STATUS_LINES[] = {
+    { 200, "HTTP/1.1 200 OK\r\n", "HTTP/1.0 200 OK\r\n" },
+    { 206, "HTTP/1.1 206 Partial Content\r\n", "HTTP/1.0 206 Partial Content\r\n" },
+    { 301, "HTTP/1.1 301 Moved Permanently\r\n", "HTTP/1.0 301 Moved Permanently\r\n" },
+    { 304, "HTTP/1.1 304 Not Modified\r\n", "HTTP/1.0 304 Not Modified\r\n" },
+    { 400, "HTTP/1.1 400 Bad Request\r\n", "HTTP/1.0 400 Bad Request\r\n" },
+    { 404, "HTTP/1.1 404 Not Found\r\n", "HTTP/1.0 404 Not Found\r\n" },
+    { 413, "HTTP/1.1 413 Content Too Large\r\n", "HTTP/1.0 413 Content Too Large\r\n" },
+    { 416, "HTTP/1.1 416 Range Not Satisfiable\r\n", "HTTP/1.0 416 Range Not Satisfiable\r\n" },
+    { 431, "HTTP/1.1 431 Request Header Fields Too Large\r\n",
+    "HTTP/1.0 431 Request Header Fields Too Large\r\n" },
+    { 501, "HTTP/1.1 501 Not Implemented\r\n", "HTTP/1.0 501 Not Implemented\r\n" },
+};
+
 /**
- * @brief Creates key-value pairs in the HeaderMap containing info regarding
- * HTTP response.This function is a utitliy function which isn't supposed to be
- * called in isolation.
- * @param  header_map (HeaderMap&).
- * @param  read_status (int) whether the operation of reading the resource asked
- * for was successful or not.
+ * @brief Turns response into an error page
+ * @param response (Response&)
+ * @param status_code HTTP status code of the error (must be in STATUS_LINES)
+ * @param body HTML page explaining the error
  */
-static auto fillHTTPResponseInfo (HeaderMap& header_map, bool read_status) -> void {
-    if (read_status == false) {
-        header_map["status-code"]   = "404";
-        header_map["reason-phrase"] = "Not Found";
-        header_map["body"]          = RESOURCE_NOT_FOUND_HTML;
-    } else {
-        if (header_map["content-type"] == "USCT" || header_map["content-type"] == "") {
-            header_map["status-code"]   = "404";
-            header_map["reason-phrase"] = "Bad Request";
-            header_map["body"]          = CONTENT_TYPE_NOT_SUPPORTED_HTML;
-        } else {
-            header_map["status-code"]   = "200";
-            header_map["reason-phrase"] = "OK";
-        }
-    }
+static auto fillErrorResponse (Response& response, int status_code, std::string_view body) -> void {
+    response.status_code  = status_code;
+    response.content_type = "text/html";
+    response.body         = body;
 }
 
 /**
- * @brief Construct a HTTP Response
- * @param header_map (HeaderMap&)
- * @return HTTP response in the form of std::string
+ * @brief Redirects the request for a directory without the trailing '/' to
+ * the path with it, so relative links of its index.html or listing resolve
+ * below it
  */
-static auto constructResponse (HeaderMap& header_map) -> std::string {
-    std::string response = "";
-    response += header_map["http-version"] + " ";
-    response += header_map["status-code"] + " ";
-    response += header_map["reason-phrase"] + "\r\n";
-    response += "Content-Type: " + header_map["content-type"] + "\r\n";
-    response += "Content-Length: " + std::to_string (header_map["body"].length ()) + "\r\n\r\n";
-    response += header_map["body"];
+static auto fillRedirectResponse (Response& response, const Request& request) -> void {
+    fillErrorResponse (response, 301, MOVED_PERMANENTLY_HTML);
+    std::string_view query = request.target.substr (request.path.size ());
+    response.location.reserve (request.path.size () + 1 + query.size ());
+    response.location += request.path;
+    response.location += '/';
+    response.location += query;
+}
 
-    return response;
+// @brief Whether resource_path is a directory
+static auto isDirectory (const std::pmr::string& resource_path) -> bool {
+    struct stat file_stat;
+    return stat (resource_path.c_str (), &file_stat) == 0 && S_ISDIR (file_stat.st_mode);
+}
+
+/**
+ * @brief Appends the path of a request target to resource_path with its
+ * percent-encoded octets decoded (links of directory listings are encoded)
+ * @return false if an escape is malformed or stands for a NUL or a '/', or a
+ * segment is "." or ".." once decoded: the path could leave the served
+ * directory
+ */
+static auto appendDecodedPath (std::pmr::string& resource_path, std::string_view path) -> bool {
+    auto hex_value = [] (char c) -> int {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    };
+    // where the segment being decoded starts in resource_path
+    size_t segment_start = resource_path.size ();
+    auto is_dot_segment  = [&resource_path, &segment_start] {
+        std::string_view segment = std::string_view (resource_path).substr (segment_start);
+        return segment == "." || segment == "..";
+    };
+    for (size_t i = 0; i < path.size (); i++) {
+        if (path[i] == '/') {
+            if (is_dot_segment ())
+                return false;
+            resource_path += '/';
+            segment_start = resource_path.size ();
+            continue;
+        }
+        if (path[i] != '%') {
+            resource_path += path[i];
+            continue;
+        }
+        int high = i + 2 < path.size () ? hex_value (path[i + 1]) : -1;
+        int low  = i + 2 < path.size () ? hex_value (path[i + 2]) : -1;
+        char octet = static_cast<char> (high * 16 + low);
+        if (high < 0 || low < 0 || octet == '\0' || octet == '/')
+            return false;
+        resource_path += octet;
+        i += 2;
+    }
+    return !is_dot_segment ();
+}
+
+// @brief Lets go of the file in response, which is answered without it
+static auto dropBody (Response& response) -> void {
+    if (response.file_fd >= 0) {
+        close (response.file_fd);
+        response.file_fd = -1;
+    }
+    response.file_size = 0;
+    response.cached_file.reset ();
+    response.body = {};
+}
+
+// @brief Appends the decimal digits of number to out
+static auto appendNumber (std::pmr::string& out, uint64_t number) -> void {
+    char digits[std::numeric_limits<uint64_t>::digits10 + 1];
+    auto [end, error] = std::to_chars (std::begin (digits), std::end (digits), number);
+    if (error == std::errc ())
+        out.append (digits, end);
 }
 
-auto parseRequest (HeaderMap& header_map, const std::string& message) -> void {
-    std::istringstream req_msg_stream (message);
+// @brief Appends "a-b/size" (b included) to out
+static auto appendRange (std::pmr::string& out, ByteRange range, size_t size) -> void {
+    appendNumber (out, range.start);
+    out += '-';
+    appendNumber (out, range.end - 1);
+    out += '/';
+    appendNumber (out, size);
+}
 
-    req_msg_stream >> header_map["method"] >> header_map["resource-path"] >>
-    header_map["http-version"];
-    header_map["resource-path"] =
-    "." + header_map["resource-path"]; // resource_path by default is
-                                       // "/x/y/..../z.ext". convert it to
-                                       // "./x/y/.../z.ext"
+// @brief Puts a random delimiter of the parts of a multipart/byteranges body
+// into boundary
+static auto makeBoundary (std::pmr::string& boundary) -> void {
+    thread_local std::mt19937_64 generator{ std::random_device{}() };
+    constexpr std::string_view HEX_DIGITS = "0123456789abcdef";
 
-    // * TODO: Display the directory if the file is not specified
-    // serve index.html if no resource is specified
-    if (header_map["resource-path"] == "./" || header_map["resource-path"] == "") {
-        header_map["resource-path"] = "./index.html";
-        header_map["content-type"]  = "text/html";
+    boundary.assign (16, '0');
+    uint64_t bits = generator ();
+    for (char& digit : boundary) {
+        digit = HEX_DIGITS[bits & 0xf];
+        bits >>= 4;
     }
+}
 
-    std::string header_line;
+/**
+ * @brief Whether the If-Range condition of request holds for the file in
+ * response (which it does if there is none): its entity tag, compared
+ * strongly, or its modification date
+ */
+static auto ifRangeMatches (const Request& request, const Response& response) -> bool {
+    std::string_view if_range = request.get (Header::IF_RANGE);
+    if (if_range.empty ())
+        return true;
+    if (if_range.front () == '"') {
+        char etag_buffer[MAX_ETAG_SIZE];
+        return if_range == makeETag (response, etag_buffer);
+    }
+    time_t date = 0;
+    return parseHttpDate (if_range, date) && date == response.last_modified.tv_sec;
+}
 
-    while (std::getline (req_msg_stream, header_line)) {
-        // Ignore empty lines (end of headers)
-        if (header_line.empty ())
-            continue;
+/**
+ * @brief Cuts the ranges of the file in response the Range header of request
+ * asks for out of it (206), or turns it into a 416 if none of them lie within
+ * it. A response to a request without (usable) ranges is left as it is.
+ */
+static auto applyRange (const Request& request, Response& response) -> void {
+    std::string_view range_value = request.get (Header::RANGE);
+    if (range_value.empty () || !ifRangeMatches (request, response))
+        return;
+
+    std::array<ByteRange, MAX_RANGES> ranges;
+    size_t range_count = 0;
+    switch (parseRange (range_value, response.full_size, ranges, range_count)) {
+    case RangeStatus::IGNORED:
+        return;
 
-        // Find the position of the first colon
-        size_t colon_pos = header_line.find (':');
-        if (colon_pos != std::string::npos) {
-            std::string header_name  = header_line.substr (0, colon_pos);
-            std::string header_value = header_line.substr (colon_pos + 1);
+    case RangeStatus::UNSATISFIABLE:
+        dropBody (response);
+        response.mime_type = nullptr;
+        fillErrorResponse (response, 416, RANGE_NOT_SATISFIABLE_HTML);
+        response.content_range = "bytes */";
+        appendNumber (response.content_range, response.full_size);
+        return;
 
-            // Trim leading spaces in header value
-            header_value.erase (0, header_value.find_first_not_of (" \t"));
+    case RangeStatus::SATISFIABLE:
+        break;
+    }
 
-            // Insert into map
-            header_map[header_name] = header_value;
+    response.status_code = 206;
+    if (range_count == 1) {
+        ByteRange range = ranges[0];
+        response.content_range = "bytes ";
+        appendRange (response.content_range, range, response.full_size);
+        if (response.file_fd >= 0) {
+            response.file_offset = static_cast<off_t> (range.start);
+            response.file_size   = range.end - range.start;
+        } else {
+            response.body = response.body.substr (range.start, range.end - range.start);
         }
+        return;
     }
+
+    // every part repeats the type of the file, the response has its own
+    makeBoundary (response.multipart_boundary);
+    response.parts.reserve (range_count);
+    for (size_t i = 0; i < range_count; i++) {
+        // BodyPart isn't allocator-aware, its head is given the allocator
+        std::pmr::string& head =
+        response.parts.emplace_back (std::pmr::string (response.parts.get_allocator ()), ranges[i]).head;
+        head += "\r\n--";
+        head += response.multipart_boundary;
+        head += "\r\nContent-Type: ";
+        head += response.content_type;
+        head += "\r\nContent-Range: bytes ";
+        appendRange (head, ranges[i], response.full_size);
+        head += "\r\n\r\n";
+    }
+    response.multipart_end = "\r\n--";
+    response.multipart_end += response.multipart_boundary;
+    response.multipart_end += "--\r\n";
 }
 
-auto handleRequest (HeaderMap& header_map, const std::string& http_request) -> std::string {
-    parseRequest (header_map, http_request);
-    getContentType (header_map);
+/**
+ * @brief Picks the status line and renders the headers of a HTTP Response
+ * into one buffer. The body isn't touched, it is sent from where it is.
+ * @param request (const Request&) the request being answered
+ * @param response (Response&) whose status line and headers are filled
+ */
+static auto constructResponse (const Request& request, Response& response) -> void {
+    size_t content_length = response.file_fd >= 0 ? response.file_size : response.body.size ();
+    if (!response.parts.empty ()) {
+        content_length = response.multipart_end.size ();
+        for (const BodyPart& part : response.parts)
+            content_length += part.head.size () + part.range.end - part.range.start;
+    }
+
+    // answer with the version of the request if we speak it
+    for (const StatusLine& status_line : STATUS_LINES) {
+        if (status_line.status_code == response.status_code) {
+            response.status_line =
+            request.version == "HTTP/1.0" ? status_line.http_1_0 : status_line.http_1_1;
+            break;
+        }
+    }
 
-    for (int i = 0; i < TOTAL_CONTENT_TYPES; i++) {
-        if (header_map["method"] == "GET") {
-            if (header_map["content-type"] == ALL_CONTENT_TYPES[i]) {
-                bool read_status = readResource (header_map, header_map["resource-path"]);
-                fillHTTPResponseInfo (header_map, read_status);
-            }
+    char length_buffer[24];
+    auto [length_end, error] = std::to_chars (length_buffer, length_buffer + sizeof (length_buffer), content_length);
+    std::string_view length (length_buffer, length_end - length_buffer);
+
+    // validators and caching policy of files, none for generated pages
+    char etag_buffer[MAX_ETAG_SIZE];
+    char date_buffer[HTTP_DATE_SIZE];
+    std::string_view etag, last_modified, cache_control;
+    if (response.mime_type) {
+        etag          = makeETag (response, etag_buffer);
+        last_modified = formatHttpDate (response.last_modified.tv_sec, date_buffer);
+        cache_control = mime::cacheControl (response.mime_type->cache_policy);
+    }
+
+    constexpr std::string_view CONTENT_TYPE_FIELD     = "Content-Type: ";
+    constexpr std::string_view MULTIPART_TYPE         = "multipart/byteranges; boundary=";
+    constexpr std::string_view CONTENT_LENGTH_FIELD   = "Content-Length: ";
+    constexpr std::string_view CONTENT_RANGE_FIELD    = "Content-Range: ";
+    constexpr std::string_view ACCEPT_RANGES_FIELD    = "Accept-Ranges: bytes\r\n";
+    constexpr std::string_view CONTENT_ENCODING_FIELD = "Content-Encoding: ";
+    constexpr std::string_view VARY_FIELD             = "Vary: Accept-Encoding\r\n";
+    constexpr std::string_view ETAG_FIELD             = "ETag: ";
+    constexpr std::string_view LAST_MODIFIED_FIELD    = "Last-Modified: ";
+    constexpr std::string_view CACHE_CONTROL_FIELD    = "Cache-Control: ";
+    constexpr std::string_view LOCATION_FIELD         = "Location: ";
+    constexpr std::string_view CONNECTION_CLOSE_FIELD = "Connection: close\r\n";
+    constexpr std::string_view CRLF                   = "\r\n";
+
+    // a 304 has no body, so nothing describing one
+    bool has_body = response.status_code != 304;
+    // ranges are only served of files sent as they are
+    bool accept_ranges = has_body && response.mime_type && response.content_encoding.empty ();
+
+    // sized up front, so rendering allocates exactly once
+    std::pmr::string& headers = response.headers;
+    headers.reserve (CONTENT_TYPE_FIELD.size () + MULTIPART_TYPE.size () +
+    response.multipart_boundary.size () + response.content_type.size () +
+    CONTENT_LENGTH_FIELD.size () + length.size () + CONTENT_RANGE_FIELD.size () +
+    response.content_range.size () + ACCEPT_RANGES_FIELD.size () + CONTENT_ENCODING_FIELD.size () +
+    response.content_encoding.size () + VARY_FIELD.size () + ETAG_FIELD.size () + etag.size () +
+    LAST_MODIFIED_FIELD.size () + last_modified.size () + CACHE_CONTROL_FIELD.size () +
+    cache_control.size () + LOCATION_FIELD.size () + response.location.size () +
+    CONNECTION_CLOSE_FIELD.size () + 9 * CRLF.size ());
+    if (has_body) {
+        headers += CONTENT_TYPE_FIELD;
+        if (!response.parts.empty ()) {
+            headers += MULTIPART_TYPE;
+            headers += response.multipart_boundary;
+        } else {
+            headers += response.content_type;
         }
+        headers += CRLF;
+        headers += CONTENT_LENGTH_FIELD;
+        headers += length;
+        headers += CRLF;
+    }
+    if (!response.content_range.empty ()) {
+        headers += CONTENT_RANGE_FIELD;
+        headers += response.content_range;
+        headers += CRLF;
+    }
+    if (accept_ranges) {
+        headers += ACCEPT_RANGES_FIELD;
+    }
+    if (!response.content_encoding.empty () && has_body) {
+        headers += CONTENT_ENCODING_FIELD;
+        headers += response.content_encoding;
+        headers += CRLF;
+    }
+    if (response.vary_accept_encoding) {
+        headers += VARY_FIELD;
+    }
+    if (response.mime_type) {
+        headers += ETAG_FIELD;
+        headers += etag;
+        headers += CRLF;
+        headers += LAST_MODIFIED_FIELD;
+        headers += last_modified;
+        headers += CRLF;
+        headers += CACHE_CONTROL_FIELD;
+        headers += cache_control;
+        headers += CRLF;
+    }
+    if (!response.location.empty ()) {
+        headers += LOCATION_FIELD;
+        headers += response.location;
+        headers += CRLF;
+    }
+    if (response.close_connection) {
+        headers += CONNECTION_CLOSE_FIELD;
+    }
+    headers += CRLF;
+}
+
+/**
+ * @brief Body of handleRequest() and handleRequestFromMemory()
+ * @param blocked nullptr if the disk may be used, otherwise set as soon as it
+ * would be (the response is unfinished then)
+ */
+static auto respond (const Request& request, FileCache* file_cache, Compressor* compressor,
+DirectoryListings* listings, bool close_connection, std::pmr::memory_resource* memory, bool* blocked) -> Response {
+    Response response (memory);
+    response.close_connection =
+    close_connection || request.get (Header::CONNECTION).find ("close") != std::string_view::npos;
+
+    if (request.method != "GET") {
         // could add further else if statements to incorporate other HTTP
         // methods like PUT, POST
+        fillErrorResponse (response, 501, NOT_IMPLEMENTED_HTML);
+    } else {
+        // the path by default is "/x/y/..../z.ext". convert it to
+        // "./x/y/.../z.ext"
+        constexpr std::string_view INDEX_FILE = "index.html";
+        std::pmr::string resource_path (memory);
+        resource_path.reserve (request.path.size () + 1 + INDEX_FILE.size ());
+        resource_path += '.';
+        bool valid_path = appendDecodedPath (resource_path, request.path);
+
+        // serve the index.html of a directory, or else list it
+        bool directory = resource_path.back () == '/';
+        if (directory) {
+            resource_path += INDEX_FILE;
+        }
+
+        const mime::MimeType* mime_type = mime::findByPath (resource_path);
+        // compressed variants are looked for before the file itself, see
+        // Compressor::schedule()
+        MissingVariant missing_variants[std::size (ENCODINGS)];
+        size_t missing_count = 0;
+        // ranges refer to the file as it is, so they are never compressed
+        bool compressed = valid_path && mime_type && mime_type->compressible &&
+        request.get (Header::RANGE).empty () &&
+        getCompressedFileData (response, request, resource_path,
+        parseAcceptEncoding (request.get (Header::ACCEPT_ENCODING)), file_cache,
+        compressor, missing_variants, missing_count, blocked);
+
+        bool found = compressed;
+        if (blocked) {
+            // what isn't in the file cache takes a stat() or open()
+            if (valid_path && mime_type && !found && !*blocked)
+                found = getFileData (response, request, resource_path, file_cache, blocked);
+            if (valid_path && !found) {
+                *blocked = true;
+                return response;
+            }
+        }
+
+        if (!valid_path) {
+            fillErrorResponse (response, 400, BAD_REQUEST_HTML);
+        } else if (!mime_type) {
+            if (isDirectory (resource_path)) {
+                fillRedirectResponse (response, request);
+            } else {
+                fillErrorResponse (response, 404, CONTENT_TYPE_NOT_SUPPORTED_HTML);
+            }
+        } else if (!found && !getFileData (response, request, resource_path, file_cache, nullptr)) {
+            std::shared_ptr<const CachedFile> listing;
+            if (directory && listings) {
+                std::string directory_path (
+                std::string_view (resource_path).substr (0, resource_path.size () - INDEX_FILE.size ()));
+                // what follows the '?', if there is one
+                std::string_view query = request.target.substr (request.path.size ());
+                listing = listings->getPage (directory_path, request.path, query.substr (query.empty () ? 0 : 1));
+            }
+            if (listing) {
+                // generated, so sent without validators like other pages
+                response.content_type = DirectoryListings::CONTENT_TYPE;
+                response.body         = listing->contents;
+                response.cached_file  = std::move (listing);
+            } else if (!directory && isDirectory (resource_path)) {
+                fillRedirectResponse (response, request);
+            } else {
+                fillErrorResponse (response, 404, RESOURCE_NOT_FOUND_HTML);
+            }
+        } else {
+            response.mime_type    = mime_type;
+            response.content_type = mime_type->type;
+            // the body depends on Accept-Encoding, caches must know
+            response.vary_accept_encoding = mime_type->compressible;
+
+            // only files held in memory are compressed in the background
+            for (size_t i = 0; i < missing_count && !compressed && response.cached_file; i++) {
+                std::string variant_path (resource_path);
+                variant_path += missing_variants[i].encoding->suffix;
+                compressor->schedule (variant_path, missing_variants[i].encoding->coding,
+                response.cached_file, missing_variants[i].generation);
+            }
+
+            // conditions are evaluated before ranges (RFC 9110 13.2.2)
+            if (isNotModified (request, response)) {
+                dropBody (response);
+                response.status_code = 304;
+            } else if (!compressed) {
+                applyRange (request, response);
+            }
+        }
+    }
+
+    constructResponse (request, response);
+    return response;
+}
+
+auto handleRequest (const Request& request, FileCache* file_cache, Compressor* compressor,
+DirectoryListings* listings, bool close_connection, std::pmr::memory_resource* memory) -> Response {
+    return respond (request, file_cache, compressor, listings, close_connection, memory, nullptr);
+}
+
+auto handleRequestFromMemory (const Request& request, FileCache* file_cache, Compressor* compressor,
+bool close_connection, std::pmr::memory_resource* memory) -> std::optional<Response> {
+    bool blocked      = false;
+    Response response = respond (request, file_cache, compressor, nullptr, close_connection, memory, &blocked);
+    if (blocked)
+        return std::nullopt;
+    return response;
+}
+
+auto makeErrorResponse (int status_code) -> Response {
+    Response response;
+
+    switch (status_code) {
+    case 413:
+        fillErrorResponse (response, 413, REQUEST_TOO_LARGE_HTML);
+        break;
+    case 431:
+        fillErrorResponse (response, 431, REQUEST_TOO_LARGE_HTML);
+        break;
+    case 501:
+        fillErrorResponse (response, 501, NOT_IMPLEMENTED_HTML);
+        break;
+    default:
+        fillErrorResponse (response, 400, BAD_REQUEST_HTML);
+        break;
     }
 
-    return constructResponse (header_map);
+    // where the next request starts is unknown, so nothing can follow
+    response.close_connection = true;
+    constructResponse (Request (), response);
+    return response;
+}
+
+auto makePageResponse (const Request& request, std::string_view content_type,
+std::shared_ptr<const CachedFile> page, bool close_connection) -> Response {
+    Response response;
+    response.close_connection =
+    close_connection || request.get (Header::CONNECTION).find ("close") != std::string_view::npos;
+    response.content_type = content_type;
+    response.body         = page->contents;
+    response.cached_file  = std::move (page);
+
+    constructResponse (request, response);
+    return response;
 }
 
-auto printHeaderMap (const HeaderMap& header_map) -> void {
-    for (const auto& [key, value] : header_map) {
-        std::cout << key << ": " << value << "\n";
+Response::Response (std::pmr::memory_resource* p_Memory)
+: headers (p_Memory), content_range (p_Memory), location (p_Memory), parts (p_Memory),
+  multipart_boundary (p_Memory), multipart_end (p_Memory) {
+}
+
+Response::Response (Response&& p_Other) noexcept
+: status_code (p_Other.status_code), content_type (p_Other.content_type),
+  mime_type (p_Other.mime_type), status_line (p_Other.status_line), headers (std::move (p_Other.headers)),
+  body (p_Other.body), cached_file (std::move (p_Other.cached_file)), file_fd (p_Other.file_fd),
+  file_offset (p_Other.file_offset), file_size (p_Other.file_size),
+  content_encoding (p_Other.content_encoding),
+  vary_accept_encoding (p_Other.vary_accept_encoding), last_modified (p_Other.last_modified),
+  inode (p_Other.inode), full_size (p_Other.full_size), content_range (std::move (p_Other.content_range)),
+  location (std::move (p_Other.location)),
+  parts (std::move (p_Other.parts)), multipart_boundary (std::move (p_Other.multipart_boundary)),
+  multipart_end (std::move (p_Other.multipart_end)), close_connection (p_Other.close_connection) {
+    p_Other.file_fd = -1;
+}
+
+// the strings of a response stay with the memory resource they came from,
+// which move assignment of them alone wouldn't do (it copies them if the
+// resources differ)
+Response& Response::operator= (Response&& p_Other) noexcept {
+    if (this != &p_Other) {
+        std::destroy_at (this);
+        std::construct_at (this, std::move (p_Other));
     }
+    return *this;
+}
+
+Response::~Response () {
+    if (file_fd >= 0)
+        close (file_fd);
 }
 
-auto printHeaderKeys (const HeaderMap& header_map) -> void {
-    for (const auto& [key, value] : header_map) {
-        std::cout << key << "\n";
+auto printRequest (const Request& request) -> void {
+    std::cout << request.method << " " << request.target << " " << request.version << "\n";
+    for (size_t i = 0; i < HEADER_COUNT; i++) {
+        if (!request.headers[i].empty ())
+            std::cout << HEADER_NAMES[i] << ": " << request.headers[i] << "\n";
+    }
+    for (size_t i = 0; i < request.other_header_count; i++) {
+        std::cout << request.other_headers[i].name << ": " << request.other_headers[i].value << "\n";
     }
 }
 
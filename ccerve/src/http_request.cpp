@@ -0,0 +1,375 @@
+/**
+ * @file http_request.cpp
+ * @brief Contains the definition of the HTTP request parser
+ */
+
+#include "http_request.hpp"
+
+#include <algorithm>
+
+namespace ccerve {
+namespace parse {
+
+static auto toLower (char character) -> char {
+    return (character >= 'A' && character <= 'Z') ? character - 'A' + 'a' : character;
+}
+
+auto equalsIgnoreCase (std::string_view lhs, std::string_view rhs) -> bool {
+    if (lhs.size () != rhs.size ())
+        return false;
+    for (size_t i = 0; i < lhs.size (); i++) {
+        if (toLower (lhs[i]) != toLower (rhs[i]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the slot of a header name
+ * @return index into Request::headers, HEADER_COUNT if it isn't a known header
+ */
+static auto findHeader (std::string_view name) -> size_t {
+    for (size_t i = 0; i < HEADER_COUNT; i++) {
+        // most names are ruled out by their length already
+        if (name.size () == HEADER_NAMES[i].size () && equalsIgnoreCase (name, HEADER_NAMES[i]))
+            return i;
+    }
+    return HEADER_COUNT;
+}
+
+static auto isSpace (char character) -> bool {
+    return character == ' ' || character == '\t';
+}
+
+// @brief Removes spaces and tabs from both ends of value
+static auto trim (std::string_view value) -> std::string_view {
+    while (!value.empty () && isSpace (value.front ()))
+        value.remove_prefix (1);
+    while (!value.empty () && isSpace (value.back ()))
+        value.remove_suffix (1);
+    return value;
+}
+
+/**
+ * @brief Takes the next line (without "\r\n" or "\n") off the front of
+ * message
+ * @return the line, the rest of message if it has no line break
+ */
+static auto nextLine (std::string_view& message) -> std::string_view {
+    size_t line_end = message.find ('\n');
+    std::string_view line = message.substr (0, line_end);
+
+    message.remove_prefix (line_end == std::string_view::npos ? message.size () : line_end + 1);
+    if (!line.empty () && line.back () == '\r')
+        line.remove_suffix (1);
+    return line;
+}
+
+std::string_view Request::get (std::string_view p_Name) const {
+    size_t header_index = findHeader (p_Name);
+    if (header_index < HEADER_COUNT)
+        return headers[header_index];
+
+    for (size_t i = 0; i < other_header_count; i++) {
+        if (equalsIgnoreCase (other_headers[i].name, p_Name))
+            return other_headers[i].value;
+    }
+    return {};
+}
+
+auto parseRequest (std::string_view message, Request& request) -> bool {
+    // empty lines in front of the request line are ignored (RFC 9112 2.2)
+    std::string_view request_line;
+    while (request_line.empty () && !message.empty ()) {
+        request_line = nextLine (message);
+    }
+
+    // method SP request-target SP HTTP-version
+    size_t method_end = request_line.find (' ');
+    if (method_end == std::string_view::npos || method_end == 0)
+        return false;
+    size_t target_end = request_line.find (' ', method_end + 1);
+    if (target_end == std::string_view::npos || target_end == method_end + 1)
+        return false;
+
+    request.method  = request_line.substr (0, method_end);
+    request.target  = request_line.substr (method_end + 1, target_end - method_end - 1);
+    request.version = request_line.substr (target_end + 1);
+    if (!request.version.starts_with ("HTTP/"))
+        return false;
+    request.path = request.target.substr (0, request.target.find ('?'));
+
+    while (!message.empty ()) {
+        std::string_view header_line = nextLine (message);
+        if (header_line.empty ())
+            break; // end of headers
+
+        // a colon is required and no whitespace may precede it. This also
+        // rejects obsolete line folding (continuation lines start with one).
+        size_t colon_pos = 0;
+        while (colon_pos < header_line.size () && header_line[colon_pos] != ':') {
+            if (isSpace (header_line[colon_pos]))
+                return false;
+            colon_pos++;
+        }
+        if (colon_pos == header_line.size () || colon_pos == 0)
+            return false;
+        std::string_view name  = header_line.substr (0, colon_pos);
+        std::string_view value = trim (header_line.substr (colon_pos + 1));
+
+        size_t header_index = findHeader (name);
+        if (header_index < HEADER_COUNT) {
+            request.headers[header_index] = value;
+        } else if (request.other_header_count < Request::MAX_OTHER_HEADERS) {
+            request.other_headers[request.other_header_count++] = { name, value };
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Whether a quality value ("0", "0.0", "0.000", ...) refuses the coding
+ * it belongs to
+ */
+static auto isZeroQuality (std::string_view quality) -> bool {
+    if (quality.empty () || quality[0] != '0')
+        return false;
+    if (quality.size () > 1 && quality[1] != '.')
+        return false;
+    for (size_t i = 2; i < quality.size (); i++) {
+        if (quality[i] != '0')
+            return false;
+    }
+    return true;
+}
+
+auto parseAcceptEncoding (std::string_view value) -> AcceptedEncodings {
+    AcceptedEncodings accepted;
+    // -1: not listed, 0: refused, 1: accepted
+    int brotli = -1, gzip = -1, any = -1;
+
+    while (!value.empty ()) {
+        size_t element_end       = value.find (',');
+        std::string_view element = value.substr (0, element_end);
+        value.remove_prefix (element_end == std::string_view::npos ? value.size () : element_end + 1);
+
+        // coding [ ";" "q=" qvalue ]
+        size_t parameter_start  = element.find (';');
+        std::string_view coding = trim (element.substr (0, parameter_start));
+        int acceptable          = 1;
+        if (parameter_start != std::string_view::npos) {
+            std::string_view parameter = trim (element.substr (parameter_start + 1));
+            if ((parameter.starts_with ("q=") || parameter.starts_with ("Q=")) &&
+            isZeroQuality (parameter.substr (2)))
+                acceptable = 0;
+        }
+
+        if (equalsIgnoreCase (coding, "br")) {
+            brotli = acceptable;
+        } else if (equalsIgnoreCase (coding, "gzip") || equalsIgnoreCase (coding, "x-gzip")) {
+            gzip = acceptable;
+        } else if (coding == "*") {
+            any = acceptable;
+        }
+    }
+
+    accepted.brotli = brotli == 1 || (brotli == -1 && any == 1);
+    accepted.gzip   = gzip == 1 || (gzip == -1 && any == 1);
+    return accepted;
+}
+
+auto matchesEntityTag (std::string_view value, std::string_view etag) -> bool {
+    if (trim (value) == "*")
+        return true;
+
+    // #( [ "W/" ] DQUOTE *etagc DQUOTE ), tags can't contain quotes
+    while (!value.empty ()) {
+        while (!value.empty () && (isSpace (value.front ()) || value.front () == ','))
+            value.remove_prefix (1);
+        if (value.starts_with ("W/"))
+            value.remove_prefix (2);
+        if (value.empty () || value.front () != '"')
+            return false;
+
+        size_t tag_end = value.find ('"', 1);
+        if (tag_end == std::string_view::npos)
+            return false;
+        if (value.substr (0, tag_end + 1) == etag)
+            return true;
+        value.remove_prefix (tag_end + 1);
+    }
+    return false;
+}
+
+// @brief Parses a non-empty run of digits, false if it isn't one (or too long)
+static auto parsePosition (std::string_view digits, size_t& position) -> bool {
+    if (digits.empty () || digits.size () > 18)
+        return false;
+    position = 0;
+    for (char digit : digits) {
+        if (digit < '0' || digit > '9')
+            return false;
+        position = position * 10 + (digit - '0');
+    }
+    return true;
+}
+
+auto parseRange (std::string_view value, size_t size, std::array<ByteRange, MAX_RANGES>& ranges,
+size_t& range_count) -> RangeStatus {
+    range_count = 0;
+    if (!value.starts_with ("bytes="))
+        return RangeStatus::IGNORED;
+    value.remove_prefix (6);
+
+    size_t specs = 0;
+    while (!value.empty ()) {
+        size_t spec_end       = value.find (',');
+        std::string_view spec = trim (value.substr (0, spec_end));
+        value.remove_prefix (spec_end == std::string_view::npos ? value.size () : spec_end + 1);
+        if (spec.empty ())
+            continue; // "bytes=0-1, ,2-3" is allowed
+
+        // many small ranges cost more than the whole file, send that instead
+        if (++specs > MAX_RANGES)
+            return RangeStatus::IGNORED;
+
+        size_t dash = spec.find ('-');
+        if (dash == std::string_view::npos)
+            return RangeStatus::IGNORED;
+
+        size_t start = 0, last = 0;
+        if (dash == 0) {
+            // "-n": the last n bytes
+            if (!parsePosition (spec.substr (1), last))
+                return RangeStatus::IGNORED;
+            if (last == 0 || size == 0)
+                continue;
+            ranges[range_count++] = { size - std::min (last, size), size };
+        } else {
+            // "a-b" or "a-"
+            if (!parsePosition (spec.substr (0, dash), start))
+                return RangeStatus::IGNORED;
+            bool open_ended = dash + 1 == spec.size ();
+            if (!open_ended && !parsePosition (spec.substr (dash + 1), last))
+                return RangeStatus::IGNORED;
+            if (!open_ended && last < start)
+                return RangeStatus::IGNORED;
+            if (start >= size)
+                continue;
+            ranges[range_count++] = { start, open_ended ? size : std::min (last + 1, size) };
+        }
+    }
+
+    if (specs == 0)
+        return RangeStatus::IGNORED;
+    return range_count > 0 ? RangeStatus::SATISFIABLE : RangeStatus::UNSATISFIABLE;
+}
+
+/**
+ * @brief Finds the empty line ending the headers
+ * @return length of the headers including the empty line, 0 if the empty
+ * line isn't in data yet
+ */
+static auto findHeadersEnd (std::string_view data, size_t from) -> size_t {
+    for (size_t line_end = data.find ('\n', from); line_end != std::string_view::npos;
+    line_end             = data.find ('\n', line_end + 1)) {
+        // "\n\n" or "\n\r\n"
+        if (line_end + 1 < data.size () && data[line_end + 1] == '\n')
+            return line_end + 2;
+        if (line_end + 2 < data.size () && data[line_end + 1] == '\r' && data[line_end + 2] == '\n')
+            return line_end + 3;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses a Content-Length value. Values above MAX_BODY_SIZE aren't
+ * parsed exactly, they only stay above it.
+ * @return false if it isn't a number
+ */
+static auto parseContentLength (std::string_view value, size_t& content_length) -> bool {
+    if (value.empty ())
+        return false;
+    content_length = 0;
+    for (char digit : value) {
+        if (digit < '0' || digit > '9')
+            return false;
+        if (content_length <= RequestReader::MAX_BODY_SIZE)
+            content_length = content_length * 10 + (digit - '0');
+    }
+    return true;
+}
+
+void RequestReader::append (std::string_view p_Data) {
+    // drop what was consumed before growing the buffer
+    if (m_Start > 0 && m_Start >= m_Buffer.size () / 2) {
+        m_Buffer.erase (0, m_Start);
+        m_Start = 0;
+    }
+    m_Buffer.append (p_Data);
+}
+
+ReadStatus RequestReader::next (Request& p_Request) {
+    // empty lines in front of the request line are ignored (RFC 9112 2.2)
+    if (m_Scanned == 0) {
+        while (m_Start < m_Buffer.size () && (m_Buffer[m_Start] == '\r' || m_Buffer[m_Start] == '\n'))
+            m_Start++;
+    }
+    std::string_view data (m_Buffer.data () + m_Start, m_Buffer.size () - m_Start);
+
+    if (m_HeadersEnd == 0) {
+        // the last line break seen may be the first of the terminator, so
+        // scan again from just before it
+        m_HeadersEnd = findHeadersEnd (data, m_Scanned > 2 ? m_Scanned - 2 : 0);
+        if (m_HeadersEnd == 0) {
+            m_Scanned = data.size ();
+            return data.size () > MAX_HEADER_SIZE ? ReadStatus::HEADERS_TOO_LARGE : ReadStatus::INCOMPLETE;
+        }
+    }
+    if (m_HeadersEnd > MAX_HEADER_SIZE)
+        return ReadStatus::HEADERS_TOO_LARGE;
+
+    p_Request = Request ();
+    if (!parseRequest (data.substr (0, m_HeadersEnd), p_Request))
+        return ReadStatus::BAD_REQUEST;
+
+    // without knowing where a chunked body ends the next request can't be
+    // found
+    if (!p_Request.get (Header::TRANSFER_ENCODING).empty ())
+        return ReadStatus::NOT_IMPLEMENTED;
+
+    size_t content_length = 0;
+    std::string_view content_length_value = p_Request.get (Header::CONTENT_LENGTH);
+    if (!content_length_value.empty () && !parseContentLength (content_length_value, content_length))
+        return ReadStatus::BAD_REQUEST;
+    if (content_length > MAX_BODY_SIZE)
+        return ReadStatus::BODY_TOO_LARGE;
+
+    // the headers are parsed again once the body is here
+    if (data.size () < m_HeadersEnd + content_length)
+        return ReadStatus::INCOMPLETE;
+
+    m_RequestLength = m_HeadersEnd + content_length;
+    return ReadStatus::COMPLETE;
+}
+
+void RequestReader::consume () {
+    m_Start += m_RequestLength;
+    m_Scanned       = 0;
+    m_HeadersEnd    = 0;
+    m_RequestLength = 0;
+
+    if (m_Start == m_Buffer.size ()) {
+        // an idle connection shouldn't keep a large buffer
+        if (m_Buffer.capacity () > 4096) {
+            std::string ().swap (m_Buffer);
+        } else {
+            m_Buffer.clear ();
+        }
+        m_Start = 0;
+    }
+}
+
+} // namespace parse
+} // namespace ccerve
@@ -4,133 +4,332 @@
  */
 
 #include "http_server.hpp"
-#include "http_parser.hpp"
+#include "handoff.hpp"
 #include "sockets.hpp"
 
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
 namespace ccerve {
 
-HttpServer::HttpServer (std::string p_IPAddress, int p_Port, bool p_Log) {
-    // Adding file sink to default logger
-    auto file_sink = std::make_shared<sinks::FileSink> ("log/log.txt");
+HttpServer::HttpServer (std::string p_IPAddress, int p_Port, bool p_Log)
+: HttpServer (ServerConfig{ .ip_address = p_IPAddress, .port = p_Port }, p_Log) {
+}
+
+// @brief Signals startListeningSession() waits for
+static sigset_t getHandledSignals () {
+    sigset_t signals;
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGINT);
+    sigaddset (&signals, SIGTERM);
+    sigaddset (&signals, SIGUSR2);
+    return signals;
+}
+
+// @brief Name of p_Backend as given to --backend
+static const char* getBackendName (IoBackend p_Backend) {
+    switch (p_Backend) {
+    case IoBackend::IO_URING: return "io_uring";
+    case IoBackend::COROUTINE: return "coroutine";
+    default: return "epoll";
+    }
+}
+
+HttpServer::HttpServer (const ServerConfig& p_Config, bool p_Log)
+: m_Config (p_Config) {
+    // set if this server was started to replace another one
+    m_HandoffChannel = handoff::takeChannel ();
+
+    // Adding file sink to default logger. The server being replaced goes on
+    // writing its log until it has finished.
+    std::shared_ptr<sinks::BaseSink> file_sink;
+    if (m_Config.log_rotate)
+        file_sink = std::make_shared<sinks::RotatingFileSink> ("log/log.txt", m_Config.log_rotation,
+        m_HandoffChannel >= 0);
+    else
+        file_sink = std::make_shared<sinks::FileSink> ("log/log.txt", m_HandoffChannel >= 0);
     log::getDefaultLogger ()->addSink (file_sink);
+    log::getDefaultLogger ()->setFullQueuePolicy (m_Config.log_full_policy);
+    log::getDefaultLogger ()->setFlushPolicy (m_Config.log_flush);
 
     // initializing the sockaddr_in struct
     m_ServerSockAddr.sin_family      = AF_INET;
-    m_ServerSockAddr.sin_port        = htons (p_Port);
-    m_ServerSockAddr.sin_addr.s_addr = inet_addr (p_IPAddress.c_str ());
+    m_ServerSockAddr.sin_port        = htons (m_Config.port);
+    m_ServerSockAddr.sin_addr.s_addr = inet_addr (m_Config.ip_address.c_str ());
 
-    createServerSocket ();
+    // every connection holds a file descriptor, so allow as many as the hard
+    // limit permits instead of the (usually 1024) soft limit
+    rlimit fd_limit;
+    if (getrlimit (RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < fd_limit.rlim_max) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        if (setrlimit (RLIMIT_NOFILE, &fd_limit) < 0) {
+            log::warn ("File descriptor limit couldn't be raised.");
+        }
+    }
 
-    // Temporary (this is so that I can use the address immediatly after Ctrl+C
-    // type exit)
-    const int enable = 1;
-    if (setsockopt (m_ServerSock, SOL_SOCKET, SO_REUSEPORT | SO_REUSEADDR,
-        &enable, sizeof (int)) < 0) {
-        log::warn (
-        "SO_REUSEPORT | SO_REUSADDR couldn't be set as an option for "
-        "server socket.");
+    if (m_Config.backend == IoBackend::IO_URING && !IoUring::isSupported ()) {
+        log::warn ("io_uring is not available, falling back to epoll.");
+        m_Config.backend = IoBackend::EPOLL;
     }
 
-    bindServerSocket ();
+    if (m_Config.cache_size > 0) {
+        try {
+            m_FileCache = std::make_unique<FileCache> (m_Config.cache_size, m_Config.cache_max_file_size);
+        } catch (const exception::FileCacheCreationFailure& excpt) {
+            log::warn ("{} Files are not cached.", excpt.what ());
+        }
+    }
+
+    if (m_Config.compress) {
+        if (!m_FileCache) {
+            log::warn ("Files are only compressed in the background if the file cache is enabled.");
+        } else {
+            m_Compressor = std::make_unique<Compressor> (*m_FileCache);
+        }
+    }
+
+    if (m_Config.directory_listings) {
+        m_Listings = std::make_unique<DirectoryListings> (m_Config.listing_cache_size);
+    }
+
+    if (m_Config.file_threads > 0) {
+        m_FilePool = std::make_unique<FilePool> (m_Config.file_threads);
+    }
+
+    m_Metrics = std::make_unique<Metrics> (m_ConnectionStats, m_FileCache.get ());
+
+    WorkerContext context;
+    context.file_cache       = m_FileCache.get ();
+    context.compressor       = m_Compressor.get ();
+    context.listings         = m_Listings.get ();
+    context.file_pool        = m_FilePool.get ();
+    context.connection_stats = &m_ConnectionStats;
+    context.metrics          = m_Metrics.get ();
+    context.metrics_path     = m_Config.metrics_path;
+    context.limits           = m_Config.limits;
+
+    // each worker takes over a socket of the server being replaced or creates
+    // and binds its own (can throw)
+    std::vector<int> taken_socks = takeOverSockets ();
+    size_t worker_count          = std::max<size_t> (m_Config.workers, 1);
+    for (size_t i = 0; i < worker_count; i++) {
+        int server_sock = i < taken_socks.size () ? taken_socks[i] : -1;
+        if (m_Config.backend == IoBackend::IO_URING) {
+            m_Workers.push_back (std::make_unique<UringWorker> (m_ServerSockAddr, context, server_sock));
+        } else if (m_Config.backend == IoBackend::COROUTINE) {
+            m_Workers.push_back (std::make_unique<CoroutineWorker> (m_ServerSockAddr, context, server_sock));
+        } else {
+            m_Workers.push_back (std::make_unique<EpollWorker> (m_ServerSockAddr, context, server_sock));
+        }
+    }
+    if (taken_socks.size () > worker_count) {
+        log::warn ("{} socket(s) taken over aren't used by the {} worker(s), connections waiting on them are reset.",
+        taken_socks.size () - worker_count, worker_count);
+        for (size_t i = worker_count; i < taken_socks.size (); i++)
+            sockets::closeSocket (taken_socks[i]);
+    }
+
+    m_WakeFd = eventfd (0, EFD_CLOEXEC);
+    if (m_WakeFd < 0) {
+        throw exception::EventLoopCreationFailure ("Wake up descriptor of the server could not be created!");
+    }
 }
 
 HttpServer::~HttpServer () {
     stopListeningSession ();
+    if (m_HandoffChannel >= 0)
+        close (m_HandoffChannel);
+    close (m_WakeFd);
 }
 
-void HttpServer::createServerSocket () {
-    m_ServerSock = sockets::createSocket (AF_INET, SOCK_STREAM, 0);
-    if (m_ServerSock < 0) {
-        throw exception::ServerSockCreationFailure (
-        "Server socket creation failed!");
-    }
+void HttpServer::blockSignals () {
+    sigset_t signals = getHandledSignals ();
+    pthread_sigmask (SIG_BLOCK, &signals, nullptr);
 }
 
-void HttpServer::bindServerSocket () {
-    if (bind (m_ServerSock, (sockaddr*)&m_ServerSockAddr, sizeof (m_ServerSockAddr)) < 0) {
-        sockets::closeSocket (m_ServerSock);
-        throw exception::ServerSockBindFailure (
-        "Server socket could not be bound to the given address.");
-    }
+std::vector<int> HttpServer::takeOverSockets () {
+    if (m_HandoffChannel < 0)
+        return {};
+
+    std::vector<int> socks = handoff::receiveSockets (m_HandoffChannel);
+    // the server may have been started with another address
+    std::erase_if (socks, [this] (int p_Sock) {
+        sockaddr_in bound{};
+        socklen_t bound_len = sizeof (bound);
+        bool matches = getsockname (p_Sock, (sockaddr*)&bound, &bound_len) == 0 && bound.sin_family == AF_INET &&
+        bound.sin_port == m_ServerSockAddr.sin_port && bound.sin_addr.s_addr == m_ServerSockAddr.sin_addr.s_addr;
+        if (!matches)
+            sockets::closeSocket (p_Sock);
+        return !matches;
+    });
+    log::info ("Took {} listening socket(s) over from the previous server.", socks.size ());
+    return socks;
 }
 
-// closing socket file descriptors
 void HttpServer::stopListeningSession () {
-    /* Variable to end listening while loop */
-    /* Join all threads */
+    // end the event loop of every worker
+    for (auto& worker : m_Workers) {
+        worker->stop ();
+    }
+
+    // Join all threads
+    std::lock_guard<std::mutex> threads_lock (m_WorkerThreadsMutex);
+    for (auto& thread : m_WorkerThreads) {
+        if (thread.joinable ())
+            thread.join ();
+    }
+    m_WorkerThreads.clear ();
 }
 
 void HttpServer::startListeningSession () {
-    // listen
-    if (listen (m_ServerSock, BACKLOG_SIZE) < 0) {
-        log::error ("Socket was not able to start listening!");
-        sockets::closeSocket (m_ServerSock);
+    // Log server start message
+    log::info ("Starting listening session at ADDRESS {} on PORT {} with {} "
+               "{} worker(s)",
+    inet_ntoa (m_ServerSockAddr.sin_addr), ntohs (m_ServerSockAddr.sin_port),
+    m_Workers.size (), getBackendName (m_Config.backend));
+
+    // blocked by blockSignals(), so they are only read from signal_fd
+    sigset_t signals = getHandledSignals ();
+    int signal_fd    = signalfd (-1, &signals, SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        log::warn ("Signals can't be waited for, the server can't be stopped gracefully.");
     }
 
-    // Log server start message
-    log::info ("Starting listening session at ADDRESS {} on PORT {}",
-    inet_ntoa (m_ServerSockAddr.sin_addr), ntohs (m_ServerSockAddr.sin_port));
-
-    char buffer[BUFFER_SIZE] = { 0 };
-    ssize_t bytes_received   = 0;
-    while (true) {
-        acceptConnection ();
-
-        bool keep_alive = true;
-        while (m_ClientSock > 0 && keep_alive) {
-            // receive request from client
-            bytes_received = recv (m_ClientSock, buffer, BUFFER_SIZE, 0);
-
-            if (bytes_received == 0) {
-                // Client closed the connection (Normal)
-                break;
-            } else if (bytes_received < 0) {
-                log::error ("Socket was not able to read data\n");
-                break;
-            }
+    {
+        std::lock_guard<std::mutex> threads_lock (m_WorkerThreadsMutex);
+        m_FinishedWorkers = 0;
+        for (size_t i = 0; i < m_Workers.size (); i++) {
+            m_WorkerThreads.emplace_back ([this, i] {
+                m_Workers[i]->run ();
+                m_FinishedWorkers++;
+                eventfd_write (m_WakeFd, 1);
+            });
+        }
+    }
+
+    // the workers serve the sockets, the server being replaced can stop
+    // accepting on them
+    if (m_HandoffChannel >= 0) {
+        handoff::sendReady (m_HandoffChannel);
+        close (m_HandoffChannel);
+        m_HandoffChannel = -1;
+    }
+
+    // blocks until the session is stopped
+    superviseWorkers (signal_fd);
+    if (signal_fd >= 0)
+        close (signal_fd);
+    stopListeningSession ();
+
+    log::info ("Connections: {} accepted, {} rejected, {} idle timeouts, {} request timeouts",
+    m_ConnectionStats.accepted.load (), m_ConnectionStats.rejected.load (),
+    m_ConnectionStats.idle_timeouts.load (), m_ConnectionStats.request_timeouts.load ());
+    log::getDefaultLogger ()->flush ();
+}
+
+void HttpServer::superviseWorkers (int p_SignalFd) {
+    using clock = std::chrono::steady_clock;
 
-            // handle request
-            parse::HeaderMap header_map;
-            std::string resp =
-            parse::handleRequest (header_map, std::string (buffer, bytes_received));
+    bool draining = false;
+    // when the connections still open are closed, only set while draining
+    auto deadline = clock::time_point::max ();
+    auto drain    = [this, &draining, &deadline] {
+        draining = true;
+        if (m_Config.drain_timeout_ms > 0)
+            deadline = clock::now () + std::chrono::milliseconds (m_Config.drain_timeout_ms);
+        for (auto& worker : m_Workers) {
+            worker->drain ();
+        }
+    };
+
+    while (m_FinishedWorkers < m_Workers.size ()) {
+        int timeout_ms = -1;
+        if (deadline != clock::time_point::max ()) {
+            auto left  = std::chrono::ceil<std::chrono::milliseconds> (deadline - clock::now ());
+            timeout_ms = static_cast<int> (std::max<long long> (left.count (), 0));
+        }
 
-            // send response to client
-            sendResponse (resp, m_ClientSock);
+        // a negative descriptor is skipped by poll()
+        pollfd fds[2] = { { m_WakeFd, POLLIN, 0 }, { p_SignalFd, POLLIN, 0 } };
+        if (poll (fds, 2, timeout_ms) < 0 && errno != EINTR) {
+            log::error ("Server was not able to wait for signals!");
+            break;
+        }
 
-            log::info ("{} -- {} {} {} {}", inet_ntoa (m_ClientSockAddr.sin_addr),
-            header_map["method"], header_map["resource-path"],
-            header_map["http-version"], header_map["status-code"]);
+        if (fds[0].revents & POLLIN) {
+            // a worker finished, the while loop counts them
+            eventfd_t value;
+            eventfd_read (m_WakeFd, &value);
+        }
 
-            // Check for "close" explicitly, otherwise assume keep-alive for
-            // HTTP/1.1
-            if (header_map["Connection"].find ("close") != std::string::npos) {
-                keep_alive = false;
+        signalfd_siginfo info;
+        if ((fds[1].revents & POLLIN) && read (p_SignalFd, &info, sizeof (info)) == sizeof (info)) {
+            int signal_number = static_cast<int> (info.ssi_signo);
+            if (signal_number == SIGUSR2) {
+                if (draining)
+                    log::warn ("SIGUSR2 ignored, the server is stopping.");
+                else if (handOver ())
+                    drain ();
+            } else if (!draining) {
+                log::info ("SIG{} received, finishing {} open connection(s).", sigabbrev_np (signal_number),
+                m_ConnectionStats.open.load ());
+                drain ();
+            } else {
+                log::info ("SIG{} received again, closing the open connections.", sigabbrev_np (signal_number));
+                deadline = clock::now ();
             }
         }
 
-        shutdown (m_ClientSock, SHUT_WR);
-        sockets::closeSocket (m_ClientSock);
-        memset (buffer, 0,
-        bytes_received); // clear buffer before next connection
+        if (clock::now () >= deadline) {
+            log::warn ("{} connection(s) still open when the server stopped, they are closed.",
+            m_ConnectionStats.open.load ());
+            for (auto& worker : m_Workers) {
+                worker->stop ();
+            }
+            deadline = clock::time_point::max ();
+        }
     }
 }
 
-void HttpServer::acceptConnection () {
-    m_ClientSock = accept (m_ServerSock, (sockaddr*)&m_ClientSockAddr, &m_ClientSockAddrLen);
+bool HttpServer::handOver () {
+    if (m_Config.upgrade_command.empty ()) {
+        log::warn ("SIGUSR2 ignored, the server doesn't know how to start its replacement.");
+        return false;
+    }
 
-    // check if connection was able to be accepted or not
-    if (m_ClientSock < 0) {
-        log::error ("Socket was not able to accept the connection!");
+    std::vector<int> socks;
+    for (auto& worker : m_Workers) {
+        if (worker->getServerSock () >= 0)
+            socks.push_back (worker->getServerSock ());
     }
-}
 
-void HttpServer::sendResponse (const std::string& p_Response, int p_ClientSock) {
-    int bytes_sent = write (p_ClientSock, p_Response.c_str (), p_Response.size ());
+    int channel = -1;
+    pid_t pid   = handoff::spawn (m_Config.upgrade_command, channel);
+    if (pid < 0) {
+        log::error ("New server could not be started: {}", strerror (errno));
+        return false;
+    }
+    log::info ("Started a new server (pid {}), handing {} listening socket(s) over.", pid, socks.size ());
 
-    // check if the whole message was able to be sent or not
-    if (static_cast<size_t> (bytes_sent) != p_Response.size ()) {
-        log::error ("Socket was not able to send data!");
+    // meanwhile the workers go on accepting
+    bool ready = handoff::sendSockets (channel, socks) && handoff::waitReady (channel, HANDOFF_TIMEOUT_MS);
+    close (channel);
+    if (!ready) {
+        // it may still be starting, it must not serve next to this server
+        kill (pid, SIGKILL);
+        waitpid (pid, nullptr, 0);
+        log::error ("New server (pid {}) failed to take over, serving on.", pid);
+        return false;
     }
+    log::info ("New server (pid {}) took over, finishing {} open connection(s).", pid,
+    m_ConnectionStats.open.load ());
+    return true;
 }
 
 } // namespace ccerve
@@ -5,23 +5,32 @@
  */
 
 #include "logger.hpp"
+#include <chrono>
+#include <ctime>
 #include <mutex>
 #include <thread>
 
 namespace ccerve {
 namespace log {
 
+// @brief Colored names of the levels, indexed by LOG_LEVEL
+static const std::string LEVEL_TAGS[] = { GREEN ("info"), YELLOW ("warn"), RED ("error") };
+
 std::vector<const Logger*>& Logger::getRegistry () {
     static std::vector<const Logger*> instances;
     return instances;
 }
 
-Logger::Logger (std::string_view p_LoggerName, LOG_LEVEL p_LogLevel, const SinksVector& p_Sinks)
+Logger::Logger (std::string_view p_LoggerName, LOG_LEVEL p_LogLevel,
+const SinksVector& p_Sinks, size_t p_QueueCapacity)
 : m_LoggerName (p_LoggerName), m_LogLevel (p_LogLevel), m_Sinks (p_Sinks),
-  m_LogQueue (), m_StopWriteThread (false) {
+  m_LogQueue (p_QueueCapacity), m_StopWriteThread (false) {
     if (p_LoggerName == "")
         m_LoggerName = "Logger" + std::to_string (getRegistry ().size ());
 
+    setFlushPolicy (FlushPolicy ());
+    m_Batch.resize (BATCH_SIZE);
+
     getRegistry ().push_back (this);
     m_WriteThread = std::thread ([this] { write (); });
 }
@@ -31,56 +40,246 @@ Logger::~Logger () {
     registry.erase (
     std::remove (registry.begin (), registry.end (), this), registry.end ());
 
-    m_StopWriteThread = true;
+    {
+        // under the lock, so the write thread can't miss it between checking
+        // and parking
+        std::lock_guard<std::mutex> park_lock{ m_ParkMutex };
+        m_StopWriteThread = true;
+    }
     m_CV.notify_one (); // since there will only ever me one write thread
     if (m_WriteThread.joinable ()) // ! I added this check just in case but is it
                                    // necessary? (When is a thread not joinable?)
         m_WriteThread.join ();
 }
 
+bool Logger::makeRoom () const {
+    switch (m_FullQueuePolicy.load (std::memory_order_relaxed)) {
+    case FullQueuePolicy::DROP:
+        m_DroppedCount.fetch_add (1, std::memory_order_relaxed);
+        return false;
+    case FullQueuePolicy::OVERWRITE:
+        if (m_LogQueue.tryConsume ([] (LogRecord&) {}))
+            m_DroppedCount.fetch_add (1, std::memory_order_relaxed);
+        return true;
+    case FullQueuePolicy::BLOCK:
+        wakeWriter ();
+        std::this_thread::yield ();
+        return true;
+    }
+    return true;
+}
+
+void Logger::notifyWriter () const {
+    // pairs with the fence in write(): either the write thread sees the
+    // message before parking or we see that it parked
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    if (m_WriterParked.load (std::memory_order_relaxed))
+        wakeWriter ();
+}
+
+void Logger::render (const LogRecord& p_Record, std::string& p_Out) const {
+    // the time only changes once a second, so its text is mostly reused
+    if (p_Record.time != m_TimeTextSecond) {
+        tm local_time;
+        localtime_r (&p_Record.time, &local_time);
+        m_TimeTextSize   = std::strftime (m_TimeText, sizeof (m_TimeText), "%c", &local_time);
+        m_TimeTextSecond = p_Record.time;
+    }
+
+    p_Out.clear ();
+    p_Out += '[';
+    p_Out.append (m_TimeText, m_TimeTextSize);
+    p_Out += "] - [";
+    p_Out += m_LoggerName;
+    p_Out += "] - [";
+    p_Out += LEVEL_TAGS[p_Record.level];
+    p_Out += "] - ";
+    if (p_Record.render)
+        p_Record.render (p_Record, p_Out);
+    else
+        p_Out += p_Record.text;
+    p_Out += '\n';
+}
+
+void Logger::wakeWriter () const {
+    if (!m_WriterParked.exchange (false))
+        return;
+
+    // the write thread is either before its wait (and sees m_WriterParked
+    // cleared) or waiting (and gets notified)
+    { std::lock_guard<std::mutex> park_lock{ m_ParkMutex }; }
+    m_CV.notify_one ();
+}
+
+void Logger::writeToSinks (std::span<const std::string> p_Msgs) const {
+    for (auto& sink : m_Sinks) {
+        sink->write (p_Msgs);
+    }
+}
+
+void Logger::flushSinks () const {
+    for (auto& sink : m_Sinks) {
+        sink->flush ();
+    }
+}
+
 void Logger::write () const {
-    using namespace std::chrono_literals;
+    using clock = std::chrono::steady_clock;
+
+    unsigned idle_rounds = 0;
+
+    // messages written to the sinks since they were last flushed, and when
+    // the first of them was written
+    size_t unflushed = 0;
+    clock::time_point first_unflushed;
 
     while (true) {
-        std::unique_lock<std::mutex> queue_lock{ m_LogQueueMutex };
+        // read before the queue: a flush() is done once the queue was found
+        // empty after it had been called
+        uint64_t flush_requests = m_FlushRequests.load ();
+
+        // take as much as is there (up to a batch) and hand it over at once.
+        // Records are formatted in their slot, they aren't copied out.
+        size_t count   = 0;
+        bool has_error = false;
+        auto take      = [&] (LogRecord& p_Record) {
+            render (p_Record, m_Batch[count++]);
+            has_error |= p_Record.level == LOG_LEVEL::ERROR;
+        };
+        while (count < BATCH_SIZE && m_LogQueue.tryConsume (take)) {
+        }
+
+        // The queue is empty (or a batch is full). Report messages lost
+        // since the last time it was full.
+        uint64_t dropped = m_DroppedCount.load (std::memory_order_relaxed);
+        if (count < BATCH_SIZE && dropped != m_ReportedDropCount) {
+            LogRecord report;
+            report.time  = time (nullptr);
+            report.level = LOG_LEVEL::WARN;
+            report.text  = std::format ("{} log messages were dropped, the queue was full",
+            dropped - m_ReportedDropCount);
+            render (report, m_Batch[count++]);
+            m_ReportedDropCount = dropped;
+        }
+
+        clock::time_point now = clock::now ();
+        bool flush            = false;
+        if (count > 0) {
+            writeToSinks (std::span<const std::string> (m_Batch.data (), count));
+            if (unflushed == 0)
+                first_unflushed = now;
+            unflushed += count;
+
+            size_t every_messages = m_FlushEveryMessages.load (std::memory_order_relaxed);
+            flush = (has_error && m_FlushOnError.load (std::memory_order_relaxed)) ||
+            (every_messages > 0 && unflushed >= every_messages);
+        }
+
+        // how long the sinks may hold back what they got, nothing to wait
+        // for if there is no limit or nothing to flush
+        unsigned every_ms   = m_FlushEveryMs.load (std::memory_order_relaxed);
+        auto flush_deadline = clock::time_point::max ();
+        if (unflushed > 0 && every_ms > 0) {
+            flush_deadline = first_unflushed + std::chrono::milliseconds (every_ms);
+            flush |= now >= flush_deadline;
+        }
+
+        bool flush_requested = count < BATCH_SIZE && flush_requests != m_FlushesDone.load ();
+        if (flush || flush_requested) {
+            flushSinks ();
+            unflushed      = 0;
+            flush_deadline = clock::time_point::max ();
+        }
+        if (flush_requested) {
+            {
+                std::lock_guard<std::mutex> park_lock{ m_ParkMutex };
+                m_FlushesDone = flush_requests;
+            }
+            m_FlushedCV.notify_all ();
+        }
+
+        if (count > 0) {
+            idle_rounds = 0;
+            continue;
+        }
 
         /*
-        The destructor of Logger class will set m_StopWriteThread to true
-        and then call m_CV notify_one(). This will trigger the
-        lambda function call and check if the condition is true. In this case,
-        condition will be true (m_StopWriteThread = true). The while loop
-        will empty the remaining elements and then finish the function
+        The destructor of Logger class sets m_StopWriteThread to true. The
+        queue is emptied and the sinks are flushed before the function
+        finishes.
         */
-        m_CV.wait (queue_lock, [this] { // ! is capturing "this" required?
-            return m_StopWriteThread || !m_LogQueue.empty ();
-        });
-
-        // Process everything currently in the queue
-        while (!m_LogQueue.empty ()) {
-            std::string msg = std::move (m_LogQueue.front ());
-            m_LogQueue.pop ();
-
-            // This allows the main thread to keep pushing logs while we are
-            // doing slow I/O.
-            queue_lock.unlock ();
-
-            for (auto& sink : m_Sinks) {
-                sink->write (msg); // ! Multiple front() calls (one for each
-                                   // sink). Is this fine?
+        if (m_StopWriteThread) {
+            if (m_LogQueue.empty ()) {
+                flushSinks ();
+                break;
             }
-            // std::this_thread::sleep_for(1ms);
-
-            queue_lock.lock (); // lock again (we are still in while loop)
+            continue;
         }
 
-        // If we reach this point, we have ensured that m_LogQueue is empty
-        if (m_StopWriteThread)
-            break;
+        // more messages usually follow shortly, wait for them without
+        // sleeping first
+        if (idle_rounds < SPIN_ROUNDS + YIELD_ROUNDS) {
+            if (idle_rounds++ >= SPIN_ROUNDS)
+                std::this_thread::yield ();
+            continue;
+        }
 
-        // lock will be released when this scope ends
+        std::unique_lock<std::mutex> park_lock{ m_ParkMutex };
+        m_WriterParked.store (true);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        if (m_LogQueue.empty () && m_FlushRequests.load () == m_FlushesDone.load ()) {
+            auto woken = [this] {
+                return !m_WriterParked.load () || m_StopWriteThread;
+            };
+            if (flush_deadline == clock::time_point::max ())
+                m_CV.wait (park_lock, woken);
+            else
+                m_CV.wait_until (park_lock, flush_deadline, woken);
+        }
+        m_WriterParked.store (false);
+        idle_rounds = 0;
     }
 }
 
+void Logger::flush () const {
+    std::unique_lock<std::mutex> park_lock{ m_ParkMutex };
+    uint64_t request = ++m_FlushRequests;
+    park_lock.unlock ();
+
+    // pairs with the check before parking in write(): either the write
+    // thread sees the request or we see that it parked
+    wakeWriter ();
+
+    park_lock.lock ();
+    m_FlushedCV.wait (park_lock, [this, request] { return m_FlushesDone.load () >= request; });
+}
+
+void Logger::setFullQueuePolicy (FullQueuePolicy p_Policy) {
+    m_FullQueuePolicy = p_Policy;
+}
+
+FullQueuePolicy Logger::getFullQueuePolicy () const {
+    return m_FullQueuePolicy;
+}
+
+uint64_t Logger::getDroppedCount () const {
+    return m_DroppedCount;
+}
+
+void Logger::setFlushPolicy (const FlushPolicy& p_Policy) {
+    m_FlushEveryMessages = p_Policy.every_messages;
+    m_FlushEveryMs       = p_Policy.every_ms;
+    m_FlushOnError       = p_Policy.on_error;
+}
+
+FlushPolicy Logger::getFlushPolicy () const {
+    FlushPolicy policy;
+    policy.every_messages = m_FlushEveryMessages;
+    policy.every_ms       = m_FlushEveryMs;
+    policy.on_error       = m_FlushOnError;
+    return policy;
+}
+
 void Logger::addSink (std::shared_ptr<sinks::BaseSink> p_Sink) {
     m_Sinks.push_back (p_Sink);
 }
@@ -101,7 +300,7 @@ std::string_view Logger::getLoggerName () {
     return m_LoggerName;
 };
 
-std::shared_ptr<Logger> getDefaultLogger () {
+std::shared_ptr<Logger>& getDefaultLogger () {
     static std::shared_ptr<Logger> DefaultLogger =
     std::make_shared<Logger> ("Default Logger");
     return DefaultLogger;
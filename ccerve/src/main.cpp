@@ -5,6 +5,10 @@
  */
 
 #include "http_server.hpp"
+
+#include <csignal>
+#include <string_view>
+#include <vector>
 using namespace std;
 
 
@@ -29,45 +33,200 @@ TODO:
 - Display response code in logs too (DONE)
 
 - If only directory is requested in HTTP request, make a HTML page listing all
-the directory contents (micmicing the behavior of python's http server module)
+the directory contents (micmicing the behavior of python's http server module) (DONE)
 
 ! NOTE: The code is still uncomplete, unoptimized with possible (most certainly)
 ! tremendous amount of bugs
 */
 
-int main (int argc, char* argv[]) {
-    // default values
-    std::string ip_address = "127.0.0.1";
-    int port               = 8000;
+// @brief Prints how the executable should be run
+static void printUsage (const char* p_Program) {
+    std::cerr << "Usage: " << p_Program << " [--workers N] [--backend epoll|io_uring|coroutine] [--cache-size MiB] "
+                 "[--compress] [--no-listings] [--file-threads N] [--idle-timeout s] [--request-timeout s] [--max-requests N] "
+                 "[--max-connections N] [--drain-timeout s] [--metrics-path PATH] [--log-full block|drop|overwrite] [--log-flush-ms ms] "
+                 "[--log-flush-lines N] [--log-segment-size MiB] [--log-rotate-every s] [--log-keep N] "
+                 "[--log-dated] [ip_address port]"
+              << std::endl;
+}
 
+/**
+ * @brief Converts a command line argument to a number. Exits if it isn't one.
+ * @param p_Name What the argument is (used in the error message)
+ * @param p_Value The argument
+ */
+static int parseNumber (std::string_view p_Name, const char* p_Value) {
     try {
-        if (argc == 3) // if ip_address and port both are specified in the
-                       // command (e.g ./cerve 0.0.0.0 10000)
-        {
-            ip_address = argv[1];
-            port = std::stoi (argv[2]); // this can throw a invalid_argument exception
-            if (port > 65535 || port < 0) {
-                std::cerr << "Port number must be in range 0-65535" << std::endl;
+        return std::stoi (p_Value); // this can throw a invalid_argument exception
+    } catch (const std::exception& excpt) // for non-integer values (e.g ./cerve 127.0.0.1 hello)
+    {
+        std::cerr << "Invalid " << p_Name << ": " << p_Value << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
+
+int main (int argc, char* argv[]) {
+    // sendfile() can't be told MSG_NOSIGNAL: writing to a connection the
+    // client reset fails with EPIPE instead of killing the server. Inherited
+    // by every thread started later.
+    signal (SIGPIPE, SIG_IGN);
+
+    // before the first thread is started, the server handles SIGTERM, SIGINT
+    // and SIGUSR2 itself
+    ccerve::HttpServer::blockSignals ();
+
+    // default values (127.0.0.1:8000, one worker)
+    ccerve::ServerConfig config;
+    std::vector<const char*> positional_args;
+
+    // a hot upgrade (SIGUSR2) starts the binary found at the same path again
+    config.upgrade_command.assign (argv, argv + argc);
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+
+        if (arg == "--workers" && i + 1 < argc) {
+            int workers = parseNumber ("number of workers", argv[++i]);
+            if (workers < 1) {
+                std::cerr << "Number of workers must be at least 1" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.workers = workers;
+        } else if (arg == "--backend" && i + 1 < argc) {
+            std::string_view backend = argv[++i];
+            if (backend == "epoll") {
+                config.backend = ccerve::IoBackend::EPOLL;
+            } else if (backend == "io_uring") {
+                config.backend = ccerve::IoBackend::IO_URING;
+            } else if (backend == "coroutine") {
+                config.backend = ccerve::IoBackend::COROUTINE;
+            } else {
+                std::cerr << "Backend must be epoll, io_uring or coroutine" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            int cache_size = parseNumber ("cache size", argv[++i]);
+            if (cache_size < 0) {
+                std::cerr << "Cache size must not be negative" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.cache_size = static_cast<size_t> (cache_size) * 1024 * 1024;
+        } else if (arg == "--compress") {
+            config.compress = true;
+        } else if (arg == "--no-listings") {
+            config.directory_listings = false;
+        } else if (arg == "--file-threads" && i + 1 < argc) {
+            int file_threads = parseNumber ("number of file threads", argv[++i]);
+            if (file_threads < 0) {
+                std::cerr << "Number of file threads must not be negative (0 for none)" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.file_threads = static_cast<size_t> (file_threads);
+        } else if ((arg == "--idle-timeout" || arg == "--request-timeout") && i + 1 < argc) {
+            int timeout = parseNumber ("timeout", argv[++i]);
+            if (timeout < 0) {
+                std::cerr << "Timeouts must not be negative (0 for no timeout)" << std::endl;
                 exit (EXIT_FAILURE);
             }
-        } else if (argc != 1) // 2, 4, 5 ... arguments
-        {
-            std::cerr << "Usage: " << argv[0] << " [ip_address port]" << std::endl;
+            (arg == "--idle-timeout" ? config.limits.idle_timeout_ms : config.limits.request_timeout_ms) =
+            static_cast<unsigned> (timeout) * 1000;
+        } else if ((arg == "--max-requests" || arg == "--max-connections") && i + 1 < argc) {
+            int limit = parseNumber ("limit", argv[++i]);
+            if (limit < 0) {
+                std::cerr << "Limits must not be negative (0 for no limit)" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            (arg == "--max-requests" ? config.limits.max_requests : config.limits.max_connections) =
+            static_cast<size_t> (limit);
+        } else if (arg == "--drain-timeout" && i + 1 < argc) {
+            int timeout = parseNumber ("drain timeout", argv[++i]);
+            if (timeout < 0) {
+                std::cerr << "Drain timeout must not be negative (0 for no timeout)" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.drain_timeout_ms = static_cast<unsigned> (timeout) * 1000;
+        } else if (arg == "--metrics-path" && i + 1 < argc) {
+            config.metrics_path = argv[++i];
+            if (!config.metrics_path.starts_with ('/')) {
+                std::cerr << "Metrics path must start with /" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+        } else if (arg == "--log-full" && i + 1 < argc) {
+            std::string_view policy = argv[++i];
+            if (policy == "block") {
+                config.log_full_policy = ccerve::log::FullQueuePolicy::BLOCK;
+            } else if (policy == "drop") {
+                config.log_full_policy = ccerve::log::FullQueuePolicy::DROP;
+            } else if (policy == "overwrite") {
+                config.log_full_policy = ccerve::log::FullQueuePolicy::OVERWRITE;
+            } else {
+                std::cerr << "Log queue policy must be block, drop or overwrite" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+        } else if ((arg == "--log-flush-ms" || arg == "--log-flush-lines") && i + 1 < argc) {
+            int limit = parseNumber ("log flush interval", argv[++i]);
+            if (limit < 0) {
+                std::cerr << "Log flush intervals must not be negative (0 to turn them off)" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            if (arg == "--log-flush-ms")
+                config.log_flush.every_ms = static_cast<unsigned> (limit);
+            else
+                config.log_flush.every_messages = static_cast<size_t> (limit);
+        } else if ((arg == "--log-segment-size" || arg == "--log-rotate-every" || arg == "--log-keep") &&
+        i + 1 < argc) {
+            int value = parseNumber ("log rotation setting", argv[++i]);
+            if (value < (arg == "--log-segment-size" ? 1 : 0)) {
+                std::cerr << "Log segments must be at least 1 MiB, the other rotation settings "
+                             "must not be negative"
+                          << std::endl;
+                exit (EXIT_FAILURE);
+            }
+            config.log_rotate = true;
+            if (arg == "--log-segment-size")
+                config.log_rotation.segment_size = static_cast<size_t> (value) * 1024 * 1024;
+            else if (arg == "--log-rotate-every")
+                config.log_rotation.max_age_s = static_cast<unsigned> (value);
+            else
+                config.log_rotation.retention = static_cast<size_t> (value);
+        } else if (arg == "--log-dated") {
+            config.log_rotate               = true;
+            config.log_rotation.dated_names = true;
+        } else if (arg.starts_with ("--")) {
+            printUsage (argv[0]);
             exit (EXIT_FAILURE);
+        } else {
+            positional_args.push_back (argv[i]);
         }
+    }
 
-        ccerve::HttpServer server (ip_address, port); // this can throw server specific exceptions
-        server.startListeningSession ();
-    } catch (const std::invalid_argument& excpt) // for non-integer ports (e.g ./cerve 127.0.0.1 hello)
+    if (positional_args.size () == 2) // if ip_address and port both are
+                                      // specified in the command (e.g ./cerve
+                                      // 0.0.0.0 10000)
+    {
+        config.ip_address = positional_args[0];
+        config.port       = parseNumber ("port number", positional_args[1]);
+        if (config.port > 65535 || config.port < 0) {
+            std::cerr << "Port number must be in range 0-65535" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    } else if (positional_args.size () != 0) // 1, 3, 4 ... arguments
     {
-        std::cerr << "Invalid port number: " << argv[2] << std::endl;
+        printUsage (argv[0]);
         exit (EXIT_FAILURE);
+    }
+
+    try {
+        ccerve::HttpServer server (config); // this can throw server specific exceptions
+        server.startListeningSession ();
     } catch (const ccerve::exception::ServerSockCreationFailure& excpt) {
         std::cerr << excpt.what () << "\n";
         exit (EXIT_FAILURE);
     } catch (const ccerve::exception::ServerSockBindFailure& excpt) {
         std::cerr << excpt.what () << "\n";
         exit (EXIT_FAILURE);
+    } catch (const ccerve::exception::EventLoopCreationFailure& excpt) {
+        std::cerr << excpt.what () << "\n";
+        exit (EXIT_FAILURE);
     }
 
     return 0;
@@ -0,0 +1,186 @@
+/**
+ * @file metrics.cpp
+ * @brief Holds the definition of the Metrics class
+ */
+
+#include "metrics.hpp"
+
+#include <format>
+#include <iterator>
+
+namespace ccerve {
+
+void WorkerMetrics::countRequest (std::string_view p_Method, int p_StatusCode) {
+    size_t status = 0;
+    while (status < STATUS_CODES.size () && STATUS_CODES[status] != p_StatusCode)
+        status++;
+    requests_by_status[status].add ();
+
+    size_t method = 0;
+    while (method < METHODS.size () && METHODS[method] != p_Method)
+        method++;
+    requests_by_method[method].add ();
+}
+
+Metrics::Metrics (const ConnectionStats& p_ConnectionStats, FileCache* p_FileCache)
+: m_ConnectionStats (p_ConnectionStats), m_FileCache (p_FileCache) {
+}
+
+WorkerMetrics& Metrics::addWorker () {
+    std::lock_guard<std::mutex> workers_lock (m_WorkersMutex);
+    return *m_Workers.emplace_back (std::make_unique<WorkerMetrics> ());
+}
+
+// @brief Names of the phases as they appear in the "phase" label
+static constexpr std::string_view PHASE_NAMES[] = { "parse", "file", "send" };
+
+// @brief Histogram buckets exported: powers of two from 128 ns to 32 s.
+// They are bucket boundaries of LatencyHistogram, so they are exact.
+static constexpr unsigned FIRST_EXPORTED_BIT = 7;
+static constexpr unsigned LAST_EXPORTED_BIT  = 35;
+
+// @brief Quantiles exported next to the histograms
+static constexpr double QUANTILES[] = { 0.5, 0.99, 0.999 };
+
+// @brief Sum of the histograms of one phase over every worker
+struct MergedHistogram {
+    std::array<uint64_t, LatencyHistogram::BUCKET_COUNT> buckets{};
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+
+    void add (const LatencyHistogram& p_Histogram) {
+        for (size_t i = 0; i < buckets.size (); i++)
+            buckets[i] += p_Histogram.getBucket (i);
+        count += p_Histogram.getCount ();
+        sum += p_Histogram.getSum ();
+    }
+
+    // @brief Values counted below p_Limit ns (p_Limit must be a bucket start)
+    uint64_t countBelow (uint64_t p_Limit) const {
+        uint64_t below = 0;
+        for (size_t i = 0; i < buckets.size () && LatencyHistogram::bucketStart (i) < p_Limit; i++)
+            below += buckets[i];
+        return below;
+    }
+
+    // @brief Middle of the bucket holding the p_Quantile quantile (ns)
+    double quantile (double p_Quantile) const {
+        uint64_t rank = static_cast<uint64_t> (p_Quantile * static_cast<double> (count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets.size (); i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                uint64_t start = LatencyHistogram::bucketStart (i);
+                uint64_t end   = LatencyHistogram::bucketStart (i + 1);
+                return static_cast<double> (start + end - 1) / 2;
+            }
+        }
+        return 0;
+    }
+};
+
+// @brief Appends the HELP and TYPE lines of a metric
+static void appendHeader (std::string& p_Out, std::string_view p_Name, std::string_view p_Type,
+std::string_view p_Help) {
+    std::format_to (std::back_inserter (p_Out), "# HELP {} {}\n# TYPE {} {}\n", p_Name, p_Help, p_Name, p_Type);
+}
+
+// @brief Appends a metric without labels
+static void appendValue (std::string& p_Out, std::string_view p_Name, std::string_view p_Type,
+std::string_view p_Help, uint64_t p_Value) {
+    appendHeader (p_Out, p_Name, p_Type, p_Help);
+    std::format_to (std::back_inserter (p_Out), "{} {}\n", p_Name, p_Value);
+}
+
+void Metrics::render (std::string& p_Out) {
+    std::lock_guard<std::mutex> workers_lock (m_WorkersMutex);
+    auto out = std::back_inserter (p_Out);
+
+    // sums over every worker
+    std::array<uint64_t, WorkerMetrics::STATUS_CODES.size () + 1> by_status{};
+    std::array<uint64_t, WorkerMetrics::METHODS.size () + 1> by_method{};
+    uint64_t bytes_received = 0, bytes_sent = 0, accept_errors = 0;
+    std::array<MergedHistogram, WorkerMetrics::PHASE_COUNT> latencies;
+    for (const auto& worker : m_Workers) {
+        for (size_t i = 0; i < by_status.size (); i++)
+            by_status[i] += worker->requests_by_status[i].get ();
+        for (size_t i = 0; i < by_method.size (); i++)
+            by_method[i] += worker->requests_by_method[i].get ();
+        bytes_received += worker->bytes_received.get ();
+        bytes_sent += worker->bytes_sent.get ();
+        accept_errors += worker->accept_errors.get ();
+        for (size_t i = 0; i < latencies.size (); i++)
+            latencies[i].add (worker->latencies[i]);
+    }
+
+    appendHeader (p_Out, "ccerve_requests_total", "counter", "Requests answered, by status code.");
+    for (size_t i = 0; i < by_status.size (); i++) {
+        if (i < WorkerMetrics::STATUS_CODES.size ())
+            std::format_to (out, "ccerve_requests_total{{code=\"{}\"}} {}\n", WorkerMetrics::STATUS_CODES[i], by_status[i]);
+        else
+            std::format_to (out, "ccerve_requests_total{{code=\"other\"}} {}\n", by_status[i]);
+    }
+
+    appendHeader (p_Out, "ccerve_requests_by_method_total", "counter", "Requests answered, by method.");
+    for (size_t i = 0; i < by_method.size (); i++) {
+        std::string_view method = i < WorkerMetrics::METHODS.size () ? WorkerMetrics::METHODS[i] : "other";
+        std::format_to (out, "ccerve_requests_by_method_total{{method=\"{}\"}} {}\n", method, by_method[i]);
+    }
+
+    appendValue (p_Out, "ccerve_received_bytes_total", "counter", "Bytes received from clients.", bytes_received);
+    appendValue (p_Out, "ccerve_sent_bytes_total", "counter", "Bytes sent to clients.", bytes_sent);
+
+    appendValue (p_Out, "ccerve_connections_active", "gauge", "Connections open right now.",
+    m_ConnectionStats.open.load ());
+    appendValue (p_Out, "ccerve_connections_accepted_total", "counter", "Connections accepted.",
+    m_ConnectionStats.accepted.load ());
+    appendValue (p_Out, "ccerve_connections_rejected_total", "counter",
+    "Connections closed right after being accepted, too many were open.", m_ConnectionStats.rejected.load ());
+    appendHeader (p_Out, "ccerve_connection_timeouts_total", "counter", "Connections closed by a timeout.");
+    std::format_to (out, "ccerve_connection_timeouts_total{{timeout=\"idle\"}} {}\n",
+    m_ConnectionStats.idle_timeouts.load ());
+    std::format_to (out, "ccerve_connection_timeouts_total{{timeout=\"request\"}} {}\n",
+    m_ConnectionStats.request_timeouts.load ());
+    appendValue (p_Out, "ccerve_accept_errors_total", "counter", "Failed accepts.", accept_errors);
+
+    if (m_FileCache) {
+        FileCacheStats stats = m_FileCache->getStats ();
+        appendValue (p_Out, "ccerve_file_cache_hits_total", "counter", "Files found in the cache.", stats.hits);
+        appendValue (p_Out, "ccerve_file_cache_misses_total", "counter", "Files read from disk.", stats.misses);
+        appendValue (p_Out, "ccerve_file_cache_evictions_total", "counter",
+        "Files dropped from the cache to make room.", stats.evictions);
+        appendValue (p_Out, "ccerve_file_cache_invalidations_total", "counter",
+        "Files dropped from the cache because they changed.", stats.invalidations);
+        appendValue (p_Out, "ccerve_file_cache_entries", "gauge", "Files in the cache.", stats.entries);
+        appendValue (p_Out, "ccerve_file_cache_bytes", "gauge", "Bytes the cached files take up.", stats.bytes);
+    }
+
+    appendHeader (p_Out, "ccerve_request_duration_seconds", "histogram",
+    "Time spent on a request: parsing it, finding its file and sending the response.");
+    for (size_t phase = 0; phase < latencies.size (); phase++) {
+        const MergedHistogram& histogram = latencies[phase];
+        for (unsigned bit = FIRST_EXPORTED_BIT; bit <= LAST_EXPORTED_BIT; bit++) {
+            uint64_t limit = uint64_t{ 1 } << bit;
+            std::format_to (out, "ccerve_request_duration_seconds_bucket{{phase=\"{}\",le=\"{}\"}} {}\n",
+            PHASE_NAMES[phase], static_cast<double> (limit) / 1e9, histogram.countBelow (limit));
+        }
+        std::format_to (out, "ccerve_request_duration_seconds_bucket{{phase=\"{}\",le=\"+Inf\"}} {}\n",
+        PHASE_NAMES[phase], histogram.count);
+        std::format_to (out, "ccerve_request_duration_seconds_sum{{phase=\"{}\"}} {}\n",
+        PHASE_NAMES[phase], static_cast<double> (histogram.sum) / 1e9);
+        std::format_to (out, "ccerve_request_duration_seconds_count{{phase=\"{}\"}} {}\n",
+        PHASE_NAMES[phase], histogram.count);
+    }
+
+    // the histograms keep far more detail than the exported buckets
+    appendHeader (p_Out, "ccerve_request_duration_quantile_seconds", "gauge",
+    "Quantiles of the time spent on a request, to within 1/16 of their value.");
+    for (size_t phase = 0; phase < latencies.size (); phase++) {
+        for (double quantile : QUANTILES) {
+            std::format_to (out, "ccerve_request_duration_quantile_seconds{{phase=\"{}\",quantile=\"{}\"}} {}\n",
+            PHASE_NAMES[phase], quantile, latencies[phase].quantile (quantile) / 1e9);
+        }
+    }
+}
+
+} // namespace ccerve
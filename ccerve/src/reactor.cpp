@@ -0,0 +1,134 @@
+/**
+ * @file reactor.cpp
+ * @brief Holds the definition of the Reactor class
+ */
+
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <utility>
+
+namespace ccerve {
+namespace coro {
+
+// @brief Monotonic time in ns
+static uint64_t nowNs () {
+    timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t> (now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+Reactor::Reactor (size_t p_MaxEvents) : m_EventLoop (p_MaxEvents) {
+}
+
+Reactor::~Reactor () {
+    for (Sleeper& sleeper : m_Sleepers)
+        sleeper.handle.destroy ();
+}
+
+bool Reactor::watch (int p_Fd) {
+    // edge triggered: an operation only waits after its system call said it
+    // would block, so it can't miss the edge it waits for
+    if (!m_EventLoop.add (p_Fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET))
+        return false;
+    if (static_cast<size_t> (p_Fd) >= m_Waiters.size ())
+        m_Waiters.resize (p_Fd + 1);
+    m_Waiters[p_Fd] = { .watched = true };
+    return true;
+}
+
+void Reactor::unwatch (int p_Fd) {
+    Waiters* waiters = findWaiters (p_Fd);
+    if (!waiters)
+        return;
+    m_EventLoop.remove (p_Fd);
+    for (Operation* operation : { waiters->readable, waiters->writable }) {
+        if (operation) {
+            operation->result = -ECANCELED;
+            m_Posted.push_back (operation->waiter);
+        }
+    }
+    *waiters = {};
+}
+
+void Reactor::post (std::coroutine_handle<> p_Handle) {
+    m_Posted.push_back (p_Handle);
+}
+
+bool Reactor::poll (int p_TimeoutMs) {
+    int timeout  = m_Posted.empty () ? p_TimeoutMs : 0;
+    int sleep_ms = getSleepMs ();
+    if (sleep_ms >= 0)
+        timeout = timeout < 0 ? sleep_ms : std::min (timeout, sleep_ms);
+
+    int ready = m_EventLoop.wait (timeout);
+    if (ready < 0)
+        return false;
+
+    for (int i = 0; i < ready; i++) {
+        const epoll_event& event = m_EventLoop.getEvent (i);
+        // errors and hang-ups wake both directions, their system calls
+        // report them
+        if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+            complete (event.data.fd, Interest::READABLE);
+        if (event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+            complete (event.data.fd, Interest::WRITABLE);
+    }
+
+    uint64_t now = nowNs ();
+    while (!m_Sleepers.empty () && m_Sleepers.front ().due <= now) {
+        std::pop_heap (m_Sleepers.begin (), m_Sleepers.end (), isDueLater);
+        m_Posted.push_back (m_Sleepers.back ().handle);
+        m_Sleepers.pop_back ();
+    }
+
+    // whatever they post is resumed too
+    while (!m_Posted.empty ()) {
+        m_Resuming.swap (m_Posted);
+        for (std::coroutine_handle<> handle : m_Resuming)
+            handle.resume ();
+        m_Resuming.clear ();
+    }
+    return true;
+}
+
+bool Reactor::park (int p_Fd, Interest p_Interest, Operation& p_Operation) {
+    Waiters* waiters = findWaiters (p_Fd);
+    if (!waiters)
+        return false;
+    (p_Interest == Interest::READABLE ? waiters->readable : waiters->writable) = &p_Operation;
+    return true;
+}
+
+void Reactor::complete (int p_Fd, Interest p_Interest) {
+    // unwatched by a coroutine resumed earlier in the batch
+    Waiters* waiters = findWaiters (p_Fd);
+    if (!waiters)
+        return;
+    Operation*& waiting = p_Interest == Interest::READABLE ? waiters->readable : waiters->writable;
+    if (!waiting || !waiting->attempt (*waiting))
+        return;
+    // the coroutine may unwatch p_Fd, so the slot is cleared before
+    std::exchange (waiting, nullptr)->waiter.resume ();
+}
+
+void Reactor::addSleeper (unsigned p_Ms, std::coroutine_handle<> p_Handle) {
+    m_Sleepers.push_back ({ nowNs () + static_cast<uint64_t> (p_Ms) * 1000000, p_Handle });
+    std::push_heap (m_Sleepers.begin (), m_Sleepers.end (), isDueLater);
+}
+
+bool Reactor::isDueLater (const Sleeper& p_Left, const Sleeper& p_Right) {
+    return p_Left.due > p_Right.due;
+}
+
+int Reactor::getSleepMs () const {
+    if (m_Sleepers.empty ())
+        return -1;
+    uint64_t now = nowNs ();
+    uint64_t due = m_Sleepers.front ().due;
+    return due <= now ? 0 : static_cast<int> ((due - now + 999999) / 1000000);
+}
+
+} // namespace coro
+} // namespace ccerve
@@ -6,15 +6,35 @@
 
 #include "sinks.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
 namespace ccerve {
 namespace sinks {
 
 void BaseSink::write (std::string_view p_Msg) {
 }
 
+void BaseSink::write (std::span<const std::string> p_Msgs) {
+    for (const std::string& msg : p_Msgs)
+        write (std::string_view (msg));
+}
+
+void BaseSink::flush () {
+}
+
 std::vector<std::string_view> FileSink::FileSinks;
 
-FileSink::FileSink (std::string_view p_Path) {
+FileSink::FileSink (std::string_view p_Path, bool p_Append) {
     using namespace std;
     filesystem::path path (p_Path);
 
@@ -35,13 +55,19 @@ FileSink::FileSink (std::string_view p_Path) {
         filesystem::create_directories (path.parent_path ());
     }
 
-    m_File = ofstream (path); // create the log file
+    // create the log file
+    m_File = open (path.c_str (), O_WRONLY | O_CREAT | (p_Append ? 0 : O_TRUNC) | O_APPEND | O_CLOEXEC, 0644);
+    if (m_File < 0) {
+        std::cerr << std::format ("Log file '{}' couldn't be opened: {}\n", p_Path, strerror (errno));
+    }
+    m_Buffer.reserve (BUFFER_SIZE);
     FileSinks.push_back (m_FilePath);
 }
 
 FileSink::~FileSink () {
-    if (m_File.is_open ())
-        m_File.close (); // ! what if close() fails?
+    flush ();
+    if (m_File >= 0)
+        close (m_File); // ! what if close() fails?
     FileSinks.erase (std::find (FileSinks.begin (), FileSinks.end (), this->m_FilePath));
 }
 
@@ -49,12 +75,290 @@ void FileSink::write (std::string_view p_Msg) {
     std::lock_guard<std::mutex> file_lock (
     m_FileMutex); // ! Improve: Only lock when two sinks point to the same
                   // file
-    m_File << p_Msg << std::flush;
+    m_Buffer.append (p_Msg);
+    if (m_Buffer.size () >= BUFFER_SIZE)
+        writeOut ({});
+}
+
+void FileSink::write (std::span<const std::string> p_Msgs) {
+    std::lock_guard<std::mutex> file_lock (m_FileMutex);
+
+    size_t size = m_Buffer.size ();
+    for (const std::string& msg : p_Msgs)
+        size += msg.size ();
+
+    // a full buffer goes out together with the batch, without copying it
+    if (size >= BUFFER_SIZE) {
+        writeOut (p_Msgs);
+        return;
+    }
+    for (const std::string& msg : p_Msgs)
+        m_Buffer.append (msg);
+}
+
+void FileSink::flush () {
+    std::lock_guard<std::mutex> file_lock (m_FileMutex);
+    if (!m_Buffer.empty ())
+        writeOut ({});
+}
+
+void FileSink::writeOut (std::span<const std::string> p_Msgs) {
+    if (m_File < 0) {
+        m_Buffer.clear ();
+        return;
+    }
+
+    std::vector<iovec>& pieces = m_Pieces;
+    pieces.clear ();
+    if (!m_Buffer.empty ())
+        pieces.push_back ({ m_Buffer.data (), m_Buffer.size () });
+    for (const std::string& msg : p_Msgs) {
+        if (!msg.empty ())
+            pieces.push_back ({ const_cast<char*> (msg.data ()), msg.size () });
+    }
+
+    size_t done = 0;
+    while (done < pieces.size ()) {
+        int count     = static_cast<int> (std::min<size_t> (pieces.size () - done, IOV_MAX));
+        ssize_t wrote = writev (m_File, pieces.data () + done, count);
+        if (wrote < 0) {
+            if (errno == EINTR)
+                continue;
+            break; // nothing sensible left to do with log messages
+        }
+
+        // skip what was written, a piece may have been written partially
+        size_t left = static_cast<size_t> (wrote);
+        while (done < pieces.size () && left >= pieces[done].iov_len) {
+            left -= pieces[done].iov_len;
+            done++;
+        }
+        if (left > 0) {
+            pieces[done].iov_base = static_cast<char*> (pieces[done].iov_base) + left;
+            pieces[done].iov_len -= left;
+        }
+    }
+    m_Buffer.clear ();
+}
+
+// @brief Whether p_Suffix starts with a date as dated segments are named
+// after ("20261017-230512")
+static bool isDated (std::string_view p_Suffix) {
+    static constexpr std::string_view PATTERN = "dddddddd-dddddd";
+    if (p_Suffix.size () < PATTERN.size ())
+        return false;
+    for (size_t i = 0; i < PATTERN.size (); i++) {
+        bool digit = std::isdigit (static_cast<unsigned char> (p_Suffix[i]));
+        if (PATTERN[i] == 'd' ? !digit : p_Suffix[i] != PATTERN[i])
+            return false;
+    }
+    return true;
+}
+
+RotatingFileSink::Segment::~Segment () {
+    if (data)
+        munmap (data, size);
+    if (fd >= 0)
+        close (fd);
+}
+
+RotatingFileSink::RotatingFileSink (std::string_view p_Path, const RotationPolicy& p_Policy, bool p_Shared)
+: m_Path (p_Path), m_Policy (p_Policy) {
+    std::filesystem::path path (p_Path);
+    std::error_code error;
+    if (path.has_parent_path ())
+        std::filesystem::create_directories (path.parent_path (), error);
+
+    std::lock_guard<std::mutex> segment_lock (m_Mutex);
+
+    // a segment left behind by a crash still has its padding, cut it off at
+    // the last byte written and rotate it like any other. A segment still
+    // mapped by another server can't be cut (its writes past the end would
+    // fault), that server trims it when it's done.
+    int old_fd = p_Shared ? -1 : open (m_Path.c_str (), O_RDWR | O_CLOEXEC);
+    if (p_Shared && std::filesystem::exists (m_Path, error)) {
+        retire ();
+    } else if (old_fd >= 0) {
+        struct stat file_stat;
+        if (fstat (old_fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            size_t size = static_cast<size_t> (file_stat.st_size);
+            void* data  = mmap (nullptr, size, PROT_READ, MAP_SHARED, old_fd, 0);
+            if (data != MAP_FAILED) {
+                const char* bytes = static_cast<const char*> (data);
+                while (size > 0 && bytes[size - 1] == '\0')
+                    size--;
+                munmap (data, static_cast<size_t> (file_stat.st_size));
+                if (ftruncate (old_fd, static_cast<off_t> (size)) < 0) {
+                    std::cerr << std::format ("Log segment '{}' couldn't be trimmed: {}\n", m_Path, strerror (errno));
+                }
+            }
+        }
+        close (old_fd);
+        retire ();
+    }
+    openSegment ();
+
+    if (m_Policy.sync_interval_ms > 0)
+        m_SyncThread = std::thread ([this] { syncLoop (); });
+}
+
+RotatingFileSink::~RotatingFileSink () {
+    {
+        std::lock_guard<std::mutex> segment_lock (m_Mutex);
+        m_StopSync = true;
+    }
+    m_SyncCV.notify_one ();
+    if (m_SyncThread.joinable ())
+        m_SyncThread.join ();
+
+    std::lock_guard<std::mutex> segment_lock (m_Mutex);
+    closeSegment ();
+}
+
+void RotatingFileSink::write (std::string_view p_Msg) {
+    std::lock_guard<std::mutex> segment_lock (m_Mutex);
+    append (p_Msg);
+}
+
+void RotatingFileSink::write (std::span<const std::string> p_Msgs) {
+    std::lock_guard<std::mutex> segment_lock (m_Mutex);
+    for (const std::string& msg : p_Msgs)
+        append (msg);
+}
+
+void RotatingFileSink::append (std::string_view p_Msg) {
+    bool too_old = m_Policy.max_age_s > 0 && m_Used > 0 &&
+    time (nullptr) - m_StartTime >= static_cast<time_t> (m_Policy.max_age_s);
+    if (!m_Segment || too_old || m_Used + p_Msg.size () > m_Segment->size) {
+        // a message larger than a whole segment is cut
+        if (m_Used > 0 || !m_Segment)
+            rotate ();
+        if (!m_Segment)
+            return;
+        p_Msg = p_Msg.substr (0, m_Segment->size);
+    }
+
+    std::memcpy (m_Segment->data + m_Used, p_Msg.data (), p_Msg.size ());
+    m_Used += p_Msg.size ();
+}
+
+void RotatingFileSink::openSegment () {
+    m_Used      = 0;
+    m_Synced    = 0;
+    m_StartTime = time (nullptr);
+
+    auto segment = std::make_shared<Segment> ();
+    segment->size = std::max<size_t> (m_Policy.segment_size, 4096);
+    segment->fd   = open (m_Path.c_str (), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment->fd < 0 || ftruncate (segment->fd, static_cast<off_t> (segment->size)) < 0) {
+        std::cerr << std::format ("Log segment '{}' couldn't be created: {}\n", m_Path, strerror (errno));
+        return;
+    }
+
+    void* data = mmap (nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << std::format ("Log segment '{}' couldn't be mapped: {}\n", m_Path, strerror (errno));
+        return;
+    }
+    segment->data = static_cast<char*> (data);
+    m_Segment     = std::move (segment);
+}
+
+void RotatingFileSink::closeSegment () {
+    if (!m_Segment)
+        return;
+
+    // start writing back what wasn't synced yet, then drop the padding
+    msync (m_Segment->data, m_Segment->size, MS_ASYNC);
+    if (ftruncate (m_Segment->fd, static_cast<off_t> (m_Used)) < 0) {
+        std::cerr << std::format ("Log segment '{}' couldn't be trimmed: {}\n", m_Path, strerror (errno));
+    }
+    m_Segment.reset ();
+}
+
+void RotatingFileSink::rotate () {
+    closeSegment ();
+    retire ();
+    openSegment ();
+}
+
+void RotatingFileSink::retire () {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    fs::path path (m_Path);
+
+    if (m_Policy.retention == 0) {
+        fs::remove (path, error);
+        return;
+    }
+
+    if (!m_Policy.dated_names) {
+        // log.txt.1 is the newest, shift every segment up by one
+        fs::remove (m_Path + "." + std::to_string (m_Policy.retention), error);
+        for (size_t number = m_Policy.retention - 1; number >= 1; number--) {
+            fs::rename (m_Path + "." + std::to_string (number),
+            m_Path + "." + std::to_string (number + 1), error);
+        }
+        fs::rename (path, m_Path + ".1", error);
+        return;
+    }
+
+    char date[32];
+    time_t now = time (nullptr);
+    tm local_time;
+    localtime_r (&now, &local_time);
+    std::strftime (date, sizeof (date), "%Y%m%d-%H%M%S", &local_time);
+
+    // several rotations within a second get a counter
+    std::string rotated = m_Path + "." + date;
+    for (int i = 1; fs::exists (rotated, error); i++)
+        rotated = m_Path + "." + date + "-" + std::to_string (i);
+    fs::rename (path, rotated, error);
+
+    // the names sort by time, so the oldest ones come first
+    std::string prefix = path.filename ().string () + ".";
+    fs::path directory = path.has_parent_path () ? path.parent_path () : fs::path (".");
+    std::vector<fs::path> segments;
+    for (const auto& entry : fs::directory_iterator (directory, error)) {
+        std::string name = entry.path ().filename ().string ();
+        if (name.starts_with (prefix) && isDated (std::string_view (name).substr (prefix.size ())))
+            segments.push_back (entry.path ());
+    }
+    std::sort (segments.begin (), segments.end ());
+    for (size_t i = 0; i + m_Policy.retention < segments.size (); i++)
+        fs::remove (segments[i], error);
+}
+
+void RotatingFileSink::syncLoop () {
+    const size_t page_size = static_cast<size_t> (sysconf (_SC_PAGESIZE));
+    std::unique_lock<std::mutex> segment_lock (m_Mutex);
+
+    while (!m_StopSync) {
+        m_SyncCV.wait_for (segment_lock, std::chrono::milliseconds (m_Policy.sync_interval_ms));
+        if (!m_Segment || m_Synced == m_Used)
+            continue;
+
+        // sync without holding the lock, writers only append meanwhile and a
+        // rotated segment stays mapped until this reference is dropped
+        std::shared_ptr<Segment> segment = m_Segment;
+        size_t from                      = m_Synced / page_size * page_size;
+        size_t to                        = m_Used;
+        segment_lock.unlock ();
+        msync (segment->data + from, to - from, MS_SYNC);
+        segment_lock.lock ();
+
+        if (segment == m_Segment)
+            m_Synced = to;
+    }
 }
 
 void StdOutSink::write (std::string_view p_Msg) {
     std::cout << p_Msg;
 }
 
+void StdOutSink::flush () {
+    std::cout.flush ();
+}
+
 } // namespace sinks
 } // namespace ccerve
@@ -0,0 +1,273 @@
+/**
+ * @file uring.cpp
+ * @brief Holds the definition of the IoUring class
+ */
+
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ccerve {
+
+static int uringSetup (unsigned p_Entries, io_uring_params* p_Params) {
+    return static_cast<int> (syscall (__NR_io_uring_setup, p_Entries, p_Params));
+}
+
+static int uringEnter (int p_Fd, unsigned p_ToSubmit, unsigned p_MinComplete, unsigned p_Flags) {
+    return static_cast<int> (syscall (__NR_io_uring_enter, p_Fd, p_ToSubmit,
+    p_MinComplete, p_Flags, nullptr, 0));
+}
+
+static int uringRegister (int p_Fd, unsigned p_Opcode, void* p_Arg, unsigned p_NrArgs) {
+    return static_cast<int> (
+    syscall (__NR_io_uring_register, p_Fd, p_Opcode, p_Arg, p_NrArgs));
+}
+
+IoUring::IoUring (unsigned p_Entries) {
+    // Only the worker thread submits, so let the kernel run completion work
+    // when we enter the ring instead of interrupting us. Older kernels don't
+    // know these flags, retry without them.
+    memset (&m_Params, 0, sizeof (m_Params));
+    m_Params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    m_Params.cq_entries = p_Entries * 4;
+    m_RingFd            = uringSetup (p_Entries, &m_Params);
+
+    if (m_RingFd < 0 && errno == EINVAL) {
+        memset (&m_Params, 0, sizeof (m_Params));
+        m_Params.flags      = IORING_SETUP_CQSIZE;
+        m_Params.cq_entries = p_Entries * 4;
+        m_RingFd            = uringSetup (p_Entries, &m_Params);
+    }
+    if (m_RingFd < 0) {
+        throw exception::IoUringCreationFailure ("io_uring instance could not be created!");
+    }
+
+    m_SqRingSize = m_Params.sq_off.array + m_Params.sq_entries * sizeof (unsigned);
+    m_CqRingSize = m_Params.cq_off.cqes + m_Params.cq_entries * sizeof (io_uring_cqe);
+    m_SqesSize   = m_Params.sq_entries * sizeof (io_uring_sqe);
+
+    // both rings live in one mapping on every kernel we can run on, but keep
+    // the two-mapping fallback cheap
+    if (m_Params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_SqRingSize = m_CqRingSize = std::max (m_SqRingSize, m_CqRingSize);
+    }
+
+    m_SqRing = mmap (nullptr, m_SqRingSize, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQ_RING);
+    if (m_SqRing == MAP_FAILED) {
+        close (m_RingFd);
+        throw exception::IoUringCreationFailure ("io_uring rings could not be mapped!");
+    }
+
+    if (m_Params.features & IORING_FEAT_SINGLE_MMAP) {
+        m_CqRing = m_SqRing;
+    } else {
+        m_CqRing = mmap (nullptr, m_CqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_CQ_RING);
+        if (m_CqRing == MAP_FAILED) {
+            munmap (m_SqRing, m_SqRingSize);
+            close (m_RingFd);
+            throw exception::IoUringCreationFailure ("io_uring rings could not be mapped!");
+        }
+    }
+
+    m_Sqes = static_cast<io_uring_sqe*> (mmap (nullptr, m_SqesSize, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQES));
+    if (m_Sqes == MAP_FAILED) {
+        if (m_CqRing != m_SqRing)
+            munmap (m_CqRing, m_CqRingSize);
+        munmap (m_SqRing, m_SqRingSize);
+        close (m_RingFd);
+        throw exception::IoUringCreationFailure ("io_uring entries could not be mapped!");
+    }
+
+    char* sq_ring = static_cast<char*> (m_SqRing);
+    m_SqHead      = reinterpret_cast<unsigned*> (sq_ring + m_Params.sq_off.head);
+    m_SqTail      = reinterpret_cast<unsigned*> (sq_ring + m_Params.sq_off.tail);
+    m_SqMask      = reinterpret_cast<unsigned*> (sq_ring + m_Params.sq_off.ring_mask);
+    m_SqArray     = reinterpret_cast<unsigned*> (sq_ring + m_Params.sq_off.array);
+    m_SqeTail     = *m_SqTail;
+
+    // submission entries are always used in ring order, so the indirection
+    // array maps every slot to itself once and is never touched again
+    for (unsigned i = 0; i < m_Params.sq_entries; i++) {
+        m_SqArray[i] = i;
+    }
+
+    char* cq_ring = static_cast<char*> (m_CqRing);
+    m_CqHead      = reinterpret_cast<unsigned*> (cq_ring + m_Params.cq_off.head);
+    m_CqTail      = reinterpret_cast<unsigned*> (cq_ring + m_Params.cq_off.tail);
+    m_CqMask      = reinterpret_cast<unsigned*> (cq_ring + m_Params.cq_off.ring_mask);
+    m_Cqes        = reinterpret_cast<io_uring_cqe*> (cq_ring + m_Params.cq_off.cqes);
+}
+
+IoUring::~IoUring () {
+    if (m_BufRing) {
+        io_uring_buf_reg reg{};
+        reg.bgid = m_BufGroup;
+        uringRegister (m_RingFd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        munmap (m_BufRing, m_BufRingSize);
+    }
+
+    munmap (m_Sqes, m_SqesSize);
+    if (m_CqRing != m_SqRing)
+        munmap (m_CqRing, m_CqRingSize);
+    munmap (m_SqRing, m_SqRingSize);
+    close (m_RingFd);
+}
+
+// @brief Operations UringWorker submits
+static constexpr uint8_t REQUIRED_OPS[] = {
+    IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_SENDMSG, IORING_OP_SHUTDOWN, IORING_OP_POLL_ADD,
+    IORING_OP_FILES_UPDATE, IORING_OP_READ, IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL,
+    // IORING_RECV_MULTISHOT came with Linux 6.0 as this one did: a flag
+    // can't be probed, the operation stands in for it
+    IORING_OP_SEND_ZC,
+};
+
+// @brief Whether the ring p_RingFd takes a provided buffer ring (Linux 5.19,
+// like multishot accept)
+static bool probeBufferRing (int p_RingFd) {
+    // the kernel wants the ring page aligned
+    size_t ring_size = sysconf (_SC_PAGESIZE);
+    void* ring       = mmap (nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr    = reinterpret_cast<uint64_t> (ring);
+    reg.ring_entries = 1;
+    bool registered  = uringRegister (p_RingFd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+    if (registered)
+        uringRegister (p_RingFd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap (ring, ring_size);
+    return registered;
+}
+
+// @brief Whether the ring p_RingFd supports every operation of REQUIRED_OPS
+static bool probeOperations (int p_RingFd) {
+    std::vector<unsigned char> memory (sizeof (io_uring_probe) + IORING_OP_LAST * sizeof (io_uring_probe_op));
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*> (memory.data ());
+    if (uringRegister (p_RingFd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+        return false;
+
+    return std::ranges::all_of (REQUIRED_OPS, [probe] (uint8_t p_Op) {
+        return p_Op <= probe->last_op && p_Op < probe->ops_len && (probe->ops[p_Op].flags & IO_URING_OP_SUPPORTED);
+    });
+}
+
+bool IoUring::isSupported () {
+    io_uring_params params{};
+    int ring_fd = uringSetup (2, &params);
+    if (ring_fd < 0)
+        return false;
+    bool supported = probeBufferRing (ring_fd) && probeOperations (ring_fd);
+    close (ring_fd);
+    return supported;
+}
+
+io_uring_sqe* IoUring::getSqe () {
+    unsigned head = std::atomic_ref<unsigned> (*m_SqHead).load (std::memory_order_acquire);
+
+    // ring is full, let the kernel consume what's queued
+    if (m_SqeTail - head >= m_Params.sq_entries) {
+        submitAndWait (0);
+        head = std::atomic_ref<unsigned> (*m_SqHead).load (std::memory_order_acquire);
+        if (m_SqeTail - head >= m_Params.sq_entries)
+            return nullptr;
+    }
+
+    io_uring_sqe* sqe = &m_Sqes[m_SqeTail & *m_SqMask];
+    m_SqeTail++;
+    memset (sqe, 0, sizeof (*sqe));
+    return sqe;
+}
+
+bool IoUring::reserveSqes (unsigned p_Count) {
+    unsigned head = std::atomic_ref<unsigned> (*m_SqHead).load (std::memory_order_acquire);
+    if (m_Params.sq_entries - (m_SqeTail - head) >= p_Count)
+        return true;
+
+    submitAndWait (0);
+    head = std::atomic_ref<unsigned> (*m_SqHead).load (std::memory_order_acquire);
+    return m_Params.sq_entries - (m_SqeTail - head) >= p_Count;
+}
+
+unsigned IoUring::flushSubmissions () {
+    unsigned tail = *m_SqTail;
+    std::atomic_ref<unsigned> (*m_SqTail).store (m_SqeTail, std::memory_order_release);
+    return m_SqeTail - tail;
+}
+
+int IoUring::submitAndWait (unsigned p_WaitNr) {
+    unsigned to_submit = flushSubmissions ();
+
+    // nothing to hand over and nothing to wait for, skip the system call
+    if (to_submit == 0 && p_WaitNr == 0)
+        return 0;
+
+    int submitted;
+    do {
+        submitted = uringEnter (m_RingFd, to_submit, p_WaitNr,
+        p_WaitNr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    return submitted < 0 ? -errno : submitted;
+}
+
+bool IoUring::setupBufferRing (uint16_t p_GroupId, unsigned p_Count, unsigned p_Size) {
+    m_BufRingSize = p_Count * sizeof (io_uring_buf);
+    void* ring    = mmap (nullptr, m_BufRingSize, PROT_READ | PROT_WRITE,
+       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED)
+        return false;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr    = reinterpret_cast<uint64_t> (ring);
+    reg.ring_entries = p_Count;
+    reg.bgid         = p_GroupId;
+    if (uringRegister (m_RingFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap (ring, m_BufRingSize);
+        return false;
+    }
+
+    m_BufRing  = static_cast<io_uring_buf_ring*> (ring);
+    m_BufCount = p_Count;
+    m_BufSize  = p_Size;
+    m_BufGroup = p_GroupId;
+    m_BufMemory.resize (static_cast<size_t> (p_Count) * p_Size);
+
+    for (unsigned i = 0; i < p_Count; i++) {
+        returnBuffer (static_cast<uint16_t> (i));
+    }
+    return true;
+}
+
+void IoUring::returnBuffer (uint16_t p_BufferId) {
+    std::atomic_ref<uint16_t> tail (m_BufRing->tail);
+    uint16_t current_tail = tail.load (std::memory_order_relaxed);
+
+    // Not m_BufRing->bufs: in C++ the empty struct __DECLARE_FLEX_ARRAY puts
+    // in front of it has a size of 1, which moves the array by 8 bytes. The
+    // entries start right at the beginning of the ring.
+    io_uring_buf* bufs = reinterpret_cast<io_uring_buf*> (m_BufRing);
+    io_uring_buf& buf  = bufs[current_tail & (m_BufCount - 1)];
+    buf.addr          = reinterpret_cast<uint64_t> (getBuffer (p_BufferId));
+    buf.len           = m_BufSize;
+    buf.bid           = p_BufferId;
+
+    tail.store (current_tail + 1, std::memory_order_release);
+}
+
+bool IoUring::registerFiles (unsigned p_Count) {
+    // -1 leaves a slot empty
+    std::vector<int> files (p_Count, -1);
+    return uringRegister (m_RingFd, IORING_REGISTER_FILES, files.data (), p_Count) >= 0;
+}
+
+} // namespace ccerve
@@ -0,0 +1,582 @@
+/**
+ * @file uring_worker.cpp
+ * @brief Holds the definition of the UringWorker class
+ */
+
+#include "uring_worker.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <utility>
+
+namespace ccerve {
+
+UringWorker::UringWorker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context, int p_ServerSock)
+: Worker (p_ServerSockAddr, p_Context, p_ServerSock) {
+}
+
+UringWorker::~UringWorker () {
+    m_Ring.reset ();
+    m_Connections.clear ();
+}
+
+void UringWorker::run () {
+    if (!startListening ())
+        return;
+
+    try {
+        m_Ring = std::make_unique<IoUring> (RING_ENTRIES);
+    } catch (const exception::IoUringCreationFailure& excpt) {
+        log::error ("{}", excpt.what ());
+        return;
+    }
+
+    if (!m_Ring->setupBufferRing (RECV_BUFFER_GROUP, RECV_BUFFER_COUNT, BUFFER_SIZE)) {
+        log::error ("Provided buffer ring could not be registered (needs Linux 5.19+)!");
+        m_Ring.reset ();
+        return;
+    }
+
+    // a slot can only be filled by an operation linked to the read using it
+    // if the kernel picks the file of the read when it runs, not when it's
+    // submitted
+    if (m_Ring->hasFeature (IORING_FEAT_LINKED_FILE) && m_Ring->registerFiles (FILE_SLOTS)) {
+        for (int slot = FILE_SLOTS - 1; slot >= 0; slot--) {
+            m_FreeFileSlots.push_back (slot);
+        }
+    }
+
+    submitWakePoll ();
+    submitAccept ();
+
+    while (!m_Stop) {
+        if (m_DrainRequested && !m_Draining)
+            startDraining ();
+        if (m_Draining && m_Connections.empty ())
+            break;
+
+        flushDirtyConnections ();
+        if (!m_Timers.empty () && !m_TickTimeoutArmed)
+            submitTickTimeout ();
+
+        // hands over everything queued in the last batch and waits for the
+        // next one: usually the only system call per loop iteration
+        int ret = m_Ring->submitAndWait (1);
+        if (ret < 0 && ret != -EBUSY && ret != -EAGAIN) {
+            log::error ("io_uring was not able to wait for completions!");
+            break;
+        }
+
+        m_Ring->forEachCompletion (
+        [this] (const io_uring_cqe& p_Cqe) { handleCompletion (p_Cqe); });
+
+        expireTimers ([this] (Connection& p_Conn) {
+            int fd = p_Conn.getSock ();
+            // also ends a send stuck on a client which doesn't read
+            shutdown (fd, SHUT_RDWR);
+            closeConnection (fd, m_Connections.at (fd));
+        });
+    }
+
+    // closing the ring cancels every operation still in flight
+    m_Ring.reset ();
+    releaseConnections (m_Connections.size ());
+    m_Connections.clear ();
+    m_DirtyConnections.clear ();
+    m_FreeFileSlots.clear ();
+}
+
+void UringWorker::submitAccept () {
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!sqe) {
+        log::error ("io_uring submission ring is full!");
+        return;
+    }
+
+    // one submission keeps accepting until it fails
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = m_ServerSock;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data    = encodeUserData (m_ServerSock, Operation::ACCEPT);
+}
+
+void UringWorker::submitWakePoll () {
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!sqe) {
+        log::error ("io_uring submission ring is full!");
+        return;
+    }
+
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = m_WakeFd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = encodeUserData (m_WakeFd, Operation::WAKE);
+}
+
+void UringWorker::submitTickTimeout () {
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!sqe)
+        return; // tried again in the next loop iteration
+
+    // completes with -ETIME once the tick has passed
+    sqe->opcode    = IORING_OP_TIMEOUT;
+    sqe->fd        = -1;
+    sqe->addr      = reinterpret_cast<uint64_t> (&m_TickTimeout);
+    sqe->len       = 1;
+    sqe->user_data = encodeUserData (0, Operation::TIMEOUT);
+    m_TickTimeoutArmed = true;
+}
+
+void UringWorker::startDraining () {
+    m_Draining = true;
+
+    // the accept still in flight completes with -ECANCELED and isn't armed
+    // again. New connections go to the sockets still bound to the address,
+    // e.g. those of the server which took them over.
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (sqe) {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->fd        = -1;
+        sqe->addr      = encodeUserData (m_ServerSock, Operation::ACCEPT);
+        sqe->user_data = encodeUserData (0, Operation::CANCEL);
+    }
+    closeServerSocket ();
+
+    // a request which has just arrived is answered (with "close") once its
+    // recv completes, closing its connection would make the client see an
+    // error. closeConnection() may erase the connection.
+    for (auto conn_itr = m_Connections.begin (); conn_itr != m_Connections.end ();) {
+        auto& [fd, uconn] = *conn_itr++;
+        if (!uconn.closing && !isSending (uconn) && isFinished (*uconn.conn) && !sockets::hasUnreadData (fd))
+            closeConnection (fd, uconn);
+    }
+}
+
+void UringWorker::submitRecv (int p_Fd, UringConnection& p_UConn) {
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!sqe) {
+        log::error ("io_uring submission ring is full!");
+        closeConnection (p_Fd, p_UConn);
+        return;
+    }
+
+    // multishot: posts a completion for every chunk of data until the client
+    // closes. The kernel picks a buffer from the provided buffer ring.
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = p_Fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = encodeUserData (p_Fd, Operation::RECV);
+
+    p_UConn.pending_ops++;
+    p_UConn.receiving = true;
+}
+
+void UringWorker::pauseRecv (int p_Fd, UringConnection& p_UConn) {
+    if (!p_UConn.receiving || p_UConn.recv_canceling)
+        return;
+    // without a free entry the reader keeps buffering, which is what
+    // happened before the input was paused
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!sqe)
+        return;
+    sqe->opcode            = IORING_OP_ASYNC_CANCEL;
+    sqe->fd                = -1;
+    sqe->addr              = encodeUserData (p_Fd, Operation::RECV);
+    sqe->user_data         = encodeUserData (p_Fd, Operation::CANCEL);
+    p_UConn.recv_canceling = true;
+}
+
+void UringWorker::submitSend (int p_Fd, UringConnection& p_UConn) {
+    OutputSegment& segment = p_UConn.in_flight;
+    bool new_file          = false;
+
+    if (segment.isDone () && p_UConn.gathered.empty ()) {
+        if (!p_UConn.conn->hasPendingWrites ())
+            return;
+        if (p_UConn.conn->nextSegmentInMemory ()) {
+            // e.g. the responses to a batch of pipelined requests
+            while (p_UConn.gathered.size () < Connection::MAX_GATHERED_SEGMENTS &&
+            p_UConn.conn->nextSegmentInMemory ()) {
+                p_UConn.gathered.push_back (p_UConn.conn->takeNextSegment ());
+            }
+        } else {
+            segment  = p_UConn.conn->takeNextSegment ();
+            new_file = true;
+        }
+    }
+
+    // register + read + send + shutdown have to go out in the same submission
+    if (!m_Ring->reserveSqes (4)) {
+        log::error ("io_uring submission ring is full!");
+        closeConnection (p_Fd, p_UConn);
+        return;
+    }
+
+    bool last_send = !p_UConn.conn->hasPendingWrites ();
+    size_t length  = 0;
+
+    if (p_UConn.gathered.empty ()) {
+        // the read of the next chunk is linked in front of its send
+        if (new_file)
+            submitRegisterFile (p_Fd, p_UConn);
+        length = std::min (segment.remaining (), FILE_CHUNK_SIZE);
+        submitFileRead (p_Fd, p_UConn, length);
+        last_send = last_send && length == segment.remaining ();
+    }
+
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (!p_UConn.gathered.empty ()) {
+        // rebuilt for every submission: the vector may have moved the
+        // segments (and the short strings stored inside them)
+        p_UConn.gathered_iov.clear ();
+        for (const OutputSegment& gathered_segment : p_UConn.gathered) {
+            p_UConn.gathered_iov.push_back (
+            { const_cast<char*> (gathered_segment.bytes ().data () + gathered_segment.data_offset),
+            gathered_segment.remaining () });
+        }
+        p_UConn.gathered_msg            = msghdr{};
+        p_UConn.gathered_msg.msg_iov    = p_UConn.gathered_iov.data ();
+        p_UConn.gathered_msg.msg_iovlen = p_UConn.gathered_iov.size ();
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr   = reinterpret_cast<uint64_t> (&p_UConn.gathered_msg);
+        sqe->len    = 1;
+    } else {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->addr   = reinterpret_cast<uint64_t> (p_UConn.file_chunk.get ());
+        sqe->len    = static_cast<uint32_t> (length);
+    }
+
+    // MSG_WAITALL: the kernel retries short sends itself, so a send only
+    // completes early (and breaks the link below) on a real error.
+    // MSG_MORE: more of the response follows (a body after its head, the next
+    // chunk of a file). Without it the follow-up waits for the client's
+    // delayed ACK (Nagle).
+    sqe->fd        = p_Fd;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (last_send ? 0 : MSG_MORE);
+    sqe->user_data = encodeUserData (p_Fd, Operation::SEND);
+    p_UConn.pending_ops++;
+    p_UConn.sending = true;
+
+    // The client asked for "Connection: close" and nothing is read after that
+    // request, so this is the last response. Link the shutdown to its last
+    // send instead of waiting for the send to complete.
+    if (!p_UConn.conn->getKeepAlive () && last_send) {
+        io_uring_sqe* shutdown_sqe = m_Ring->getSqe ();
+
+        sqe->flags |= IOSQE_IO_LINK;
+        shutdown_sqe->opcode    = IORING_OP_SHUTDOWN;
+        shutdown_sqe->fd        = p_Fd;
+        shutdown_sqe->len       = SHUT_RDWR;
+        shutdown_sqe->user_data = encodeUserData (p_Fd, Operation::SHUTDOWN);
+        p_UConn.pending_ops++;
+        p_UConn.shutdown_linked = true;
+    }
+}
+
+void UringWorker::submitRegisterFile (int p_Fd, UringConnection& p_UConn) {
+    if (m_FreeFileSlots.empty ())
+        return;
+
+    p_UConn.file_slot = m_FreeFileSlots.back ();
+    m_FreeFileSlots.pop_back ();
+
+    // the kernel reads the descriptor from in_flight, which stays put until
+    // the chain completes
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    sqe->opcode       = IORING_OP_FILES_UPDATE;
+    sqe->fd           = -1;
+    sqe->addr         = reinterpret_cast<uint64_t> (&p_UConn.in_flight.file_fd);
+    sqe->len          = 1;
+    sqe->off          = static_cast<uint64_t> (p_UConn.file_slot);
+    sqe->flags        = IOSQE_IO_LINK;
+    sqe->user_data    = encodeUserData (p_Fd, Operation::REGISTER_FILE);
+    p_UConn.pending_ops++;
+}
+
+void UringWorker::submitFileRead (int p_Fd, UringConnection& p_UConn, size_t p_Length) {
+    if (!p_UConn.file_chunk)
+        p_UConn.file_chunk.reset (new char[FILE_CHUNK_SIZE]);
+
+    // a short read (the file was truncated) breaks the link, so the send is
+    // canceled and the connection closed
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    sqe->opcode       = IORING_OP_READ;
+    sqe->addr         = reinterpret_cast<uint64_t> (p_UConn.file_chunk.get ());
+    sqe->len          = static_cast<uint32_t> (p_Length);
+    sqe->off          = static_cast<uint64_t> (p_UConn.in_flight.file_offset);
+    sqe->flags        = IOSQE_IO_LINK;
+    sqe->user_data    = encodeUserData (p_Fd, Operation::READ);
+    if (p_UConn.file_slot >= 0) {
+        sqe->fd = p_UConn.file_slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = p_UConn.in_flight.file_fd;
+    }
+    p_UConn.pending_ops++;
+}
+
+void UringWorker::releaseFileSlot (UringConnection& p_UConn) {
+    if (p_UConn.file_slot < 0)
+        return;
+
+    // drops the reference the table holds on the file. Not tied to the
+    // connection, which may be gone when this completes.
+    io_uring_sqe* sqe = m_Ring->getSqe ();
+    if (sqe) {
+        sqe->opcode    = IORING_OP_FILES_UPDATE;
+        sqe->fd        = -1;
+        sqe->addr      = reinterpret_cast<uint64_t> (&NO_FILE);
+        sqe->len       = 1;
+        sqe->off       = static_cast<uint64_t> (p_UConn.file_slot);
+        sqe->user_data = encodeUserData (0, Operation::RELEASE_FILE);
+        m_FreeFileSlots.push_back (p_UConn.file_slot);
+    }
+    p_UConn.file_slot = -1;
+}
+
+void UringWorker::flushDirtyConnections () {
+    for (int fd : m_DirtyConnections) {
+        auto conn_itr = m_Connections.find (fd);
+        if (conn_itr == m_Connections.end ())
+            continue;
+
+        UringConnection& uconn = conn_itr->second;
+        uconn.dirty            = false;
+        // if a send is in flight, the new data goes out when it completes
+        if (!uconn.sending && !uconn.closing)
+            submitSend (fd, uconn);
+    }
+    m_DirtyConnections.clear ();
+}
+
+void UringWorker::handleCompletion (const io_uring_cqe& p_Cqe) {
+    int fd       = static_cast<int> (p_Cqe.user_data >> 8);
+    Operation op = static_cast<Operation> (p_Cqe.user_data & 0xff);
+
+    if (op == Operation::ACCEPT) {
+        handleAccept (p_Cqe);
+        return;
+    } else if (op == Operation::WAKE) {
+        // stop() or drain() was called (the while loop checks which), or
+        // the file pool answered requests
+        resetWakeUp ();
+        if (!m_Stop)
+            submitWakePoll ();
+        handleFileJobs (
+        [this] (int p_Sock) -> Connection* {
+            auto conn_itr = m_Connections.find (p_Sock);
+            if (conn_itr == m_Connections.end () || conn_itr->second.closing)
+                return nullptr;
+            return conn_itr->second.conn.get ();
+        },
+        [this] (Connection& p_Conn) {
+            UringConnection& uconn = m_Connections.at (p_Conn.getSock ());
+            if (!uconn.dirty) {
+                uconn.dirty = true;
+                m_DirtyConnections.push_back (p_Conn.getSock ());
+            }
+            updateTimer (p_Conn, isSending (uconn));
+        });
+        return;
+    } else if (op == Operation::RELEASE_FILE || op == Operation::CANCEL) {
+        return;
+    } else if (op == Operation::TIMEOUT) {
+        // the timers are advanced after every batch
+        m_TickTimeoutArmed = false;
+        return;
+    }
+
+    auto conn_itr = m_Connections.find (fd);
+    if (conn_itr == m_Connections.end ()) {
+        if (p_Cqe.flags & IORING_CQE_F_BUFFER)
+            m_Ring->returnBuffer (p_Cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        return;
+    }
+    UringConnection& uconn = conn_itr->second;
+
+    if (op == Operation::RECV) {
+        handleRecv (fd, uconn, p_Cqe);
+    } else if (op == Operation::SEND) {
+        handleSend (fd, uconn, p_Cqe);
+    } else if (op == Operation::SHUTDOWN) {
+        uconn.shutdown_linked = false;
+        // canceled because the linked send failed, or done and there is no
+        // recv (its input was paused) which would see the end and close
+        if (p_Cqe.res < 0 || !uconn.receiving)
+            closeConnection (fd, uconn);
+    } else if (op == Operation::READ || op == Operation::REGISTER_FILE) {
+        // a failure cancels the linked send, which closes the connection
+        if (p_Cqe.res < 0 && p_Cqe.res != -ECANCELED)
+            log::error ("File could not be read!");
+    }
+
+    // multishot operations stay in flight as long as IORING_CQE_F_MORE is set
+    if (!(p_Cqe.flags & IORING_CQE_F_MORE) && --uconn.pending_ops == 0 && uconn.closing) {
+        releaseFileSlot (uconn);
+        m_Connections.erase (conn_itr);
+        releaseConnections ();
+    }
+}
+
+void UringWorker::handleAccept (const io_uring_cqe& p_Cqe) {
+    // the multishot accept ended (e.g. on an error), arm it again
+    if (!(p_Cqe.flags & IORING_CQE_F_MORE) && !m_Stop && !m_Draining) {
+        submitAccept ();
+    }
+
+    if (p_Cqe.res < 0) {
+        if (p_Cqe.res != -ECONNABORTED && p_Cqe.res != -ECANCELED) {
+            m_WorkerMetrics->accept_errors.add ();
+            log::error ("Socket was not able to accept the connection!");
+        }
+        return;
+    }
+
+    int client_sock = p_Cqe.res;
+    if (!admitConnection ()) {
+        sockets::closeSocket (client_sock);
+        return;
+    }
+
+    sockaddr_in client_sock_addr{};
+    socklen_t client_sock_addr_len = sizeof (client_sock_addr);
+    getpeername (client_sock, (sockaddr*)&client_sock_addr, &client_sock_addr_len);
+
+    UringConnection& uconn = m_Connections[client_sock];
+    uconn.conn = std::make_unique<Connection> (client_sock, client_sock_addr, &m_ConnectionMemory);
+    updateTimer (*uconn.conn, false);
+    // released right away if the recv can't be submitted
+    submitRecv (client_sock, uconn);
+}
+
+void UringWorker::handleRecv (int p_Fd, UringConnection& p_UConn, const io_uring_cqe& p_Cqe) {
+    if (p_Cqe.flags & IORING_CQE_F_BUFFER) {
+        uint16_t buffer_id = p_Cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+        // nothing is read after a request asking for "Connection: close"
+        if (p_Cqe.res > 0 && !p_UConn.closing && p_UConn.conn->getKeepAlive ()) {
+            handleInput (*p_UConn.conn,
+            std::string_view (m_Ring->getBuffer (buffer_id), p_Cqe.res));
+            // the client doesn't take its responses, stop receiving
+            if (p_UConn.conn->isInputPaused ())
+                pauseRecv (p_Fd, p_UConn);
+
+            if (!p_UConn.dirty) {
+                p_UConn.dirty = true;
+                m_DirtyConnections.push_back (p_Fd);
+            }
+            updateTimer (*p_UConn.conn, isSending (p_UConn));
+        }
+        m_Ring->returnBuffer (buffer_id);
+    }
+
+    if (p_Cqe.flags & IORING_CQE_F_MORE)
+        return;
+
+    p_UConn.receiving = false;
+    bool paused       = std::exchange (p_UConn.recv_canceling, false) && p_Cqe.res == -ECANCELED;
+
+    if (p_Cqe.res == 0) {
+        // Client closed the connection (Normal)
+        closeConnection (p_Fd, p_UConn);
+    } else if (p_Cqe.res == -ENOBUFS || p_Cqe.res > 0 || paused) {
+        // ran out of provided buffers (they are back in the ring now), the
+        // kernel ended the multishot recv or pauseRecv() did, arm it again
+        // unless the input (still) is paused
+        if (!p_UConn.closing && !p_UConn.conn->isInputPaused ())
+            submitRecv (p_Fd, p_UConn);
+    } else {
+        if (p_Cqe.res != -ECONNRESET && p_Cqe.res != -ECANCELED)
+            log::error ("Socket was not able to read data\n");
+        closeConnection (p_Fd, p_UConn);
+    }
+}
+
+void UringWorker::handleSend (int p_Fd, UringConnection& p_UConn, const io_uring_cqe& p_Cqe) {
+    p_UConn.sending = false;
+
+    if (p_Cqe.res < 0) {
+        // canceled: the linked read failed and has been logged already
+        if (p_Cqe.res != -EPIPE && p_Cqe.res != -ECONNRESET && p_Cqe.res != -ECANCELED)
+            log::error ("Socket was not able to send data!");
+        // a linked shutdown is canceled together with the failed send
+        p_UConn.shutdown_linked = false;
+        closeConnection (p_Fd, p_UConn);
+        return;
+    }
+
+    if (!p_UConn.gathered.empty ()) {
+        // a send can end in the middle of any of the gathered segments
+        size_t unconsumed = p_Cqe.res;
+        size_t done_count = 0;
+        for (OutputSegment& gathered_segment : p_UConn.gathered) {
+            size_t consumed = std::min (unconsumed, gathered_segment.remaining ());
+            gathered_segment.consume (consumed);
+            unconsumed -= consumed;
+            if (!gathered_segment.isDone ())
+                break;
+            done_count++;
+        }
+        p_UConn.gathered.erase (p_UConn.gathered.begin (), p_UConn.gathered.begin () + done_count);
+    } else {
+        p_UConn.in_flight.consume (p_Cqe.res);
+        if (p_UConn.in_flight.isDone ()) {
+            // closes the file right away instead of with the next segment
+            releaseFileSlot (p_UConn);
+            p_UConn.in_flight = OutputSegment ();
+        }
+    }
+    countSent (*p_UConn.conn, p_Cqe.res,
+    p_UConn.in_flight.isDone () && p_UConn.gathered.empty () && !p_UConn.conn->hasPendingWrites ());
+    if (p_UConn.closing)
+        return;
+
+    // the client took enough of its responses, serve the requests it sent
+    // meanwhile and receive again
+    if (resumeInput (*p_UConn.conn) && !p_UConn.receiving && !p_UConn.conn->isInputPaused ()) {
+        submitRecv (p_Fd, p_UConn);
+        if (p_UConn.closing)
+            return;
+    }
+
+    // sends the rest of a short send, the next file chunk or what was queued
+    // in the meantime
+    if (!p_UConn.in_flight.isDone () || !p_UConn.gathered.empty () ||
+    p_UConn.conn->hasPendingWrites ()) {
+        submitSend (p_Fd, p_UConn);
+    } else if (isFinished (*p_UConn.conn) && !p_UConn.shutdown_linked) {
+        closeConnection (p_Fd, p_UConn);
+        return;
+    }
+    if (!p_UConn.closing)
+        updateTimer (*p_UConn.conn, isSending (p_UConn));
+}
+
+void UringWorker::closeConnection (int p_Fd, UringConnection& p_UConn) {
+    if (p_UConn.closing)
+        return;
+    p_UConn.closing = true;
+    m_Timers.cancel (p_UConn.conn->getTimer ());
+
+    // nothing is in flight (e.g. its recv was canceled while the input was
+    // paused), so no completion would release it
+    if (p_UConn.pending_ops == 0) {
+        releaseFileSlot (p_UConn);
+        m_Connections.erase (p_Fd);
+        releaseConnections ();
+        return;
+    }
+
+    // ends the multishot recv, the connection is released in
+    // handleCompletion() once its last operation completes
+    if (p_UConn.receiving && !p_UConn.shutdown_linked)
+        shutdown (p_Fd, SHUT_RDWR);
+}
+
+} // namespace ccerve
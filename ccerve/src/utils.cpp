@@ -11,12 +11,13 @@
  * was unable to make it work with std::string.
  */
 
-// @brief For holding the current time.
-static time_t s_CurrentTime;
+// @brief For holding the current time. (thread_local since every worker
+// thread logs)
+static thread_local time_t s_CurrentTime;
 
 static const size_t s_CurrentTimeStrSize = 100;
 // @brief String representation of the current time.
-static char s_CurrentTimeStr[s_CurrentTimeStrSize];
+static thread_local char s_CurrentTimeStr[s_CurrentTimeStrSize];
 
 static const size_t s_TimeFormatStrSize = 100;
 // @brief Format in which time should be shown
@@ -28,3 +29,86 @@ const char* getCurrentTime () {
     std::localtime (&s_CurrentTime));
     return s_CurrentTimeStr;
 }
+
+static constexpr const char* DAY_NAMES[7]    = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static constexpr const char* MONTH_NAMES[12] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+// @brief Writes p_Value as p_Digits decimal digits
+static char* writeDigits (char* p_Buffer, int p_Value, int p_Digits) {
+    for (int i = p_Digits - 1; i >= 0; i--) {
+        p_Buffer[i] = static_cast<char> ('0' + p_Value % 10);
+        p_Value /= 10;
+    }
+    return p_Buffer + p_Digits;
+}
+
+// @brief Appends p_Text, which has p_Length characters
+static char* writeText (char* p_Buffer, const char* p_Text, size_t p_Length) {
+    for (size_t i = 0; i < p_Length; i++) {
+        p_Buffer[i] = p_Text[i];
+    }
+    return p_Buffer + p_Length;
+}
+
+std::string_view formatHttpDate (time_t p_Time, char* p_Buffer) {
+    // not strftime: %a and %b depend on the locale
+    tm date;
+    gmtime_r (&p_Time, &date);
+
+    char* position = p_Buffer;
+    position       = writeText (position, DAY_NAMES[date.tm_wday], 3);
+    position       = writeText (position, ", ", 2);
+    position       = writeDigits (position, date.tm_mday, 2);
+    position       = writeText (position, " ", 1);
+    position       = writeText (position, MONTH_NAMES[date.tm_mon], 3);
+    position       = writeText (position, " ", 1);
+    position       = writeDigits (position, date.tm_year + 1900, 4);
+    position       = writeText (position, " ", 1);
+    position       = writeDigits (position, date.tm_hour, 2);
+    position       = writeText (position, ":", 1);
+    position       = writeDigits (position, date.tm_min, 2);
+    position       = writeText (position, ":", 1);
+    position       = writeDigits (position, date.tm_sec, 2);
+    position       = writeText (position, " GMT", 4);
+    return std::string_view (p_Buffer, position - p_Buffer);
+}
+
+// @brief Reads p_Digits decimal digits at p_Offset of p_Date
+static bool readDigits (std::string_view p_Date, size_t p_Offset, size_t p_Digits, int& p_Value) {
+    p_Value = 0;
+    for (size_t i = p_Offset; i < p_Offset + p_Digits; i++) {
+        if (p_Date[i] < '0' || p_Date[i] > '9')
+            return false;
+        p_Value = p_Value * 10 + (p_Date[i] - '0');
+    }
+    return true;
+}
+
+bool parseHttpDate (std::string_view p_Date, time_t& p_Time) {
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    //  0    5  8   12   17 20 23 26
+    if (p_Date.size () != HTTP_DATE_SIZE || p_Date.substr (3, 2) != ", " || p_Date[7] != ' ' ||
+    p_Date[11] != ' ' || p_Date[16] != ' ' || p_Date[19] != ':' || p_Date[22] != ':' ||
+    p_Date.substr (25) != " GMT") {
+        return false;
+    }
+
+    tm date{};
+    date.tm_mon = -1;
+    for (int month = 0; month < 12; month++) {
+        if (p_Date.substr (8, 3) == MONTH_NAMES[month])
+            date.tm_mon = month;
+    }
+
+    int year = 0;
+    if (date.tm_mon < 0 || !readDigits (p_Date, 5, 2, date.tm_mday) || !readDigits (p_Date, 12, 4, year) ||
+    !readDigits (p_Date, 17, 2, date.tm_hour) || !readDigits (p_Date, 20, 2, date.tm_min) ||
+    !readDigits (p_Date, 23, 2, date.tm_sec)) {
+        return false;
+    }
+    date.tm_year = year - 1900;
+
+    p_Time = timegm (&date);
+    return true;
+}
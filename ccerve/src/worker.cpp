@@ -0,0 +1,287 @@
+/**
+ * @file worker.cpp
+ * @brief Holds the definition of the Worker base class
+ */
+
+#include "worker.hpp"
+#include "http_parser.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+namespace ccerve {
+
+Worker::Worker (const sockaddr_in& p_ServerSockAddr, const WorkerContext& p_Context, int p_ServerSock)
+: m_ServerSock (p_ServerSock), m_ServerSockAddr (p_ServerSockAddr), m_Stop (false), m_DrainRequested (false),
+  m_ConnectionMemory (std::pmr::pool_options{ 0, MAX_POOLED_BLOCK }), m_FileCache (p_Context.file_cache),
+  m_Compressor (p_Context.compressor), m_Listings (p_Context.listings),
+  m_FilePool (p_Context.file_pool), m_Limits (p_Context.limits),
+  m_ConnectionStats (p_Context.connection_stats ? p_Context.connection_stats : &m_OwnConnectionStats),
+  m_Metrics (p_Context.metrics_path.empty () ? nullptr : p_Context.metrics),
+  m_MetricsPath (p_Context.metrics_path),
+  m_WorkerMetrics (p_Context.metrics ? &p_Context.metrics->addWorker () : &m_OwnWorkerMetrics),
+  m_Timers (currentTick ()) {
+    // a socket taken over is bound (and listening) already
+    if (m_ServerSock < 0) {
+        createServerSocket ();
+
+        // SO_REUSEPORT lets every worker bind its own socket to the same
+        // address, also while the sockets of a server this one replaces are
+        // still open. SO_REUSEADDR is so that the address can be used again
+        // right after the server stopped.
+        const int enable = 1;
+        if (setsockopt (m_ServerSock, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof (int)) < 0 ||
+        setsockopt (m_ServerSock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof (int)) < 0) {
+            log::warn (
+            "SO_REUSEPORT | SO_REUSADDR couldn't be set as an option for "
+            "server socket.");
+        }
+
+        bindServerSocket ();
+    }
+
+    m_WakeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_WakeFd < 0) {
+        sockets::closeSocket (m_ServerSock);
+        throw exception::EventLoopCreationFailure (
+        "Wake up descriptor of the event loop could not be created!");
+    }
+}
+
+Worker::~Worker () {
+    closeServerSocket ();
+    close (m_WakeFd);
+}
+
+void Worker::createServerSocket () {
+    // not inherited by a server started to replace this one, it gets the
+    // sockets it takes over explicitly
+    m_ServerSock = sockets::createSocket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_ServerSock < 0) {
+        throw exception::ServerSockCreationFailure (
+        "Server socket creation failed!");
+    }
+}
+
+void Worker::bindServerSocket () {
+    if (bind (m_ServerSock, (sockaddr*)&m_ServerSockAddr, sizeof (m_ServerSockAddr)) < 0) {
+        sockets::closeSocket (m_ServerSock);
+        throw exception::ServerSockBindFailure (
+        "Server socket could not be bound to the given address.");
+    }
+}
+
+bool Worker::startListening () {
+    if (listen (m_ServerSock, BACKLOG_SIZE) < 0) {
+        log::error ("Socket was not able to start listening!");
+        return false;
+    }
+    return true;
+}
+
+void Worker::stop () {
+    m_Stop = true;
+    eventfd_write (m_WakeFd, 1);
+}
+
+void Worker::drain () {
+    m_DrainRequested = true;
+    eventfd_write (m_WakeFd, 1);
+}
+
+void Worker::resetWakeUp () {
+    eventfd_t value;
+    eventfd_read (m_WakeFd, &value);
+}
+
+void Worker::closeServerSocket () {
+    if (m_ServerSock < 0)
+        return;
+    sockets::closeSocket (m_ServerSock);
+    m_ServerSock = -1;
+}
+
+uint64_t Worker::currentTick () {
+    // the coarse clock is read without a system call
+    timespec now;
+    clock_gettime (CLOCK_MONOTONIC_COARSE, &now);
+    return (static_cast<uint64_t> (now.tv_sec) * 1000 + now.tv_nsec / 1000000) / TICK_MS;
+}
+
+bool Worker::admitConnection () {
+    size_t open = m_ConnectionStats->open.fetch_add (1);
+    if (m_Limits.max_connections > 0 && open >= m_Limits.max_connections) {
+        m_ConnectionStats->open--;
+        m_ConnectionStats->rejected++;
+        return false;
+    }
+    m_ConnectionStats->accepted++;
+    return true;
+}
+
+void Worker::updateTimer (Connection& p_Conn, bool p_Sending) {
+    // rounded up, so a deadline never comes early
+    auto ticks = [] (unsigned p_Ms) { return (p_Ms + TICK_MS - 1) / TICK_MS; };
+
+    if (!p_Sending && p_Conn.getRequestReader ().hasPendingData ()) {
+        // a slowly dripping request doesn't push its deadline back
+        if (p_Conn.getDeadline () == Connection::Deadline::REQUEST && p_Conn.getTimer ().isArmed ())
+            return;
+        p_Conn.setDeadline (Connection::Deadline::REQUEST);
+    } else {
+        p_Conn.setDeadline (Connection::Deadline::IDLE);
+    }
+
+    // a timeout of 0 means there is none
+    unsigned timeout_ms = p_Conn.getDeadline () == Connection::Deadline::REQUEST ?
+    m_Limits.request_timeout_ms :
+    m_Limits.idle_timeout_ms;
+    if (timeout_ms == 0)
+        m_Timers.cancel (p_Conn.getTimer ());
+    else
+        m_Timers.arm (p_Conn.getTimer (), currentTick () + ticks (timeout_ms));
+}
+
+void Worker::countSent (Connection& p_Conn, size_t p_Bytes, bool p_Drained) {
+    m_WorkerMetrics->bytes_sent.add (p_Bytes);
+    if (!p_Drained)
+        return;
+    if (p_Conn.isSendClockRunning ())
+        m_WorkerMetrics->recordLatency (Phase::SEND, monotonicNs () - p_Conn.stopSendClock ());
+    // nothing of the responses is left, the next ones start with a clean arena
+    p_Conn.releaseArena ();
+}
+
+void Worker::handleInput (Connection& p_Conn, std::string_view p_Data) {
+    parse::RequestReader& reader = p_Conn.getRequestReader ();
+    reader.append (p_Data);
+    m_WorkerMetrics->bytes_received.add (p_Data.size ());
+
+    // serve every request which is complete, in order (pipelining), as long
+    // as the client takes the responses
+    while (p_Conn.getKeepAlive () && p_Conn.getPendingJob () == 0 && !p_Conn.isBackedUp ()) {
+        parse::Request request;
+        uint64_t parse_start     = monotonicNs ();
+        parse::ReadStatus status = reader.next (request);
+        if (status == parse::ReadStatus::INCOMPLETE)
+            break;
+        uint64_t parse_end = monotonicNs ();
+        m_WorkerMetrics->recordLatency (Phase::PARSE, parse_end - parse_start);
+
+        if (status != parse::ReadStatus::COMPLETE) {
+            int status_code = 400;
+            if (status == parse::ReadStatus::HEADERS_TOO_LARGE)
+                status_code = 431;
+            else if (status == parse::ReadStatus::BODY_TOO_LARGE)
+                status_code = 413;
+            else if (status == parse::ReadStatus::NOT_IMPLEMENTED)
+                status_code = 501;
+
+            // makeErrorResponse() announces that the connection is closed
+            m_WorkerMetrics->countRequest (request.method, status_code);
+            p_Conn.startSendClock (parse_end);
+            p_Conn.queueResponse (parse::makeErrorResponse (status_code));
+            p_Conn.setKeepAlive (false);
+            log::info ("{} -- {}", inet_ntoa (p_Conn.getSockAddr ().sin_addr), status_code);
+            break;
+        }
+
+        // the last request a connection may send is answered with "close"
+        // (or the first one since the worker started draining)
+        bool last_request = m_Limits.max_requests > 0 && p_Conn.countRequest () >= m_Limits.max_requests;
+        last_request |= m_Draining;
+        parse::Response response;
+        if (m_Metrics && request.path == m_MetricsPath && request.method == "GET") {
+            auto page = std::make_shared<CachedFile> ();
+            m_Metrics->render (page->contents);
+            response = parse::makePageResponse (request, Metrics::CONTENT_TYPE, std::move (page), last_request);
+        } else if (!m_FilePool) {
+            response = parse::handleRequest (request, m_FileCache, m_Compressor, m_Listings, last_request,
+            p_Conn.getArena ());
+        } else if (auto answered = parse::handleRequestFromMemory (request, m_FileCache, m_Compressor,
+                   last_request, p_Conn.getArena ())) {
+            response = std::move (*answered);
+        } else {
+            // the disk could keep every other connection of the worker waiting
+            offloadRequest (p_Conn, last_request, parse_end);
+            reader.consume ();
+            break;
+        }
+        queueAnswer (p_Conn, request, std::move (response), parse_end);
+
+        // the views of request point into the reader until here
+        reader.consume ();
+    }
+
+    // reading on would only grow the reader. Nothing is read after "close",
+    // so there is nothing to resume either.
+    if (!p_Conn.getKeepAlive ())
+        p_Conn.setInputPaused (false);
+    else if (p_Conn.isBackedUp () || p_Conn.getPendingJob () != 0)
+        p_Conn.setInputPaused (true);
+}
+
+bool Worker::resumeInput (Connection& p_Conn) {
+    if (!p_Conn.isInputPaused () || p_Conn.isBackedUp () || p_Conn.getPendingJob () != 0)
+        return false;
+    p_Conn.setInputPaused (false);
+    handleInput (p_Conn, {});
+    return true;
+}
+
+void Worker::queueAnswer (Connection& p_Conn, const parse::Request& p_Request, parse::Response&& p_Response,
+uint64_t p_Start) {
+    int status_code = p_Response.status_code;
+
+    uint64_t handle_end = monotonicNs ();
+    m_WorkerMetrics->recordLatency (Phase::FILE, handle_end - p_Start);
+    m_WorkerMetrics->countRequest (p_Request.method, status_code);
+    p_Conn.startSendClock (handle_end);
+
+    // the client asked for "close" or it was the last request, otherwise
+    // assume keep-alive for HTTP/1.1
+    if (p_Response.close_connection) {
+        p_Conn.setKeepAlive (false);
+    }
+    p_Conn.queueResponse (std::move (p_Response));
+
+    log::info ("{} -- {} {} {} {}", inet_ntoa (p_Conn.getSockAddr ().sin_addr),
+    p_Request.method, p_Request.target, p_Request.version, status_code);
+}
+
+void Worker::offloadRequest (Connection& p_Conn, bool p_LastRequest, uint64_t p_Start) {
+    auto job          = std::make_unique<FileJob> ();
+    job->sock         = p_Conn.getSock ();
+    job->id           = ++m_LastJob;
+    job->text         = p_Conn.getRequestReader ().current ();
+    job->last_request = p_LastRequest;
+    job->start        = p_Start;
+    // the job's own views of its copy, those parsed before go with the
+    // reader's buffer
+    parse::parseRequest (job->text, job->request);
+    p_Conn.setPendingJob (job->id);
+
+    m_FilePool->submit ([this, job = std::move (job)] () mutable {
+        // allocated from the default resource: the arena of the connection
+        // belongs to the worker's thread
+        job->response = parse::handleRequest (job->request, m_FileCache, m_Compressor, m_Listings,
+        job->last_request);
+
+        // the start of a file sent from disk is read here, so the worker's
+        // first sendfile() finds it in the page cache
+        const parse::Response& response = job->response;
+        if (response.file_fd >= 0)
+            readahead (response.file_fd, response.file_offset, std::min (response.file_size, FILE_PREFETCH_SIZE));
+
+        {
+            std::lock_guard<std::mutex> jobs_lock (m_FileJobsMutex);
+            m_AnsweredJobs.push_back (std::move (job));
+        }
+        eventfd_write (m_WakeFd, 1);
+    });
+}
+
+} // namespace ccerve
@@ -0,0 +1,532 @@
+/**
+ * @file unit_tests.cpp
+ * @brief Unit tests of the request handling and of the workers, which need no
+ * running server: a worker is run on a thread of its own where needed
+ *
+ * Usage: unit-tests
+ */
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "compressor.hpp"
+#include "connection.hpp"
+#include "file_cache.hpp"
+#include "file_pool.hpp"
+#include "http_parser.hpp"
+#include "http_request.hpp"
+#include "metrics.hpp"
+#include "timer_wheel.hpp"
+#include "uring.hpp"
+#include "uring_worker.hpp"
+#include "unit_tests.h"
+
+/**
+ * @brief Status code "GET p_Target" is answered with
+ * @param p_FromMemory by handleRequestFromMemory() instead of handleRequest()
+ * @return 0 if handleRequestFromMemory() needs the disk for it
+ */
+static int statusOf (std::string_view p_Target, ccerve::FileCache& p_FileCache, bool p_FromMemory = false) {
+    std::string text = "GET " + std::string (p_Target) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ccerve::parse::Request request;
+    if (!ccerve::parse::parseRequest (text, request))
+        return -1;
+    if (!p_FromMemory)
+        return ccerve::parse::handleRequest (request, &p_FileCache).status_code;
+
+    auto response = ccerve::parse::handleRequestFromMemory (request, &p_FileCache, nullptr, false,
+    std::pmr::get_default_resource ());
+    return response ? response->status_code : 0;
+}
+
+// @brief A path whose segments leave the served directory (decoded or not)
+// is answered with a 400 instead of the file it names
+static void testPathTraversal (ccerve::FileCache& p_FileCache) {
+    constexpr std::string_view TRAVERSALS[] = {
+        "/../secret.txt",
+        "/%2e%2e/secret.txt",
+        "/%2E%2E/secret.txt",
+        "/.%2e/secret.txt",
+        "/site/../../secret.txt",
+        "/site/%2e%2e/%2e%2e/secret.txt",
+        "/%2e%2e%2fsecret.txt",
+        "/..%2fsecret.txt",
+        "/%2e%2e",
+        "/..",
+        "/./index.html",
+        "/%2e/index.html",
+        "/index.html%00",
+    };
+    for (std::string_view target : TRAVERSALS) {
+        tests::check (statusOf (target, p_FileCache) == 400, "400 for " + std::string (target));
+        // without looking at the disk, as the workers do first
+        tests::check (statusOf (target, p_FileCache, true) == 400, "400 from memory for " + std::string (target));
+    }
+
+    // dots which don't make up a segment are names like others
+    tests::check (statusOf ("/index.html", p_FileCache) == 200, "200 for /index.html");
+    tests::check (statusOf ("/%69ndex.html", p_FileCache) == 200, "200 for /%69ndex.html");
+    tests::check (statusOf ("/..index.html", p_FileCache) == 404, "404 for /..index.html");
+}
+
+namespace parse = ccerve::parse;
+
+// @brief A request may arrive in pieces, several may arrive at once
+// (pipelining), headers without an end are cut off
+static void testRequestReader () {
+    constexpr std::string_view FIRST  = "GET /a.css HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    constexpr std::string_view SECOND = "GET /b.css HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4\r\n\r\nbody";
+    parse::Request request;
+
+    // split at every position, the end of the headers too
+    bool split_ok = true;
+    for (size_t split = 1; split < FIRST.size (); split++) {
+        parse::RequestReader reader;
+        reader.append (FIRST.substr (0, split));
+        split_ok = split_ok && reader.next (request) == parse::ReadStatus::INCOMPLETE;
+        reader.append (FIRST.substr (split));
+        split_ok = split_ok && reader.next (request) == parse::ReadStatus::COMPLETE && request.path == "/a.css";
+        reader.consume ();
+        split_ok = split_ok && !reader.hasPendingData ();
+    }
+    tests::check (split_ok, "a request split over two append() calls");
+
+    // a byte at a time, the body included
+    parse::RequestReader dripping;
+    parse::ReadStatus status = parse::ReadStatus::INCOMPLETE;
+    for (size_t i = 0; i < SECOND.size () && status == parse::ReadStatus::INCOMPLETE; i++) {
+        dripping.append (SECOND.substr (i, 1));
+        status = dripping.next (request);
+    }
+    tests::check (status == parse::ReadStatus::COMPLETE && request.path == "/b.css" &&
+    dripping.current ().size () == SECOND.size (),
+    "a request with a body arriving a byte at a time");
+
+    // pipelined: one append(), the requests come out in order, the last one
+    // incomplete until its rest arrives
+    parse::RequestReader pipelined;
+    std::string text;
+    for (int i = 0; i < 3; i++) {
+        text += FIRST;
+        text += SECOND;
+    }
+    text += FIRST.substr (0, 10);
+    pipelined.append (text);
+    std::vector<std::string> paths;
+    while (pipelined.next (request) == parse::ReadStatus::COMPLETE) {
+        paths.emplace_back (request.path);
+        pipelined.consume ();
+    }
+    tests::check (paths == std::vector<std::string>{ "/a.css", "/b.css", "/a.css", "/b.css", "/a.css", "/b.css" },
+    "pipelined requests are read in order");
+    tests::check (pipelined.hasPendingData (), "a pipelined request cut short waits for its rest");
+    pipelined.append (FIRST.substr (10));
+    tests::check (pipelined.next (request) == parse::ReadStatus::COMPLETE && request.path == "/a.css",
+    "a pipelined request cut short is read once complete");
+
+    // 431: no end of the headers within MAX_HEADER_SIZE, or one past it
+    parse::RequestReader endless;
+    endless.append ("GET / HTTP/1.1\r\nX-Filler: ");
+    endless.append (std::string (parse::RequestReader::MAX_HEADER_SIZE, 'x'));
+    tests::check (endless.next (request) == parse::ReadStatus::HEADERS_TOO_LARGE,
+    "headers without an end past MAX_HEADER_SIZE");
+    parse::RequestReader oversized;
+    oversized.append ("GET / HTTP/1.1\r\nX-Filler: " + std::string (parse::RequestReader::MAX_HEADER_SIZE, 'x') +
+    "\r\n\r\n");
+    tests::check (oversized.next (request) == parse::ReadStatus::HEADERS_TOO_LARGE,
+    "headers ending past MAX_HEADER_SIZE");
+    tests::check (parse::makeErrorResponse (431).status_code == 431, "headers too large are answered with a 431");
+}
+
+// @brief Ranges of a 1000 byte representation, as "a-b" (end excluded)
+static std::string rangesOf (std::string_view p_Value, parse::RangeStatus& p_Status) {
+    std::array<parse::ByteRange, parse::MAX_RANGES> ranges;
+    size_t range_count = 0;
+    p_Status = parse::parseRange (p_Value, 1000, ranges, range_count);
+    std::string rendered;
+    for (size_t i = 0; i < range_count; i++)
+        rendered += std::to_string (ranges[i].start) + "-" + std::to_string (ranges[i].end) + " ";
+    return rendered;
+}
+
+static void testParseRange () {
+    parse::RangeStatus status;
+    tests::check (rangesOf ("bytes=0-99", status) == "0-100 " && status == parse::RangeStatus::SATISFIABLE,
+    "range a-b");
+    tests::check (rangesOf ("bytes=900-", status) == "900-1000 " && status == parse::RangeStatus::SATISFIABLE,
+    "open-ended range");
+    tests::check (rangesOf ("bytes=-100", status) == "900-1000 " && status == parse::RangeStatus::SATISFIABLE,
+    "suffix range");
+    tests::check (rangesOf ("bytes=-5000", status) == "0-1000 " && status == parse::RangeStatus::SATISFIABLE,
+    "suffix range longer than the representation");
+    tests::check (rangesOf ("bytes=990-2000", status) == "990-1000 " && status == parse::RangeStatus::SATISFIABLE,
+    "range clamped to the representation");
+    // kept as asked for, in their order
+    tests::check (rangesOf ("bytes=500-599, 0-99,50-149", status) == "500-600 0-100 50-150 " &&
+    status == parse::RangeStatus::SATISFIABLE,
+    "overlapping ranges");
+    tests::check (rangesOf ("bytes=1000-,2000-2999", status).empty () && status == parse::RangeStatus::UNSATISFIABLE,
+    "ranges past the end are unsatisfiable");
+    tests::check (rangesOf ("bytes=2000-,0-9", status) == "0-10 " && status == parse::RangeStatus::SATISFIABLE,
+    "an unsatisfiable range next to a satisfiable one is dropped");
+    tests::check (rangesOf ("bytes=-0", status).empty () && status == parse::RangeStatus::UNSATISFIABLE,
+    "empty suffix range");
+
+    std::string many = "bytes=0-0";
+    for (size_t i = 1; i < parse::MAX_RANGES; i++)
+        many += "," + std::to_string (i * 10) + "-" + std::to_string (i * 10);
+    tests::check (rangesOf (many, status).size () > 0 && status == parse::RangeStatus::SATISFIABLE,
+    "MAX_RANGES ranges");
+    // the ranges of an ignored header aren't looked at
+    rangesOf (many + ",500-500", status);
+    tests::check (status == parse::RangeStatus::IGNORED, "more than MAX_RANGES ranges are ignored");
+
+    for (std::string_view malformed : { "bytes=", "bytes=a-b", "bytes=5-1", "items=0-1", "bytes=0" }) {
+        rangesOf (malformed, status);
+        tests::check (status == parse::RangeStatus::IGNORED, "malformed range " + std::string (malformed));
+    }
+}
+
+static void testMatchesEntityTag () {
+    constexpr std::string_view ETAG = "\"1a-2b\"";
+    tests::check (parse::matchesEntityTag ("\"1a-2b\"", ETAG), "strong tag matches");
+    tests::check (parse::matchesEntityTag ("W/\"1a-2b\"", ETAG), "weak tag matches weakly");
+    tests::check (parse::matchesEntityTag ("\"x\", W/\"y\" ,\"1a-2b\"", ETAG), "tag in a list");
+    tests::check (parse::matchesEntityTag ("*", ETAG), "* matches");
+    tests::check (parse::matchesEntityTag (" * ", ETAG), "* with spaces matches");
+    tests::check (!parse::matchesEntityTag ("\"1a-2c\"", ETAG), "other tag doesn't match");
+    tests::check (!parse::matchesEntityTag ("\"1a-2b", ETAG), "unterminated tag doesn't match");
+    tests::check (!parse::matchesEntityTag ("1a-2b", ETAG), "unquoted tag doesn't match");
+    tests::check (!parse::matchesEntityTag ("\"x\", *", ETAG), "* in a list doesn't match");
+}
+
+// @brief Status code of "GET /index.html" with p_Headers (each ending with
+// CRLF)
+static int statusWithHeaders (std::string_view p_Headers, ccerve::FileCache& p_FileCache,
+std::string* p_Etag = nullptr) {
+    std::string text = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n" + std::string (p_Headers) + "\r\n";
+    parse::Request request;
+    if (!parse::parseRequest (text, request))
+        return -1;
+    parse::Response response = parse::handleRequest (request, &p_FileCache);
+    if (p_Etag) {
+        size_t etag_start = response.headers.find ("ETag: ");
+        size_t etag_end   = response.headers.find ("\r\n", etag_start);
+        if (etag_start != std::string::npos)
+            *p_Etag = response.headers.substr (etag_start + 6, etag_end - etag_start - 6);
+    }
+    return response.status_code;
+}
+
+// @brief Conditional requests: If-None-Match compares weakly, If-Range
+// strongly, so a weak If-Range sends the whole file
+static void testConditionalRequests (ccerve::FileCache& p_FileCache) {
+    std::string etag;
+    tests::check (statusWithHeaders ("", p_FileCache, &etag) == 200 && etag.starts_with ('"'), "ETag of a file");
+    tests::check (statusWithHeaders ("If-None-Match: " + etag + "\r\n", p_FileCache) == 304, "If-None-Match");
+    tests::check (statusWithHeaders ("If-None-Match: W/" + etag + "\r\n", p_FileCache) == 304,
+    "weak If-None-Match");
+    tests::check (statusWithHeaders ("If-None-Match: \"other\"\r\n", p_FileCache) == 200, "other If-None-Match");
+    tests::check (statusWithHeaders ("If-None-Match: *\r\n", p_FileCache) == 304, "If-None-Match: *");
+
+    std::string range = "Range: bytes=0-3\r\n";
+    tests::check (statusWithHeaders (range, p_FileCache) == 206, "Range");
+    tests::check (statusWithHeaders (range + "If-Range: " + etag + "\r\n", p_FileCache) == 206, "If-Range");
+    tests::check (statusWithHeaders (range + "If-Range: W/" + etag + "\r\n", p_FileCache) == 200,
+    "weak If-Range sends everything");
+    tests::check (statusWithHeaders (range + "If-Range: \"other\"\r\n", p_FileCache) == 200,
+    "other If-Range sends everything");
+    tests::check (statusWithHeaders ("Range: bytes=5000-\r\n", p_FileCache) == 416, "unsatisfiable Range");
+}
+
+// @brief A variant the compressor made in memory is sent to clients asking
+// for the file compressed, but isn't a file of its own: the path it is cached
+// under stays a 404 like it is on disk
+static void testCompressedVariants (ccerve::FileCache& p_FileCache) {
+    if (!ccerve::Compressor::isSupported (ccerve::ContentCoding::GZIP))
+        return;
+
+    std::ofstream ("style.css") << std::string (4096, 'a');
+    ccerve::Compressor compressor (p_FileCache);
+    std::string text = "GET /style.css HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n";
+    parse::Request request;
+    if (!parse::parseRequest (text, request)) {
+        tests::check (false, "request for style.css parses");
+        return;
+    }
+
+    // the first request schedules the variant, later ones get it once it's ready
+    bool compressed = false;
+    for (int attempt = 0; attempt < 200 && !compressed; attempt++) {
+        compressed = parse::handleRequest (request, &p_FileCache, &compressor).content_encoding == "gzip";
+        if (!compressed)
+            std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    }
+    tests::check (compressed, "compressed variant is sent");
+    tests::check (statusOf ("/style.css.gz", p_FileCache) == 404, "variant isn't a file");
+    // a 404 is left to handleRequest() like any other
+    tests::check (statusOf ("/style.css.gz", p_FileCache, true) == 0, "variant isn't sent from memory");
+}
+
+// @brief Owner of a timer, remembers the tick it expired at
+struct TimedThing {
+    ccerve::TimerWheel<TimedThing>::Timer timer{ *this };
+    uint64_t expired_at = 0;
+};
+
+// @brief Timers expire at their tick whichever level they were armed in and
+// however often they moved down, canceled ones don't
+static void testTimerWheel () {
+    using Wheel = ccerve::TimerWheel<TimedThing>;
+    // not at a turn of any level
+    constexpr uint64_t START = 100;
+    Wheel wheel (START);
+
+    // around the turns of levels 1, 2 and 3, and clamped past the last one
+    constexpr uint64_t DELAYS[] = { 1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 262143, 262144, 262145,
+        Wheel::MAX_DELAY - 1, Wheel::MAX_DELAY, Wheel::MAX_DELAY + 1000 };
+    constexpr size_t COUNT = std::size (DELAYS);
+    std::vector<TimedThing> things (COUNT);
+    for (size_t i = 0; i < COUNT; i++)
+        wheel.arm (things[i].timer, START + DELAYS[i]);
+
+    // canceled in level 2 before it moved down, and after it moved down to
+    // level 0
+    TimedThing canceled_early, canceled_late, rearmed;
+    wheel.arm (canceled_early.timer, START + 5000);
+    wheel.arm (canceled_late.timer, START + 300000);
+    // armed in level 2, then re-armed to a tick in level 0
+    wheel.arm (rearmed.timer, START + 200000);
+
+    size_t expired = 0;
+    auto on_expired = [&wheel, &expired] (TimedThing& p_Thing) {
+        p_Thing.expired_at = wheel.getNow ();
+        expired++;
+    };
+    wheel.cancel (canceled_early.timer);
+    wheel.advance (START + 3, on_expired);
+    wheel.arm (rearmed.timer, START + 10);
+    wheel.advance (START + 299990, on_expired);
+    tests::check (canceled_late.timer.isArmed (), "a timer far away stays armed");
+    wheel.cancel (canceled_late.timer);
+    // in one jump: the ticks on the way are still gone through one by one
+    wheel.advance (START + Wheel::MAX_DELAY + 10, on_expired);
+
+    bool all_on_time = true;
+    for (size_t i = 0; i < COUNT; i++) {
+        uint64_t expected = START + std::min (DELAYS[i], Wheel::MAX_DELAY);
+        all_on_time       = all_on_time && things[i].expired_at == expected && !things[i].timer.isArmed ();
+        if (things[i].expired_at != expected)
+            std::fprintf (stderr, "timer of delay %llu expired at %llu\n",
+            static_cast<unsigned long long> (DELAYS[i]), static_cast<unsigned long long> (things[i].expired_at));
+    }
+    tests::check (all_on_time, "timers expire at their tick across the levels");
+    tests::check (rearmed.expired_at == START + 10, "a re-armed timer expires at its new tick");
+    tests::check (canceled_early.expired_at == 0 && canceled_late.expired_at == 0, "canceled timers don't expire");
+    tests::check (expired == COUNT + 1 && wheel.empty (), "every armed timer expired once");
+
+    // a tick which has passed expires with the next one
+    TimedThing late;
+    wheel.arm (late.timer, 0);
+    wheel.advance (wheel.getNow () + 1, on_expired);
+    tests::check (late.expired_at == wheel.getNow (), "a timer armed in the past expires with the next tick");
+}
+
+/**
+ * @brief A connection whose client doesn't take its responses is backed up
+ * once MAX_QUEUED_SEGMENTS are queued (the workers stop reading it then),
+ * and isn't anymore once they are sent
+ */
+static void testBackpressure (ccerve::FileCache& p_FileCache) {
+    int socks[2];
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, socks) != 0) {
+        std::perror ("socketpair");
+        tests::check (false, "socket pair for a connection");
+        return;
+    }
+    std::string text = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    parse::Request request;
+    parse::parseRequest (text, request);
+
+    {
+        ccerve::Connection conn (socks[0], sockaddr_in{});
+        size_t queued = 0;
+        while (!conn.isBackedUp () && queued <= ccerve::Connection::MAX_QUEUED_SEGMENTS) {
+            conn.queueResponse (
+            parse::handleRequest (request, &p_FileCache, nullptr, nullptr, false, conn.getArena ()));
+            queued++;
+        }
+        tests::check (conn.isBackedUp () && queued <= ccerve::Connection::MAX_QUEUED_SEGMENTS,
+        "a connection backs up before MAX_QUEUED_SEGMENTS responses");
+
+        // the client reads everything
+        std::vector<char> buffer (64 * 1024);
+        size_t bytes_sent = 0;
+        while (conn.flush (bytes_sent) && conn.hasPendingWrites ()) {
+            while (read (socks[1], buffer.data (), buffer.size ()) > 0) {
+            }
+        }
+        tests::check (!conn.isBackedUp () && !conn.hasPendingWrites (), "a connection isn't backed up once sent");
+    }
+    close (socks[1]);
+}
+
+// @brief Connects to p_Address, waiting for the worker bound to it to listen
+static int connectTo (const sockaddr_in& p_Address) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int sock = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (connect (sock, reinterpret_cast<const sockaddr*> (&p_Address), sizeof (p_Address)) == 0)
+            return sock;
+        close (sock);
+        std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    }
+    return -1;
+}
+
+// @brief Waits for the value of p_Name in what p_Metrics renders to become
+// p_Value, at most a second
+static bool waitForMetric (ccerve::Metrics& p_Metrics, std::string_view p_Name, uint64_t p_Value) {
+    std::string line = std::string (p_Name) + " " + std::to_string (p_Value) + "\n";
+    for (int attempt = 0; attempt < 100; attempt++) {
+        std::string rendered;
+        p_Metrics.render (rendered);
+        if (rendered.find (line) != std::string::npos)
+            return true;
+        std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    }
+    return false;
+}
+
+// @brief Sends "GET p_Target" with "Connection: close" to p_Address
+// @return the socket, -1 if it couldn't be sent
+static int sendClosingRequest (const sockaddr_in& p_Address, std::string_view p_Target) {
+    int sock = connectTo (p_Address);
+    std::string text = "GET " + std::string (p_Target) + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    if (sock >= 0 && send (sock, text.data (), text.size (), MSG_NOSIGNAL) != ssize_t (text.size ())) {
+        close (sock);
+        return -1;
+    }
+    return sock;
+}
+
+// @brief Reads the response on p_Sock until the server closes it, then
+// closes p_Sock
+static std::string receiveResponse (int p_Sock) {
+    std::string received;
+    if (p_Sock < 0)
+        return received;
+    char buffer[4096];
+    ssize_t bytes_received;
+    while ((bytes_received = recv (p_Sock, buffer, sizeof (buffer), 0)) > 0)
+        received.append (buffer, bytes_received);
+    close (p_Sock);
+    return received;
+}
+
+/**
+ * @brief A "Connection: close" request for a file which isn't cached goes to
+ * the file pool, which pauses the input of its connection: UringWorker must
+ * still release the connection once the response is sent, not leak it. The
+ * FIFO keeps the file pool busy until the recv of the connection has been
+ * canceled for sure.
+ */
+static void testUringReleasesPausedConnection () {
+    if (!ccerve::IoUring::isSupported ()) {
+        std::printf ("io_uring isn't supported, skipping its worker\n");
+        return;
+    }
+    if (mkfifo ("fifo.txt", 0600) != 0) {
+        std::perror ("mkfifo");
+        tests::check (false, "FIFO for the io_uring worker");
+        return;
+    }
+
+    ccerve::FileCache file_cache (1024 * 1024, 64 * 1024);
+    ccerve::FilePool file_pool (2);
+    ccerve::ConnectionStats connection_stats;
+    ccerve::Metrics metrics (connection_stats);
+    ccerve::WorkerContext context;
+    context.file_cache       = &file_cache;
+    context.file_pool        = &file_pool;
+    context.connection_stats = &connection_stats;
+    context.metrics          = &metrics;
+
+    // any free port
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    ccerve::UringWorker worker (address, context);
+    socklen_t address_length = sizeof (address);
+    getsockname (worker.getServerSock (), reinterpret_cast<sockaddr*> (&address), &address_length);
+    std::thread worker_thread ([&worker] { worker.run (); });
+
+    std::string received = receiveResponse (sendClosingRequest (address, "/index.html"));
+    tests::check (received.starts_with ("HTTP/1.1 200"), "io_uring answers a request of the file pool");
+    tests::check (waitForMetric (metrics, "ccerve_connections_active", 0),
+    "io_uring releases a closed connection after a request of the file pool");
+
+    // the file pool's open() of the FIFO waits for a writer, which only
+    // comes once the worker has handled the request
+    int sock = sendClosingRequest (address, "/fifo.txt");
+    std::this_thread::sleep_for (std::chrono::milliseconds (200));
+    int writer = -1;
+    for (int attempt = 0; attempt < 100 && writer < 0; attempt++) {
+        writer = open ("fifo.txt", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (writer < 0)
+            std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    }
+    if (writer >= 0)
+        close (writer);
+    received = receiveResponse (sock);
+    // not a regular file
+    tests::check (received.starts_with ("HTTP/1.1 404"), "io_uring answers a request for a FIFO");
+    tests::check (waitForMetric (metrics, "ccerve_connections_active", 0),
+    "io_uring releases a closed connection whose input was paused");
+
+    worker.stop ();
+    worker_thread.join ();
+    unlink ("fifo.txt");
+}
+
+int main () {
+    char root[] = "/tmp/ccerve-tests-XXXXXX";
+    if (!mkdtemp (root)) {
+        std::perror ("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    // served from <root>/site, the secret is next to it
+    std::filesystem::path site = std::filesystem::path (root) / "site";
+    std::filesystem::create_directories (site);
+    std::ofstream (site / "index.html") << "<p>index</p>";
+    std::ofstream (std::filesystem::path (root) / "secret.txt") << "secret";
+    // handleRequest() resolves paths relative to the working directory
+    std::filesystem::current_path (site);
+
+    testRequestReader ();
+    testParseRange ();
+    testMatchesEntityTag ();
+    testTimerWheel ();
+    {
+        ccerve::FileCache file_cache (1024 * 1024, 64 * 1024);
+        testPathTraversal (file_cache);
+        testConditionalRequests (file_cache);
+        testCompressedVariants (file_cache);
+        testBackpressure (file_cache);
+    }
+    testUringReleasesPausedConnection ();
+
+    std::filesystem::current_path ("/");
+    std::filesystem::remove_all (root);
+    return tests::g_Failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
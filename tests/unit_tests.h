@@ -0,0 +1,25 @@
+#pragma once
+
+/**
+ * @file unit_tests.h
+ * @brief Tiny harness for the unit tests: every check which fails is
+ * printed and counted, main() fails if any did.
+ */
+
+#include <cstdio>
+#include <string_view>
+
+namespace tests {
+
+// @brief Number of checks which failed so far
+inline unsigned g_Failures = 0;
+
+// @brief Prints p_Name and counts it as a failure unless p_Passed
+inline void check (bool p_Passed, std::string_view p_Name) {
+    if (p_Passed)
+        return;
+    g_Failures++;
+    std::fprintf (stderr, "FAILED: %.*s\n", static_cast<int> (p_Name.size ()), p_Name.data ());
+}
+
+} // namespace tests